@@ -57,22 +57,48 @@ static const char Version[] = "1.1";
  */
 
 #include "oligocast_config.h"
+#if defined(__linux__) && (defined(HAVE_RECVMMSG) || defined(HAVE_SENDMMSG))
+#define _GNU_SOURCE /* for recvmmsg() & sendmmsg() */
+#endif
+#ifdef DO_WORKERS
+#include <pthread.h>
+#include <stdatomic.h>
+#endif /* DO_WORKERS */
+#ifdef HAVE_SHM_OPEN
+#include <stdatomic.h>
+#endif /* HAVE_SHM_OPEN */
+#ifdef HAVE_MSG_ZEROCOPY
+#include <poll.h>
+#include <linux/errqueue.h>
+#endif /* HAVE_MSG_ZEROCOPY */
+#ifdef DEE_USDT
+#include <sys/sdt.h>
+#endif /* DEE_USDT */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <math.h>
 #include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <signal.h>
 #include <sys/time.h>
 #include <sys/types.h>
-#include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#if defined(HAVE_UDP_SEGMENT) || defined(HAVE_UDP_GRO)
+#include <netinet/udp.h>
+#endif /* HAVE_UDP_SEGMENT || HAVE_UDP_GRO */
 #include <arpa/inet.h>
 #include <net/if.h>
 #include <libgen.h>
@@ -89,6 +115,751 @@ enum reported_events {
     reported_event_cmd,                 /* command received and handled */
     reported_event_note,                /* informational note */
     reported_event_pkt,                 /* something about received packet */
+    reported_event_lat,                 /* latency statistics (-L) */
+    reported_event_stats,               /* packet statistics (-S) */
+    reported_event_srcup,               /* packet from new/returning source */
+    reported_event_srcdn,               /* time out on one source */
+    reported_event_srcstats,            /* per-source statistics (-S) */
+    reported_event_churn,               /* join/leave statistics (-C, -L) */
+};
+
+enum flush_policy {
+    /* when emit()'s output is flushed ("-f flush:...") */
+    flush_policy_line,                  /* after every line */
+    flush_policy_lines,                 /* after every cfg_flush_lines lines */
+    flush_policy_interval,              /* cfg_flush_us after the first one */
+    flush_policy_idle,                  /* before waiting for more to do */
+};
+
+#ifdef DEE_PROFILE
+enum prof_phase {
+    /* parts of the main loop whose time DEE_PROFILE measures */
+    prof_other,                         /* anything not listed below */
+    prof_wait,                          /* waiting: evloop_wait_until() */
+    prof_recv,                          /* receiving packets: rx_batch() */
+    prof_check,                         /* checking, counting: rx_packets() */
+    prof_emit,                          /* formatting output: emit_at() */
+    prof_flush,                         /* writing output: fflush() */
+    prof_send,                          /* sending packets: tx_burst() */
+    prof_timers,                        /* timeouts and -L/-S reports */
+    prof_churn,                         /* joining and leaving groups (-C) */
+    prof_command,                       /* reading and handling commands */
+    prof_nphases
+};
+
+struct profile {
+    /* what DEE_PROFILE measures; see prof_enter() */
+    int64_t pf_ns[prof_nphases];        /* time spent in each phase */
+    uint64_t pf_calls[prof_nphases];    /* times each phase was entered */
+    uint64_t pf_sys[prof_nphases];      /* system calls made in each */
+    uint64_t pf_pkts;                   /* packets sent or received */
+    int64_t pf_start;                   /* when it started measuring */
+    int64_t pf_since;                   /* when the current phase began */
+    int pf_cur;                         /* current phase */
+};
+#endif /* DEE_PROFILE */
+
+enum rx_tstamp {
+    /* where the time each packet was received comes from ("-o tstamp") */
+    rx_tstamp_user,                     /* read the clock after receiving */
+    rx_tstamp_sw,                       /* kernel timestamp, SO_TIMESTAMPNS */
+    rx_tstamp_hw,                       /* NIC timestamp, SO_TIMESTAMPING */
+};
+
+/*
+ * The "-f binary:" event log file starts with a 'struct binhdr', then has
+ * any number of 'struct binrec'.  Both are written in the machine's own
+ * byte order, so the file can be mapped into memory and used directly on
+ * the same kind of machine; bh_order tells which it was.  The decoder in
+ * testing/binlog.py shows how to read them.
+ */
+#define BINLOG_MAGIC "OLGE" /* bh_magic[] */
+#define BINLOG_VERSION 1 /* bh_version */
+
+struct binhdr {
+    char                    bh_magic[4];    /* BINLOG_MAGIC */
+    uint32_t                bh_order;       /* 0x01020304 */
+    uint16_t                bh_version;     /* BINLOG_VERSION */
+    uint16_t                bh_reclen;      /* sizeof(struct binrec) */
+    uint32_t                bh_pad;         /* zero */
+    uint64_t                bh_start;       /* time file opened, ns */
+    uint64_t                bh_pad2;        /* zero */
+};
+
+struct binrec {
+    uint64_t                br_time;        /* time, ns since 1970 */
+    uint64_t                br_seq;         /* sequence number if BINREC_SEQ */
+    int64_t                 br_lat;         /* latency, ns, if BINREC_LAT */
+    uint32_t                br_group;       /* group index, or all ones */
+    uint16_t                br_len;         /* packet length, max 65535 */
+    uint8_t                 br_event;       /* enum reported_events */
+    uint8_t                 br_flags;       /* BINREC_* */
+};
+
+#define BINREC_SEQ 1 /* br_seq is filled in, from "-d seq" */
+#define BINREC_LAT 2 /* br_lat is filled in, from "-d seq" */
+#define BINREC_BAD 4 /* packet didn't match "-d" */
+
+/*
+ * A "-F" traffic profile is either a pcap file, whose UDP packets are
+ * replayed, or one made of a 'struct tracehdr' then any number of
+ * 'struct tracerec', each followed by tc_caplen bytes of the packet,
+ * padded to a multiple of 8 bytes.  Like the "-f binary:" file it's in
+ * the byte order of the machine that wrote it, and th_order tells which.
+ * testing/mktrace.py makes them.
+ */
+#define TRACE_MAGIC "OLGT" /* th_magic[] */
+#define TRACE_VERSION 1 /* th_version */
+#define TRACE_MAX_DELTA 3600000000000LL /* most ns between packets, 1 hour */
+#define TRACE_MAX_SPAN (INT64_MAX / 4) /* most ns for the whole profile */
+#define UDP_MAX_IPV4 65507 /* most UDP payload in an IPv4 packet */
+#define UDP_MAX_IPV6 65527 /* most UDP payload in an IPv6 packet */
+
+struct tracehdr {
+    char                    th_magic[4];    /* TRACE_MAGIC */
+    uint32_t                th_order;       /* 0x01020304 */
+    uint16_t                th_version;     /* TRACE_VERSION */
+    uint16_t                th_reclen;      /* sizeof(struct tracerec) */
+    uint32_t                th_pad;         /* zero */
+};
+
+struct tracerec {
+    uint64_t                tc_delta;       /* ns since the packet before */
+    uint32_t                tc_len;         /* UDP payload length */
+    uint32_t                tc_caplen;      /* bytes of it that follow */
+};
+
+enum trace_format {
+    trace_format_olgt,                      /* tracehdr & tracerec */
+    trace_format_pcap,                      /* pcap, microseconds */
+    trace_format_pcap_ns,                   /* pcap, nanoseconds */
+};
+
+struct trace {
+    /*
+     * The "-F" traffic profile, mapped into memory, and what's been
+     * learned about it by going through it once.
+     */
+    char *                  tr_fn;          /* file name */
+    uint8_t *               tr_map;         /* its contents */
+    size_t                  tr_size;        /* size of tr_map */
+    enum trace_format       tr_fmt;         /* what's in it */
+    int                     tr_swap;        /* other machine's byte order */
+    uint32_t                tr_link;        /* pcap link type */
+    double                  tr_speed;       /* replay speed, 1 for 1x */
+    size_t                  tr_reclen;      /* th_reclen */
+    size_t                  tr_first;       /* first packet's offset */
+    int64_t                 tr_t0;          /* first packet's pcap time */
+    uint64_t                tr_npkts;       /* packets to replay */
+    int64_t                 tr_period;      /* ns from one pass to the next */
+    size_t                  tr_maxlen;      /* longest packet */
+    uint8_t *               tr_zero;        /* tr_maxlen zeroes */
+};
+
+struct trpos {
+    /* a place in the "-F" traffic profile, at a packet to replay */
+    size_t                  tp_off;         /* offset in tr_map */
+    int64_t                 tp_t;           /* ns after the first packet */
+};
+
+struct trpkt {
+    /* one packet from the "-F" traffic profile */
+    int64_t                 tk_t;           /* pcap time, or tc_delta, ns */
+    size_t                  tk_len;         /* UDP payload length */
+    uint8_t *               tk_pay;         /* what was captured of it */
+    size_t                  tk_paylen;      /* bytes at tk_pay */
+    size_t                  tk_next;        /* offset of what follows */
+};
+
+struct binlog {
+    /*
+     * Records for the "-f binary:" file, waiting to be written out.
+     * There's one in the configuration, and (with -w) one for each worker
+     * thread; they all append to the same file, whole records at a time.
+     */
+
+    uint8_t *               bl_buf;         /* records not written yet */
+    size_t                  bl_used;        /* bytes in bl_buf */
+    int64_t                 bl_since;       /* when first one added, mono_ns */
+};
+
+struct grpcount {
+    /*
+     * A snapshot of one group's counters, for other programs to read
+     * (-M, -H).  Times are in nanoseconds.
+     */
+
+    uint64_t                gc_up;          /* 1 if receiving, not timed out */
+    uint64_t                gc_pkts;        /* packets sent or received */
+    uint64_t                gc_bytes;       /* bytes in them */
+    uint64_t                gc_bad;         /* ...not matching "-d" */
+    uint64_t                gc_trunc;       /* ...too big to receive whole */
+    uint64_t                gc_kdrops;      /* dropped by the kernel */
+    uint64_t                gc_lost;        /* "-d seq" packets lost */
+    uint64_t                gc_reord;       /* ...reordered */
+    uint64_t                gc_dup;         /* ...duplicated */
+    uint64_t                gc_tlast;       /* last packet received, ns */
+    uint64_t                gc_lat_n;       /* "-d seq" latency samples */
+    uint64_t                gc_lat_p50;     /* ...median */
+    uint64_t                gc_lat_p99;     /* ...99th percentile */
+    uint64_t                gc_lat_max;     /* ...highest */
+    uint64_t                gc_jitter;      /* ...RFC 3550 jitter */
+};
+
+#define HTTP_MAXCONN 8 /* connections to -H at once; more drop the oldest */
+#define HTTP_REQMAX 2048 /* longest HTTP request handled */
+#define HTTP_HDRROOM 256 /* room for HTTP response header before body */
+
+struct httpconn {
+    /* one connection to the -H metrics server */
+    int                     hc_fd;          /* socket; -1 if slot unused */
+    int64_t                 hc_when;        /* when accepted, mono_ns() */
+    size_t                  hc_got;         /* bytes of request in hc_req[] */
+    char                    hc_req[HTTP_REQMAX]; /* request received */
+    char *                  hc_out;         /* response not sent yet, or NULL */
+    size_t                  hc_outlen;      /* ...its length */
+    size_t                  hc_sent;        /* ...and how much got sent */
+};
+
+struct httpsrv {
+    /*
+     * The -H metrics server: a listening socket and connections, all
+     * nonblocking, handled in the main loop along with everything else.
+     */
+
+    int                     hs_fd;          /* listening socket */
+    struct oligocast_evloop *hs_evl;        /* event loop it's in */
+    struct httpconn         hs_conns[HTTP_MAXCONN]; /* connections */
+    char *                  hs_buf;         /* response being built */
+    size_t                  hs_size;        /* allocated size of hs_buf */
+    size_t                  hs_used;        /* bytes used in hs_buf */
+    int                     hs_overflow;    /* hs_buf turned out too small */
+    struct grpcount *       hs_gc;          /* per group counters */
+    char **                 hs_labels;      /* per group metric labels */
+    int *                   hs_gintf;       /* per group index in hs_intfs */
+    char **                 hs_intfs;       /* distinct interface names */
+    int                     hs_nintfs;      /* number of them */
+};
+
+#ifdef HAVE_SHM_OPEN
+/*
+ * The "-M" shared memory segment holds a 'struct shmhdr' and then a
+ * 'struct shmgroup' for each group, each a whole number of cache lines.
+ * Only this program writes it.  To read a group consistently: read
+ * sg_seq, and if it's odd (being written) try again; read the rest; then
+ * read sg_seq again and if it changed, try again.
+ */
+#define SHM_MAGIC "OLGM" /* sh_magic[] */
+#define SHM_VERSION 1 /* sh_version */
+#define SHM_LINE 64 /* cache line size assumed */
+
+struct shmhdr {
+    char                    sh_magic[4];    /* SHM_MAGIC */
+    uint32_t                sh_version;     /* SHM_VERSION */
+    uint32_t                sh_hdrlen;      /* sizeof(struct shmhdr) */
+    uint32_t                sh_reclen;      /* sizeof(struct shmgroup) */
+    uint32_t                sh_ngroups;     /* number of shmgroup after */
+    uint32_t                sh_pid;         /* process writing it */
+    uint64_t                sh_start;       /* when it started, ns */
+    _Atomic uint64_t        sh_updated;     /* last update, ns */
+    uint32_t                sh_period_us;   /* how often it's updated */
+    uint32_t                sh_dir;         /* 1 sending, 2 receiving */
+} __attribute__((aligned(SHM_LINE)));
+
+struct shmgroup {
+    _Atomic uint64_t        sg_seq;         /* odd while being written */
+    uint32_t                sg_idx;         /* index of group */
+    uint32_t                sg_up;          /* 1 if receiving, not timed out */
+    uint64_t                sg_pkts;        /* packets sent or received */
+    uint64_t                sg_bytes;       /* bytes received */
+    uint64_t                sg_bad;         /* packets not matching "-d" */
+    uint64_t                sg_lost;        /* "-d seq" packets lost */
+    uint64_t                sg_reord;       /* ...reordered */
+    uint64_t                sg_dup;         /* ...duplicated */
+    uint64_t                sg_tlast;       /* last packet received, ns */
+    uint64_t                sg_lat_p50;     /* "-d seq" latency, ns, median */
+    uint64_t                sg_lat_p99;     /* ...99th percentile */
+    uint64_t                sg_lat_max;     /* ...highest */
+    uint64_t                sg_jitter;      /* ...RFC 3550 jitter, ns */
+    char                    sg_name[80];    /* group label */
+    uint64_t                sg_trunc;       /* packets too big, cut short */
+} __attribute__((aligned(SHM_LINE)));
+#endif /* HAVE_SHM_OPEN */
+
+struct tscache {
+    /*
+     * A timestamp formatted to the second, saved so the next one in
+     * the same second doesn't need localtime() & strftime() again.
+     */
+    time_t                  tc_sec;         /* the second it's for */
+    int                     tc_len;         /* length of tc_buf[] */
+    char                    tc_buf[64];     /* formatted */
+};
+
+struct rxbufs {
+    /*
+     * Space to receive packets into, up to rb_batch of them at a time.
+     * There's one in the configuration, and (with -w) one for each worker
+     * thread.
+     */
+
+    uint8_t *               rb_data;        /* data in received packet(s) */
+    size_t                  rb_len;         /* space per packet in rb_data */
+    uint8_t **              rb_pkt;         /* where each packet starts */
+    int *                   rb_got;         /* length of each received packet */
+    uint8_t *               rb_trunc;       /* whether each was cut short */
+    int                     rb_batch;       /* max packets per receive call */
+    struct timespec *       rb_ts;          /* when each was received */
+#ifdef HAVE_UDP_GRO
+    /*
+     * With "-o gro" the kernel may put several packets, all the same
+     * size but maybe the last, in what rb_batch receives as one; they're
+     * split up again in rb_pkt[], rb_got[], rb_ts[].
+     */
+    int                     rb_gro;         /* UDP_GRO is on */
+    int *                   rb_gso;         /* size of each packet combined */
+#endif /* HAVE_UDP_GRO */
+#ifdef HAVE_SO_TIMESTAMPNS
+    uint8_t *               rb_ctl;         /* control messages, for rb_ts */
+#endif /* HAVE_SO_TIMESTAMPNS */
+#ifdef HAVE_SO_RXQ_OVFL
+    uint32_t                rb_drops;       /* socket's kernel drops, or 0 */
+#endif /* HAVE_SO_RXQ_OVFL */
+    struct sockaddr_storage *rb_from;       /* who sent each ("-o sources");
+                                             * or NULL when not wanted */
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr *        rb_msgs;        /* for recvmmsg() */
+    struct iovec *          rb_iovs;        /* for recvmmsg() */
+#endif /* HAVE_RECVMMSG */
+};
+
+#ifdef HAVE_PACKET_RING
+struct rxring {
+    /*
+     * "-o ring": a packet ring receiving on one interface, and a hash
+     * table of the groups received on it, by address and port.
+     */
+
+    struct oligocast_ring * rr_ring;        /* the ring; NULL if it failed */
+    unsigned int            rr_ifidx;       /* interface index */
+    int                     rr_ngroups;     /* groups on it */
+    struct mcgroup **       rr_hash;        /* them, in a hash table */
+    unsigned                rr_hmask;       /* size of rr_hash[], minus 1 */
+    struct rxbufs           rr_rb;          /* points at packets in ring */
+};
+#endif /* HAVE_PACKET_RING */
+
+#define SEQ_WINDOW 1024 /* "-d seq" reordering recognized this far back */
+#define SEQ_RESTART 16 /* far behind this many in a row: sender restarted */
+
+/*
+ * Counters in the latency histograms and "-S" statistics.  With -w they're
+ * written by a worker thread and read by the main thread, without locking.
+ */
+#ifdef DO_WORKERS
+typedef atomic_uint_fast64_t hcount_t;
+#define HCOUNT_GET(p) atomic_load_explicit((p), memory_order_relaxed)
+#define HCOUNT_SET(p, v) atomic_store_explicit((p), (v), memory_order_relaxed)
+#define HCOUNT_ADD(p, v) \
+    atomic_fetch_add_explicit((p), (v), memory_order_relaxed)
+#else /* DO_WORKERS */
+typedef uint64_t hcount_t;
+#define HCOUNT_GET(p) (*(p))
+#define HCOUNT_SET(p, v) (*(p) = (v))
+#define HCOUNT_ADD(p, v) (*(p) += (v))
+#endif /* !DO_WORKERS */
+
+/*
+ * Latency histogram: "log-linear" like HdrHistogram.  Values below
+ * 2*HIST_SUB each get a bin; above that each power of two range is
+ * divided into HIST_SUB bins.  So each bin is within about 1/HIST_SUB
+ * of the value.
+ */
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BINS ((64 - HIST_SUB_BITS) * HIST_SUB)
+
+struct histogram {
+    hcount_t                hi_bins[HIST_BINS]; /* nanoseconds */
+    hcount_t                hi_negative;    /* samples < 0, counted as 0 */
+    hcount_t                hi_jitter;      /* RFC 3550 jitter, nanoseconds */
+    uint64_t                hi_prev[HIST_BINS]; /* hi_bins[] last report */
+    uint64_t                hi_prev_negative; /* hi_negative last report */
+};
+
+/*
+ * Pointer to a group's latency histogram.  It's allocated on the first
+ * "-d seq" packet, which with -w is in a worker thread, and read by the
+ * main thread; so the worker publishes it with HIST_PUT() and readers get
+ * it with HIST_GET().
+ */
+#ifdef DO_WORKERS
+typedef struct histogram *_Atomic histptr_t;
+#define HIST_GET(p) atomic_load_explicit((p), memory_order_acquire)
+#define HIST_PUT(p, h) atomic_store_explicit((p), (h), memory_order_release)
+#else /* DO_WORKERS */
+typedef struct histogram *histptr_t;
+#define HIST_GET(p) (*(p))
+#define HIST_PUT(p, h) (*(p) = (h))
+#endif /* !DO_WORKERS */
+
+struct rxstats {
+    /*
+     * What's been received on a group, for "-S".  The counters only go
+     * up, and the main thread reports how much they changed; except
+     * st_iat_min and st_iat_max, which it starts over each time (with -w,
+     * a packet received right then might be missed from them).
+     */
+
+    hcount_t                st_pkts;        /* packets received */
+    hcount_t                st_bytes;       /* bytes in them */
+    hcount_t                st_bad;         /* ...not matching '-d' */
+    hcount_t                st_trunc;       /* ...too big for rb_len */
+    hcount_t                st_kdrops;      /* dropped by the kernel */
+    hcount_t                st_iat_n;       /* inter-arrival times measured */
+    hcount_t                st_iat_sum;     /* ...their total, ns */
+    hcount_t                st_iat_min;     /* ...shortest since report, ns */
+    hcount_t                st_iat_max;     /* ...longest since report, ns */
+    int64_t                 st_tlast;       /* last packet's timestamp, ns */
+    uint64_t                st_prev_pkts;   /* st_pkts last report */
+    uint64_t                st_prev_bytes;  /* st_bytes last report */
+    uint64_t                st_prev_bad;    /* st_bad last report */
+    uint64_t                st_prev_trunc;  /* st_trunc last report */
+    uint64_t                st_prev_kdrops; /* st_kdrops last report */
+    uint64_t                st_prev_iat_n;  /* st_iat_n last report */
+    uint64_t                st_prev_iat_sum;/* st_iat_sum last report */
+    uint64_t                st_prev_lost;   /* lost packets last report */
+};
+
+struct seqsender {
+    /*
+     * With "-d seq": what's been received on a group from one sender.
+     * Sequence numbers from ss_hi back to (ss_hi - SEQ_WINDOW + 1) have
+     * a bit in ss_bits[], at (seq % SEQ_WINDOW), set if they've been
+     * received.  Ones further back than that are stragglers, unless
+     * SEQ_RESTART come in a row, which means the sender started over.
+     */
+
+    struct seqsender *      ss_next;        /* next in mg_senders list */
+    uint32_t                ss_id;          /* sender ID from the packets */
+    uint64_t                ss_lo;          /* lowest sequence number seen */
+    uint64_t                ss_hi;          /* highest sequence number seen */
+    uint64_t                ss_bits[SEQ_WINDOW / 64]; /* which were seen */
+    int64_t                 ss_transit;     /* receive minus send time, ns */
+    int                     ss_far;         /* in a row from way behind */
+};
+
+struct rxsource {
+    /*
+     * With "-o sources": what's been received on a group from one source
+     * address and port.  They're in a hash table, mg_rxsrc[], by
+     * addr_hash(); entries stay once they're used, the source just goes
+     * "down" after a timeout.  Only the main thread uses them.
+     */
+
+    uint8_t                 rs_addr[16];    /* address, 4 or 16 bytes */
+    uint16_t                rs_port;        /* UDP port number */
+    uint8_t                 rs_used;        /* this entry is in use */
+    uint8_t                 rs_up;          /* receiving, not timed out */
+    uint64_t                rs_pkts;        /* packets received */
+    uint64_t                rs_bytes;       /* bytes in them */
+    uint64_t                rs_prev_pkts;   /* rs_pkts last report */
+    uint64_t                rs_prev_bytes;  /* rs_bytes last report */
+    uint64_t                rs_gap_max;     /* longest gap since report, ns */
+    int64_t                 rs_tlast;       /* last packet's timestamp, ns */
+    int64_t                 rs_tseen;       /* ...when handled, mono_ns() */
+};
+
+struct churn {
+    /*
+     * With -C: joining and leaving groups, over and over, at a rate.
+     * The thread that receives a group's packets (the main thread, or its
+     * -w worker) does it, so each has one of these for its own groups.
+     * ch_left[] has the groups that aren't joined, in the order they
+     * left; ch_joined[] those that are, in the order they joined, which
+     * since they're all held the same time is also the order they leave.
+     * Both are rings, with room for all the groups.
+     */
+    struct mcgroup **       ch_left;        /* groups not joined */
+    int                     ch_lhead;       /* first in ch_left[] */
+    int                     ch_nleft;       /* number in ch_left[] */
+    struct mcgroup **       ch_joined;      /* groups joined */
+    int                     ch_jhead;       /* first in ch_joined[] */
+    int                     ch_njoined;     /* number in ch_joined[] */
+    int                     ch_size;        /* room in each */
+    double                  ch_rate;        /* joins per second, its share */
+    int64_t                 ch_next;        /* next join due, mono_ns() */
+    double                  ch_carry;       /* fraction of ns in ch_next */
+    uint64_t                ch_rand;        /* "random" xorshift state */
+};
+
+struct churnstats {
+    /*
+     * With -C: what joining and leaving has done, all threads together.
+     * The main thread reports how much the counts changed.
+     */
+    struct histogram        cs_join;        /* join to first packet, ns */
+    struct histogram        cs_leave;       /* leave to last packet, ns */
+    hcount_t                cs_joins;       /* times groups were joined */
+    hcount_t                cs_leaves;      /* times groups were left */
+    hcount_t                cs_nopkt;       /* ...with no packet since join */
+    uint64_t                cs_prev_joins;  /* cs_joins last report */
+    uint64_t                cs_prev_leaves; /* cs_leaves last report */
+    uint64_t                cs_prev_nopkt;  /* cs_nopkt last report */
+};
+
+#ifdef DO_WORKERS
+struct wkpkt {
+    /* a packet a worker thread received, for the main thread to report */
+    struct mcgroup *        wp_g;           /* group it came in on */
+    int64_t                 wp_ns;          /* when: ns since 1970 */
+};
+
+struct worker {
+    /*
+     * A worker thread (-w), which receives and checks packets on some of
+     * the groups.  It just counts them; the main thread does the reporting,
+     * so output stays in order.  For "-v", which reports each packet, it
+     * puts them in wk_vring[], which the main thread takes them out of.
+     */
+
+    int                     wk_idx;         /* index in cfg_workers[] */
+    pthread_t               wk_thread;      /* the thread */
+    struct config *         wk_cfg;         /* configuration */
+    struct oligocast_evloop *wk_evl;        /* waits for its groups' sockets */
+    struct rxbufs           wk_rx;          /* space to receive packets */
+    struct binlog           wk_binlog;      /* for "-f binary:" */
+    struct mcgroup **       wk_groups;      /* groups it handles */
+    int                     wk_ngroups;     /* number of entries wk_groups[] */
+    struct churn *          wk_churn;       /* joins & leaves them (-C) */
+    atomic_int              wk_pending;     /* main thread has been told of
+                                             * new packets, not looked yet */
+    int                     wk_running;     /* thread's been started */
+    int                     wk_poke[2];     /* pipe: main thread wakes it */
+    atomic_int              wk_flush;       /* write out wk_binlog, please */
+    struct wkpkt *          wk_vring;       /* WK_VRING packets, for "-v" */
+    atomic_uint             wk_vhead;       /* ...next the main thread takes */
+    atomic_uint             wk_vtail;       /* ...next the worker fills in */
+    atomic_uint_fast64_t    wk_vlost;       /* ...packets that didn't fit */
+    uint64_t                wk_vlost_seen;  /* wk_vlost already reported */
+};
+#endif /* DO_WORKERS */
+
+#ifdef DO_SOURCES
+struct srclist {
+    /*
+     * A list of source addresses, for filtering.  It's kept compact: just
+     * the 4 (IPv4) or 16 (IPv6) bytes of each address, in network byte
+     * order, packed together; all in one list are the same family.  And
+     * sorted (srcs_sort()) so memcmp() orders them, and changed in place.
+     * They're only made into 'struct sockaddr' to hand to the system.
+     */
+    uint8_t *               sl_addrs;       /* the addresses */
+    int                     sl_n;           /* how many */
+    int                     sl_room;        /* how many there's room for */
+    int                     sl_alen;        /* bytes each, 4 or 16; 0 unset */
+};
+#define SRCS_ADDR(sl, i) ((sl)->sl_addrs + (size_t)(i) * (sl)->sl_alen)
+static const struct srclist srcs_empty = { NULL, 0, 0, 0 };
+#endif /* DO_SOURCES */
+
+struct pktdata {
+    /*
+     * What goes in the packets sent, or is expected in those received,
+     * as given by -d.  There's one for the command line (cfg_data), and
+     * any group can have its own, from -d in the -G file.
+     */
+    uint8_t *               pd_data;        /* data to send */
+    size_t                  pd_len;         /* number of bytes in pd_data */
+    int                     pd_chk;         /* check data in received packet */
+    int                     pd_seq;         /* pd_data starts with seq hdr */
+    int                     pd_pat;         /* PATTERN_* after it, or 0 */
+    int                     pd_crc;         /* CRC32C at the end ",crc" */
+};
+
+struct mcgroup {
+    /*
+     * One multicast group this program sends to or receives from: its
+     * settings, its socket, and its live state.  Normally there's just one,
+     * given by -g, -p, -i, -I, -E.  With -G there's one for each line of
+     * a file, which can also give it its own -d, -R, -T.
+     */
+
+    int                     mg_idx;         /* index in cfg_groups[] */
+    struct sockaddr_storage mg_grp;         /* multicast group */
+    socklen_t               mg_grplen;      /* size of mg_grp */
+    int                     mg_port;        /* UDP port number */
+    struct oligocast_if     mg_intf;        /* network interface */
+    char *                  mg_label;       /* output label; NULL for cfg's */
+    char *                  mg_label_csv;   /* mg_label, CSV-escaped */
+#ifdef DO_SOURCES
+    /* Source filtering settings:
+     *      Apparent current working setting:
+     *          mg_osfmode -- mode: MCAST_{IN,EX}CLUDE
+     *          mg_osources -- source addresses
+     *      Desired new setting:
+     *          mg_sfmode -- mode: MCAST_{IN,EX}CLUDE
+     *          mg_sources -- source addresses
+     *      How to get from one to the other:
+     *          mg_sfull -- the whole filter has to be set again
+     *          mg_sadd -- otherwise, sources to add, one at a time
+     *          mg_ssub -- and sources to remove, one at a time
+     */
+    uint32_t                mg_sfmode;
+    struct srclist          mg_sources;
+    uint32_t                mg_osfmode;
+    struct srclist          mg_osources;
+    int                     mg_sfull;
+    struct srclist          mg_sadd;
+    struct srclist          mg_ssub;
+#endif /* DO_SOURCES */
+    int                     mg_reapply;     /* filter needs to be applied */
+    int                     mg_critical;    /* failing to apply it is fatal */
+    struct oligocast_sml_state mg_sml_state; /* for setup_mcast_listen() */
+    int                     mg_sok;         /* socket for this group */
+    struct sockaddr_storage mg_dst;         /* address to send to */
+    socklen_t               mg_dstlen;      /* size of mg_dst */
+    int                     mg_up;          /* receiving, not timed out */
+    int64_t                 mg_tlast;       /* last packet when, mono_ns() */
+    int64_t                 mg_tdue;        /* heap key: timeout or next tx */
+    int                     mg_theap_pos;   /* index in cfg_theap[] or -1 */
+    struct pktdata *        mg_data;        /* -d: &cfg_data, or its own */
+    int                     mg_ttl;         /* TTL / hop limit; -1 default */
+    double                  mg_rate;        /* -R rate; 0 -P; -1 cfg_rate */
+    int                     mg_rate_bits;   /* mg_rate is bits not packets */
+    int64_t                 mg_tx_next;     /* next packet due, mono_ns() */
+    double                  mg_tx_carry;    /* fraction of ns in mg_tx_next */
+    uint64_t                mg_tx_seq;      /* next sequence number to send */
+    uint64_t                mg_tx_pkts;     /* packets sent */
+    uint64_t                mg_tx_bytes;    /* bytes of data sent */
+    struct trpos            mg_tr;          /* -F: next packet to send */
+    struct trpos            mg_tr_send;     /* -F: first one being sent now */
+    int64_t                 mg_tr_base;     /* -F: mono_ns() of pass start */
+#ifdef HAVE_MSG_ZEROCOPY
+    /*
+     * With "-o zerocopy" the kernel reads the data to send straight
+     * out of our memory, some time after sendmmsg() returns, so "-d seq"
+     * headers come from a pool, and each is only reused after the
+     * kernel says it's done with it.  The kernel numbers sends on the
+     * socket 0, 1, 2, ...; with "-o gso" one send can have several packets,
+     * so mg_zc_marks[] tracks how many headers had been used by each.
+     * The kernel's notices of which sends are done can come out of order,
+     * so mg_zc_fin[] marks those done past mg_zc_done, until the ones
+     * before are done too.
+     */
+    int                     mg_zc;          /* zero copy turned on */
+    uint8_t *               mg_zc_hdrs;     /* pool of ZC_POOL headers */
+    uint32_t                mg_zc_sent;     /* number of sends so far */
+    uint32_t                mg_zc_done;     /* sends below this completed */
+    uint32_t *              mg_zc_marks;    /* mg_zc_hsent after each send */
+    uint8_t *               mg_zc_fin;      /* each send done, out of order */
+    uint32_t                mg_zc_hsent;    /* headers used so far */
+    uint32_t                mg_zc_hdone;    /* headers below this free again */
+#endif /* HAVE_MSG_ZEROCOPY */
+#ifdef HAVE_UDP_SEGMENT
+    int                     mg_gso;         /* UDP_SEGMENT ("-o gso") usable */
+#endif /* HAVE_UDP_SEGMENT */
+    struct seqsender *      mg_senders;     /* "-d seq" senders heard from */
+    uint64_t                mg_sq_lost;     /* ...missing sequence numbers */
+    uint64_t                mg_sq_reord;    /* ...arrived out of order */
+    uint64_t                mg_sq_dup;      /* ...arrived more than once */
+    uint64_t                mg_sq_lost_seen;/* mg_sq_lost already reported */
+    uint64_t                mg_sq_reord_seen;/* mg_sq_reord already reported */
+    uint64_t                mg_sq_dup_seen; /* mg_sq_dup already reported */
+    histptr_t               mg_lat;         /* "-d seq" latency, or NULL */
+    struct rxstats          mg_stats;       /* for "-S" */
+    struct rxsource *       mg_rxsrc;       /* "-o sources" hash table */
+    unsigned                mg_rxsrc_mask;  /* size of mg_rxsrc[], minus 1 */
+    int                     mg_rxsrc_n;     /* entries used in mg_rxsrc[] */
+    int                     mg_rxsrc_full;  /* reached RXSRC_MAX of them */
+    /*
+     * With -C, the group is joined & left over and over.  The times
+     * are CLOCK_REALTIME, like packets' receive timestamps, except
+     * mg_ch_tdue.
+     */
+    int                     mg_ch_joined;   /* joined now */
+    int                     mg_ch_wait;     /* ...no packet since then */
+    int64_t                 mg_ch_tdue;     /* when to leave, mono_ns() */
+    int64_t                 mg_ch_tjoin;    /* when it joined, ns */
+    int64_t                 mg_ch_tleave;   /* when it left, ns; 0 if not */
+    int64_t                 mg_ch_tlate;    /* last packet after that */
+#ifdef HAVE_PACKET_RING
+    struct rxring *         mg_ring;        /* "-o ring" receiving it */
+#endif /* HAVE_PACKET_RING */
+#ifdef DO_WORKERS
+    /*
+     * With -w, the worker thread for the group counts packets here, and
+     * the main thread reports them.
+     */
+    struct worker *         mg_worker;      /* worker thread handling it */
+    atomic_uint_fast64_t    mg_wk_rx;       /* packets received */
+    atomic_uint_fast64_t    mg_wk_bad;      /* ...not matching '-d' */
+    atomic_int_fast64_t     mg_wk_tlast;    /* ...last one when, mono_ns() */
+    atomic_int_fast64_t     mg_wk_trx;      /* ...its timestamp, nsec */
+    atomic_uint_fast64_t    mg_wk_lost;     /* copy of mg_sq_lost */
+    atomic_uint_fast64_t    mg_wk_reord;    /* copy of mg_sq_reord */
+    atomic_uint_fast64_t    mg_wk_dup;      /* copy of mg_sq_dup */
+    uint64_t                mg_wk_rx_seen;  /* mg_wk_rx already reported */
+    uint64_t                mg_wk_bad_seen; /* mg_wk_bad already reported */
+#endif /* DO_WORKERS */
+};
+
+#define CMD_BUFSIZE 65536 /* room for command input, stdin & each -K conn. */
+#define CMDSOCK_MAXCONN 8 /* connections to -K at once; more are refused */
+
+struct cmdring {
+    /*
+     * Command input that's been read but not handled yet, in a ring
+     * buffer: read in after the end of what's there, taken off the front,
+     * and usually handled right where it is, without moving it around.
+     */
+    char                    cr_buf[CMD_BUFSIZE]; /* the bytes */
+    size_t                  cr_head;        /* where the first one is */
+    size_t                  cr_got;         /* how many there are */
+};
+
+/*
+ * Commands to the -K socket can be text, like on stdin, or binary.  Each
+ * is a CMDBIN_HDRLEN byte header, in network byte order:
+ *      4 bytes -- length of the rest: header and data, at least 8
+ *      1 byte -- operation, CMDBIN_*
+ *      1 byte -- flags, CMDBIN_F_*
+ *      2 bytes -- zero
+ *      4 bytes -- index of the group it's for, like ".g"; or
+ *                 CMDBIN_GSEL for the one selected already
+ * and then the data:
+ *      CMDBIN_TEXT -- a command as would be given on stdin, no newline
+ *      CMDBIN_INCLUDE, CMDBIN_EXCLUDE -- like "-I" and "-E": source
+ *          addresses, 4 (IPv4) or 16 (IPv6) bytes each, packed together;
+ *          with CMDBIN_F_ADD or CMDBIN_F_SUB, like "+" and "-"
+ *      CMDBIN_RATE -- like "-R": 8 bytes, packets per second times 1000,
+ *          or bits with CMDBIN_F_BITS; or 0 to turn it off
+ * There's no response.
+ */
+#define CMDBIN_HDRLEN 12 /* size of the header */
+#define CMDBIN_MAXLEN CMD_BUFSIZE /* largest command, header and all */
+#define CMDBIN_GSEL 0xffffffffu /* "group" that means cfg_gsel */
+#define CMDBIN_TEXT 0
+#define CMDBIN_INCLUDE 1
+#define CMDBIN_EXCLUDE 2
+#define CMDBIN_RATE 3
+#define CMDBIN_F_ADD 1
+#define CMDBIN_F_SUB 2
+#define CMDBIN_F_BITS 4
+
+struct cmdconn {
+    /* one connection to the -K command socket */
+    int                     cc_fd;          /* socket; -1 if closed */
+    struct cmdring          cc_in;          /* commands received */
+};
+
+struct cmdsock {
+    /* the -K command socket: where it listens, and connections to it */
+    int                     cs_fd;          /* listening socket */
+    char *                  cs_path;        /* its name */
+    struct oligocast_evloop *cs_evl;        /* event loop it's in */
+    struct cmdconn          cs_conns[CMDSOCK_MAXCONN]; /* connections */
+    int                     cs_next;        /* one to look at first */
 };
 
 struct config {
@@ -102,47 +873,110 @@ struct config {
 
     int                     cfg_dir;        /* direction: TX >0, RX <0 */
     int                     cfg_af;         /* address family (inferred) */
-    struct sockaddr_storage cfg_grp;        /* multicast group */
-    socklen_t               cfg_grplen;     /* size of cfg_grp */
-    int                     cfg_port;       /* UDP port number */
-    struct oligocast_if     cfg_intf;       /* network interface */
-    int                     cfg_ttl;        /* time to live / hop limit */
-#ifdef DO_SOURCES
-    /* Source filtering settings:
-     *      Apparent current working setting:
-     *          cfg_osfmode -- mode: MCAST_{IN,EX}CLUDE
-     *          cfg_osources -- array of source addresses
-     *          cfg_onsources -- number of entries in cfg_osources
-     *      Desired new setting:
-     *          cfg_sfmode -- mode: MCAST_{IN,EX}CLUDE
-     *          cfg_sources -- array of source addresses
-     *          cfg_nsources -- number of entries in cfg_sources
-     */
-    uint32_t                cfg_sfmode;
-    struct sockaddr_storage *cfg_sources;
-    int                     cfg_nsources;
-    uint32_t                cfg_osfmode;
-    struct sockaddr_storage *cfg_osources;
-    int                     cfg_onsources;
-#endif /* DO_SOURCES */
+    struct mcgroup          cfg_tmpl;       /* group from command line */
+    char *                  cfg_group_file; /* -G file name */
+    struct mcgroup **       cfg_groups;     /* all the groups */
+    int                     cfg_ngroups;    /* number of entries cfg_groups[] */
+    struct mcgroup *        cfg_gsel;       /* group stdin commands act on */
+    struct mcgroup *        cfg_gcmd;       /* group last command acted on */
+    struct mcgroup **       cfg_theap;      /* up groups: min-heap on mg_tdue */
+    int                     cfg_ntheap;     /* number of entries cfg_theap[] */
     int                     cfg_verbose;    /* report each packet */
     char *                  cfg_label;      /* output label */
     char *                  cfg_label_csv;  /* cfg_label, CSV-escaped */
     int                     cfg_csv;        /* CSV-formatted output */
+    enum flush_policy       cfg_flush;      /* when to flush output */
+    int                     cfg_flush_lines;/* lines, flush_policy_lines */
+    long                    cfg_flush_us;   /* usec, flush_policy_interval */
+    int                     cfg_flush_count;/* lines written, not flushed */
+    int64_t                 cfg_flush_next; /* when to flush, mono_ns() */
+#ifdef HAVE_SHM_OPEN
+    char *                  cfg_shm_name;   /* "-M" segment name, or NULL */
+    long                    cfg_shm_us;     /* how often to update it */
+    int64_t                 cfg_shm_next;   /* next update, mono_ns() */
+    struct shmhdr *         cfg_shm;        /* the segment, mapped */
+    size_t                  cfg_shm_len;    /* its size */
+#endif /* HAVE_SHM_OPEN */
+    char *                  cfg_http_addr;  /* "-H" address, or NULL */
+    struct httpsrv *        cfg_http;       /* "-H" metrics server, or NULL */
+    int                     cfg_binlog_fd;  /* "-f binary:" file, or -1 */
+    struct binlog           cfg_binlog;     /* records for it */
     float                   cfg_period;     /* seconds between packets */
-    long                    cfg_period_us;  /* cfg_period as microseconds */
+    int64_t                 cfg_period_ns;  /* cfg_period as nanoseconds */
     float                   cfg_multiplier; /* this times cfg_period = timeout*/
-    long                    cfg_timeout_us; /* microseconds timeout */
-    uint8_t *               cfg_data;       /* data to send */
-    size_t                  cfg_data_len;   /* number of bytes in cfg_data */
-    int                     cfg_data_chk;   /* check data in received packet */
-    uint8_t *               cfg_data_rx;    /* data in received packet */
+    int64_t                 cfg_timeout_ns; /* nanoseconds timeout */
+    double                  cfg_rate;       /* send rate (-R), or 0 for -P */
+    int                     cfg_rate_bits;  /* cfg_rate is bits not packets */
+    struct mcgroup **       cfg_tx_gs;      /* groups to send to together */
+    int *                   cfg_tx_gn;      /* ...how many packets each */
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr *        cfg_tx_msgs;    /* for sendmmsg() */
+    struct iovec *          cfg_tx_iovs;    /* for sendmmsg() */
+    int                     cfg_tx_nmsgs;   /* entries in cfg_tx_msgs[] */
+    uint8_t *               cfg_tx_hdrs;    /* "-d seq" headers, sendmmsg() */
+    uint8_t *               cfg_tx_ctl;     /* control msgs, sendmmsg() */
+    uint8_t *               cfg_tx_body;    /* SEQ_VARIES() rest, sendmmsg() */
+    int                     cfg_tx_nbody;   /* packets cfg_tx_body is for */
+    size_t                  cfg_tx_bodylen; /* bytes each, in cfg_tx_body */
+#endif /* HAVE_SENDMMSG */
+    struct pktdata          cfg_data;       /* data to send (-d) */
+    uint32_t                cfg_seq_id;     /* sender ID for seq hdr */
+    long                    cfg_lat_us;     /* latency report period (-L) */
+    int64_t                 cfg_lat_next;   /* next latency report, mono_ns() */
+    long                    cfg_stats_us;   /* statistics report period (-S) */
+    int64_t                 cfg_stats_next; /* next statistics report */
+    int                     cfg_batch;      /* max packets per receive call */
+    enum rx_tstamp          cfg_tstamp;     /* receive timestamps (-o) */
+#ifdef HAVE_MSG_ZEROCOPY
+    int                     cfg_zerocopy;   /* send with MSG_ZEROCOPY (-o) */
+#endif /* HAVE_MSG_ZEROCOPY */
+#ifdef HAVE_UDP_SEGMENT
+    int                     cfg_gso;        /* send with UDP_SEGMENT (-o) */
+#endif /* HAVE_UDP_SEGMENT */
+#ifdef HAVE_TX_PKTINFO
+    int                     cfg_txshare;    /* groups share sockets (-o) */
+#endif /* HAVE_TX_PKTINFO */
+#ifdef HAVE_UDP_GRO
+    int                     cfg_gro;        /* receive with UDP_GRO (-o) */
+#endif /* HAVE_UDP_GRO */
+#ifdef HAVE_PACKET_RING
+    int                     cfg_ring;       /* receive by packet ring (-o) */
+    struct rxring *         cfg_rings;      /* the rings, one per interface */
+    int                     cfg_nrings;     /* number of them */
+#endif /* HAVE_PACKET_RING */
+    struct rxbufs           cfg_rx;         /* space to receive packets */
+    size_t                  cfg_rx_len;     /* room for each (-o rxlen) */
+    int                     cfg_rcvbuf;     /* SO_RCVBUF (-o), 0 for default */
+    int                     cfg_sndbuf;     /* SO_SNDBUF (-o), 0 for default */
+#ifdef HAVE_SO_BUSY_POLL
+    int                     cfg_busypoll;   /* SO_BUSY_POLL usec (-o), or -1 */
+#endif /* HAVE_SO_BUSY_POLL */
+#ifdef HAVE_SO_PRIORITY
+    int                     cfg_priority;   /* SO_PRIORITY (-o), or -1 */
+#endif /* HAVE_SO_PRIORITY */
+    int                     cfg_spin;       /* poll without sleeping (-o) */
+    int64_t                 cfg_spinwait;   /* ns to poll before deadlines */
+    int                     cfg_rxsrc;      /* count by source (-o sources) */
+    int64_t                 cfg_rxsrc_next; /* next rxsrc_sweeps(), mono_ns() */
+    double                  cfg_churn_rate; /* joins per second (-C) or 0 */
+    int64_t                 cfg_churn_hold; /* ns each stays joined, or -1 */
+    int                     cfg_churn_random; /* random times and order */
+    struct churn *          cfg_churn;      /* -C without -w, or NULL */
+    struct churnstats *     cfg_churnstats; /* -C counts, or NULL */
+    char *                  cfg_trace_fn;   /* -F traffic profile file */
+    double                  cfg_trace_speed; /* -F replay speed */
+    struct trace *          cfg_trace;      /* -F, loaded, or NULL */
+    int                     cfg_nworkers;   /* worker threads (-w) */
+    struct worker **        cfg_workers;    /* worker threads */
+    int                     cfg_wake[2];    /* pipe: workers wake main thread */
     int                     cfg_join;       /* join even when transmitting */
     int                     cfg_command_in; /* allow commands on stdin */
-    char                    cfg_command_buf[4096]; /* partial commands read */
-    int                     cfg_command_got;/* bytes in cfg_command_buf[] */
+    struct cmdring          cfg_command_ring; /* commands read from stdin */
     int                     cfg_command_ignore; /* ignore command */
-    struct oligocast_sml_state cfg_sml_state; /* for setup_mcast_listen() */
+    char                    cfg_command_tmp[CMD_BUFSIZE + 1]; /* a command
+                                             * that wrapped around a ring */
+    char *                  cfg_cmdsock_path; /* "-K" socket, or NULL */
+    struct cmdsock *        cfg_cmdsock;    /* "-K" command socket, or NULL */
 };
 
 enum command_action {
@@ -160,51 +994,350 @@ enum command_action {
     command_action_time_change,         /* period/multiplier/timeout changed */
 };
 
+#define GROUP_FILE 'G' /* option() prefix character for "-G" file lines */
+
 static void usage(FILE *fp);
 static enum command_action option(struct config *cfg,
                                   int pc, int oc, char *arg);
-static enum command_action source_option(struct config *cfg,
+static enum command_action group_option(struct config *cfg, struct mcgroup *g,
+                                        int pc, int oc, char *arg);
+static enum command_action source_option(struct config *cfg, struct mcgroup *g,
                                          int pc, int oc, char *arg);
-static enum command_action data_option(struct config *cfg, char *arg);
+static enum command_action data_option(struct config *cfg,
+                                       struct pktdata *pd, char *arg);
+static enum command_action rate_option(double *rate, int *bits, char *arg);
+static enum command_action churn_option(struct config *cfg, char *arg);
+static enum command_action trace_option(struct config *cfg, char *arg);
 static enum command_action format_option(struct config *cfg, int pc, char *arg);
+static enum command_action sockopt_option(struct config *cfg, char *arg);
+static enum command_action sockopt_onoff(int *flag, char *arg, char *val);
+static enum command_action sockopt_number(long *l, char *arg, char *val,
+                                          long min, long max);
 #ifdef DEE_TEST
 static enum command_action dee_test_option(struct config *cfg, char *arg);
 #endif /* DEE_TEST */
+#ifdef DO_SOURCES
+static enum command_action sources_change(struct mcgroup *g, int oc,
+                                          uint32_t newmode, int delta,
+                                          struct srclist *sl);
+#endif /* DO_SOURCES */
 static enum command_action command(struct config *cfg);
+static enum command_action command_text(struct config *cfg, char *cmd);
+static ssize_t cmdring_read(struct cmdring *cr, int fd);
+static ssize_t cmdring_find(struct cmdring *cr, int c);
+static char *cmdring_get(struct cmdring *cr, size_t len, char *tmp);
+static void cmdring_drop(struct cmdring *cr, size_t len);
+static void cmdsock_setup(struct config *cfg, struct oligocast_evloop *evl);
+static int cmdsock_ready(struct config *cfg, struct oligocast_evready *rd);
+static void cmdsock_close(struct config *cfg, struct cmdconn *cc);
+static enum command_action cmdsock_command(struct config *cfg);
+static enum command_action cmdbin(struct config *cfg, uint8_t *cmd, size_t len);
+static enum command_action cmdbin_op(struct config *cfg, uint8_t *cmd,
+                                     size_t len);
+static void cmdsock_remove(struct config *cfg);
 static void progname_to_progdir(void);
 static void errout(char *fmt, ...);
 static void errthrottle(void);
-static void emit(struct config *cfg, enum reported_events evt, char *extra);
+static void emit(struct config *cfg, struct mcgroup *g,
+                 enum reported_events evt, char *extra);
+static void emit_at(struct config *cfg, struct mcgroup *g,
+                    enum reported_events evt, char *extra,
+                    struct timespec *when);
+static void out_line(struct config *cfg);
+static long out_flushing(struct config *cfg);
+static enum command_action binlog_open(struct config *cfg, char *path);
+static void binlog_add(struct config *cfg, struct binlog *bl,
+                       enum reported_events evt, struct mcgroup *g,
+                       struct timespec *when, int len, uint64_t seq,
+                       int64_t lat, int flags);
+static void binlog_rx(struct config *cfg, struct binlog *bl,
+                      struct mcgroup *g, struct rxbufs *rb, int i, int bad);
+static void binlog_tx(struct config *cfg, struct mcgroup *g, int count);
+static void binlog_write(struct config *cfg, struct binlog *bl);
+static long binlog_aging(struct config *cfg, struct binlog *bl);
 static int auto_pton(char *s, struct sockaddr_storage *ss,
                      socklen_t *sslen, struct config *cfg);
 static char *auto_ntop(void *src, char *dst, socklen_t size);
+static uint8_t *addr_bytes(struct sockaddr_storage *ss);
+static uint16_t *addr_port(struct sockaddr_storage *ss);
+static unsigned addr_hash(int af, uint8_t *addr, int port);
 #ifdef DO_SOURCES
-static void sort_addrs(struct sockaddr_storage *addrs, int naddrs);
-static int sort_addrs_compare(const void *x, const void *y);
-static void add_addrs(struct sockaddr_storage **res_addrs, int *res_naddrs,
-                      struct sockaddr_storage *lft_addrs, int lft_naddrs,
-                      struct sockaddr_storage *rgt_addrs, int rgt_naddrs);
-static void sub_addrs(struct sockaddr_storage **res_addrs, int *res_naddrs,
-                      struct sockaddr_storage *inc_addrs, int inc_naddrs,
-                      struct sockaddr_storage *exc_addrs, int exc_naddrs);
+static int srcs_cmp4(const void *x, const void *y);
+static int srcs_cmp16(const void *x, const void *y);
+static void srcs_sort(struct srclist *sl);
+static void srcs_room(struct srclist *sl, int n, int alen);
+static int srcs_find(struct srclist *sl, const uint8_t *addr);
+static int srcs_insert(struct srclist *sl, struct srclist *ins);
+static int srcs_remove(struct srclist *sl, struct srclist *rm);
+static void srcs_copy(struct srclist *dst, struct srclist *src);
+static void srcs_sockaddr(struct srclist *sl, int i,
+                          struct sockaddr_storage *ss);
+static struct sockaddr_storage *srcs_sockaddrs(struct srclist *sl);
+static void sources_pending(struct mcgroup *g, struct srclist *chg, int delta);
 #endif /* DO_SOURCES */
-static int timestamp_log(struct timeval *tv, char *buf, size_t len, void *arg);
-static int timestamp_raw(struct timeval *tv, char *buf, size_t len, void *arg);
-static int timestamp_num(struct timeval *tv, char *buf, size_t len, void *arg);
-static int timestamp_none(struct timeval *tv, char *buf, size_t len, void *arg);
+static int timestamp_log(struct timespec *ts, char *buf, size_t len, void *arg);
+static int timestamp_raw(struct timespec *ts, char *buf, size_t len, void *arg);
+static int timestamp_num(struct timespec *ts, char *buf, size_t len, void *arg);
+static int timestamp_none(struct timespec *ts, char *buf, size_t len,
+                          void *arg);
+static int timestamp_frac(struct timespec *ts, char *buf, size_t len);
+static int timestamp_secs(struct timespec *ts, char *buf, size_t len,
+                          const char *fmt, struct tscache *tc);
 static char *csv_escape(char *s);
-static char *make_default_label(struct config *cfg);
-static void group_check(struct config *cfg, int first_time);
+static char *csv_escape_reuse(char *s);
+static char *make_default_label(struct mcgroup *g);
+static void group_check(struct config *cfg, struct mcgroup *g, int first_time);
+static struct mcgroup *group_new(struct mcgroup *like);
+static void group_add(struct config *cfg, struct mcgroup *g);
+static void group_file(struct config *cfg, char *fn);
+static void group_socket(struct config *cfg, struct mcgroup *g);
+static void group_dest(struct mcgroup *g);
+static void sockbuf_size(int sok, int opt, int forceopt, int size,
+                         const char *name);
+static void group_filter(struct config *cfg, struct mcgroup *g);
+#if defined(DO_SOURCES) && defined(HAVE_MCAST_JOIN_SOURCE_GROUP)
+static int group_filter_delta(struct config *cfg, struct mcgroup *g);
+#endif /* DO_SOURCES && HAVE_MCAST_JOIN_SOURCE_GROUP */
+static int64_t group_timeouts(struct config *cfg, int64_t now);
+static int64_t sooner(int64_t next, int64_t now, long us);
+static void theap_insert(struct config *cfg, struct mcgroup *g);
+static void theap_remove(struct config *cfg, struct mcgroup *g);
+static void theap_up(struct config *cfg, int pos);
+static void theap_down(struct config *cfg, int pos);
+static void theap_rekey(struct config *cfg);
+static void rx_buffers_setup(struct config *cfg, struct rxbufs *rb);
+static int rx_batch(struct rxbufs *rb, int sok);
+#ifdef HAVE_SO_TIMESTAMPNS
+static void rx_cmsg_ts(struct msghdr *mh, struct timespec *ts);
+#ifdef HAVE_UDP_GRO
+static int rx_cmsg_gro(struct msghdr *mh);
+static int rx_gro_split(struct rxbufs *rb, int n);
+#endif /* HAVE_UDP_GRO */
+#ifdef HAVE_SO_RXQ_OVFL
+static void rx_cmsg_ovfl(struct msghdr *mh, uint32_t *drops);
+#endif /* HAVE_SO_RXQ_OVFL */
+#endif /* HAVE_SO_TIMESTAMPNS */
+static void rx_packets(struct config *cfg, struct mcgroup *g,
+                       struct rxbufs *rb, int n);
+#ifdef HAVE_PACKET_RING
+static void ring_setup(struct config *cfg, struct oligocast_evloop *evl);
+static struct mcgroup *ring_match(struct config *cfg, struct rxring *rr,
+                                  uint8_t *pkt, int len,
+                                  uint8_t **data, int *dlen,
+                                  struct sockaddr_storage *from);
+static int ring_ready(struct config *cfg, struct oligocast_evready *rd);
+#endif /* HAVE_PACKET_RING */
+static int rx_mismatch(struct config *cfg, struct mcgroup *g,
+                       struct rxbufs *rb, int i);
+static void seq_stamp(struct config *cfg, struct mcgroup *g, uint8_t *buf);
+static uint64_t seq_seed(uint8_t *hdr);
+static void seq_fill(struct pktdata *pd, uint8_t *hdr, uint8_t *rest);
+static int seq_verify(struct pktdata *pd, uint8_t *buf, int len);
+static int seq_track(struct mcgroup *g, uint8_t *buf, int len,
+                     struct timespec *rxts);
+static void hist_add(struct histogram *h, int64_t v);
+static int hist_bin(uint64_t v);
+static uint64_t hist_value(int bin);
+static long lat_reports(struct config *cfg);
+static void lat_report(struct config *cfg, struct mcgroup *g);
+static uint64_t hist_since(struct histogram *h, uint64_t *val);
+static void seq_report(struct config *cfg, struct mcgroup *g,
+                       uint64_t lost, uint64_t reord, uint64_t dup);
+static void stats_add(struct mcgroup *g, struct rxbufs *rb, int n, int bad);
+static long stats_reports(struct config *cfg);
+static void stats_report(struct config *cfg, struct mcgroup *g, double sec);
+static struct rxsource *rxsrc_find(struct config *cfg, struct mcgroup *g,
+                                   struct sockaddr_storage *from);
+static void rxsrc_grow(struct mcgroup *g);
+static void rxsrc_add(struct config *cfg, struct mcgroup *g,
+                      struct rxbufs *rb, int n);
+static long rxsrc_sweeps(struct config *cfg);
+static void rxsrc_report(struct config *cfg, struct mcgroup *g, double sec);
+static void rxsrc_event(struct config *cfg, struct mcgroup *g,
+                        struct rxsource *rs, enum reported_events evt,
+                        char *more);
+static struct churn *churn_new(struct config *cfg, struct mcgroup **groups,
+                               int ngroups, uint64_t seed);
+static int64_t churn_ops(struct config *cfg, struct churn *ch, int64_t now);
+static int churn_join(struct config *cfg, struct mcgroup *g, int64_t due);
+static void churn_leave(struct config *cfg, struct mcgroup *g);
+static void churn_rx(struct config *cfg, struct mcgroup *g,
+                     struct rxbufs *rb, int n);
+static double churn_random(struct churn *ch);
+static void churn_report(struct config *cfg);
+static void group_counters(struct config *cfg, struct mcgroup *g,
+                           struct grpcount *gc);
+#ifdef HAVE_SHM_OPEN
+static enum command_action shm_option(struct config *cfg, char *arg);
+static void shm_setup(struct config *cfg);
+static long shm_update(struct config *cfg);
+static void shm_group(struct config *cfg, struct mcgroup *g,
+                      struct shmgroup *sg);
+static int shm_stale(struct config *cfg);
+static void shm_remove(struct config *cfg);
+#endif /* HAVE_SHM_OPEN */
+static void http_setup(struct config *cfg, struct oligocast_evloop *evl);
+static char *http_label_value(char *s);
+static int http_ready(struct config *cfg, struct oligocast_evready *rd);
+static void http_accept(struct config *cfg);
+static void http_request(struct config *cfg, struct httpconn *hc);
+static void http_send(struct config *cfg, struct httpconn *hc,
+                      char *data, size_t len);
+static void http_close(struct config *cfg, struct httpconn *hc);
+static size_t http_metrics(struct config *cfg);
+static void http_add(struct httpsrv *hs, char *fmt, ...);
+static void http_hist(struct httpsrv *hs, char *name, char *help,
+                      struct histogram *h);
+static void put32(uint8_t *buf, uint32_t v);
+static void put64(uint8_t *buf, uint64_t v);
+static uint32_t get32(uint8_t *buf);
+static uint64_t get64(uint8_t *buf);
+#ifdef DO_WORKERS
+static void worker_setup(struct config *cfg);
+static void *worker_main(void *arg);
+static void worker_wake(struct config *cfg);
+static void worker_vpush(struct worker *wk, struct mcgroup *g,
+                         struct rxbufs *rb, int n);
+static void worker_collect(struct config *cfg, struct worker *wk);
+static void worker_tlast(struct mcgroup *g);
+static void worker_flush(struct config *cfg);
+#endif /* DO_WORKERS */
+static int64_t mono_ns(void);
+#ifdef DEE_PROFILE
+static void prof_start(void);
+static int prof_enter(int phase);
+static void prof_leave(int was);
+static void prof_report(struct config *cfg);
+#define prof_syscall() (++prof.pf_sys[prof.pf_cur])
+#define prof_packets(n) (prof.pf_pkts += (n))
+#else /* DEE_PROFILE */
+#define prof_start() ((void)0)
+#define prof_enter(phase) (0)
+#define prof_leave(was) ((void)(was))
+#define prof_syscall() ((void)0)
+#define prof_packets(n) ((void)0)
+#endif /* !DEE_PROFILE */
+#ifdef DEE_USDT
+/* probes for bpftrace etc: group index, packet count or length & data */
+#define probe_tx(g, n) DTRACE_PROBE2(oligocast, tx, (g)->mg_idx, (n))
+#define probe_rx(g, len, pkt) \
+    DTRACE_PROBE3(oligocast, rx, (g)->mg_idx, (len), (pkt))
+#else /* DEE_USDT */
+#define probe_tx(g, n) ((void)0)
+#define probe_rx(g, len, pkt) ((void)0)
+#endif /* !DEE_USDT */
+static double tx_interval(struct config *cfg, struct mcgroup *g, int *rated);
+static int64_t tx_pace(struct config *cfg, struct mcgroup *g, int64_t now,
+                       int *due);
+static void tx_paced(struct config *cfg, struct mcgroup *g, int sent);
+static void tx_start(struct config *cfg);
+static int64_t tx_groups(struct config *cfg, int64_t now);
+static void tx_batch(struct config *cfg, int ng);
+static int tx_burst(struct config *cfg, struct mcgroup **gs, int *counts,
+                    int ng);
+#ifdef HAVE_SENDMMSG
+static int tx_per(struct mcgroup *g);
+static void tx_control(struct config *cfg, struct mcgroup *g,
+                       struct msghdr *mh, uint8_t *ctl, int n);
+#endif /* HAVE_SENDMMSG */
+#ifdef HAVE_TX_PKTINFO
+static int tx_share(struct config *cfg, struct mcgroup *g);
+#endif /* HAVE_TX_PKTINFO */
+static void trace_load(struct config *cfg);
+static void trace_get(struct trace *tr, uint8_t *p, void *v, size_t len);
+static int trace_parse(struct trace *tr, size_t off, struct trpkt *pk);
+static int trace_read(struct trace *tr, struct trpos *tp, struct trpkt *pk);
+static size_t trace_pkt(struct config *cfg, struct mcgroup *g,
+                        struct trpos *tp, struct iovec *iov);
+static int64_t trace_pace(struct config *cfg, struct mcgroup *g, int64_t now,
+                          int *due);
+#ifdef HAVE_MSG_ZEROCOPY
+static void zc_reap(struct config *cfg, struct mcgroup *g, int wait_ms);
+static void zc_drain(struct config *cfg);
+#endif /* HAVE_MSG_ZEROCOPY */
+static void exit_setup(struct config *cfg, struct oligocast_evloop *evl);
+static void exit_signal(int sig);
+static void exit_cleanup(void);
 
 /** ** configuration ** **/
 
 static char *progname = "oligocast";
 static int progdir = 0; /* progname implies TX (>0) or RX (<0) or neutral */
-static int (*timestamp_formatter)(struct timeval *, char *, size_t, void *) =
+static int (*timestamp_formatter)(struct timespec *, char *, size_t, void *) =
     timestamp_log;
 static void *timestamp_formatter_arg = NULL;
-
-#define RX_EXTRA 512 /* how much larger cfg_data_rx is than cfg_data_len says */
+static int timestamp_digits = 3; /* digits after the decimal point in times */
+static volatile sig_atomic_t caught_signal = 0; /* SIGINT etc. to exit on */
+static int signal_pipe[2] = { -1, -1 }; /* exit_signal() wakes main loop */
+static struct config *exit_cfg = NULL; /* what exit_cleanup() cleans up */
+#ifdef DO_WORKERS
+static pthread_t main_thread; /* the one that's not a -w worker thread */
+#endif /* DO_WORKERS */
+#ifdef DO_WORKERS
+#define PER_THREAD _Thread_local /* errout() can be called from -w threads */
+#else /* DO_WORKERS */
+#define PER_THREAD
+#endif /* !DO_WORKERS */
+#ifdef DEE_PROFILE
+static PER_THREAD struct profile prof; /* only the main thread's is reported */
+#endif /* DEE_PROFILE */
+
+#define RX_MAXLEN 65535 /* default rb_len: room for any UDP datagram */
+#define RX_RING_BATCH 256 /* "-o ring" packets handled together */
+#define RX_RING_BLOCKS 16 /* "-o ring" blocks handled at a time */
+#define MAX_BATCH 1024 /* maximum value of "-b" option */
+#define RXSRC_MIN 64 /* "-o sources" hash table size to start with */
+#define RXSRC_MAX 65536 /* most sources "-o sources" keeps track of per group */
+#define MAX_WORKERS 64 /* max worker threads (-w) */
+#define WK_VRING 4096 /* packets a worker can pass on for "-v" at a time */
+#define TX_MAX_LAG 20000000 /* ns behind "-R" schedule before giving up on it */
+#define TX_BATCH_MAX 256 /* most packets for several groups in one sendmmsg() */
+#define MAX_READY 64 /* max file descriptors handled per event loop wakeup */
+#define CHURN_BURST 64 /* most "-C" joins at a time, before looking at input */
+#define CHURN_MAX_LAG 20000000 /* ns behind "-C" schedule before giving up */
+#define SEQ_MAGIC 0x4f4c4753 /* "OLGS": first 4 bytes of "-d seq" header */
+#define SEQ_CRC_LEN 4 /* size of ",crc" CRC32C at the end */
+/* is what follows the "-d seq" header different in each packet */
+#define SEQ_VARIES(pd) ((pd)->pd_pat || (pd)->pd_crc)
+#define SEQ_HDR_LEN 24 /* size of "-d seq" header */
+#define OUT_BUFSIZE 65536 /* stdio buffer for output, see "-f flush:" */
+#define BINLOG_BUFSIZE (32768 * sizeof(struct binrec)) /* "-f binary:" */
+#define BINLOG_MAXAGE 1000000 /* usec a "-f binary:" record may wait */
+#define ZC_POOL 4096 /* "-o zerocopy" headers that may be in flight */
+#define ZC_WAIT_MS 5 /* how long to wait when they're all in flight */
+#define HW_TS_SLOP 1000000000LL /* ns "-o tstamp=hw" may be off the clock */
+#ifdef HAVE_UDP_GRO
+#define RX_CTL_GRO CMSG_SPACE(sizeof(int)) /* UDP_GRO control message */
+#define RX_GRO_LEN 65536 /* rb_len with "-o gro" */
+#define RX_GRO_SEGS 64 /* most packets the kernel combines in one */
+#else /* HAVE_UDP_GRO */
+#define RX_CTL_GRO 0
+#endif /* !HAVE_UDP_GRO */
+#ifdef HAVE_SO_RXQ_OVFL
+#define RX_CTL_OVFL CMSG_SPACE(sizeof(uint32_t)) /* SO_RXQ_OVFL drop count */
+#else /* HAVE_SO_RXQ_OVFL */
+#define RX_CTL_OVFL 0
+#endif /* !HAVE_SO_RXQ_OVFL */
+#if defined(HAVE_SO_TIMESTAMPING)
+#define RX_CTL_LEN (CMSG_SPACE(3 * sizeof(struct timespec)) + RX_CTL_GRO + \
+                    RX_CTL_OVFL)
+#elif defined(HAVE_SO_TIMESTAMPNS)
+#define RX_CTL_LEN (CMSG_SPACE(sizeof(struct timespec)) + RX_CTL_GRO + \
+                    RX_CTL_OVFL)
+#endif /* HAVE_SO_TIMESTAMPING || HAVE_SO_TIMESTAMPNS */
+#ifdef HAVE_UDP_SEGMENT
+#define TX_CTL_GSO CMSG_SPACE(sizeof(uint16_t)) /* UDP_SEGMENT */
+#define TX_GSO_SEGS 64 /* most packets in one "-o gso" send */
+#define TX_GSO_MAX 65000 /* most bytes in one "-o gso" send */
+#else /* HAVE_UDP_SEGMENT */
+#define TX_CTL_GSO 0
+#endif /* !HAVE_UDP_SEGMENT */
+#ifdef HAVE_TX_PKTINFO
+#define TX_CTL_PKTINFO CMSG_SPACE(sizeof(struct in6_pktinfo)) /* or in_ */
+#else /* HAVE_TX_PKTINFO */
+#define TX_CTL_PKTINFO 0
+#endif /* !HAVE_TX_PKTINFO */
+#define TX_CTL_LEN (TX_CTL_GSO + TX_CTL_PKTINFO) /* each message, cfg_tx_ctl */
 
 /*
  * usage()
@@ -226,7 +1359,9 @@ static void usage(FILE *fp)
     fprintf(fp,
             "    -g grp -- multicast group address to listen to\n"
             "    -p port -- UDP port number to use\n"
-            "    -i iface -- name of network interface to use\n");
+            "    -i iface -- name of network interface to use\n"
+            "    -G file -- handle several groups, listed in file;\n"
+            "               see GROUPS\n");
     if (progdir >= 0) {
         fprintf(fp,
             "    -T ttl -- time to live / hop limit value to use;\n"
@@ -249,25 +1384,184 @@ static void usage(FILE *fp)
             "        -f rawtime -- timestamps like: 1599943404.456\n"
             "        -f numtime -- timestamps like: 2020-09-12-13:46:43.789\n"
             "        -f notime -- no timestamps\n"
+            "        -f ms, -f us, -f ns -- show timestamps to the\n"
+            "                      millisecond (default), microsecond,\n"
+            "                      or nanosecond\n"
+            "        -f flush:line -- write out each line right away\n"
+            "                      (the default)\n"
+            "        -f flush:100 -- write out every 100 lines\n"
+            "        -f flush:0.5s -- write out within 0.5 seconds\n"
+            "        -f flush:idle -- write out when there's nothing else\n"
+            "                      to do\n"
+            "        -f binary:file -- also log every packet & event to\n"
+            "                      file, in a compact binary format; see\n"
+            "                      testing/binlog.py; \"binary:-\" to stop\n"
             "    -P sec -- period between packets in seconds; default 1.0\n");
+    if (progdir >= 0) {
+        fprintf(fp,
+            "    -R rate -- send at a rate, instead of one packet per period:\n"
+            "        -R 1000 -- packets per second; can suffix k, M, G\n"
+            "        -R 1.5Mbps -- bits per second of data sent\n"
+            "        -R - -- stop; go back to the period given by -P\n"
+            "    -F file[:speed] -- instead of -R or -P, replay the packet\n"
+            "              lengths & times in a traffic profile, over and\n"
+            "              over, to each group: a pcap file's UDP packets,\n"
+            "              or a trace from testing/mktrace.py; speed 2 for\n"
+            "              twice as fast; the data comes from it too, but\n"
+            "              with \"-d seq\" that header replaces the start\n");
+    }
     if (progdir <= 0) {
         fprintf(fp,
-            "    -m mult -- multiply packet period to get timeout; default 3.0\n");
+            "    -m mult -- multiply packet period to get timeout; default 3.0\n"
+            "    -L sec -- with \"-d seq\", report latency every sec seconds;\n"
+            "              and with -C, join & leave times; \"-\" to stop\n"
+            "    -S sec -- report packet statistics every sec seconds;\n"
+            "              cheaper than -v at high rates; \"-\" to stop\n"
+            "    -C rate[:sec][:random] -- membership churn: join the groups\n"
+            "              at rate joins per second (can suffix k), leave\n"
+            "              each sec seconds later (default 1; \"-\" to stay),\n"
+            "              and join it again later; \"random\" for random\n"
+            "              times and order; -L reports the time from join\n"
+            "              to first packet, and from leave to last; the\n"
+            "              kernel stops a socket's packets when it leaves,\n"
+            "              so that's only telling with -o ring\n");
     }
     fprintf(fp,
             "    -d data -- message data, %s:\n"
             "        hex:ABCDEF -- some bytes in hexadecimal\n"
             "        text:abcdef -- some literal text\n"
-            "        len:123 -- some number of bytes of made up data\n",
+            "        len:123 -- some number of bytes of made up data\n"
+            "        seq:123 -- sequence numbered header, padded to 123 bytes\n"
+            "                   (or just \"seq\", %d bytes); the receiver\n"
+            "                   reports lost, reordered, duplicated packets\n"
+            "        prbs:123 -- like seq:123, but padded with pseudorandom\n"
+            "                   data, different in each packet, checked\n"
+            "        count:123 -- like prbs:123, but with counting words\n"
+            "        seq:123,crc -- (or prbs, count) end each packet with\n"
+            "                   a CRC32C of the rest, checked\n"
+            "                   (done with: %s)\n",
             ((progdir == 0) ? "to send, or to expect to receive" :
              ((progdir < 0) ? "to expect to receive" :
-                              "to send")));
+                              "to send")),
+            (int)SEQ_HDR_LEN, pattern_init());
+    fprintf(fp,
+            "    -b count -- %s up to count packets at a time; default 1\n",
+            ((progdir == 0) ? "send (with -R) or receive" :
+             ((progdir < 0) ? "receive" : "send (with -R)")));
+#ifdef DO_WORKERS
+    if (progdir <= 0) {
+        fprintf(fp,
+            "    -w count -- receive in count threads, spreading the groups\n"
+            "                (-G) among them; with -C each joins and leaves\n"
+            "                its own\n");
+    }
+#endif /* DO_WORKERS */
+    fprintf(fp,
+            "    -H [addr:]port -- serve counters for each group in\n"
+            "                OpenMetrics (Prometheus) format over HTTP\n");
+#ifdef HAVE_SHM_OPEN
+    fprintf(fp,
+            "    -M name[:sec] -- keep counters for each group in shared\n"
+            "                memory segment /name, updated every sec\n"
+            "                seconds (default 1)\n");
+#endif /* HAVE_SHM_OPEN */
+    fprintf(fp,
+            "    -o sockopt -- socket option:\n");
+#ifdef HAVE_MSG_ZEROCOPY
+    if (progdir >= 0) {
+        fprintf(fp,
+            "        -o zerocopy -- send without copying the data, where\n"
+            "                       the network interface can; for big\n"
+            "                       packets (-d len:N), fast (-R)\n");
+    }
+#endif /* HAVE_MSG_ZEROCOPY */
+#ifdef HAVE_UDP_SEGMENT
+    if (progdir >= 0) {
+        fprintf(fp,
+            "        -o gso -- with -b, have the kernel split one big send\n"
+            "                  into the packets (UDP GSO)\n");
+    }
+#endif /* HAVE_UDP_SEGMENT */
+#ifdef HAVE_TX_PKTINFO
+    if (progdir >= 0) {
+        fprintf(fp,
+            "        -o txshare -- with -G, send to all the groups with the\n"
+            "                      same TTL and interface through one\n"
+            "                      socket, several at a time; not with\n"
+            "                      -o zerocopy\n");
+    }
+#endif /* HAVE_TX_PKTINFO */
+#ifdef HAVE_UDP_GRO
+    if (progdir <= 0) {
+        fprintf(fp,
+            "        -o gro -- let the kernel combine received packets,\n"
+            "                  to be split up again here (UDP GRO)\n");
+    }
+#endif /* HAVE_UDP_GRO */
+#ifdef HAVE_PACKET_RING
+    if (progdir <= 0) {
+        fprintf(fp,
+            "        -o ring -- receive through a packet ring on the\n"
+            "                   interface, bypassing the UDP stack; needs\n"
+            "                   privileges; not with -w\n");
+    }
+#endif /* HAVE_PACKET_RING */
+    if (progdir <= 0) {
+        fprintf(fp,
+            "        -o rxlen=N -- room for received packets up to N bytes;\n"
+            "                      bigger ones are counted as truncated;\n"
+            "                      default %d\n"
+            "        -o tstamp=user -- time packets after receiving them\n"
+#ifdef HAVE_SO_TIMESTAMPNS
+            "        -o tstamp=sw -- kernel timestamps on received packets\n"
+            "                        (the default)\n"
+#endif /* HAVE_SO_TIMESTAMPNS */
+#ifdef HAVE_SO_TIMESTAMPING
+            "        -o tstamp=hw -- network interface (hardware)\n"
+            "                        timestamps, where available; the\n"
+            "                        interface clock must be kept in step\n"
+            "                        with the system clock (PTP, phc2sys);\n"
+            "                        the interface is left timestamping\n"
+            "                        after exit\n"
+#endif /* HAVE_SO_TIMESTAMPING */
+            , (int)RX_MAXLEN);
+        fprintf(fp,
+            "        -o rcvbuf=N -- socket receive buffer of N bytes (k, M\n"
+            "                       suffixes allowed); more room for bursts\n"
+#ifdef HAVE_SO_BUSY_POLL
+            "        -o busypoll=N -- have the kernel poll the network\n"
+            "                         interface for up to N usec\n"
+            "                         (SO_BUSY_POLL)\n"
+#endif /* HAVE_SO_BUSY_POLL */
+            "        -o spin -- check for packets continually without\n"
+            "                   sleeping; uses a whole CPU\n"
+            "        -o sources -- keep track of each source address and\n"
+            "                      port packets come from: when they start\n"
+            "                      and stop, and counts with -S; not\n"
+            "                      with -w\n");
+    }
+    if (progdir >= 0) {
+        fprintf(fp,
+            "        -o sndbuf=N -- socket send buffer of N bytes (k, M\n"
+            "                       suffixes allowed)\n");
+    }
+#ifdef HAVE_SO_PRIORITY
+    fprintf(fp,
+            "        -o priority=N -- queueing priority of the packets,\n"
+            "                         0-6 (SO_PRIORITY)\n");
+#endif /* HAVE_SO_PRIORITY */
+    fprintf(fp,
+            "        -o spinwait=N -- sleep until N usec before each packet\n"
+            "                         or timeout is due, and check\n"
+            "                         continually from then on; more exact\n");
     if (progdir >= 0) {
         fprintf(fp,
             "    -j -- join the multicast group even when transmitting\n");
     }
     fprintf(fp,
             "    -k -- enable reading comments from stdin; see COMMANDS\n"
+            "    -K path -- also take commands on Unix socket 'path'; see\n"
+            "               COMMANDS\n"
             "    -h -- display help message and exit\n");
 
     fprintf(fp,
@@ -281,20 +1575,35 @@ static void usage(FILE *fp)
             "    #\n"
             "        comment; ignore the whole line\n"
 #ifdef DO_SOURCES
-            "    -E, -I, -v, -l, -f, -P%s, -d, -h\n"
+            "    -E, -I, -v, -l, -f, -P%s, -d, -b, -h\n"
 #else
-            "    -v, -l, -f, -P%s, -d, -h\n"
+            "    -v, -l, -f, -P%s, -d, -b, -h\n"
 #endif /* DO_SOURCES */
             "        same as the command line options\n"
             "    +v, +k\n"
             "        opposites of the command line options\n"
             "    ?E, ?I\n"
             "        state queries related to the command line options\n"
+#ifdef DEE_PROFILE
+            "    ?c\n"
+            "        report where the time has gone (DEE_PROFILE)\n"
+#endif /* DEE_PROFILE */
+            "    .g index\n"
+            "        with -G: make -E, -I, ?E, ?I act on the group at index\n"
+            "        (counting from 0, in order of the file); default 0\n"
             "    ..\n"
             "        command does nothing; but is echoed with timestamp\n"
             "    .x\n"
-            "        terminate the program\n",
-            (progdir <= 0) ? ", -m" : "");
+            "        terminate the program\n"
+            "    With -K, the same commands can also come over connections\n"
+            "    to a Unix socket, each one following a 12 byte header:\n"
+            "    4 byte length of the rest, 1 byte type 0, 3 bytes 0,\n"
+            "    4 bytes 0xffffffff (or a group index, as for .g).  Types 1\n"
+            "    and 2 set -I and -E from packed 4 or 16 byte addresses\n"
+            "    (flags byte 1 to add, 2 to remove); type 3 sets -R from an\n"
+            "    8 byte rate times 1000 (flags byte 4 for bits per second).\n",
+            ((progdir == 0) ? ", -R, -m, -L, -S" :
+             ((progdir < 0) ? ", -m, -L, -S" : ", -R")));
 
 #ifdef DO_SOURCES
     fprintf(fp,
@@ -321,6 +1630,24 @@ static void usage(FILE *fp)
             "        \"+\" or \"-\" to add to (or subtract from) the existing\n"
             "        list instead of replacing it.\n");
 #endif /* DO_SOURCES */
+
+    fprintf(fp,
+            "\n"
+            "GROUPS:\n"
+            "    With the -G option, this program handles several multicast\n"
+            "    groups, each with its own socket, instead of just the one\n"
+            "    given by -g.  Each line of the file describes one group,\n"
+            "    using options like those on the command line:\n"
+#ifdef DO_SOURCES
+            "        -g grp [-p port] [-i iface] [-I/-E addr(s)] [-l label]\n"
+#else /* DO_SOURCES */
+            "        -g grp [-p port] [-i iface] [-l label]\n"
+#endif /* DO_SOURCES */
+            "            [-d data] [-R rate] [-T ttl]\n"
+            "    Blank lines and lines beginning with '#' are ignored.\n"
+            "    Settings left out are taken from the command line.\n"
+            "    When sending, each group's packets go at its own rate,\n"
+            "    interleaved with the others'.\n");
     fflush(fp);
 }
 
@@ -336,6 +1663,9 @@ static void usage(FILE *fp)
  *          '-' - for a '-' command on stdin
  *          '+' - for a '+' command on stdin
  *          '.' - for a '.' command on stdin
+ *          '?' - for a '?' command on stdin
+ *          GROUP_FILE - for an option on a line of the -G file; only
+ *              passed to group_option() and source_option()
  *      oc - option character: example 'I' for the '-I' option
  *      arg - argument for this option/command if any
  *
@@ -346,7 +1676,7 @@ static void usage(FILE *fp)
 static enum command_action option(struct config *cfg, int pc, int oc, char *arg)
 {
     float f;
-    char errbuf[256];
+    int i;
 
     switch (oc) {
     case 't': /* -t option on command line: transmit (send) */
@@ -376,84 +1706,48 @@ static enum command_action option(struct config *cfg, int pc, int oc, char *arg)
         break;
 
     case 'g': /* -g option on command line: specify the multicast group */
-        if (pc != 0) {
-            errout("-g may only appear on the command line");
-            return(command_action_error);
-        }
-        if (cfg->cfg_grp.ss_family != AF_UNSPEC) {
-            errout("-g may not be used more than once");
-            return(command_action_error);
-        }
-        cfg->cfg_grplen = sizeof(cfg->cfg_grp);
-        if (!auto_pton(arg, &cfg->cfg_grp, &cfg->cfg_grplen, cfg)) {
-            return(command_action_error);
+        if (pc == '.') {
+            /* .g command: select the group other commands act on */
+            i = atoi(arg);
+            if (i < 0 || i >= cfg->cfg_ngroups) {
+                errout("group index %d out of range 0-%d",
+                       i, cfg->cfg_ngroups - 1);
+                return(command_action_error);
+            }
+            cfg->cfg_gsel = cfg->cfg_groups[i];
+            return(command_action_none);
         }
-        break;
+        return(group_option(cfg, &cfg->cfg_tmpl, pc, oc, arg));
 
     case 'p': /* -p option on command line: specify the UDP port number */
-        if (pc != 0) {
-            errout("-p may only appear on the command line");
-            return(command_action_error);
-        }
-        if (cfg->cfg_port != 0) {
-            errout("-p may not be used more than once");
-            return(command_action_error);
-        }
-        cfg->cfg_port = atoi(arg);
-        if (cfg->cfg_port < 1 || cfg->cfg_port > 65535) {
-            errout("-p port must be in range 1-65535");
-            return(command_action_error);
-        }
-        break;
+        return(group_option(cfg, &cfg->cfg_tmpl, pc, oc, arg));
 
     case 'i': /* -i option on command line: specify the network interface */
-        if (pc == '?') {
-            /* for testing: display interface information */
-            char abuf[16];
-            snprintf(errbuf, sizeof(errbuf),
-                     "interface info: name '%s' index %u v4addr %s",
-                     cfg->cfg_intf.nam, (unsigned)cfg->cfg_intf.idx,
-                     inet_ntop(AF_INET, &cfg->cfg_intf.adr,
-                               abuf, sizeof(abuf)));
-            emit(cfg, reported_event_note, errbuf);
-            return(command_action_none);
-        }
-        if (pc != 0) {
-            errout("-i may only appear on the command line");
-            return(command_action_error);
-        }
-        if (cfg->cfg_intf.nam[0] != '\0') {
-            errout("-i may not be used more than once");
+        return(group_option(cfg, pc ? cfg->cfg_gsel : &cfg->cfg_tmpl,
+                            pc, oc, arg));
+
+    case 'G': /* -G option on command line: file listing groups */
+        if (pc != '\0') {
+            errout("-G may only appear on the command line");
             return(command_action_error);
         }
-        identify_interface(arg, &cfg->cfg_intf, errbuf, sizeof(errbuf));
-        if (errbuf[0]) {
-            errout("%s", errbuf);
+        if (cfg->cfg_group_file != NULL) {
+            errout("-G may not be used more than once");
             return(command_action_error);
         }
+        cfg->cfg_group_file = strdup(arg);
         break;
 
     case 'T': /* -T option on command line: specify TTL / hop limit value */
-        if (pc != '\0') {
-            errout("-T may only appear on the command line");
-            return(command_action_error);
-        }
-        if (!strcmp(arg, "-")) {
-            cfg->cfg_ttl = -1;
-        } else {
-            cfg->cfg_ttl = atoi(arg);
-            if (cfg->cfg_ttl < 0 || cfg->cfg_ttl > 255) {
-                errout("TTL/hop limit value '%s' outside range 0-255", arg);
-                return(command_action_error);
-            }
-        }
-        break;
+        return(group_option(cfg, &cfg->cfg_tmpl, pc, oc, arg));
 
     case 'E': /* -E option or command: exclude sources */
-        return(source_option(cfg, pc, oc, arg));
+        return(source_option(cfg, pc ? cfg->cfg_gsel : &cfg->cfg_tmpl,
+                             pc, oc, arg));
 
     case 'I': /* -I option or command: include sources */
-        return(source_option(cfg, pc, oc, arg));
+        return(source_option(cfg, pc ? cfg->cfg_gsel : &cfg->cfg_tmpl,
+                             pc, oc, arg));
 
     case 'v':
         if (pc == '\0' || pc == '-') {
@@ -488,9 +1782,13 @@ static enum command_action option(struct config *cfg, int pc, int oc, char *arg)
             errout("%c%c is not a valid command", pc, oc);
             return(command_action_error);
         }
+        if (pc != '\0' && cfg->cfg_trace != NULL) {
+            errout("-P doesn't apply while replaying a trace (-F)");
+            return(command_action_error);
+        }
         f = atof(arg);
-        if (!(f >= 0.001 && f <= 60.0)) {
-            errout("-P period must be in range 0.001-60 seconds");
+        if (!(f >= 0.00001 && f <= 60.0)) {
+            errout("-P period must be in range 0.00001-60 seconds");
             return(command_action_error);
         }
         cfg->cfg_period = f;
@@ -509,18 +1807,150 @@ static enum command_action option(struct config *cfg, int pc, int oc, char *arg)
         cfg->cfg_multiplier = f;
         return(command_action_time_change);
 
-    case 'd': /* -d option or command: data to send/expect in messages */
+    case 'L': /* -L option or command: set latency report period */
         if (pc != '-' && pc != '\0') {
             errout("%c%c is not a valid command", pc, oc);
             return(command_action_error);
         }
-        return(data_option(cfg, arg));
+        if (!strcmp(arg, "-") || !strcmp(arg, "0")) {
+            cfg->cfg_lat_us = 0;
+            break;
+        }
+        f = atof(arg);
+        if (!(f >= 0.1 && f <= 3600.0)) {
+            errout("-L period must be in range 0.1-3600 seconds");
+            return(command_action_error);
+        }
+        cfg->cfg_lat_us = rint(f * 1e+6);
+        cfg->cfg_lat_next = 0; /* start over */
+        break;
 
-#ifdef DEE_TEST
+    case 'S': /* -S option or command: set statistics report period */
+        if (pc != '-' && pc != '\0') {
+            errout("%c%c is not a valid command", pc, oc);
+            return(command_action_error);
+        }
+        if (!strcmp(arg, "-") || !strcmp(arg, "0")) {
+            cfg->cfg_stats_us = 0;
+            break;
+        }
+        f = atof(arg);
+        if (!(f >= 0.1 && f <= 3600.0)) {
+            errout("-S period must be in range 0.1-3600 seconds");
+            return(command_action_error);
+        }
+        cfg->cfg_stats_us = rint(f * 1e+6);
+        cfg->cfg_stats_next = 0; /* start over */
+        break;
+
+    case 'C': /* -C membership churn */
+        if (pc != '\0') {
+            errout("-C only allowed on command line");
+            return(command_action_error);
+        }
+        return(churn_option(cfg, arg));
+
+    case 'F': /* -F traffic profile to replay */
+        if (pc != '\0') {
+            errout("-F only allowed on command line");
+            return(command_action_error);
+        }
+        return(trace_option(cfg, arg));
+
+    case 'R': /* -R option or command: set send rate */
+        if (pc != '-' && pc != '\0') {
+            errout("%c%c is not a valid command", pc, oc);
+            return(command_action_error);
+        }
+        if (pc != '\0' && cfg->cfg_trace != NULL) {
+            errout("-R doesn't apply while replaying a trace (-F)");
+            return(command_action_error);
+        }
+        return(rate_option(&cfg->cfg_rate, &cfg->cfg_rate_bits, arg));
+
+    case 'd': /* -d option or command: data to send/expect in messages */
+        if (pc != '-' && pc != '\0') {
+            errout("%c%c is not a valid command", pc, oc);
+            return(command_action_error);
+        }
+        if (pc != '\0' && cfg->cfg_nworkers > 0) {
+            errout("-d can't be changed while using -w");
+            return(command_action_error);
+        }
+        if (pc != '\0' && cfg->cfg_trace != NULL) {
+            errout("-d can't be changed while replaying a trace (-F)");
+            return(command_action_error);
+        }
+        return(data_option(cfg, &cfg->cfg_data, arg));
+
+    case 'b': /* -b option or command: receive batch size */
+        if (pc != '-' && pc != '\0') {
+            errout("%c%c is not a valid command", pc, oc);
+            return(command_action_error);
+        }
+        if (pc != '\0' && cfg->cfg_nworkers > 0) {
+            errout("-b can't be changed while using -w");
+            return(command_action_error);
+        }
+        i = atoi(arg);
+        if (i < 1 || i > MAX_BATCH) {
+            errout("-b count must be in range 1-%d", (int)MAX_BATCH);
+            return(command_action_error);
+        }
+        cfg->cfg_batch = i;
+        if (pc != '\0' && cfg->cfg_rx.rb_data != NULL) {
+            /* while running: the receive buffers need to change too */
+            rx_buffers_setup(cfg, &cfg->cfg_rx);
+        }
+        break;
+
+#ifdef DEE_TEST
     case 'D': /* -D option or command: debugging/test */
         return(dee_test_option(cfg, arg));
 #endif /* DEE_TEST */
 
+#ifdef DO_WORKERS
+    case 'w': /* -w receive in worker threads */
+        if (pc != '\0') {
+            errout("-w only allowed on command line");
+            return(command_action_error);
+        }
+        i = atoi(arg);
+        if (i < 1 || i > MAX_WORKERS) {
+            errout("-w count must be in range 1-%d", (int)MAX_WORKERS);
+            return(command_action_error);
+        }
+        cfg->cfg_nworkers = i;
+        break;
+#endif /* DO_WORKERS */
+
+    case 'H': /* -H HTTP metrics server */
+        if (pc != '\0') {
+            errout("-H only allowed on command line");
+            return(command_action_error);
+        }
+        if (cfg->cfg_http_addr) {
+            free(cfg->cfg_http_addr);
+        }
+        cfg->cfg_http_addr = strdup(arg);
+        return(command_action_none);
+
+#ifdef HAVE_SHM_OPEN
+    case 'M': /* -M shared memory counters */
+        if (pc != '\0') {
+            errout("-M only allowed on command line");
+            return(command_action_error);
+        }
+        return(shm_option(cfg, arg));
+#endif /* HAVE_SHM_OPEN */
+
+    case 'o': /* -o socket options */
+        if (pc != '\0') {
+            errout("-o only allowed on command line");
+            return(command_action_error);
+        }
+        return(sockopt_option(cfg, arg));
+
     case 'j': /* -j join multicast group even when sending */
         if (pc != '\0') {
             errout("-j only allowed on command line");
@@ -532,7 +1962,7 @@ static enum command_action option(struct config *cfg, int pc, int oc, char *arg)
     case 'k': /* -k listen for commands on stdin */
         if (pc == '+') {
             cfg->cfg_command_in = 0;
-            cfg->cfg_command_got = 0;
+            cmdring_drop(&cfg->cfg_command_ring, cfg->cfg_command_ring.cr_got);
             cfg->cfg_command_ignore = 0;
         } else if (pc == '-' || pc == '\0') {
             cfg->cfg_command_in = 1;
@@ -542,6 +1972,17 @@ static enum command_action option(struct config *cfg, int pc, int oc, char *arg)
         }
         break;
 
+    case 'K': /* -K command socket */
+        if (pc != '\0') {
+            errout("-K only allowed on command line");
+            return(command_action_error);
+        }
+        if (cfg->cfg_cmdsock_path) {
+            free(cfg->cfg_cmdsock_path);
+        }
+        cfg->cfg_cmdsock_path = strdup(arg);
+        break;
+
     case 'x': /* .x exit the program */
         if (pc == '.') {
             return(command_action_exit_program);
@@ -554,6 +1995,18 @@ static enum command_action option(struct config *cfg, int pc, int oc, char *arg)
     case '.': /* .. no operation (command is echoed) */
         return(command_action_none);
 
+#ifdef DEE_PROFILE
+    case 'c': /* ?c report where the time has gone */
+        if (pc == '?') {
+            prof_report(cfg);
+            return(command_action_none);
+        } else {
+            errout("%c%c is not a valid command", pc, oc);
+            return(command_action_error);
+        }
+        break;
+#endif /* DEE_PROFILE */
+
     case 'h': /* display help (usage) message */
         if (cfg->cfg_verbose > 1) {
             fputs(License, stdout);
@@ -586,6 +2039,158 @@ static enum command_action option(struct config *cfg, int pc, int oc, char *arg)
     return(command_action_none);
 }
 
+/*
+ * group_option()
+ *
+ * Handle a command line option, or a command, that's about a particular
+ * multicast group: -g, -p, -i, -T; or on a line of the -G file, those
+ * and also -I, -E, -l, -d, -R.
+ *
+ * Parameters:
+ *      cfg - configuration structure
+ *      g - the group it's about
+ *      pc - prefix character, as for option()
+ *      oc - option character, as for option()
+ *      arg - argument for this option/command if any
+ *
+ * Return value:
+ *      What (if any) additional action needs to be taken in response
+ *      to the command.
+ */
+static enum command_action group_option(struct config *cfg, struct mcgroup *g,
+                                        int pc, int oc, char *arg)
+{
+    char errbuf[256];
+
+    switch (oc) {
+    case 'g': /* -g: specify the multicast group */
+        if (pc != '\0' && pc != GROUP_FILE) {
+            errout("-g may only appear on the command line");
+            return(command_action_error);
+        }
+        if (g->mg_grp.ss_family != AF_UNSPEC) {
+            errout("-g may not be used more than once");
+            return(command_action_error);
+        }
+        g->mg_grplen = sizeof(g->mg_grp);
+        if (!auto_pton(arg, &g->mg_grp, &g->mg_grplen, cfg)) {
+            return(command_action_error);
+        }
+        break;
+
+    case 'p': /* -p: specify the UDP port number */
+        if (pc != '\0' && pc != GROUP_FILE) {
+            errout("-p may only appear on the command line");
+            return(command_action_error);
+        }
+        if (g->mg_port != 0 && pc != GROUP_FILE) {
+            errout("-p may not be used more than once");
+            return(command_action_error);
+        }
+        g->mg_port = atoi(arg);
+        if (g->mg_port < 1 || g->mg_port > 65535) {
+            errout("-p port must be in range 1-65535");
+            return(command_action_error);
+        }
+        break;
+
+    case 'i': /* -i: specify the network interface */
+        if (pc == '?') {
+            /* for testing: display interface information */
+            char abuf[16];
+            snprintf(errbuf, sizeof(errbuf),
+                     "interface info: name '%s' index %u v4addr %s",
+                     g->mg_intf.nam, (unsigned)g->mg_intf.idx,
+                     inet_ntop(AF_INET, &g->mg_intf.adr,
+                               abuf, sizeof(abuf)));
+            emit(cfg, g, reported_event_note, errbuf);
+            return(command_action_none);
+        }
+        if (pc != '\0' && pc != GROUP_FILE) {
+            errout("-i may only appear on the command line");
+            return(command_action_error);
+        }
+        if (g->mg_intf.nam[0] != '\0' && pc != GROUP_FILE) {
+            errout("-i may not be used more than once");
+            return(command_action_error);
+        }
+        identify_interface(arg, &g->mg_intf, errbuf, sizeof(errbuf));
+        if (errbuf[0]) {
+            errout("%s", errbuf);
+            return(command_action_error);
+        }
+        break;
+
+    case 'E': /* -E: exclude sources */
+    case 'I': /* -I: include sources */
+        return(source_option(cfg, g, pc, oc, arg));
+
+    case 'l': /* -l: set output label, for this group */
+        if (pc != GROUP_FILE) {
+            errout("%c%c is not a valid command", pc, oc);
+            return(command_action_error);
+        }
+        if (g->mg_label) {
+            free(g->mg_label);
+        }
+        if (g->mg_label_csv) {
+            free(g->mg_label_csv);
+        }
+        g->mg_label = strdup(arg);
+        g->mg_label_csv = csv_escape(arg);
+        break;
+
+    case 'T': /* -T: specify TTL / hop limit value */
+        if (pc != '\0' && pc != GROUP_FILE) {
+            errout("-T may only appear on the command line");
+            return(command_action_error);
+        }
+        if (!strcmp(arg, "-")) {
+            g->mg_ttl = -1;
+        } else {
+            g->mg_ttl = atoi(arg);
+            if (g->mg_ttl < 0 || g->mg_ttl > 255) {
+                errout("TTL/hop limit value '%s' outside range 0-255", arg);
+                return(command_action_error);
+            }
+        }
+        break;
+
+    case 'd': /* -d: data to send or expect, in this group */
+        if (pc != GROUP_FILE) {
+            errout("%c%c is not a valid command", pc, oc);
+            return(command_action_error);
+        }
+        if (g->mg_data == &cfg->cfg_data) {
+            /* its own, instead of the command line's */
+            struct pktdata *pd = calloc(1, sizeof(*pd));
+            if (pd == NULL) {
+                errout("out of memory for -d");
+                return(command_action_error);
+            }
+            g->mg_data = pd;
+        }
+        return(data_option(cfg, g->mg_data, arg));
+
+    case 'R': /* -R: rate to send at, to this group */
+        if (pc != GROUP_FILE) {
+            errout("%c%c is not a valid command", pc, oc);
+            return(command_action_error);
+        }
+        if (rate_option(&g->mg_rate, &g->mg_rate_bits, arg) ==
+            command_action_error) {
+            return(command_action_error);
+        }
+        break;
+
+    default:
+        errout("-%c is not valid in a group's settings", oc);
+        return(command_action_error);
+    }
+
+    return(command_action_none);
+}
+
 /*
  * source_option()
  *
@@ -593,10 +2198,12 @@ static enum command_action option(struct config *cfg, int pc, int oc, char *arg)
  * These manipulate lists of source addresses for filtering.
  *
  * Parameters:
- *      cfg - configuration structure, where things get stored
+ *      cfg - configuration structure
+ *      g - group whose source filter settings are to be changed
  *      pc - prefix character:
  *          '\0' when called from command line
  *          '-' or '?' when called from stdin
+ *          GROUP_FILE when called for a line of the -G file
  *          other when called wrong
  *      oc - option character: 'I' (include) or 'E' (exclude)
  *      arg - argument string; representing one or more addresses
@@ -607,16 +2214,15 @@ static enum command_action option(struct config *cfg, int pc, int oc, char *arg)
  *      What (if any) additional action needs to be taken in response
  *      to the command.
  */
-static enum command_action source_option(struct config *cfg,
+static enum command_action source_option(struct config *cfg, struct mcgroup *g,
                                          int pc, int oc, char *arg)
 {
 #ifdef DO_SOURCES
     uint32_t newmode;
     int delta = 0, pos = 0, len, end, i;
-    struct sockaddr_storage *sources; /* source list in the option */
-    int nsources, asources;
-    struct sockaddr_storage *csources; /* combined sources */
-    int cnsources;
+    struct srclist sources; /* source list in the option */
+    int asources;
+    struct sockaddr_storage ss;
     socklen_t srclen;
 
     /* special case for query option, "?E" / "?I" */
@@ -625,21 +2231,21 @@ static enum command_action source_option(struct config *cfg,
         int resa, resl;
 
         /* allocate space to represent the source list */
-        resa = 32 + 48 * cfg->cfg_nsources;
+        resa = 32 + 48 * g->mg_sources.sl_n;
         res = calloc(resa, 1);
 
         /* represent the source list */
         resl = snprintf(res, resa, "source setting: %s%s",
-                        (cfg->cfg_sfmode == MCAST_INCLUDE) ? "-I" : "-E",
-                        cfg->cfg_nsources ? "" : "-");
-        for (i = 0; i < cfg->cfg_nsources; ++i) {
+                        (g->mg_sfmode == MCAST_INCLUDE) ? "-I" : "-E",
+                        g->mg_sources.sl_n ? "" : "-");
+        for (i = 0; i < g->mg_sources.sl_n; ++i) {
             if (resl + 2 < resa) {
                 if (i) {
                     res[resl++] = ',';
                     res[resl] = '\0';
                 }
-                resl += strlen(auto_ntop(&cfg->cfg_sources[i],
-                                         res + resl, resa - resl));
+                srcs_sockaddr(&g->mg_sources, i, &ss);
+                resl += strlen(auto_ntop(&ss, res + resl, resa - resl));
             } else {
                 res[0] = '?';
                 res[1] = '\0';
@@ -649,16 +2255,21 @@ static enum command_action source_option(struct config *cfg,
         }
 
         /* emit a message about it */
-        emit(cfg, reported_event_note, res);
+        emit(cfg, g, reported_event_note, res);
         free(res);
         return(command_action_none);
     }
 
     /* sanity checks */
-    if (pc != '\0' && pc != '-') {
+    if (pc != '\0' && pc != '-' && pc != GROUP_FILE) {
         errout("%c%c is not a valid command", pc, oc);
         return(command_action_error);
     }
+    if (pc == '-' && cfg->cfg_churn_rate > 0 && cfg->cfg_nworkers > 0) {
+        /* the worker threads join & leave, using the source filters */
+        errout("-%c can't be changed while using -C with -w", oc);
+        return(command_action_error);
+    }
 
     /* include or exclude mode? */
     switch (oc) {
@@ -671,14 +2282,10 @@ static enum command_action source_option(struct config *cfg,
         delta = arg[pos];
         ++pos;
     }
-    if (delta != '\0' && pc == '\0') {
+    if (delta != '\0' && pc != '-') {
         errout("-%c doesn't take +/- deltas on command line", oc);
         return(command_action_error);
     }
-    if (delta != '\0' && newmode != cfg->cfg_sfmode) {
-        errout("-%c doesn't take +/- deltas when changing mode", oc);
-        return(command_action_error);
-    }
 
     /* how many sources in the source list? */
     if (arg[0] == '-' && arg[1] == '\0') {
@@ -694,24 +2301,28 @@ static enum command_action source_option(struct config *cfg,
     }
 
     /* parse the source list */
-    sources = calloc(asources, sizeof(sources[0]));
-    nsources = 0;
+    sources = srcs_empty;
+    srcs_room(&sources, asources, 16);
+    sources.sl_alen = 0;
     while (arg[pos]) {
-        if (nsources >= asources) {
+        if (sources.sl_n >= asources) {
             /* shouldn't happen */
             errout("internal error in source count in parsing -%c", oc);
-            free(sources);
+            free(sources.sl_addrs);
             return(command_action_error);
         }
         len = strcspn(arg + pos, ",");
         end = (arg[pos + len] == '\0');
         arg[pos + len] = '\0'; /* temporary change */
-        srclen = sizeof(sources[nsources]);
-        if (!auto_pton(arg + pos, &sources[nsources], &srclen, cfg)) {
-            free(sources);
+        srclen = sizeof(ss);
+        if (!auto_pton(arg + pos, &ss, &srclen, cfg)) {
+            free(sources.sl_addrs);
             return(command_action_error);
         }
-        ++nsources;
+        sources.sl_alen = (ss.ss_family == AF_INET6) ? 16 : 4;
+        memcpy(SRCS_ADDR(&sources, sources.sl_n), addr_bytes(&ss),
+               sources.sl_alen);
+        ++sources.sl_n;
         pos += len;
         if (!end) {
             arg[pos] = ','; /* undo temporary change */
@@ -719,74 +2330,121 @@ static enum command_action source_option(struct config *cfg,
         }
     }
 
-    /* figure out the combined list of sources */
-    sort_addrs(sources, nsources);
-    csources = NULL;
-    cnsources = 0;
+    return(sources_change(g, oc, newmode, delta, &sources));
+#else /* DO_SOURCES */
+    errout("-%c not supported in this build", oc);
+    return(command_action_error);
+#endif /* DO_SOURCES */
+}
+
+#ifdef DO_SOURCES
+/*
+ * sources_change()
+ *
+ * Store new source filter settings for group 'g', to apply later: from
+ * an "-I" or "-E" (option character 'oc') option or command, either typed
+ * or (-K) binary.
+ *
+ * Parameters:
+ *      g - group whose source filter settings are to be changed
+ *      oc - option character: 'I' (include) or 'E' (exclude)
+ *      newmode - mode: MCAST_INCLUDE or MCAST_EXCLUDE
+ *      delta - '\0' to replace the list; '+' or '-' to add to it or
+ *          remove from it
+ *      sl - the sources; this function frees sl_addrs when done
+ *
+ * Return value:
+ *      What (if any) additional action needs to be taken in response
+ *      to the command.
+ */
+static enum command_action sources_change(struct mcgroup *g, int oc,
+                                          uint32_t newmode, int delta,
+                                          struct srclist *sl)
+{
+    struct srclist sources = *sl;
+
+    if (delta != '\0' && newmode != g->mg_sfmode) {
+        errout("-%c doesn't take +/- deltas when changing mode", oc);
+        free(sources.sl_addrs);
+        return(command_action_error);
+    }
+
+    /*
+     * A delta changes the list in place, and remembers just what changed,
+     * so only that has to be applied; anything else replaces the list.
+     */
+    srcs_sort(&sources);
     switch (delta) {
     case '\0':
         /* no delta, just replace the list */
-        csources = sources;
-        cnsources = nsources;
+        if (g->mg_sources.sl_addrs) {
+            free(g->mg_sources.sl_addrs);
+        }
+        g->mg_sfmode = newmode;
+        g->mg_sources = sources;
+        g->mg_sfull = 1;
+        g->mg_sadd.sl_n = g->mg_ssub.sl_n = 0;
         break;
     case '+':
-        /* add */
-        add_addrs(&csources, &cnsources,
-                  cfg->cfg_sources, cfg->cfg_nsources,
-                  sources, nsources);
-        free(sources);
+        /* add; 'sources' is left with the ones that weren't there */
+        srcs_insert(&g->mg_sources, &sources);
+        sources_pending(g, &sources, delta);
+        free(sources.sl_addrs);
         break;
     case '-':
-        /* subtract */
-        sub_addrs(&csources, &cnsources,
-                  cfg->cfg_sources, cfg->cfg_nsources,
-                  sources, nsources);
-        free(sources);
+        /* subtract; 'sources' is left with the ones that were there */
+        srcs_remove(&g->mg_sources, &sources);
+        sources_pending(g, &sources, delta);
+        free(sources.sl_addrs);
         break;
     default:
         /* shouldn't happen */
         errout("internal error in delta code in parsing -%c", oc);
-        free(sources);
+        free(sources.sl_addrs);
         return(command_action_error);
     }
 
-    /* store the new sources to apply later */
-    if (cfg->cfg_sources) {
-        free(cfg->cfg_sources);
-        cfg->cfg_sources = NULL;
-        cfg->cfg_nsources = 0;
-    }
-    cfg->cfg_sfmode = newmode;
-    cfg->cfg_nsources = cnsources;
-    cfg->cfg_sources = csources;
-
     return(command_action_source);
-#else /* DO_SOURCES */
-    errout("-%c not supported in this build", oc);
-    return(command_action_error);
-#endif /* DO_SOURCES */
 }
+#endif /* DO_SOURCES */
 
 /*
  * data_option()
  *
- * Handle a -d command line option, or the same command from stdin.
- * This sets up data to include/expect in packets.
+ * Handle a -d command line option, or the same command from stdin, or
+ * -d on a line of the -G file.  This sets up data to include/expect in
+ * packets.
  *
  * Parameters:
- *      cfg - configuration structure, where things get stored
+ *      cfg - configuration structure
+ *      pd - where to store the data: &cfg_data, or a group's own
  *      arg - argument string
  *
  * Return value:
  *      What (if any) additional action needs to be taken in response
  *      to the command.
  */
-static enum command_action data_option(struct config *cfg, char *arg)
+static enum command_action data_option(struct config *cfg,
+                                       struct pktdata *pd, char *arg)
 {
     uint8_t *data = NULL;
-    int len = 0, i, o, ib, chk = 0;
-    char *s, *ep;
-    long l;
+    int len = 0, i, o, ib, chk = 0, seq = 0, pat = 0, crc = 0;
+    char *s, *ep, *nam, tmp[64];
+    long l, minl;
+
+    l = strlen(arg);
+    if (l > 4 && !strcmp(arg + l - 4, ",crc") && l < sizeof(tmp)) {
+        /* ",crc" at the end: add a CRC32C; only for the "seq" like ones */
+        memcpy(tmp, arg, l - 4);
+        tmp[l - 4] = '\0';
+        arg = tmp;
+        crc = 1;
+        if (strcmp(arg, "seq") && strncmp(arg, "seq:", 4) &&
+            strncmp(arg, "prbs:", 5) && strncmp(arg, "count:", 6)) {
+            errout("',crc' only goes with '-d seq', 'prbs:', 'count:'");
+            return(command_action_error);
+        }
+    }
 
     if (!strncmp(arg, "hex:", 4)) {
         /* hexadecimal; example "hex:68656c6c6f" */
@@ -836,58 +2494,266 @@ static enum command_action data_option(struct config *cfg, char *arg)
             }
         }
         chk = 1; /* check contents of received packets */
+    } else if (!strcmp(arg, "seq") || !strncmp(arg, "seq:", 4) ||
+               !strncmp(arg, "prbs:", 5) || !strncmp(arg, "count:", 6)) {
+        /*
+         * sequence numbered header, filled in for each packet sent; and
+         * maybe a pattern after it, different in each packet
+         */
+
+        nam = "seq";
+        if (arg[0] == 'p') {
+            nam = "prbs";
+            pat = PATTERN_PRBS;
+        } else if (arg[0] == 'c') {
+            nam = "count";
+            pat = PATTERN_COUNT;
+        }
+        l = minl = SEQ_HDR_LEN + (crc ? SEQ_CRC_LEN : 0);
+        if (arg[strlen(nam)] == ':') {
+            ep = NULL;
+            l = strtol(arg + strlen(nam) + 1, &ep, 0);
+            if (l < minl || l > 100000 || (ep && *ep)) {
+                errout("Length with '-d %s:' option must be integer"
+                       " %d-100000", nam, (int)minl);
+                return(command_action_error);
+            }
+        }
+        len = l;
+        data = calloc(len, 1);
+        for (i = SEQ_HDR_LEN; i < len; ++i) {
+            data[i] = (i + 1) & 255;
+        }
+        chk = seq = 1; /* check sequence numbers of received packets */
+        if (pat || crc) {
+            pattern_init();
+        }
     } else {
         errout("Unrecognized format in -d option");
         return(command_action_error);
     }
 
     /* store the result and update buffers */
-    if (cfg->cfg_data) {
-        free(cfg->cfg_data);
+#ifdef HAVE_MSG_ZEROCOPY
+    zc_drain(cfg); /* the kernel might still be reading the old data */
+#endif /* HAVE_MSG_ZEROCOPY */
+    if (pd->pd_data) {
+        free(pd->pd_data);
     }
-    if (cfg->cfg_data_rx) {
-        free(cfg->cfg_data_rx);
-    }
-    cfg->cfg_data = data;
-    cfg->cfg_data_len = len;
-    cfg->cfg_data_chk = chk;
-    cfg->cfg_data_rx = malloc(len + RX_EXTRA);
+    pd->pd_data = data;
+    pd->pd_len = len;
+    pd->pd_chk = chk;
+    pd->pd_seq = seq;
+    pd->pd_pat = pat;
+    pd->pd_crc = crc;
 
     return(command_action_none);
 }
 
 /*
- * format_option()
+ * rate_option()
  *
- * Handle a -f command line option, or the same command from stdin.
- * This has keyword suboptions related to output formatting.
+ * Handle a -R command line option, or the same command from stdin, or
+ * -R on a line of the -G file.  This sets the rate at which to send
+ * packets, overriding -P.
  *
  * Parameters:
- *      cfg - configuration structure, where things get stored
- *      pc - prefix character:
- *          '\0' when called from command line
- *          '-' when called from stdin
- *          other when called wrong
- *      arg - argument string
+ *      rate - where to store the rate: &cfg_rate, or a group's mg_rate;
+ *          0 for none
+ *      bits - where to store whether it's in bits per second
+ *      arg - argument string: a number, optionally followed by a
+ *          multiplier 'k', 'M', or 'G', optionally followed by "pps"
+ *          (packets per second, the default) or "bps" (bits per second);
+ *          or "-" to turn it off
  *
  * Return value:
  *      What (if any) additional action needs to be taken in response
  *      to the command.
  */
-static enum command_action format_option(struct config *cfg, int pc, char *arg)
+static enum command_action rate_option(double *rate, int *bits, char *arg)
 {
-    if (pc != '\0' && pc != '-') {
-        errout("%cf is not a valid command", (int)pc);
+    double r;
+    char *ep;
+    int b = 0;
+
+    if (!strcmp(arg, "-") || !strcmp(arg, "0")) {
+        /* -R - -- stop sending by rate, and use the -P period again */
+        *rate = 0;
+        *bits = 0;
+        return(command_action_time_change);
+    }
+
+    ep = NULL;
+    r = strtod(arg, &ep);
+    if (ep == NULL || ep == arg) {
+        errout("-R rate must be a number");
         return(command_action_error);
     }
-    if (!strcasecmp(arg, "csv")) {
-        /* -f csv -- enable CSV output */
-        cfg->cfg_csv = 1;
-        return(command_action_none);
-    } else if (!strcasecmp(arg, "nocsv")) {
-        /* -f nocsv -- disable CSV output */
-        cfg->cfg_csv = 0;
-        return(command_action_none);
+    switch (*ep) {
+    case 'k': case 'K': r *= 1e+3; ++ep; break;
+    case 'M':           r *= 1e+6; ++ep; break;
+    case 'G': case 'g': r *= 1e+9; ++ep; break;
+    default:                             break;
+    }
+    if (!strcasecmp(ep, "bps")) {
+        b = 1;
+    } else if (*ep != '\0' && strcasecmp(ep, "pps")) {
+        errout("-R rate has unrecognized units '%s'", ep);
+        return(command_action_error);
+    }
+    if (!(r >= 0.01 && r <= 1e+12)) {
+        errout("-R rate must be in range 0.01-1e+12");
+        return(command_action_error);
+    }
+
+    *rate = r;
+    *bits = b;
+    return(command_action_time_change);
+}
+
+/*
+ * churn_option()
+ *
+ * Handle the -C command line option, which has groups joined and left
+ * over and over instead of just joined.
+ *
+ * Parameters:
+ *      cfg - configuration structure, where things get stored
+ *      arg - argument string: "rate[:sec][:random]"; rate is joins per
+ *          second, optionally followed by a multiplier 'k' or 'M'; sec
+ *          is how long each group stays joined, or "-" to stay
+ *
+ * Return value:
+ *      What (if any) additional action needs to be taken in response
+ *      to the command.
+ */
+static enum command_action churn_option(struct config *cfg, char *arg)
+{
+    double r, f;
+    char *ep, *colon;
+
+    ep = NULL;
+    r = strtod(arg, &ep);
+    if (ep == NULL || ep == arg) {
+        errout("-C rate must be a number");
+        return(command_action_error);
+    }
+    switch (*ep) {
+    case 'k': case 'K': r *= 1e+3; ++ep; break;
+    case 'M':           r *= 1e+6; ++ep; break;
+    default:                             break;
+    }
+    if (*ep != '\0' && *ep != ':') {
+        errout("-C rate has unrecognized units '%s'", ep);
+        return(command_action_error);
+    }
+    if (!(r >= 0.01 && r <= 1e+6)) {
+        errout("-C rate must be in range 0.01-1e+6");
+        return(command_action_error);
+    }
+    cfg->cfg_churn_rate = r;
+    cfg->cfg_churn_hold = 1000000000;
+    cfg->cfg_churn_random = 0;
+
+    /* then how long, and whether random, in either order */
+    for (arg = (*ep == ':') ? ep + 1 : NULL; arg != NULL; arg = colon) {
+        colon = strchr(arg, ':');
+        if (colon) {
+            *(colon++) = '\0';
+        }
+        if (!strcmp(arg, "random")) {
+            cfg->cfg_churn_random = 1;
+        } else if (!strcmp(arg, "-")) {
+            cfg->cfg_churn_hold = -1;
+        } else {
+            f = atof(arg);
+            if (!(f >= 0.001 && f <= 86400.0)) {
+                errout("-C time must be in range 0.001-86400 seconds");
+                return(command_action_error);
+            }
+            cfg->cfg_churn_hold = rint(f * 1e+9);
+        }
+    }
+    return(command_action_none);
+}
+
+/*
+ * trace_option()
+ *
+ * Handle the -F command line option, which has packets sent as a traffic
+ * profile from a file says, instead of at a steady rate.  The file is
+ * loaded later, by trace_load().
+ *
+ * Parameters:
+ *      cfg - configuration structure, where things get stored
+ *      arg - argument string: "file[:speed]"; speed is a multiplier,
+ *          2 to replay it twice as fast, 0.5 for half as fast
+ *
+ * Return value:
+ *      What (if any) additional action needs to be taken in response
+ *      to the command.
+ */
+static enum command_action trace_option(struct config *cfg, char *arg)
+{
+    double f = 1.0;
+    char *colon, *ep;
+
+    colon = strrchr(arg, ':');
+    if (colon != NULL) {
+        /* a speed, unless it's just part of the file name */
+        ep = NULL;
+        f = strtod(colon + 1, &ep);
+        if (ep == NULL || ep == colon + 1 || *ep != '\0') {
+            f = 1.0;
+            colon = NULL;
+        } else if (!(f >= 0.001 && f <= 1000.0)) {
+            errout("-F speed must be in range 0.001-1000");
+            return(command_action_error);
+        }
+    }
+    if (cfg->cfg_trace_fn != NULL) {
+        free(cfg->cfg_trace_fn);
+    }
+    if (colon != NULL) {
+        *colon = '\0';
+    }
+    cfg->cfg_trace_fn = strdup(arg);
+    cfg->cfg_trace_speed = f;
+    return(command_action_none);
+}
+
+/*
+ * format_option()
+ *
+ * Handle a -f command line option, or the same command from stdin.
+ * This has keyword suboptions related to output formatting.
+ *
+ * Parameters:
+ *      cfg - configuration structure, where things get stored
+ *      pc - prefix character:
+ *          '\0' when called from command line
+ *          '-' when called from stdin
+ *          other when called wrong
+ *      arg - argument string
+ *
+ * Return value:
+ *      What (if any) additional action needs to be taken in response
+ *      to the command.
+ */
+static enum command_action format_option(struct config *cfg, int pc, char *arg)
+{
+    if (pc != '\0' && pc != '-') {
+        errout("%cf is not a valid command", (int)pc);
+        return(command_action_error);
+    }
+    if (!strcasecmp(arg, "csv")) {
+        /* -f csv -- enable CSV output */
+        cfg->cfg_csv = 1;
+        return(command_action_none);
+    } else if (!strcasecmp(arg, "nocsv")) {
+        /* -f nocsv -- disable CSV output */
+        cfg->cfg_csv = 0;
+        return(command_action_none);
     } else if (!strcasecmp(arg, "logtime")) {
         /* -f logtime -- "log" timestamp format */
         timestamp_formatter = &timestamp_log;
@@ -908,12 +2774,245 @@ static enum command_action format_option(struct config *cfg, int pc, char *arg)
         timestamp_formatter = &timestamp_none;
         timestamp_formatter_arg = NULL;
         return(command_action_none);
+    } else if (!strcasecmp(arg, "ms")) {
+        /* -f ms -- timestamps to the millisecond */
+        timestamp_digits = 3;
+        return(command_action_none);
+    } else if (!strcasecmp(arg, "us")) {
+        /* -f us -- timestamps to the microsecond */
+        timestamp_digits = 6;
+        return(command_action_none);
+    } else if (!strcasecmp(arg, "ns")) {
+        /* -f ns -- timestamps to the nanosecond */
+        timestamp_digits = 9;
+        return(command_action_none);
+    } else if (!strncasecmp(arg, "binary:", 7)) {
+        /* -f binary:... -- binary event log */
+        if (pc != '\0' && cfg->cfg_nworkers > 0) {
+            errout("-f binary: can't be changed while using -w");
+            return(command_action_error);
+        }
+        return(binlog_open(cfg, arg + 7));
+    } else if (!strncasecmp(arg, "flush:", 6)) {
+        /* -f flush:... -- when to write out output */
+        char *val = arg + 6, *end;
+        double f;
+
+        fflush(stdout); /* anything pending goes out under the old policy */
+        cfg->cfg_flush_count = 0;
+        if (!strcasecmp(val, "line")) {
+            cfg->cfg_flush = flush_policy_line;
+        } else if (!strcasecmp(val, "idle")) {
+            cfg->cfg_flush = flush_policy_idle;
+        } else {
+            f = strtod(val, &end);
+            if (end == val) {
+                errout("-f %s is not a valid formatting option", arg);
+                return(command_action_error);
+            } else if (!strcasecmp(end, "s")) {
+                if (!(f >= 0.001 && f <= 60.0)) {
+                    errout("-f flush: interval must be in range"
+                           " 0.001-60 seconds");
+                    return(command_action_error);
+                }
+                cfg->cfg_flush = flush_policy_interval;
+                cfg->cfg_flush_us = rint(f * 1e+6);
+            } else if (*end == '\0' && f == rint(f) &&
+                       f >= 1 && f <= 1000000) {
+                cfg->cfg_flush = flush_policy_lines;
+                cfg->cfg_flush_lines = f;
+            } else {
+                errout("-f flush: line count must be in range 1-1000000");
+                return(command_action_error);
+            }
+        }
+        return(command_action_none);
     } else {
         errout("-f %s is not a valid formatting option", arg);
         return(command_action_error);
     }
 }
 
+/*
+ * sockopt_option()
+ * Handle the "-o" option, which takes "name=value" and chooses how
+ * the sockets are set up.
+ * Parameters:
+ *      cfg - configuration to modify
+ *      arg - the option's argument
+ * Returns:
+ *      what to do next
+ */
+static enum command_action sockopt_option(struct config *cfg, char *arg)
+{
+    char *val;
+    size_t nlen;
+
+    val = strchr(arg, '=');
+    nlen = val ? (size_t)(val - arg) : strlen(arg);
+    val = val ? val + 1 : "";
+
+    if (nlen == 6 && !strncasecmp(arg, "tstamp", nlen)) {
+        /* -o tstamp=... -- where receive timestamps come from */
+        if (!strcasecmp(val, "user")) {
+            cfg->cfg_tstamp = rx_tstamp_user;
+#ifdef HAVE_SO_TIMESTAMPNS
+        } else if (!strcasecmp(val, "sw")) {
+            cfg->cfg_tstamp = rx_tstamp_sw;
+#endif /* HAVE_SO_TIMESTAMPNS */
+#ifdef HAVE_SO_TIMESTAMPING
+        } else if (!strcasecmp(val, "hw")) {
+            cfg->cfg_tstamp = rx_tstamp_hw;
+#endif /* HAVE_SO_TIMESTAMPING */
+        } else {
+            errout("-o tstamp=%s is not supported", val);
+            return(command_action_error);
+        }
+        return(command_action_none);
+#ifdef HAVE_MSG_ZEROCOPY
+    } else if (nlen == 8 && !strncasecmp(arg, "zerocopy", nlen)) {
+        /* -o zerocopy[=on|off] -- send with MSG_ZEROCOPY */
+        return(sockopt_onoff(&cfg->cfg_zerocopy, arg, val));
+#endif /* HAVE_MSG_ZEROCOPY */
+#ifdef HAVE_UDP_SEGMENT
+    } else if (nlen == 3 && !strncasecmp(arg, "gso", nlen)) {
+        /* -o gso[=on|off] -- send with UDP_SEGMENT */
+        return(sockopt_onoff(&cfg->cfg_gso, arg, val));
+#endif /* HAVE_UDP_SEGMENT */
+#ifdef HAVE_TX_PKTINFO
+    } else if (nlen == 7 && !strncasecmp(arg, "txshare", nlen)) {
+        /* -o txshare[=on|off] -- groups share sockets when sending */
+        return(sockopt_onoff(&cfg->cfg_txshare, arg, val));
+#endif /* HAVE_TX_PKTINFO */
+#ifdef HAVE_UDP_GRO
+    } else if (nlen == 3 && !strncasecmp(arg, "gro", nlen)) {
+        /* -o gro[=on|off] -- receive with UDP_GRO */
+        return(sockopt_onoff(&cfg->cfg_gro, arg, val));
+#endif /* HAVE_UDP_GRO */
+    } else if (nlen == 5 && !strncasecmp(arg, "rxlen", nlen)) {
+        /* -o rxlen=N -- room for each received packet */
+        long l;
+
+        if (sockopt_number(&l, arg, val, 1, RX_MAXLEN) ==
+            command_action_error) {
+            return(command_action_error);
+        }
+        cfg->cfg_rx_len = l;
+        return(command_action_none);
+    } else if ((nlen == 6 && !strncasecmp(arg, "rcvbuf", nlen)) ||
+               (nlen == 6 && !strncasecmp(arg, "sndbuf", nlen))) {
+        /* -o rcvbuf=N, -o sndbuf=N -- socket buffer sizes */
+        long l;
+
+        if (sockopt_number(&l, arg, val, 1, 1L << 30) ==
+            command_action_error) {
+            return(command_action_error);
+        }
+        if (tolower((unsigned char)arg[0]) == 'r') {
+            cfg->cfg_rcvbuf = l;
+        } else {
+            cfg->cfg_sndbuf = l;
+        }
+        return(command_action_none);
+#ifdef HAVE_SO_BUSY_POLL
+    } else if (nlen == 8 && !strncasecmp(arg, "busypoll", nlen)) {
+        /* -o busypoll=N -- SO_BUSY_POLL, usec */
+        long l;
+
+        if (sockopt_number(&l, arg, val, 0, 1000000) ==
+            command_action_error) {
+            return(command_action_error);
+        }
+        cfg->cfg_busypoll = l;
+        return(command_action_none);
+#endif /* HAVE_SO_BUSY_POLL */
+#ifdef HAVE_SO_PRIORITY
+    } else if (nlen == 8 && !strncasecmp(arg, "priority", nlen)) {
+        /* -o priority=N -- SO_PRIORITY */
+        long l;
+
+        if (sockopt_number(&l, arg, val, 0, 6) == command_action_error) {
+            return(command_action_error);
+        }
+        cfg->cfg_priority = l;
+        return(command_action_none);
+#endif /* HAVE_SO_PRIORITY */
+    } else if (nlen == 4 && !strncasecmp(arg, "spin", nlen)) {
+        /* -o spin[=on|off] -- don't sleep waiting for packets */
+        return(sockopt_onoff(&cfg->cfg_spin, arg, val));
+    } else if (nlen == 8 && !strncasecmp(arg, "spinwait", nlen)) {
+        /* -o spinwait=N -- usec to check continually before deadlines */
+        long l;
+
+        if (sockopt_number(&l, arg, val, 0, 1000000) ==
+            command_action_error) {
+            return(command_action_error);
+        }
+        cfg->cfg_spinwait = l * (int64_t)1000;
+        return(command_action_none);
+    } else if (nlen == 7 && !strncasecmp(arg, "sources", nlen)) {
+        /* -o sources[=on|off] -- per-source accounting */
+        return(sockopt_onoff(&cfg->cfg_rxsrc, arg, val));
+#ifdef HAVE_PACKET_RING
+    } else if (nlen == 4 && !strncasecmp(arg, "ring", nlen)) {
+        /* -o ring[=on|off] -- receive with a packet ring */
+        return(sockopt_onoff(&cfg->cfg_ring, arg, val));
+#endif /* HAVE_PACKET_RING */
+    } else {
+        errout("-o %s is not a valid socket option", arg);
+        return(command_action_error);
+    }
+}
+
+/*
+ * sockopt_onoff()
+ * For "-o name[=on|off]": set '*flag' from 'val', the part after "=", if
+ * any.  'arg' is the whole option, for error messages.
+ */
+static enum command_action sockopt_onoff(int *flag, char *arg, char *val)
+{
+    if (!*val || !strcasecmp(val, "on") || !strcmp(val, "1")) {
+        *flag = 1;
+    } else if (!strcasecmp(val, "off") || !strcmp(val, "0")) {
+        *flag = 0;
+    } else {
+        errout("-o %s: should be 'on' or 'off'", arg);
+        return(command_action_error);
+    }
+    return(command_action_none);
+}
+
+/*
+ * sockopt_number()
+ * For "-o name=N": parse 'val', the part after "=", as a number in the
+ * range 'min' to 'max', with an optional "k" (1024) or "M" (1048576)
+ * suffix, into '*l'.  'arg' is the whole option, for error messages.
+ */
+static enum command_action sockopt_number(long *l, char *arg, char *val,
+                                          long min, long max)
+{
+    char *end;
+    long mul = 1;
+
+    errno = 0;
+    *l = strtol(val, &end, 0);
+    if (end != val && (*end == 'k' || *end == 'K')) {
+        mul = 1024;
+        ++end;
+    } else if (end != val && *end == 'M') {
+        mul = 1024 * 1024;
+        ++end;
+    }
+    if (end == val || *end != '\0' || errno != 0 ||
+        *l < min / mul || *l > max / mul || *l * mul < min) {
+        errout("-o %.*s: should be in range %ld-%ld",
+               (int)strcspn(arg, "="), arg, min, max);
+        return(command_action_error);
+    }
+    *l *= mul;
+    return(command_action_none);
+}
+
 #ifdef DEE_TEST
 /*
  * dee_test_option()
@@ -1000,7 +3099,9 @@ static enum command_action dee_test_option(struct config *cfg, char *arg)
 /*
  * command()
  *
- * Parse and execute a command.
+ * Parse and execute a command from stdin, if a whole one has been read
+ * into cfg_command_ring.  It's handled right there in the ring, unless it
+ * wraps around the end.
  *
  * Parameters:
  *      cfg - configuration structure, where things get stored
@@ -1011,62 +3112,74 @@ static enum command_action dee_test_option(struct config *cfg, char *arg)
  */
 static enum command_action command(struct config *cfg)
 {
-    int l, pos;
+    struct cmdring *cr = &cfg->cfg_command_ring;
+    ssize_t l;
     char *cmd;
-    enum command_action ca;
 
     /* is there a complete line in the buffer? */
-    for (l = 0; l < cfg->cfg_command_got; ++l) {
-        if (cfg->cfg_command_buf[l] == '\n') {
-            break;
-        }
-    }
-    if (l >= cfg->cfg_command_got) {
+    l = cmdring_find(cr, '\n');
+    if (l < 0) {
         /* nope */
-        if (cfg->cfg_command_got >= sizeof(cfg->cfg_command_buf)) {
+        if (cr->cr_got >= sizeof(cr->cr_buf)) {
             if (!cfg->cfg_command_ignore) {
                 errout("ultra-long command line ignored");
                 cfg->cfg_command_ignore = 1;
             }
-            cfg->cfg_command_got = 0;
+            cmdring_drop(cr, cr->cr_got);
             return(command_action_error);
         } else {
             return(command_action_wait);
         }
     }
 
-    /* extract command into a new buffer, without any initial whitespace */
-    for (pos = 0; pos < l && isspace(cfg->cfg_command_buf[pos]); ++pos)
-        ;
-    cmd = malloc(l - pos + 1);
-    memcpy(cmd, &cfg->cfg_command_buf[pos], l - pos);
-    cmd[l - pos] = '\0';
-    if (l < cfg->cfg_command_got) {
-        ++l; /* clobber the newline at the end */
-    }
-    memmove(&cfg->cfg_command_buf[0], &cfg->cfg_command_buf[l],
-            cfg->cfg_command_got - l);
-    cfg->cfg_command_got -= l;
+    /*
+     * Take it off the front of the buffer.  It stays where it is until
+     * more is read in, after it's been handled.
+     */
+    cmd = cmdring_get(cr, l + 1, cfg->cfg_command_tmp);
+    cmd[l] = '\0'; /* clobber the newline at the end */
+    cmdring_drop(cr, l + 1);
 
     /* ignore the command if desired */
     if (cfg->cfg_command_ignore) {
         cfg->cfg_command_ignore = 0;
-        free(cmd);
         return(command_action_none);
     }
+    return(command_text(cfg, cmd));
+}
+
+/*
+ * command_text()
+ *
+ * Parse and execute a command, 'cmd', which is changed in the process.
+ * It comes from stdin, or from the -K socket.
+ *
+ * Parameters:
+ *      cfg - configuration structure, where things get stored
+ *      cmd - the command, without any newline
+ *
+ * Return value:
+ *      What (if any) additional action needs to be taken in response
+ *      to the command.
+ */
+static enum command_action command_text(struct config *cfg, char *cmd)
+{
+    int l, pos;
 
-    /* remove any final whitespace */
+    /* remove any initial and final whitespace */
+    while (isspace((unsigned char)*cmd)) {
+        ++cmd;
+    }
     l = strlen(cmd);
-    while (l > 0 && isspace(cmd[l - 1])) {
+    while (l > 0 && isspace((unsigned char)cmd[l - 1])) {
         cmd[--l] = '\0';
     }
 
     /* ignore empty lines and '#' comments */
     if (l <= 0 || cmd[0] == '#') {
-        free(cmd);
         return(command_action_none);
     }
-    emit(cfg, reported_event_cmd, cmd);
+    emit(cfg, NULL, reported_event_cmd, cmd);
 
     /*
      * command format:
@@ -1077,121 +3190,555 @@ static enum command_action command(struct config *cfg)
      */
     if (l < 2) {
         errout("Invalid command '%s'", cmd);
-        free(cmd);
         return(command_action_error);
     }
     pos = 2;
-    while (pos < l && isspace(cmd[pos]))
+    while (pos < l && isspace((unsigned char)cmd[pos]))
         ++pos;
-    ca = option(cfg, cmd[0], cmd[1], cmd + pos);
+    return(option(cfg, cmd[0], cmd[1], cmd + pos));
+}
 
-    free(cmd);
+/** ** command input buffers and the -K socket ** **/
 
-    return(ca);
+/*
+ * cmdring_read()
+ * Read what's available from file descriptor 'fd' into ring buffer 'cr',
+ * as much as there's room for, in one system call.  Returns what read()
+ * would.  If there's no room, returns -1 with errno EAGAIN; that
+ * shouldn't happen, since commands are handled when they're complete.
+ */
+static ssize_t cmdring_read(struct cmdring *cr, int fd)
+{
+    struct iovec iov[2];
+    size_t tail;
+    ssize_t rv;
+    int niov = 0;
+
+    if (cr->cr_got >= sizeof(cr->cr_buf)) {
+        errno = EAGAIN;
+        return(-1);
+    }
+    tail = (cr->cr_head + cr->cr_got) % sizeof(cr->cr_buf);
+    if (tail >= cr->cr_head) {
+        /* free space after the end, and maybe at the start */
+        iov[niov].iov_base = cr->cr_buf + tail;
+        iov[niov++].iov_len = sizeof(cr->cr_buf) - tail;
+        if (cr->cr_head > 0) {
+            iov[niov].iov_base = cr->cr_buf;
+            iov[niov++].iov_len = cr->cr_head;
+        }
+    } else {
+        /* free space between the end and the start */
+        iov[niov].iov_base = cr->cr_buf + tail;
+        iov[niov++].iov_len = cr->cr_head - tail;
+    }
+    prof_syscall();
+    rv = readv(fd, iov, niov);
+    if (rv > 0) {
+        cr->cr_got += rv;
+    }
+    return(rv);
 }
 
 /*
- * progname_to_progdir()
- *
- * See if the program name (in 'progname') indicates the direction
- * (send/receive) this is to do.  Sets 'progdir' to the result. 
+ * cmdring_find()
+ * Look for character 'c' in ring buffer 'cr'; return how far it is from
+ * the start, or -1 if it's not there.
  */
-static void progname_to_progdir(void)
+static ssize_t cmdring_find(struct cmdring *cr, int c)
 {
-    struct {
-        char *s;
-        int d;
-    } endings[] = {
-        { "send",       1 },
-        { "receive",    -1 },
-        { "recv",       -1 },
-        { "snd",        1 },
-        { "rcv",        -1 },
-        { "tx",         1 },
-        { "rx",         -1 },
-        { NULL, 0 }
-    };
-    int pnl, ei, el;
-    char *cp;
+    size_t first = sizeof(cr->cr_buf) - cr->cr_head;
+    char *p;
 
-    /* any '.' extension? */
-    cp = strrchr(progname, '.');
-    if (cp != NULL) {
-        pnl = cp - progname;
-    } else {
-        pnl = strlen(progname);
+    if (first > cr->cr_got) {
+        first = cr->cr_got;
+    }
+    p = memchr(cr->cr_buf + cr->cr_head, c, first);
+    if (p != NULL) {
+        return(p - (cr->cr_buf + cr->cr_head));
     }
+    p = memchr(cr->cr_buf, c, cr->cr_got - first);
+    if (p != NULL) {
+        return(first + (p - cr->cr_buf));
+    }
+    return(-1);
+}
 
-    /* see about command names ending with interesting hints */
-    for (ei = 0; endings[ei].s; ++ei) {
-        el = strlen(endings[ei].s);
-        if (pnl >= el &&
-            !strncasecmp(progname + pnl - el, endings[ei].s, el)) {
-            /* matched! */
-            progdir = endings[ei].d;
-            return;
-        }
+/*
+ * cmdring_get()
+ * Returns a pointer to the first 'len' bytes in ring buffer 'cr', in one
+ * piece.  That's where they are in the ring, unless they wrap around
+ * its end; then they're copied into 'tmp', which must have room.  They're
+ * not removed from the ring; cmdring_drop() does that.
+ */
+static char *cmdring_get(struct cmdring *cr, size_t len, char *tmp)
+{
+    size_t first = sizeof(cr->cr_buf) - cr->cr_head;
+
+    if (len <= first) {
+        return(cr->cr_buf + cr->cr_head);
     }
+    memcpy(tmp, cr->cr_buf + cr->cr_head, first);
+    memcpy(tmp + first, cr->cr_buf, len - first);
+    return(tmp);
 }
 
 /*
- * make_default_label()
- * Since the user didn't specify a label, make one based on their
- * configuration.  Returns a newly allocated string; caller should
- * free it when no longer wanted.
+ * cmdring_drop()
+ * Remove the first 'len' bytes from ring buffer 'cr'.
  */
-static char *make_default_label(struct config *cfg)
+static void cmdring_drop(struct cmdring *cr, size_t len)
 {
-    char ga[128], buf[256];
-    auto_ntop(&cfg->cfg_grp, ga, sizeof(ga));
-    snprintf(buf, sizeof(buf), "%s%%%s", ga, cfg->cfg_intf.nam);
-    return(strdup(buf));
+    cr->cr_head = (cr->cr_head + len) % sizeof(cr->cr_buf);
+    cr->cr_got -= len;
+    if (cr->cr_got == 0) {
+        cr->cr_head = 0; /* so the next read can be in one piece */
+    }
 }
 
 /*
- * group_check()
- *
- * Check the config, for whether the multicast group address is actually
- * a multicast address, and if needed, a source-specific multicast address.
- * Gives a warning if not.  It's only a warning, and doesn't catch all
- * restrictions and requirements for multicast addressing.  This program
- * isn't the standards police; if you do something you shouldn't be doing,
- * that's your problem.
- *
- * Standards:
- *      RFC 4607 for source specific multicast addresses
- *      RFC 1112 for IPv4 multicast addresses
- *      RFC 4291 for IPv6 multicast addresses
- *
- * Parameters:
- *      cfg -- configuration including group and sources
- *      first_time -- Nonzero to indicate this is being run the first
- *          time; zero if not.  The first time it runs more checks are done.
+ * cmdsock_setup()
+ * Start listening for commands on the -K socket, cfg_cmdsock_path.
+ * A socket that's there already is replaced only if nothing's listening
+ * on it (it's left over from before); if something is, that's probably
+ * another instance, and this gives up.  Exits on failure.
  */
-static void group_check(struct config *cfg, int first_time)
+static void cmdsock_setup(struct config *cfg, struct oligocast_evloop *evl)
 {
-    char gbuf[128];
+    struct cmdsock *cs;
+    struct sockaddr_un sa;
+    struct stat st;
+    char buf[512];
+    int i;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    if (strlen(cfg->cfg_cmdsock_path) >= sizeof(sa.sun_path)) {
+        errout("-K: socket name too long");
+        exit(1);
+    }
+    strcpy(sa.sun_path, cfg->cfg_cmdsock_path);
+
+    cs = calloc(1, sizeof(*cs));
+    if (cs == NULL) {
+        errout("-K: out of memory");
+        exit(1);
+    }
+    cs->cs_evl = evl;
+    cs->cs_path = cfg->cfg_cmdsock_path;
+    cs->cs_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (cs->cs_fd < 0) {
+        errout("-K: failed to create socket: %s", strerror(errno));
+        exit(1);
+    }
+    if (stat(sa.sun_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        /* is anything listening on the one that's there? */
+        if (connect(cs->cs_fd, (void *)&sa, sizeof(sa)) == 0) {
+            errout("-K: %s is in use; is oligocast already running?",
+                   sa.sun_path);
+            exit(1);
+        } else if (errno != ECONNREFUSED) {
+            errout("-K: %s is there already: %s",
+                   sa.sun_path, strerror(errno));
+            exit(1);
+        }
+        unlink(sa.sun_path); /* left over from before */
+    }
+    if (bind(cs->cs_fd, (void *)&sa, sizeof(sa)) < 0) {
+        errout("-K: failed to bind to %s: %s", sa.sun_path, strerror(errno));
+        exit(1);
+    }
+    cfg->cfg_cmdsock = cs; /* it's ours now, for cmdsock_remove() */
+    if (listen(cs->cs_fd, CMDSOCK_MAXCONN) < 0 ||
+        fcntl(cs->cs_fd, F_SETFL, O_NONBLOCK) < 0) {
+        errout("-K: failed to listen: %s", strerror(errno));
+        exit(1);
+    }
+    evloop_watch(evl, cs->cs_fd, EVLOOP_READ, NULL, buf, sizeof(buf));
+    if (buf[0]) {
+        errout("%s", buf);
+        exit(1);
+    }
+    for (i = 0; i < CMDSOCK_MAXCONN; ++i) {
+        cs->cs_conns[i].cc_fd = -1;
+    }
+}
+
+/*
+ * cmdsock_ready()
+ * If 'rd' is the -K listening socket or one of its connections, handle
+ * it and return nonzero; otherwise return zero.  Commands received are
+ * only read in here; cmdsock_command() handles them.
+ */
+static int cmdsock_ready(struct config *cfg, struct oligocast_evready *rd)
+{
+    struct cmdsock *cs = cfg->cfg_cmdsock;
+    struct cmdconn *cc = NULL;
+    ssize_t rv;
+    char buf[512];
+    int fd, i;
+
+    if (rd->fd == cs->cs_fd) {
+        /* new connection(s) */
+        for (;;) {
+            fd = accept(cs->cs_fd, NULL, NULL);
+            if (fd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK &&
+                    errno != EINTR) {
+                    errout("-K: accept() failed: %s", strerror(errno));
+                    errthrottle();
+                }
+                return(1);
+            }
+            for (i = 0; i < CMDSOCK_MAXCONN; ++i) {
+                cc = &cs->cs_conns[i];
+                if (cc->cc_fd < 0 && cc->cc_in.cr_got == 0) {
+                    break;
+                }
+            }
+            if (i == CMDSOCK_MAXCONN) {
+                errout("-K: connection refused, too many");
+                errthrottle();
+                close(fd);
+                continue;
+            }
+            if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+                errout("-K: connection refused, fcntl() failed: %s",
+                       strerror(errno));
+                errthrottle();
+                close(fd);
+                continue;
+            }
+            cc->cc_fd = fd;
+            evloop_watch(cs->cs_evl, fd, EVLOOP_READ, NULL, buf, sizeof(buf));
+            if (buf[0]) {
+                errout("%s", buf);
+                cmdsock_close(cfg, cc);
+            }
+        }
+    }
+
+    for (i = 0; i < CMDSOCK_MAXCONN; ++i) {
+        if (cs->cs_conns[i].cc_fd >= 0 && cs->cs_conns[i].cc_fd == rd->fd) {
+            cc = &cs->cs_conns[i];
+            break;
+        }
+    }
+    if (i == CMDSOCK_MAXCONN) {
+        return(0);
+    }
+    rv = cmdring_read(&cc->cc_in, cc->cc_fd);
+    if (rv < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+                   errno == EINTR)) {
+        return(1); /* nothing really happened */
+    }
+    if (rv <= 0) {
+        /* closed, or failed; anything received is still handled */
+        cmdsock_close(cfg, cc);
+    }
+    return(1);
+}
+
+/*
+ * cmdsock_close()
+ * Close connection 'cc' to the -K socket.  Its slot is reused once
+ * any commands left in cc_in have been handled.
+ */
+static void cmdsock_close(struct config *cfg, struct cmdconn *cc)
+{
+    char buf[512];
+
+    evloop_watch(cfg->cfg_cmdsock->cs_evl, cc->cc_fd, 0, NULL,
+                 buf, sizeof(buf));
+    close(cc->cc_fd);
+    cc->cc_fd = -1;
+}
+
+/*
+ * cmdsock_command()
+ * Handle one complete command received on the -K socket, if there is one,
+ * taking turns between the connections.
+ *
+ * Return value:
+ *      command_action_wait if there are no more; otherwise what (if any)
+ *      additional action needs to be taken in response to the command.
+ */
+static enum command_action cmdsock_command(struct config *cfg)
+{
+    struct cmdsock *cs = cfg->cfg_cmdsock;
+    struct cmdconn *cc;
+    enum command_action ca;
+    uint8_t *cmd;
+    uint32_t len;
+    int i, j;
+
+    for (j = 0; j < CMDSOCK_MAXCONN; ++j) {
+        i = (cs->cs_next + j) % CMDSOCK_MAXCONN;
+        cc = &cs->cs_conns[i];
+        if (cc->cc_in.cr_got < 4) {
+            if (cc->cc_fd < 0) {
+                cmdring_drop(&cc->cc_in, cc->cc_in.cr_got); /* never whole */
+            }
+            continue;
+        }
+        cmd = (void *)cmdring_get(&cc->cc_in, 4, cfg->cfg_command_tmp);
+        len = get32(cmd) + 4;
+        if (len < CMDBIN_HDRLEN || len > CMDBIN_MAXLEN) {
+            /* can't tell where the next one would start */
+            errout("-K: bad command length %lu; closing connection",
+                   (unsigned long)len);
+            cmdring_drop(&cc->cc_in, cc->cc_in.cr_got);
+            if (cc->cc_fd >= 0) {
+                cmdsock_close(cfg, cc);
+            }
+            return(command_action_error);
+        }
+        if (cc->cc_in.cr_got < len) {
+            if (cc->cc_fd < 0) {
+                cmdring_drop(&cc->cc_in, cc->cc_in.cr_got); /* never whole */
+            }
+            continue; /* the rest of it isn't here yet */
+        }
+
+        /* it's still there after being dropped, until more is read in */
+        cmd = (void *)cmdring_get(&cc->cc_in, len, cfg->cfg_command_tmp);
+        cmdring_drop(&cc->cc_in, len);
+        cs->cs_next = (i + 1) % CMDSOCK_MAXCONN;
+        ca = cmdbin(cfg, cmd, len);
+        return(ca);
+    }
+    return(command_action_wait);
+}
+
+/*
+ * cmdbin()
+ *
+ * Execute a command received on the -K socket: 'cmd' is all 'len' bytes
+ * of it, starting with the header.
+ *
+ * Return value:
+ *      What (if any) additional action needs to be taken in response
+ *      to the command.
+ */
+static enum command_action cmdbin(struct config *cfg, uint8_t *cmd, size_t len)
+{
+    uint32_t gi = get32(cmd + 8);
+    struct mcgroup *gsel = cfg->cfg_gsel;
+    enum command_action ca;
+
+    if (gi == CMDBIN_GSEL) {
+        ca = cmdbin_op(cfg, cmd, len);
+        cfg->cfg_gcmd = cfg->cfg_gsel;
+        return(ca);
+    }
+
+    /*
+     * A command naming its group acts on that one alone; afterwards the
+     * group that other commands act on is what it was before.
+     */
+    if (gi >= cfg->cfg_ngroups) {
+        errout("-K: group index %lu out of range 0-%d",
+               (unsigned long)gi, cfg->cfg_ngroups - 1);
+        return(command_action_error);
+    }
+    cfg->cfg_gsel = cfg->cfg_groups[gi];
+    ca = cmdbin_op(cfg, cmd, len);
+    cfg->cfg_gcmd = cfg->cfg_gsel;
+    cfg->cfg_gsel = gsel;
+    return(ca);
+}
+
+/*
+ * cmdbin_op()
+ *
+ * The part of cmdbin() that does what the command says, to cfg_gsel.
+ */
+static enum command_action cmdbin_op(struct config *cfg, uint8_t *cmd,
+                                     size_t len)
+{
+    uint8_t *data = cmd + CMDBIN_HDRLEN;
+    size_t dlen = len - CMDBIN_HDRLEN;
+    int op = cmd[4], flags = cmd[5];
+    uint64_t v;
+#ifdef DO_SOURCES
+    struct srclist sources;
+    int alen;
+#endif /* DO_SOURCES */
+
+    switch (op) {
+    case CMDBIN_TEXT:
+        /* a text command; copied, since it's not followed by a '\0' */
+        memmove(cfg->cfg_command_tmp, data, dlen);
+        cfg->cfg_command_tmp[dlen] = '\0';
+        return(command_text(cfg, cfg->cfg_command_tmp));
+#ifdef DO_SOURCES
+    case CMDBIN_INCLUDE:
+    case CMDBIN_EXCLUDE:
+        /* source list, already in the form it's kept in */
+        if (cfg->cfg_churn_rate > 0 && cfg->cfg_nworkers > 0) {
+            errout("-K: sources can't be changed while using -C with -w");
+            return(command_action_error);
+        }
+        alen = (cfg->cfg_af == AF_INET6) ? 16 : 4;
+        if (dlen % alen) {
+            errout("-K: source list length %lu isn't a multiple of %d",
+                   (unsigned long)dlen, alen);
+            return(command_action_error);
+        }
+        sources = srcs_empty;
+        srcs_room(&sources, dlen / alen, alen);
+        memcpy(sources.sl_addrs, data, dlen);
+        sources.sl_n = dlen / alen;
+        return(sources_change(cfg->cfg_gsel,
+                              (op == CMDBIN_INCLUDE) ? 'I' : 'E',
+                              (op == CMDBIN_INCLUDE) ?
+                              MCAST_INCLUDE : MCAST_EXCLUDE,
+                              (flags & CMDBIN_F_ADD) ? '+' :
+                              ((flags & CMDBIN_F_SUB) ? '-' : '\0'),
+                              &sources));
+#endif /* DO_SOURCES */
+    case CMDBIN_RATE:
+        /* send rate, in thousandths */
+        if (dlen != 8) {
+            errout("-K: rate should be 8 bytes, not %lu", (unsigned long)dlen);
+            return(command_action_error);
+        }
+        if (cfg->cfg_trace != NULL) {
+            errout("-K: rate doesn't apply while replaying a trace (-F)");
+            return(command_action_error);
+        }
+        v = get64(data);
+        if (v == 0) {
+            cfg->cfg_rate = 0;
+            cfg->cfg_rate_bits = 0;
+        } else if (v >= 10 && v <= (uint64_t)1e+15) {
+            cfg->cfg_rate = v / 1e+3;
+            cfg->cfg_rate_bits = !!(flags & CMDBIN_F_BITS);
+        } else {
+            errout("-K: rate must be in range 0.01-1e+12");
+            return(command_action_error);
+        }
+        return(command_action_time_change);
+    default:
+        errout("-K: unknown command type %d", op);
+        return(command_action_error);
+    }
+}
+
+/*
+ * cmdsock_remove()
+ * Remove the -K socket's name, when exiting.
+ */
+static void cmdsock_remove(struct config *cfg)
+{
+    if (cfg->cfg_cmdsock != NULL) {
+        unlink(cfg->cfg_cmdsock->cs_path);
+    }
+}
+
+/*
+ * progname_to_progdir()
+ *
+ * See if the program name (in 'progname') indicates the direction
+ * (send/receive) this is to do.  Sets 'progdir' to the result. 
+ */
+static void progname_to_progdir(void)
+{
+    struct {
+        char *s;
+        int d;
+    } endings[] = {
+        { "send",       1 },
+        { "receive",    -1 },
+        { "recv",       -1 },
+        { "snd",        1 },
+        { "rcv",        -1 },
+        { "tx",         1 },
+        { "rx",         -1 },
+        { NULL, 0 }
+    };
+    int pnl, ei, el;
+    char *cp;
+
+    /* any '.' extension? */
+    cp = strrchr(progname, '.');
+    if (cp != NULL) {
+        pnl = cp - progname;
+    } else {
+        pnl = strlen(progname);
+    }
+
+    /* see about command names ending with interesting hints */
+    for (ei = 0; endings[ei].s; ++ei) {
+        el = strlen(endings[ei].s);
+        if (pnl >= el &&
+            !strncasecmp(progname + pnl - el, endings[ei].s, el)) {
+            /* matched! */
+            progdir = endings[ei].d;
+            return;
+        }
+    }
+}
+
+/*
+ * make_default_label()
+ * Since the user didn't specify a label, make one based on their
+ * configuration of the group 'g'.  Returns a newly allocated string; caller
+ * should free it when no longer wanted.
+ */
+static char *make_default_label(struct mcgroup *g)
+{
+    char ga[128], buf[256];
+    auto_ntop(&g->mg_grp, ga, sizeof(ga));
+    snprintf(buf, sizeof(buf), "%s%%%s", ga, g->mg_intf.nam);
+    return(strdup(buf));
+}
+
+/*
+ * group_check()
+ *
+ * Check the config, for whether the multicast group address is actually
+ * a multicast address, and if needed, a source-specific multicast address.
+ * Gives a warning if not.  It's only a warning, and doesn't catch all
+ * restrictions and requirements for multicast addressing.  This program
+ * isn't the standards police; if you do something you shouldn't be doing,
+ * that's your problem.
+ *
+ * Standards:
+ *      RFC 4607 for source specific multicast addresses
+ *      RFC 1112 for IPv4 multicast addresses
+ *      RFC 4291 for IPv6 multicast addresses
+ *
+ * Parameters:
+ *      cfg -- configuration
+ *      g -- group, including its address and sources
+ *      first_time -- Nonzero to indicate this is being run the first
+ *          time; zero if not.  The first time it runs more checks are done.
+ */
+static void group_check(struct config *cfg, struct mcgroup *g, int first_time)
+{
+    char gbuf[128];
 #ifdef DO_SOURCES
     int ssm_group, ssm_filter;
 #endif /* DO_SOURCES */
 
     if (first_time) {
-        if (cfg->cfg_grp.ss_family == AF_INET6) {
+        if (g->mg_grp.ss_family == AF_INET6) {
             /* RFC 4291 says IPv6 multicast groups are in ff00::/8 */
-            struct sockaddr_in6 *a = (void *)&cfg->cfg_grp;
+            struct sockaddr_in6 *a = (void *)&g->mg_grp;
             uint8_t *b = (void *)&(a->sin6_addr);
             if (b[0] != 0xff) {
                 errout("warning: %s is not a multicast group",
-                       auto_ntop(&cfg->cfg_grp, gbuf, sizeof(gbuf)));
+                       auto_ntop(&g->mg_grp, gbuf, sizeof(gbuf)));
                 return;
             }
         } else {
             /* RFC 1112 says IPv4 multicast groups are in 224.0.0.0/4 */
-            struct sockaddr_in *a = (void *)&cfg->cfg_grp;
+            struct sockaddr_in *a = (void *)&g->mg_grp;
             uint8_t *b = (void *)&(a->sin_addr);
             if ((b[0] & 240) != 224) {
                 errout("warning: %s is not a multicast group",
-                       auto_ntop(&cfg->cfg_grp, gbuf, sizeof(gbuf)));
+                       auto_ntop(&g->mg_grp, gbuf, sizeof(gbuf)));
                 return;
             }
         }
@@ -1201,16 +3748,16 @@ static void group_check(struct config *cfg, int first_time)
     if (cfg->cfg_join || cfg->cfg_dir <= 0) {
         /* is this a source-specific multicast group? */
         ssm_group = 0;
-        if (cfg->cfg_grp.ss_family == AF_INET6) {
+        if (g->mg_grp.ss_family == AF_INET6) {
             /* RFC 4607 says IPv6 SSM groups are in FF3x::/32 */
-            struct sockaddr_in6 *a = (void *)&cfg->cfg_grp;
+            struct sockaddr_in6 *a = (void *)&g->mg_grp;
             uint8_t *b = (void *)&(a->sin6_addr);
             if (b[0] == 0xff && (b[1] & 0xf0) == 0x30) {
                 ssm_group = 1;
             }
         } else {
             /* RFC 4607 says IPv4 SSM groups are in 232/8 */
-            struct sockaddr_in *a = (void *)&cfg->cfg_grp;
+            struct sockaddr_in *a = (void *)&g->mg_grp;
             uint8_t *b = (void *)&(a->sin_addr);
             if (b[0] == 232) {
                 ssm_group = 1;
@@ -1218,59 +3765,911 @@ static void group_check(struct config *cfg, int first_time)
         }
 
         /* are we trying to do source-specific multicast? */
-        ssm_filter = (cfg->cfg_sfmode == MCAST_INCLUDE);
+        ssm_filter = (g->mg_sfmode == MCAST_INCLUDE);
 
         /* well, is that ok? */
         if (ssm_group && !ssm_filter) {
             errout("warning: %s is a source specific multicast group",
-                   auto_ntop(&cfg->cfg_grp, gbuf, sizeof(gbuf)));
+                   auto_ntop(&g->mg_grp, gbuf, sizeof(gbuf)));
         }
         if (ssm_filter && !ssm_group) {
             errout("warning: %s is not a source specific multicast group",
-                   auto_ntop(&cfg->cfg_grp, gbuf, sizeof(gbuf)));
+                   auto_ntop(&g->mg_grp, gbuf, sizeof(gbuf)));
         }
     }
 #endif /* DO_SOURCES */
 }
 
-/** ** utility functions ** **/
-
 /*
- * errout() - Emit an error message with timestamp.
- * Takes a printf()-style format string.
+ * group_new()
+ * Allocate a new group, with settings copied from 'like' (except for
+ * the group address and label, which are left blank), and not yet
+ * in cfg_groups[].  It shares the data to send (mg_data) with 'like'
+ * until -d gives it its own.
  */
-static void errout(char *fmt, ...)
+static struct mcgroup *group_new(struct mcgroup *like)
 {
-    va_list ap;
-    char buf[512];
-    int pos;
-    struct timeval tv;
-
-    /* timestamp */
-    gettimeofday(&tv, NULL);
-    pos = (*timestamp_formatter)(&tv, buf, sizeof(buf),
-                                 timestamp_formatter_arg);
+    struct mcgroup *g;
+
+    g = calloc(1, sizeof(*g));
+    g->mg_idx = -1;
+    g->mg_grp.ss_family = AF_UNSPEC;
+    g->mg_grplen = sizeof(g->mg_grp);
+    g->mg_port = like->mg_port;
+    g->mg_intf = like->mg_intf;
+    g->mg_label = NULL;
+    g->mg_label_csv = NULL;
+#ifdef DO_SOURCES
+    g->mg_sfmode = like->mg_sfmode;
+    g->mg_sources = srcs_empty;
+    srcs_copy(&g->mg_sources, &like->mg_sources);
+    g->mg_osfmode = MCAST_EXCLUDE;
+    g->mg_osources = srcs_empty;
+    g->mg_sfull = 1;
+    g->mg_sadd = g->mg_ssub = srcs_empty;
+#endif /* DO_SOURCES */
+    g->mg_reapply = g->mg_critical = 1;
+    g->mg_sml_state.ever_called = 0;
+    g->mg_sok = -1;
+    g->mg_up = 0;
+    g->mg_theap_pos = -1;
+    g->mg_data = like->mg_data;
+    g->mg_ttl = like->mg_ttl;
+    g->mg_rate = like->mg_rate;
+    g->mg_rate_bits = like->mg_rate_bits;
+    g->mg_tx_next = 0;
+    g->mg_tx_carry = 0;
+    g->mg_tx_bytes = 0;
+    g->mg_tr.tp_off = g->mg_tr_send.tp_off = 0;
+    g->mg_tr.tp_t = g->mg_tr_send.tp_t = 0;
+    g->mg_tr_base = 0;
+#ifdef HAVE_MSG_ZEROCOPY
+    g->mg_zc = 0;
+    g->mg_zc_hdrs = NULL;
+    g->mg_zc_marks = NULL;
+    g->mg_zc_fin = NULL;
+#endif /* HAVE_MSG_ZEROCOPY */
+#ifdef HAVE_UDP_SEGMENT
+    g->mg_gso = 0;
+#endif /* HAVE_UDP_SEGMENT */
+#ifdef HAVE_PACKET_RING
+    g->mg_ring = NULL;
+#endif /* HAVE_PACKET_RING */
+    HCOUNT_SET(&g->mg_stats.st_iat_min, UINT64_MAX);
+    g->mg_rxsrc = NULL;
+    g->mg_rxsrc_mask = 0;
+    g->mg_rxsrc_n = g->mg_rxsrc_full = 0;
+    g->mg_ch_joined = g->mg_ch_wait = 0;
+    g->mg_ch_tdue = g->mg_ch_tjoin = g->mg_ch_tleave = g->mg_ch_tlate = 0;
+    return(g);
+}
 
-    /* delimiter */
-    if (pos && pos < sizeof(buf) - 1) {
-        buf[pos++] = ' ';
-        buf[pos] = '\0';
-    }
+/*
+ * group_add()
+ * Add a group to cfg_groups[].
+ */
+static void group_add(struct config *cfg, struct mcgroup *g)
+{
+    cfg->cfg_groups = realloc(cfg->cfg_groups,
+                              (cfg->cfg_ngroups + 1) *
+                              sizeof(cfg->cfg_groups[0]));
+    g->mg_idx = cfg->cfg_ngroups;
+    cfg->cfg_groups[cfg->cfg_ngroups++] = g;
+    cfg->cfg_theap = realloc(cfg->cfg_theap,
+                             cfg->cfg_ngroups * sizeof(cfg->cfg_theap[0]));
+}
 
-    /* message */
-    if (pos < sizeof(buf)) {
-        va_start(ap, fmt);
-        pos += vsnprintf(buf + pos, sizeof(buf) - pos, fmt, ap);
-        va_end(ap);
+/*
+ * group_file()
+ * Read the file named by the -G option, and add a group for each line in it.
+ * Each line holds options like -g, -p, -i; anything not specified there
+ * comes from the command line (cfg_tmpl).  Errors in the file are fatal.
+ */
+static void group_file(struct config *cfg, char *fn)
+{
+    FILE *fp;
+    char line[65536], *tok, *arg, *save;
+    int lno = 0;
+    struct mcgroup *g;
+    const char *white = " \t\r\n";
+
+    fp = fopen(fn, "r");
+    if (fp == NULL) {
+        errout("failed to open '%s': %s", fn, strerror(errno));
+        exit(1);
     }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        ++lno;
+        if (strchr(line, '\n') == NULL && !feof(fp)) {
+            errout("%s line %d: line too long", fn, lno);
+            exit(1);
+        }
+        tok = strtok_r(line, white, &save);
+        if (tok == NULL || tok[0] == '#') {
+            continue; /* blank or comment */
+        }
+        g = group_new(&cfg->cfg_tmpl);
+        for (; tok != NULL; tok = strtok_r(NULL, white, &save)) {
+            /* option, like "-g 1.2.3.4" or "-g1.2.3.4" */
+            if (tok[0] != '-' || tok[1] == '\0') {
+                errout("%s line %d: expected option, got '%s'", fn, lno, tok);
+                exit(1);
+            }
+            if (tok[2] != '\0') {
+                arg = tok + 2;
+            } else {
+                arg = strtok_r(NULL, white, &save);
+                if (arg == NULL) {
+                    errout("%s line %d: -%c needs a value", fn, lno, tok[1]);
+                    exit(1);
+                }
+            }
+            if (group_option(cfg, g, GROUP_FILE, tok[1], arg) ==
+                command_action_error) {
 
-    /* newline and null byte */
-    if (pos < sizeof(buf)) {
-        buf[pos++] = '\n';
-        if (pos >= sizeof(buf)) {
-            pos = sizeof(buf) - 1;
+                errout("%s line %d: bad group settings", fn, lno);
+                exit(1);
+            }
         }
-        buf[pos] = '\0';
+        if (g->mg_grp.ss_family == AF_UNSPEC) {
+            errout("%s line %d: no group address; specify -g", fn, lno);
+            exit(1);
+        }
+        group_add(cfg, g);
+    }
+    if (ferror(fp)) {
+        errout("failed to read '%s': %s", fn, strerror(errno));
+        exit(1);
+    }
+    fclose(fp);
+    if (cfg->cfg_ngroups == 0) {
+        errout("no groups listed in '%s'", fn);
+        exit(1);
+    }
+}
+
+/*
+ * group_socket()
+ * Set up the socket used for all network interactions on one group,
+ * and the address to send to.  Errors are reported; serious ones
+ * are fatal.
+ */
+static void group_socket(struct config *cfg, struct mcgroup *g)
+{
+    int sok, rv;
+    struct sockaddr_storage as;
+    struct sockaddr_in *a4;
+    struct sockaddr_in6 *a6;
+    socklen_t alen;
+
+    sok = g->mg_sok = socket(cfg->cfg_af, SOCK_DGRAM, IPPROTO_UDP);
+    if (sok < 0) {
+        errout("failed to create socket: %s", strerror(errno));
+        exit(1);
+    }
+
+    if (cfg->cfg_dir < 0) {
+        /* avoid EADDRINUSE */
+        int arg = 1;
+        rv = setsockopt(sok, SOL_SOCKET, SO_REUSEADDR, &arg, sizeof(arg));
+        if (rv < 0) {
+            errout("failed to set SO_REUSEADDR: %s", strerror(errno));
+            /* go on and try, in spite of this error */
+        }
+    }
+
+    if (cfg->cfg_dir < 0) {
+        /*
+         * To receive packets we have to bind() the socket.  With several
+         * groups, bind each socket to its group's address, so it doesn't
+         * get packets for other groups on the same port.
+         */
+        memset(&as, 0, sizeof(as));
+        if (cfg->cfg_af == AF_INET6) {
+            a6 = (void *)&as;
+            a6->sin6_family = AF_INET6;
+            a6->sin6_port = htons(g->mg_port);
+            a6->sin6_addr = in6addr_any;
+            if (cfg->cfg_ngroups > 1) {
+                a6->sin6_addr = ((struct sockaddr_in6 *)&g->mg_grp)->sin6_addr;
+                a6->sin6_scope_id = g->mg_intf.idx;
+            }
+#ifdef HAVE_SA_LEN
+            a6->sin6_len = sizeof(*a6);
+#endif
+            alen = sizeof(*a6);
+        } else {
+            a4 = (void *)&as;
+            a4->sin_family = AF_INET;
+            a4->sin_port = htons(g->mg_port);
+            a4->sin_addr.s_addr = INADDR_ANY;
+            if (cfg->cfg_ngroups > 1) {
+                a4->sin_addr = ((struct sockaddr_in *)&g->mg_grp)->sin_addr;
+            }
+#ifdef HAVE_SA_LEN
+            a4->sin_len = sizeof(*a4);
+#endif
+            alen = sizeof(*a4);
+        }
+        rv = bind(sok, (void *)&as, alen);
+        if (rv < 0) {
+            errout("failed to bind socket: %s", strerror(errno));
+            exit(1);
+        }
+    }
+
+#ifdef HAVE_SO_TIMESTAMPNS
+    if (cfg->cfg_dir < 0 && cfg->cfg_tstamp == rx_tstamp_sw) {
+        /* have the kernel tell when each packet was received */
+        int arg = 1;
+        rv = setsockopt(sok, SOL_SOCKET, SO_TIMESTAMPNS, &arg, sizeof(arg));
+        if (rv < 0) {
+            errout("failed to set SO_TIMESTAMPNS: %s", strerror(errno));
+            /* go on; the times will be a little less accurate */
+        }
+    }
+#endif /* HAVE_SO_TIMESTAMPNS */
+#ifdef HAVE_SO_TIMESTAMPING
+    if (cfg->cfg_dir < 0 && cfg->cfg_tstamp == rx_tstamp_hw) {
+        /* have the network interface tell when each packet was received */
+        static int hw_complained = 0; /* only say it once, not per group */
+        char errbuf[512];
+
+        hw_timestamps(sok, &g->mg_intf, errbuf, sizeof(errbuf));
+        if (errbuf[0] && !hw_complained) {
+            errout("%s", errbuf);
+            hw_complained = 1;
+            /* go on; the kernel's timestamps will be used instead */
+        }
+    }
+#endif /* HAVE_SO_TIMESTAMPING */
+
+    if (cfg->cfg_dir < 0) {
+#ifdef HAVE_MULTICAST_ALL
+        if (cfg->cfg_af == AF_INET) {
+            /* don't receive packets for groups other sockets joined */
+            int arg = 0;
+            rv = setsockopt(sok, IPPROTO_IP, IP_MULTICAST_ALL,
+                            &arg, sizeof(arg));
+            if (rv < 0) {
+                errout("failed to set IP_MULTICAST_ALL to False: %s",
+                       strerror(errno));
+                /* go on and try, in spite of this error */
+            }
+        }
+#endif /* HAVE_MULTICAST_ALL */
+#ifdef HAVE_V6_MULTICAST_ALL
+        if (cfg->cfg_af == AF_INET6) {
+            /* don't receive packets for groups other sockets joined */
+            int arg = 0;
+            rv = setsockopt(sok, IPPROTO_IPV6, IPV6_MULTICAST_ALL,
+                            &arg, sizeof(arg));
+            if (rv < 0) {
+                errout("failed to set IPV6_MULTICAST_ALL to False: %s",
+                       strerror(errno));
+                /* go on and try, in spite of this error */
+            }
+        }
+#endif /* HAVE_V6_MULTICAST_ALL */
+    }
+
+#ifdef HAVE_MSG_ZEROCOPY
+    if (cfg->cfg_dir > 0 && cfg->cfg_zerocopy) {
+        /* let the kernel send our data without copying it */
+        int arg = 1;
+        rv = setsockopt(sok, SOL_SOCKET, SO_ZEROCOPY, &arg, sizeof(arg));
+        if (rv < 0) {
+            errout("failed to set SO_ZEROCOPY: %s", strerror(errno));
+            /* go on; the data will be copied as usual */
+        } else {
+            g->mg_zc = 1;
+            g->mg_zc_hdrs = calloc(ZC_POOL, SEQ_HDR_LEN);
+            g->mg_zc_marks = calloc(ZC_POOL, sizeof(g->mg_zc_marks[0]));
+            g->mg_zc_fin = calloc(ZC_POOL, sizeof(g->mg_zc_fin[0]));
+            g->mg_zc_sent = g->mg_zc_done = 0;
+            g->mg_zc_hsent = g->mg_zc_hdone = 0;
+        }
+    }
+#endif /* HAVE_MSG_ZEROCOPY */
+#ifdef HAVE_UDP_SEGMENT
+    if (cfg->cfg_dir > 0 && cfg->cfg_gso) {
+        /*
+         * Segment size goes with each send, but setting it to 0 here
+         * finds out whether the kernel knows about it at all.
+         */
+        int arg = 0;
+        rv = setsockopt(sok, IPPROTO_UDP, UDP_SEGMENT, &arg, sizeof(arg));
+        if (rv < 0) {
+            errout("failed to set UDP_SEGMENT: %s", strerror(errno));
+            /* go on; each packet will be sent separately */
+        } else {
+            g->mg_gso = 1;
+        }
+    }
+#endif /* HAVE_UDP_SEGMENT */
+#ifdef HAVE_UDP_GRO
+    if (cfg->cfg_dir < 0 && cfg->cfg_gro) {
+        /* let the kernel combine packets; rx_batch() splits them up */
+        int arg = 1;
+        rv = setsockopt(sok, IPPROTO_UDP, UDP_GRO, &arg, sizeof(arg));
+        if (rv < 0) {
+            errout("failed to set UDP_GRO: %s", strerror(errno));
+            /* go on; packets will just come one at a time */
+        }
+    }
+#endif /* HAVE_UDP_GRO */
+
+    /* socket buffer sizes */
+#ifdef HAVE_SO_BUFFORCE
+    if (cfg->cfg_dir < 0 && cfg->cfg_rcvbuf > 0) {
+        sockbuf_size(sok, SO_RCVBUF, SO_RCVBUFFORCE, cfg->cfg_rcvbuf,
+                     "SO_RCVBUF");
+    }
+    if (cfg->cfg_dir > 0 && cfg->cfg_sndbuf > 0) {
+        sockbuf_size(sok, SO_SNDBUF, SO_SNDBUFFORCE, cfg->cfg_sndbuf,
+                     "SO_SNDBUF");
+    }
+#else /* HAVE_SO_BUFFORCE */
+    if (cfg->cfg_dir < 0 && cfg->cfg_rcvbuf > 0) {
+        sockbuf_size(sok, SO_RCVBUF, -1, cfg->cfg_rcvbuf, "SO_RCVBUF");
+    }
+    if (cfg->cfg_dir > 0 && cfg->cfg_sndbuf > 0) {
+        sockbuf_size(sok, SO_SNDBUF, -1, cfg->cfg_sndbuf, "SO_SNDBUF");
+    }
+#endif /* !HAVE_SO_BUFFORCE */
+#ifdef HAVE_SO_BUSY_POLL
+    if (cfg->cfg_dir < 0 && cfg->cfg_busypoll >= 0) {
+        /* have the kernel poll the interface instead of waiting */
+        int arg = cfg->cfg_busypoll;
+        rv = setsockopt(sok, SOL_SOCKET, SO_BUSY_POLL, &arg, sizeof(arg));
+        if (rv < 0) {
+            errout("failed to set SO_BUSY_POLL: %s", strerror(errno));
+            /* go on; packets will come in the usual way */
+        }
+    }
+#endif /* HAVE_SO_BUSY_POLL */
+#ifdef HAVE_SO_PRIORITY
+    if (cfg->cfg_priority >= 0) {
+        int arg = cfg->cfg_priority;
+        rv = setsockopt(sok, SOL_SOCKET, SO_PRIORITY, &arg, sizeof(arg));
+        if (rv < 0) {
+            errout("failed to set SO_PRIORITY: %s", strerror(errno));
+            /* go on, in spite of this error */
+        }
+    }
+#endif /* HAVE_SO_PRIORITY */
+#ifdef HAVE_SO_RXQ_OVFL
+    if (cfg->cfg_dir < 0) {
+        /* have the kernel say how many packets it dropped, for "-S" */
+        int arg = 1;
+        rv = setsockopt(sok, SOL_SOCKET, SO_RXQ_OVFL, &arg, sizeof(arg));
+        if (rv < 0) {
+            errout("failed to set SO_RXQ_OVFL: %s", strerror(errno));
+            /* go on; they just won't be counted */
+        }
+    }
+#endif /* HAVE_SO_RXQ_OVFL */
+
+    if (cfg->cfg_dir > 0) {
+        if (g->mg_ttl >= 0) {
+            /* specify time to live / hop limit value, when sending */
+            if (cfg->cfg_af == AF_INET6) {
+                int arg = g->mg_ttl;
+                rv = setsockopt(sok, IPPROTO_IPV6, IPV6_MULTICAST_HOPS,
+                                &arg, sizeof(arg));
+                if (rv < 0) {
+                    errout("failed to set IPV6_MULTICAST_HOPS to %d: %s",
+                           (int)g->mg_ttl, strerror(errno));
+                    /* this error is not fatal; go on */
+                }
+            } else {
+                int arg = g->mg_ttl;
+                rv = setsockopt(sok, IPPROTO_IP, IP_MULTICAST_TTL,
+                                &arg, sizeof(arg));
+                if (rv < 0) {
+                    errout("failed to set IP_MULTICAST_TTL to %d: %s",
+                           (int)g->mg_ttl, strerror(errno));
+                    /* go on and try, in spite of this error */
+                }
+            }
+        }
+    }
+
+    /* attach to a network interface */
+    if (cfg->cfg_af == AF_INET6) {
+        /* IPV6_MULTICAST_IF takes ifindex */
+        int arg = g->mg_intf.idx;
+        rv = setsockopt(sok, IPPROTO_IPV6, IPV6_MULTICAST_IF,
+                        &arg, sizeof(arg));
+        if (rv < 0) {
+            errout("failed to set IPV6_MULTICAST_IF to %d (%s): %s",
+                   (int)g->mg_intf.idx, g->mg_intf.nam,
+                   strerror(errno));
+            /* go on and try, in spite of this error */
+        }
+    } else {
+#ifdef HAVE_MULTICAST_IF_IP_MREQN
+        /* IP_MULTICAST_IF can take a 'struct ip_mreqn' which can
+         * hold an ifindex
+         */
+        struct ip_mreqn oarg;
+        memset(&oarg, 0, sizeof(oarg));
+        oarg.imr_ifindex = g->mg_intf.idx;
+#else /* HAVE_MULTICAST_IF_IP_MREQN */
+        /* IP_MULTICAST_IF takes an interface address */
+        struct in_addr oarg = g->mg_intf.adr;
+        if (oarg.s_addr == INADDR_ANY) {
+            errout("problem setting IP_MULTICAST_IF:"
+                   " IPv4 address not found for '%s'", g->mg_intf.nam);
+            /* go on and try, in spite of this error */
+        }
+#endif /* HAVE_MULTICAST_IF_IP_MREQN */
+        rv = setsockopt(sok, IPPROTO_IP, IP_MULTICAST_IF, &oarg, sizeof(oarg));
+        if (rv < 0) {
+            errout("failed to set IP_MULTICAST_IF: %s", strerror(errno));
+            /* go on and try, in spite of this error */
+        }
+    }
+
+    /* set up address to send to; for convenience set it up even if receiving */
+    group_dest(g);
+}
+
+/*
+ * group_dest()
+ * Set up the address to send to on group 'g', mg_dst, from its group
+ * address and port.
+ */
+static void group_dest(struct mcgroup *g)
+{
+    struct sockaddr_in *a4;
+    struct sockaddr_in6 *a6;
+
+    g->mg_dst = g->mg_grp;
+    g->mg_dstlen = g->mg_grplen;
+    if (g->mg_grp.ss_family == AF_INET6) {
+        a6 = (void *)&g->mg_dst;
+        a6->sin6_port = htons(g->mg_port);
+    } else {
+        a4 = (void *)&g->mg_dst;
+        a4->sin_port = htons(g->mg_port);
+    }
+}
+
+
+/*
+ * sockbuf_size()
+ * Set the size of one of socket 'sok's buffers, to 'size' bytes, with
+ * socket option 'opt' (SO_RCVBUF or SO_SNDBUF), called 'name' in
+ * messages.  First try 'forceopt' (SO_RCVBUFFORCE or SO_SNDBUFFORCE),
+ * which needs privileges but isn't limited by the system's maximum;
+ * -1 to skip that.  Complains, once for each of the two kinds, if the
+ * buffer ends up smaller than asked for; but goes on anyway.
+ */
+static void sockbuf_size(int sok, int opt, int forceopt, int size,
+                         const char *name)
+{
+    static int rcv_complained = 0; /* only say it once, not per group */
+    static int snd_complained = 0; /* ditto, for the send buffer */
+    int *complained = (opt == SO_RCVBUF) ? &rcv_complained : &snd_complained;
+    int arg = size, rv = -1;
+    socklen_t alen;
+
+    if (forceopt >= 0) {
+        rv = setsockopt(sok, SOL_SOCKET, forceopt, &arg, sizeof(arg));
+    }
+    if (rv < 0) {
+        rv = setsockopt(sok, SOL_SOCKET, opt, &arg, sizeof(arg));
+    }
+    if (rv < 0) {
+        errout("failed to set %s: %s", name, strerror(errno));
+        return;
+    }
+
+    /* see what we got */
+    alen = sizeof(arg);
+    arg = 0;
+    if (getsockopt(sok, SOL_SOCKET, opt, &arg, &alen) < 0) {
+        return; /* can't tell */
+    }
+#ifdef __linux__
+    arg /= 2; /* Linux doubles it, for its own overhead */
+#endif /* __linux__ */
+    if (arg < size && !*complained) {
+        errout("%s is only %d bytes, not %d; the system limits it"
+               " (net.core.%s, or run privileged)",
+               name, arg, size, (opt == SO_RCVBUF) ? "rmem_max" : "wmem_max");
+        *complained = 1;
+    }
+}
+
+/*
+ * group_filter()
+ * Apply a group's source filter settings to its socket; including joining
+ * the multicast group.  If that fails, revert to the old settings, or
+ * exit if it's critical.
+ */
+static void group_filter(struct config *cfg, struct mcgroup *g)
+{
+    char errbuf[256];
+#ifdef DO_SOURCES
+    struct sockaddr_storage *ss;
+#endif /* DO_SOURCES */
+
+    while (g->mg_reapply) {
+        g->mg_reapply = 0;
+#if defined(DO_SOURCES) && defined(HAVE_MCAST_JOIN_SOURCE_GROUP)
+        if (!g->mg_sfull && g->mg_sml_state.joined &&
+            g->mg_sfmode == g->mg_osfmode &&
+            !(g->mg_sfmode == MCAST_INCLUDE && g->mg_sources.sl_n == 0)) {
+            /*
+             * Only a few sources changed, and the mode didn't; make just
+             * those changes.  (Except when it would leave the group; let
+             * setup_mcast_listen() keep track of that.)
+             */
+            if (group_filter_delta(cfg, g)) {
+                continue;
+            }
+            /* that didn't work; try setting the whole thing */
+        }
+#endif /* DO_SOURCES && HAVE_MCAST_JOIN_SOURCE_GROUP */
+        errbuf[0] = '\0';
+#ifdef DO_SOURCES
+        ss = srcs_sockaddrs(&g->mg_sources);
+#endif /* DO_SOURCES */
+        setup_mcast_listen(g->mg_sok, &g->mg_intf,
+                           (void *)&g->mg_grp, g->mg_grplen,
+#ifdef DO_SOURCES
+                           g->mg_sfmode, g->mg_sources.sl_n, ss,
+#endif /* DO_SOURCES */
+                           &g->mg_sml_state,
+                           errbuf, sizeof(errbuf));
+#ifdef DO_SOURCES
+        free(ss);
+#endif /* DO_SOURCES */
+        if (errbuf[0]) {
+            /* setup_mcast_listen() failed */
+
+            if (cfg->cfg_ngroups > 1) {
+                errout("%s: %s", g->mg_label, errbuf);
+            } else {
+                errout("%s", errbuf);
+            }
+#ifdef DO_SOURCES
+            if (g->mg_critical) {
+                exit(1);
+            }
+            /* instead of giving up, try to set back the old value */
+            errthrottle();
+            g->mg_sfmode = g->mg_osfmode;
+            srcs_copy(&g->mg_sources, &g->mg_osources);
+            g->mg_reapply = g->mg_critical = 1;
+#else /* DO_SOURCES */
+            /* no tricky retries when we can't even join the group */
+            exit(1);
+#endif /* !DO_SOURCES */
+        } else {
+#ifdef DO_SOURCES
+            /* the target/new settings have become the current/old ones */
+            g->mg_osfmode = g->mg_sfmode;
+            srcs_copy(&g->mg_osources, &g->mg_sources);
+#endif /* DO_SOURCES */
+        }
+#ifdef DO_SOURCES
+        /*
+         * Either way, the changes are dealt with.  But a failure leaves
+         * the old setting to be restored, whole, on the next pass.
+         */
+        g->mg_sfull = g->mg_reapply;
+        g->mg_sadd.sl_n = g->mg_ssub.sl_n = 0;
+#endif /* DO_SOURCES */
+    }
+}
+
+#if defined(DO_SOURCES) && defined(HAVE_MCAST_JOIN_SOURCE_GROUP)
+/*
+ * group_filter_delta()
+ * Apply the changes in a group's source list (mg_sadd, mg_ssub) to
+ * its socket one source at a time, and to its current list mg_osources.
+ * Additions are done first, so an include list doesn't pass through
+ * being empty.  Returns nonzero if it worked; zero if it failed, having
+ * reported why, in which case the whole filter should be set instead.
+ */
+static int group_filter_delta(struct config *cfg, struct mcgroup *g)
+{
+    char errbuf[256], abuf[INET6_ADDRSTRLEN + 1];
+    struct sockaddr_storage src;
+    int i, nadd = g->mg_sadd.sl_n;
+
+    for (i = 0; i < nadd + g->mg_ssub.sl_n; ++i) {
+        if (i < nadd) {
+            srcs_sockaddr(&g->mg_sadd, i, &src);
+        } else {
+            srcs_sockaddr(&g->mg_ssub, i - nadd, &src);
+        }
+        update_mcast_source(g->mg_sok, &g->mg_intf,
+                            (void *)&g->mg_grp, g->mg_grplen,
+                            g->mg_sfmode, i < nadd, &src,
+                            errbuf, sizeof(errbuf));
+        if (errbuf[0]) {
+            if (cfg->cfg_ngroups > 1) {
+                errout("%s: %s %s", g->mg_label, errbuf,
+                       auto_ntop(&src, abuf, sizeof(abuf)));
+            } else {
+                errout("%s %s", errbuf, auto_ntop(&src, abuf, sizeof(abuf)));
+            }
+            g->mg_sfull = 1;
+            return(0);
+        }
+    }
+
+    /* the changes have been made; now they're the current setting */
+    srcs_insert(&g->mg_osources, &g->mg_sadd);
+    srcs_remove(&g->mg_osources, &g->mg_ssub);
+    g->mg_sadd.sl_n = g->mg_ssub.sl_n = 0;
+    return(1);
+}
+#endif /* DO_SOURCES && HAVE_MCAST_JOIN_SOURCE_GROUP */
+
+/*
+ * group_timeouts()
+ * In receive (-r) mode, find any groups that have timed out, not having
+ * received a packet for a while, and report them.
+ *
+ * The groups that are up are kept in a min-heap, cfg_theap[], on mg_tdue.
+ * (In send mode the same heap holds all the groups, for tx_groups().)
+ * Receiving a packet only updates mg_tlast and doesn't touch the heap,
+ * so mg_tdue may be earlier than the real timeout.  That gets fixed up
+ * here, when the group reaches the top of the heap, which happens at most
+ * about once per timeout period per group.
+ *
+ * Parameters:
+ *      cfg - configuration, including the groups
+ *      now - the current time, mono_ns()
+ *
+ * Returns:
+ *      when the next group would time out, mono_ns()
+ */
+static int64_t group_timeouts(struct config *cfg, int64_t now)
+{
+    struct mcgroup *g;
+    int64_t due;
+
+    while (cfg->cfg_ntheap > 0 && cfg->cfg_theap[0]->mg_tdue <= now) {
+        g = cfg->cfg_theap[0];
+#ifdef DO_WORKERS
+        if (g->mg_worker) {
+            /* its worker may have received packets not reported yet */
+            worker_tlast(g);
+        }
+#endif /* DO_WORKERS */
+        due = g->mg_tlast + cfg->cfg_timeout_ns;
+        if (due > now) {
+            /* it's received packets since; its real timeout is later */
+            g->mg_tdue = due;
+            theap_down(cfg, 0);
+        } else {
+            /* time out */
+            theap_remove(cfg, g);
+            g->mg_up = 0;
+            emit(cfg, g, reported_event_dn, NULL);
+        }
+    }
+
+    if (cfg->cfg_ntheap > 0) {
+        return(cfg->cfg_theap[0]->mg_tdue);
+    } else {
+        /* half an hour, if none are going to time out */
+        return(now + 1800 * (int64_t)1000000000);
+    }
+}
+
+/*
+ * sooner()
+ * For the main loop: returns the earlier of 'next' and 'us' microseconds
+ * after 'now', both in nanoseconds, mono_ns(); or 'next' if 'us' is < 0,
+ * meaning no time in particular.
+ */
+static int64_t sooner(int64_t next, int64_t now, long us)
+{
+    if (us >= 0 && now + us * (int64_t)1000 < next) {
+        return(now + us * (int64_t)1000);
+    }
+    return(next);
+}
+
+/*
+ * theap_insert()
+ * Add a group to the timeout heap, cfg_theap[], when it comes up.
+ * Its timeout is figured from mg_tlast.
+ */
+static void theap_insert(struct config *cfg, struct mcgroup *g)
+{
+    g->mg_tdue = g->mg_tlast + cfg->cfg_timeout_ns;
+    g->mg_theap_pos = cfg->cfg_ntheap++;
+    cfg->cfg_theap[g->mg_theap_pos] = g;
+    theap_up(cfg, g->mg_theap_pos);
+}
+
+/*
+ * theap_remove()
+ * Remove a group from the timeout heap, cfg_theap[].
+ */
+static void theap_remove(struct config *cfg, struct mcgroup *g)
+{
+    int pos = g->mg_theap_pos;
+
+    g->mg_theap_pos = -1;
+    if (pos < 0) {
+        return; /* wasn't there */
+    }
+    if (pos == --cfg->cfg_ntheap) {
+        return; /* was the last entry, nothing to move */
+    }
+    /* move the last entry into the hole, and put it where it belongs */
+    cfg->cfg_theap[pos] = cfg->cfg_theap[cfg->cfg_ntheap];
+    cfg->cfg_theap[pos]->mg_theap_pos = pos;
+    theap_up(cfg, pos);
+    theap_down(cfg, cfg->cfg_theap[pos]->mg_theap_pos);
+}
+
+/*
+ * theap_up()
+ * Move the entry at 'pos' toward the top of the timeout heap, as far as
+ * it belongs.
+ */
+static void theap_up(struct config *cfg, int pos)
+{
+    struct mcgroup *g = cfg->cfg_theap[pos];
+    int parent;
+
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+        if (cfg->cfg_theap[parent]->mg_tdue <= g->mg_tdue) {
+            break;
+        }
+        cfg->cfg_theap[pos] = cfg->cfg_theap[parent];
+        cfg->cfg_theap[pos]->mg_theap_pos = pos;
+        pos = parent;
+    }
+    cfg->cfg_theap[pos] = g;
+    g->mg_theap_pos = pos;
+}
+
+/*
+ * theap_down()
+ * Move the entry at 'pos' toward the bottom of the timeout heap, as far as
+ * it belongs.
+ */
+static void theap_down(struct config *cfg, int pos)
+{
+    struct mcgroup *g = cfg->cfg_theap[pos];
+    int child;
+
+    for (;;) {
+        child = pos * 2 + 1;
+        if (child >= cfg->cfg_ntheap) {
+            break;
+        }
+        if (child + 1 < cfg->cfg_ntheap &&
+            cfg->cfg_theap[child + 1]->mg_tdue <
+            cfg->cfg_theap[child]->mg_tdue) {
+
+            ++child; /* the smaller of the two children */
+        }
+        if (g->mg_tdue <= cfg->cfg_theap[child]->mg_tdue) {
+            break;
+        }
+        cfg->cfg_theap[pos] = cfg->cfg_theap[child];
+        cfg->cfg_theap[pos]->mg_theap_pos = pos;
+        pos = child;
+    }
+    cfg->cfg_theap[pos] = g;
+    g->mg_theap_pos = pos;
+}
+
+/*
+ * theap_rekey()
+ * Figure out every group's timeout anew, and rebuild the timeout heap.
+ * For when the timeout period (cfg_timeout_ns) changes.  In send (-t)
+ * mode, where the heap is on when packets are due (see tx_groups()), it's
+ * for when the rate or period changes: the next packet is due no later
+ * than one new interval from now.  That doesn't apply to -F.
+ */
+static void theap_rekey(struct config *cfg)
+{
+    struct mcgroup *g;
+    int64_t soon, now = mono_ns();
+    int i, rated;
+
+    for (i = 0; i < cfg->cfg_ntheap; ++i) {
+        g = cfg->cfg_theap[i];
+        if (cfg->cfg_dir < 0) {
+            g->mg_tdue = g->mg_tlast + cfg->cfg_timeout_ns;
+            continue;
+        }
+        soon = now + (int64_t)tx_interval(cfg, g, &rated);
+        if (g->mg_tx_next > soon && cfg->cfg_trace == NULL) {
+            g->mg_tx_next = soon;
+            g->mg_tx_carry = 0;
+        }
+        g->mg_tdue = g->mg_tx_next;
+    }
+    for (i = cfg->cfg_ntheap / 2 - 1; i >= 0; --i) {
+        theap_down(cfg, i);
+    }
+}
+
+/** ** utility functions ** **/
+
+/*
+ * put32(), put64() - Store a 32 or 64 bit number in network byte order,
+ * at a possibly unaligned location.
+ * get32(), get64() - Retrieve one.
+ */
+static void put32(uint8_t *buf, uint32_t v)
+{
+    int i;
+
+    for (i = 3; i >= 0; --i) {
+        buf[i] = v & 255;
+        v >>= 8;
+    }
+}
+
+static void put64(uint8_t *buf, uint64_t v)
+{
+    put32(buf, v >> 32);
+    put32(buf + 4, v);
+}
+
+static uint32_t get32(uint8_t *buf)
+{
+    return((((uint32_t)buf[0]) << 24) | (((uint32_t)buf[1]) << 16) |
+           (((uint32_t)buf[2]) << 8) | buf[3]);
+}
+
+static uint64_t get64(uint8_t *buf)
+{
+    return((((uint64_t)get32(buf)) << 32) | get32(buf + 4));
+}
+
+/*
+ * errout() - Emit an error message with timestamp.
+ * Takes a printf()-style format string.
+ */
+static void errout(char *fmt, ...)
+{
+    va_list ap;
+    char buf[512];
+    int pos;
+    struct timespec ts;
+
+    /* timestamp */
+    clock_gettime(CLOCK_REALTIME, &ts);
+    pos = (*timestamp_formatter)(&ts, buf, sizeof(buf),
+                                 timestamp_formatter_arg);
+
+    /* delimiter */
+    if (pos && pos < sizeof(buf) - 1) {
+        buf[pos++] = ' ';
+        buf[pos] = '\0';
+    }
+
+    /* message */
+    if (pos < sizeof(buf)) {
+        va_start(ap, fmt);
+        pos += vsnprintf(buf + pos, sizeof(buf) - pos, fmt, ap);
+        va_end(ap);
+    }
+
+    /* newline and null byte */
+    if (pos < sizeof(buf)) {
+        buf[pos++] = '\n';
+        if (pos >= sizeof(buf)) {
+            pos = sizeof(buf) - 1;
+        }
+        buf[pos] = '\0';
     }
 
     /* out */
@@ -1278,568 +4677,5616 @@ static void errout(char *fmt, ...)
 }
 
 /*
- * errthrottle()
- * Some errors might result in an infinite loop.  This function should help
- * make them less of a pain.  Normally when it's called it does nothing.
- * But if it's called a lot of times within a short period it'll sleep,
- * slowing things down.
+ * errthrottle()
+ * Some errors might result in an infinite loop.  This function should help
+ * make them less of a pain.  Normally when it's called it does nothing.
+ * But if it's called a lot of times within a short period it'll sleep,
+ * slowing things down.
+ */
+static void errthrottle(void)
+{
+    static int errthrottle_ctr = 0; /* calls in 64 second period */
+    static time_t errthrottle_lst = 0; /* last 64 second period called */
+    int prd;
+
+    /* what time is it? use 64 second periods for convenience */
+    prd = time(NULL) >> 6;
+
+    /* how many times has errthrottle() been called in that time? */
+    if (errthrottle_lst != prd) {
+        errthrottle_lst = prd;
+        errthrottle_ctr = 0;
+    }
+    ++errthrottle_ctr;
+
+    /* sleep if it's a lot */
+    if (errthrottle_ctr > 20) {
+        sleep(1);
+    }
+}
+
+/*
+ * emit()
+ * Emit a line of our main output.
+ * Parameters:
+ *      cfg - configuration
+ *      g - group it's about; or NULL for the whole program
+ *      evt - event: what happened; one of enum reported_events
+ *      extra - extra information if any
+ */
+static void emit(struct config *cfg, struct mcgroup *g,
+                 enum reported_events evt, char *extra)
+{
+    emit_at(cfg, g, evt, extra, NULL);
+}
+
+/*
+ * emit_at()
+ * Like emit() but for something that happened at a particular time,
+ * such as when a packet was received.
+ * Parameters:
+ *      cfg - configuration
+ *      g - group it's about; or NULL for the whole program
+ *      evt - event: what happened; one of enum reported_events
+ *      extra - extra information if any
+ *      when - when it happened; or NULL for now
+ */
+static void emit_at(struct config *cfg, struct mcgroup *g,
+                    enum reported_events evt, char *extra,
+                    struct timespec *when)
+{
+    struct timespec now;
+    char ts[128];
+    char *ekw, *eph, *eex, *lbl, *lblc;
+    int csv_fields = 0, was;
+
+    if (cfg->cfg_binlog_fd >= 0 &&
+        evt != reported_event_rx && evt != reported_event_tx) {
+
+        /* "-f binary:" gets all events; packets are logged elsewhere */
+        if (when == NULL) {
+            clock_gettime(CLOCK_REALTIME, &now);
+            when = &now;
+        }
+        binlog_add(cfg, &cfg->cfg_binlog, evt, g, when, 0, 0, 0, 0);
+    }
+
+    /*
+     * Decide whether 'evt' is an event we're reporting now,
+     * and what to call it.
+     */
+    switch (evt) {
+    case reported_event_tx:
+        /* transmitted packet: only report if verbose */
+        if (cfg->cfg_verbose == 0) return;
+        ekw = "sent";
+        eph = "sent packet to";
+        break;
+    case reported_event_rx:
+        /* received packet: only report if verbose */
+        if (cfg->cfg_verbose == 0) return;
+        ekw = "recv";
+        eph = "received packet on";
+        break;
+    case reported_event_up:
+        /*
+         * Coming "up" after receiving a packet: *don't* report if verbose,
+         * because then reported_event_rx shows up.
+         * (except with doubly-verbose)
+         */
+        if (cfg->cfg_verbose == 1) return;
+        ekw = "up";
+        eph = "started receiving packets on";
+        break;
+    case reported_event_dn:
+        /* timeout after not receiving a packet: *don't* report if verbose,
+         * because then the absence of reported_event_rx should be clear
+         * enough.
+         * (except with doubly-verbose)
+         */
+        if (cfg->cfg_verbose == 1) return;
+        ekw = "down";
+        eph = "no longer receiving packets on";
+        break;
+    case reported_event_cmd:
+        /* command issued on stdin; see -k */
+        ekw = "command";
+        eph = "received command for";
+        break;
+    case reported_event_note:
+        /* informational note */
+        ekw = "note";
+        eph = "note:";
+        break;
+    case reported_event_pkt:
+        /* something about a packet we received */
+        ekw = "pkt";
+        eph = "for packet on";
+        break;
+    case reported_event_lat:
+        /* latency statistics */
+        ekw = "latency";
+        eph = "latency on";
+        break;
+    case reported_event_stats:
+        /* packet statistics; with CSV, 'extra' is already several fields */
+        ekw = "stats";
+        eph = "statistics on";
+        csv_fields = 1;
+        break;
+    case reported_event_srcup:
+        /* packet from a source not heard from before, or lately */
+        ekw = "srcup";
+        eph = "source up on";
+        csv_fields = 1;
+        break;
+    case reported_event_srcdn:
+        /* timeout after not receiving a packet from a source */
+        ekw = "srcdown";
+        eph = "source down on";
+        csv_fields = 1;
+        break;
+    case reported_event_srcstats:
+        /* packet statistics for one source */
+        ekw = "srcstats";
+        eph = "source statistics on";
+        csv_fields = 1;
+        break;
+    case reported_event_churn:
+        /* joining and leaving groups: how many, how long it took */
+        ekw = "churn";
+        eph = "membership churn on";
+        break;
+    default:
+        /* unknown event, don't report it */
+        return;
+    }
+
+    /* fill in a timestamp */
+    was = prof_enter(prof_emit);
+    if (when == NULL) {
+        clock_gettime(CLOCK_REALTIME, &now);
+        when = &now;
+    }
+    (*timestamp_formatter)(when, ts, sizeof(ts), timestamp_formatter_arg);
+
+    /* the group's label, if it has its own */
+    if (g != NULL && g->mg_label != NULL) {
+        lbl = g->mg_label;
+        lblc = g->mg_label_csv;
+    } else {
+        lbl = cfg->cfg_label;
+        lblc = cfg->cfg_label_csv;
+    }
+
+    /* message */
+    if (cfg->cfg_csv) {
+        /* comma separated values format: time, label, keyword, extra */
+        eex = (extra && !csv_fields) ? csv_escape_reuse(extra) : extra;
+        printf("%s%s%s,%s,%s\n",
+               ts, ts[0] ? "," : "",
+               lblc, ekw, eex ? : "");
+    } else {
+        /* more or less human readable format */
+        printf("%s%s%s %s%s%s\n",
+               ts, ts[0] ? " " : "", eph, lbl,
+               extra ? " " : "", extra ? : "");
+    }
+
+    /* write out the message, now or later */
+    out_line(cfg);
+    prof_leave(was);
+}
+
+/*
+ * out_line()
+ * Called after each line of output emit() produces, to flush it out,
+ * or not, according to cfg_flush.
+ */
+static void out_line(struct config *cfg)
+{
+    int was;
+
+    switch (cfg->cfg_flush) {
+    case flush_policy_lines:
+        if (++cfg->cfg_flush_count < cfg->cfg_flush_lines) {
+            return;
+        }
+        break;
+    case flush_policy_interval:
+        if (cfg->cfg_flush_count++ == 0) {
+            /* first line since last flush: it goes out by this time */
+            cfg->cfg_flush_next = mono_ns() + cfg->cfg_flush_us * 1000;
+        }
+        return;
+    case flush_policy_idle:
+        ++cfg->cfg_flush_count;
+        return;
+    default:
+        break;
+    }
+    was = prof_enter(prof_flush);
+    prof_syscall();
+    fflush(stdout);
+    prof_leave(was);
+    cfg->cfg_flush_count = 0;
+}
+
+/*
+ * out_flushing()
+ * Called from the main loop before waiting for something to do: flush
+ * out any output that's been waiting long enough.  Returns the number
+ * of microseconds until it should be called again, or -1 if it doesn't
+ * matter.
+ */
+static long out_flushing(struct config *cfg)
+{
+    int64_t now;
+    int was;
+
+    if (cfg->cfg_flush_count == 0) {
+        return(-1); /* nothing waiting */
+    }
+    if (cfg->cfg_flush == flush_policy_interval) {
+        now = mono_ns();
+        if (now < cfg->cfg_flush_next) {
+            return((cfg->cfg_flush_next - now + 999) / 1000);
+        }
+    } else if (cfg->cfg_flush != flush_policy_idle) {
+        return(-1); /* out_line() takes care of it */
+    }
+    was = prof_enter(prof_flush);
+    prof_syscall();
+    fflush(stdout);
+    prof_leave(was);
+    cfg->cfg_flush_count = 0;
+    return(-1);
+}
+
+/** ** binary event log ** **/
+
+/*
+ * binlog_open()
+ * Handle "-f binary:path": start writing the binary event log to a file,
+ * replacing its contents, and stop writing any previous one.  "-" for
+ * 'path' just stops.
+ */
+static enum command_action binlog_open(struct config *cfg, char *path)
+{
+    struct binhdr bh;
+    struct timespec now;
+    int fd;
+
+    if (cfg->cfg_binlog_fd >= 0) {
+        /* finish with the old one, including what worker threads have */
+        binlog_write(cfg, &cfg->cfg_binlog);
+#ifdef DO_WORKERS
+        worker_flush(cfg);
+#endif /* DO_WORKERS */
+        close(cfg->cfg_binlog_fd);
+        cfg->cfg_binlog_fd = -1;
+    }
+    if (!strcmp(path, "-")) {
+        return(command_action_none);
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666);
+    if (fd < 0) {
+        errout("failed to open %s: %s", path, strerror(errno));
+        return(command_action_error);
+    }
+    memset(&bh, 0, sizeof(bh));
+    memcpy(bh.bh_magic, BINLOG_MAGIC, sizeof(bh.bh_magic));
+    bh.bh_order = 0x01020304;
+    bh.bh_version = BINLOG_VERSION;
+    bh.bh_reclen = sizeof(struct binrec);
+    clock_gettime(CLOCK_REALTIME, &now);
+    bh.bh_start = now.tv_sec * (uint64_t)1000000000 + now.tv_nsec;
+    if (write(fd, &bh, sizeof(bh)) != sizeof(bh)) {
+        errout("failed to write %s: %s", path, strerror(errno));
+        close(fd);
+        return(command_action_error);
+    }
+    cfg->cfg_binlog_fd = fd;
+    return(command_action_none);
+}
+
+/*
+ * binlog_add()
+ * Add a record to the binary event log, through buffer 'bl'.
+ * Parameters:
+ *      cfg - configuration
+ *      bl - buffer belonging to the calling thread
+ *      evt - what happened
+ *      g - group it's about; or NULL for the whole program
+ *      when - when it happened
+ *      len - length of the packet if any
+ *      seq - sequence number if 'flags' has BINREC_SEQ
+ *      lat - latency if 'flags' has BINREC_LAT
+ *      flags - BINREC_* flags
+ */
+static void binlog_add(struct config *cfg, struct binlog *bl,
+                       enum reported_events evt, struct mcgroup *g,
+                       struct timespec *when, int len, uint64_t seq,
+                       int64_t lat, int flags)
+{
+    struct binrec *br;
+
+    if (bl->bl_buf == NULL) {
+        bl->bl_buf = malloc(BINLOG_BUFSIZE);
+        bl->bl_used = 0;
+        if (bl->bl_buf == NULL) {
+            errout("out of memory for -f binary: buffer");
+            exit(1);
+        }
+    }
+    if (bl->bl_used == 0) {
+        bl->bl_since = mono_ns();
+    }
+    br = (struct binrec *)(bl->bl_buf + bl->bl_used);
+    br->br_time = when->tv_sec * (uint64_t)1000000000 + when->tv_nsec;
+    br->br_seq = seq;
+    br->br_lat = lat;
+    br->br_group = (g != NULL && g->mg_idx >= 0) ? g->mg_idx : 0xffffffff;
+    br->br_len = (len > 65535) ? 65535 : len;
+    br->br_event = evt;
+    br->br_flags = flags;
+    bl->bl_used += sizeof(*br);
+    if (bl->bl_used + sizeof(*br) > BINLOG_BUFSIZE) {
+        binlog_write(cfg, bl);
+    }
+}
+
+/*
+ * binlog_rx()
+ * Add a record to the binary event log, through buffer 'bl', for the i'th
+ * packet in 'rb', received on group 'g'.  'bad' is nonzero if it didn't
+ * match "-d".
+ */
+static void binlog_rx(struct config *cfg, struct binlog *bl,
+                      struct mcgroup *g, struct rxbufs *rb, int i, int bad)
+{
+    uint8_t *buf = rb->rb_pkt[i];
+    struct timespec *ts = &rb->rb_ts[i];
+    uint64_t seq = 0;
+    int64_t lat = 0;
+    int flags = bad ? BINREC_BAD : 0;
+
+    if (rb->rb_got[i] >= SEQ_HDR_LEN && get32(buf) == SEQ_MAGIC) {
+        seq = get64(buf + 8);
+        lat = ts->tv_sec * (int64_t)1000000000 + ts->tv_nsec -
+            (int64_t)get64(buf + 16);
+        flags |= BINREC_SEQ | BINREC_LAT;
+    }
+    binlog_add(cfg, bl, reported_event_rx, g, ts, rb->rb_got[i],
+               seq, lat, flags);
+}
+
+/*
+ * binlog_tx()
+ * Add records to the binary event log for 'count' packets just sent on
+ * group 'g'.
+ */
+static void binlog_tx(struct config *cfg, struct mcgroup *g, int count)
+{
+    struct timespec now;
+    struct trpos tp = g->mg_tr_send;
+    struct iovec iov[2];
+    size_t len = g->mg_data->pd_len;
+    int i;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    for (i = 0; i < count; ++i) {
+        if (cfg->cfg_trace != NULL) {
+            len = trace_pkt(cfg, g, &tp, iov); /* -F: each its own length */
+        }
+        if (g->mg_data->pd_seq) {
+            binlog_add(cfg, &cfg->cfg_binlog, reported_event_tx, g, &now,
+                       len, g->mg_tx_seq - count + i, 0, BINREC_SEQ);
+        } else {
+            binlog_add(cfg, &cfg->cfg_binlog, reported_event_tx, g, &now,
+                       len, 0, 0, 0);
+        }
+    }
+}
+
+/*
+ * binlog_write()
+ * Write out the records in 'bl' to the binary event log file.
+ */
+static void binlog_write(struct config *cfg, struct binlog *bl)
+{
+    size_t pos = 0;
+    ssize_t rv;
+
+    while (pos < bl->bl_used && cfg->cfg_binlog_fd >= 0) {
+        rv = write(cfg->cfg_binlog_fd, bl->bl_buf + pos, bl->bl_used - pos);
+        if (rv < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rv <= 0) {
+            errout("failed to write binary event log: %s",
+                   rv < 0 ? strerror(errno) : "short write");
+            errthrottle();
+            break; /* drop them rather than get stuck */
+        }
+        pos += rv;
+    }
+    bl->bl_used = 0;
+}
+
+/*
+ * binlog_aging()
+ * Write out the records in 'bl' if they've waited BINLOG_MAXAGE.  Returns
+ * the number of microseconds until it should be called again, or -1 if
+ * there's nothing waiting.
+ */
+static long binlog_aging(struct config *cfg, struct binlog *bl)
+{
+    int64_t age;
+
+    if (bl->bl_used == 0) {
+        return(-1);
+    }
+    age = (mono_ns() - bl->bl_since) / 1000;
+    if (age < BINLOG_MAXAGE) {
+        return(BINLOG_MAXAGE - age);
+    }
+    binlog_write(cfg, bl);
+    return(-1);
+}
+
+/*
+ * auto_pton()
+ *
+ * Parse an IP address.  Determines from its contents whether it's IPv4
+ * or IPv6.
+ *
+ * Parameters:
+ *      s - the address string to parse
+ *      ss - structure to store it in
+ *      sslen - before: size of 'ss'; after: size actually used in 'ss'
+ *      cfg - config structure; cfg->cfg_af will be updated/enforced, so
+ *          that this program accepts only all-IPv4 or all-IPv6.
+ * Return:
+ *      !=0 on success
+ *      0 on failure
+ */
+static int auto_pton(char *s, struct sockaddr_storage *ss,
+                     socklen_t *sslen, struct config *cfg)
+{
+    int rv;
+    void *ap;
+
+    if (cfg->cfg_af == AF_UNSPEC) {
+        /*
+         * Figure out what address family this is.  Simple idea: ':'
+         * appears in IPv6 addresses, not in IPv4.
+         */
+        if (strchr(s, ':')) {
+            cfg->cfg_af = AF_INET6;
+        } else {
+            cfg->cfg_af = AF_INET;
+        }
+    }
+    memset(ss, 0, sizeof(*ss));
+    ss->ss_family = cfg->cfg_af;
+    if (cfg->cfg_af == AF_INET6) {
+        if (*sslen < sizeof(struct sockaddr_in6)) {
+            errout("internal error: trying to fit IPv6 address in short space");
+            return(0);
+        }
+        *sslen = sizeof(struct sockaddr_in6);
+        ap = &((struct sockaddr_in6 *)ss)->sin6_addr;
+        ((struct sockaddr_in6 *)ss)->sin6_port = 0;
+#ifdef HAVE_SA_LEN
+        ((struct sockaddr_in6 *)ss)->sin6_len = sizeof(struct sockaddr_in6);
+#endif
+    } else {
+        if (*sslen < sizeof(struct sockaddr_in)) {
+            errout("internal error: trying to fit IPv4 address in short space");
+            return(0);
+        }
+        *sslen = sizeof(struct sockaddr_in);
+        ap = &((struct sockaddr_in *)ss)->sin_addr;
+        ((struct sockaddr_in *)ss)->sin_port = 0;
+#ifdef HAVE_SA_LEN
+        ((struct sockaddr_in *)ss)->sin_len = sizeof(struct sockaddr_in);
+#endif
+    }
+    rv = inet_pton(cfg->cfg_af, s, ap);
+    if (rv > 0) {
+        return(1); /* success */
+    } else if (rv == 0) {
+        errout("Invalid %s address '%s'",
+               (cfg->cfg_af == AF_INET6) ? "IPv6" : "IPv4", s);
+        return(0);
+    } else {
+        errout("Error in parsing address '%s': %s", s, strerror(errno));
+        return(0);
+    }
+}
+
+/*
+ * auto_ntop()
+ *
+ * Format an IPv4 or IPv6 address.  Determines from its contents whether
+ * it's IPv4 or IPv6.  Wrapper around inet_ntop().
+ *
+ * Parameters:
+ *      src - the address (pointer to a 'struct sockaddr*')
+ *      dst - buffer to store the result
+ *      size - size of dst in bytes
+ * Return:
+ *      pointer to the string in dst
+ */
+static char *auto_ntop(void *src, char *dst, socklen_t size)
+{
+    int af;
+
+    /* what kind of address is it? */
+    if (src == NULL) {
+        af = AF_UNSPEC;
+    } else {
+        af = ((struct sockaddr *)src)->sa_family;
+    }
+
+    /* format this kind of address */
+    switch (af) {
+    case AF_INET:
+        /* IPv4 */
+        if(!inet_ntop(af, &((struct sockaddr_in *)src)->sin_addr, dst, size)) {
+            snprintf(dst, size, "?");
+        }
+        break;
+    case AF_INET6:
+        /* IPv6 */
+        if(!inet_ntop(af, &((struct sockaddr_in6 *)src)->sin6_addr, dst, size)){
+            snprintf(dst, size, "?");
+        }
+        break;
+    default:
+        /* unsupported, or maybe there's no address */
+        snprintf(dst, size, "?");
+        break;
+    }
+
+    return(dst);
+}
+
+/*
+ * addr_bytes()
+ * Returns a pointer to the IPv4 or IPv6 address in 'ss'.
+ */
+static uint8_t *addr_bytes(struct sockaddr_storage *ss)
+{
+    if (ss->ss_family == AF_INET6) {
+        return((void *)&((struct sockaddr_in6 *)ss)->sin6_addr);
+    } else {
+        return((void *)&((struct sockaddr_in *)ss)->sin_addr);
+    }
+}
+
+/*
+ * addr_port()
+ * Returns a pointer to the port number, in network byte order, in 'ss'.
+ */
+static uint16_t *addr_port(struct sockaddr_storage *ss)
+{
+    if (ss->ss_family == AF_INET6) {
+        return(&((struct sockaddr_in6 *)ss)->sin6_port);
+    } else {
+        return(&((struct sockaddr_in *)ss)->sin_port);
+    }
+}
+
+/*
+ * addr_hash()
+ * Hash function for an address 'addr' (of family 'af') and port number;
+ * for finding groups in rr_hash[] and sources in mg_rxsrc[].
+ */
+static unsigned addr_hash(int af, uint8_t *addr, int port)
+{
+    unsigned h = 2166136261u; /* FNV-1a */
+    int i, len = (af == AF_INET6) ? 16 : 4;
+
+    for (i = 0; i < len; ++i) {
+        h = (h ^ addr[i]) * 16777619u;
+    }
+    h = (h ^ (port & 255)) * 16777619u;
+    h = (h ^ (port >> 8)) * 16777619u;
+    return(h);
+}
+
+#ifdef DO_SOURCES
+/*
+ * srcs_cmp4()
+ * srcs_cmp16()
+ *
+ * Compare two packed IPv4 (4 byte) or IPv6 (16 byte) addresses and return
+ * <0, =0, >0 depending on their order: the same as memcmp() would.  These
+ * are used with qsort(), by srcs_sort().
+ */
+static int srcs_cmp4(const void *x, const void *y)
+{
+    uint32_t a, b;
+
+    memcpy(&a, x, sizeof(a));
+    memcpy(&b, y, sizeof(b));
+    a = ntohl(a);
+    b = ntohl(b);
+    return((a > b) - (a < b));
+}
+
+static int srcs_cmp16(const void *x, const void *y)
+{
+    return(memcmp(x, y, 16));
+}
+
+/*
+ * srcs_sort()
+ *
+ * Sort a list of source addresses into a straightforward consistent
+ * order, that of memcmp().  That makes comparisons and merges easier.
+ *
+ * Parameters:
+ *      sl - the list
+ */
+static void srcs_sort(struct srclist *sl)
+{
+    if (sl->sl_n > 1) {
+        qsort(sl->sl_addrs, sl->sl_n, sl->sl_alen,
+              (sl->sl_alen == 16) ? &srcs_cmp16 : &srcs_cmp4);
+    }
+}
+
+/*
+ * srcs_room()
+ *
+ * Make sure there's room for 'n' addresses of 'alen' bytes each in a
+ * list of source addresses.  A list only changes 'alen' while it's
+ * empty, since all addresses in it are of the same family.
+ *
+ * Parameters:
+ *      sl - the list; reallocated if there isn't room
+ *      n - number of addresses it needs room for
+ *      alen - size of each address: 4 or 16
+ */
+static void srcs_room(struct srclist *sl, int n, int alen)
+{
+    int k;
+
+    if (sl->sl_alen != alen) {
+        sl->sl_alen = alen;
+        sl->sl_room = 0;
+    }
+    if (n <= sl->sl_room) {
+        return;
+    }
+    k = sl->sl_room * 2;
+    if (k < n) {
+        k = n;
+    }
+    if (k < 8) {
+        k = 8;
+    }
+    sl->sl_addrs = realloc(sl->sl_addrs, (size_t)k * alen);
+    if (sl->sl_addrs == NULL) {
+        errout("out of memory for source addresses");
+        exit(1);
+    }
+    sl->sl_room = k;
+}
+
+/*
+ * srcs_find()
+ *
+ * Look for an address in a sorted list of source addresses.
+ *
+ * Parameters:
+ *      sl - the list
+ *      addr - the address, sl->sl_alen bytes
+ *
+ * Return value:
+ *      Nonzero if it's there, zero if not.
+ */
+static int srcs_find(struct srclist *sl, const uint8_t *addr)
+{
+    int lo = 0, hi = sl->sl_n, mid, c;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        c = memcmp(SRCS_ADDR(sl, mid), addr, sl->sl_alen);
+        if (c == 0) {
+            return(1);
+        } else if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return(0);
+}
+
+/*
+ * srcs_insert()
+ *
+ * Add the addresses in one list to another, in place, keeping the
+ * ordering that srcs_sort() establishes, and without duplicates.  The
+ * second list is changed too, to hold just the addresses that weren't
+ * already in the first.
+ *
+ * Parameters:
+ *      sl - the list to add to; reallocated if there isn't room
+ *      ins - sorted list of addresses to add; changed as described above
+ *
+ * Return value:
+ *      Number of addresses added, now in 'ins'.
+ */
+static int srcs_insert(struct srclist *sl, struct srclist *ins)
+{
+    int alen = ins->sl_alen;
+    int i, j, o, k;
+
+    /* which ones are new? */
+    for (i = j = o = 0; j < ins->sl_n; ++j) {
+        if (o > 0 && !memcmp(SRCS_ADDR(ins, j), SRCS_ADDR(ins, o - 1), alen)) {
+            continue; /* duplicate in 'ins' */
+        }
+        while (i < sl->sl_n &&
+               memcmp(SRCS_ADDR(sl, i), SRCS_ADDR(ins, j), alen) < 0) {
+            ++i;
+        }
+        if (i < sl->sl_n &&
+            !memcmp(SRCS_ADDR(sl, i), SRCS_ADDR(ins, j), alen)) {
+            continue; /* already in 'sl' */
+        }
+        if (o != j) {
+            memcpy(SRCS_ADDR(ins, o), SRCS_ADDR(ins, j), alen);
+        }
+        ++o;
+    }
+    ins->sl_n = o;
+    if (o == 0) {
+        return(0);
+    }
+
+    /* merge from the end, so nothing's overwritten before it's moved */
+    srcs_room(sl, sl->sl_n + o, alen);
+    i = sl->sl_n - 1;
+    j = o - 1;
+    for (k = sl->sl_n + o - 1; j >= 0; --k) {
+        if (i >= 0 && memcmp(SRCS_ADDR(sl, i), SRCS_ADDR(ins, j), alen) > 0) {
+            memcpy(SRCS_ADDR(sl, k), SRCS_ADDR(sl, i), alen);
+            --i;
+        } else {
+            memcpy(SRCS_ADDR(sl, k), SRCS_ADDR(ins, j), alen);
+            --j;
+        }
+    }
+    sl->sl_n += o;
+    return(o);
+}
+
+/*
+ * srcs_remove()
+ *
+ * Remove the addresses in one list from another, in place, keeping the
+ * ordering that srcs_sort() establishes.  The second list is changed
+ * too, to hold just the addresses that were in the first.
+ *
+ * Parameters:
+ *      sl - the list to remove from
+ *      rm - sorted list of addresses to remove; changed as described above
+ *
+ * Return value:
+ *      Number of addresses removed, now in 'rm'.
+ */
+static int srcs_remove(struct srclist *sl, struct srclist *rm)
+{
+    int alen = sl->sl_alen;
+    int i, j, o, r, c = 0;
+
+    for (i = j = o = r = 0; i < sl->sl_n && j < rm->sl_n; ++i) {
+        while (j < rm->sl_n &&
+               (c = memcmp(SRCS_ADDR(rm, j), SRCS_ADDR(sl, i), alen)) < 0) {
+            ++j;
+        }
+        if (j < rm->sl_n && c == 0) {
+            /* remove it, and skip any duplicates of it in 'rm' */
+            memcpy(SRCS_ADDR(rm, r), SRCS_ADDR(sl, i), alen);
+            ++r;
+            while (j < rm->sl_n &&
+                   !memcmp(SRCS_ADDR(rm, j), SRCS_ADDR(sl, i), alen)) {
+                ++j;
+            }
+            continue;
+        }
+        if (o != i) {
+            memcpy(SRCS_ADDR(sl, o), SRCS_ADDR(sl, i), alen);
+        }
+        ++o;
+    }
+    if (o != i) {
+        /* the rest stay */
+        memmove(SRCS_ADDR(sl, o), SRCS_ADDR(sl, i),
+                (size_t)(sl->sl_n - i) * alen);
+    }
+    sl->sl_n = o + (sl->sl_n - i);
+    rm->sl_n = r;
+    return(r);
+}
+
+/*
+ * srcs_copy()
+ *
+ * Replace the contents of a list of source addresses with those of
+ * another, reusing the space it has if there's enough.
+ *
+ * Parameters:
+ *      dst - the list to fill in; reallocated if there isn't room
+ *      src - the addresses to copy
+ */
+static void srcs_copy(struct srclist *dst, struct srclist *src)
+{
+    if (src->sl_n > 0) {
+        srcs_room(dst, src->sl_n, src->sl_alen);
+        memcpy(dst->sl_addrs, src->sl_addrs, (size_t)src->sl_n * src->sl_alen);
+    }
+    dst->sl_n = src->sl_n;
+}
+
+/*
+ * srcs_sockaddr()
+ *
+ * Fill in 'ss' with entry 'i' of a list of source addresses, for use
+ * where the APIs want a 'struct sockaddr'.
+ */
+static void srcs_sockaddr(struct srclist *sl, int i,
+                          struct sockaddr_storage *ss)
+{
+    memset(ss, 0, sizeof(*ss));
+    if (sl->sl_alen == 16) {
+        ss->ss_family = AF_INET6;
+#ifdef HAVE_SA_LEN
+        ((struct sockaddr_in6 *)ss)->sin6_len = sizeof(struct sockaddr_in6);
+#endif
+    } else {
+        ss->ss_family = AF_INET;
+#ifdef HAVE_SA_LEN
+        ((struct sockaddr_in *)ss)->sin_len = sizeof(struct sockaddr_in);
+#endif
+    }
+    memcpy(addr_bytes(ss), SRCS_ADDR(sl, i), sl->sl_alen);
+}
+
+/*
+ * srcs_sockaddrs()
+ *
+ * Returns a newly allocated array of all the addresses in a list of
+ * source addresses, as 'struct sockaddr_storage', for setup_mcast_listen().
+ * The caller should free it.
+ */
+static struct sockaddr_storage *srcs_sockaddrs(struct srclist *sl)
+{
+    struct sockaddr_storage *ss;
+    int i;
+
+    ss = calloc(sl->sl_n + 1, sizeof(ss[0]));
+    for (i = 0; i < sl->sl_n; ++i) {
+        srcs_sockaddr(sl, i, &ss[i]);
+    }
+    return(ss);
+}
+
+/*
+ * sources_pending()
+ *
+ * After a delta (-I +..., -E -..., etc) changed group 'g's source list,
+ * note the changes, the addresses in sorted list 'chg', to be applied
+ * to the socket later (group_filter()).  'delta' is '+' if they were
+ * added, '-' if they were removed.  Adding something that's waiting to
+ * be removed just cancels that, and vice versa.
+ */
+static void sources_pending(struct mcgroup *g, struct srclist *chg, int delta)
+{
+    struct srclist one;
+    uint8_t buf[16];
+    int i;
+
+    one.sl_addrs = buf;
+    one.sl_room = 1;
+    one.sl_alen = chg->sl_alen;
+    for (i = 0; i < chg->sl_n; ++i) {
+        memcpy(buf, SRCS_ADDR(chg, i), chg->sl_alen);
+        one.sl_n = 1;
+        if (delta == '+') {
+            if (srcs_remove(&g->mg_ssub, &one) == 0) {
+                one.sl_n = 1;
+                srcs_insert(&g->mg_sadd, &one);
+            }
+        } else {
+            if (srcs_remove(&g->mg_sadd, &one) == 0) {
+                one.sl_n = 1;
+                srcs_insert(&g->mg_ssub, &one);
+            }
+        }
+    }
+}
+#endif /* DO_SOURCES */
+
+/*
+ * csv_escape()
+ * Returns a copy of 's' with quotes and escapes added to make any odd
+ * characters safe for inclusion in a single field of a CSV file.  The
+ * returned string is allocated memory and should be freed by the caller
+ * when no longer needed.
+ *
+ * See also RFC 4180.
+ */
+static char *csv_escape(char *s)
+{
+    return(strdup(csv_escape_reuse(s)));
+}
+
+/*
+ * csv_escape_reuse()
+ * Like csv_escape() but doesn't allocate memory each time: returns 's'
+ * itself if it doesn't need changing, or else a buffer which may be
+ * overwritten by the next call.
+ */
+static char *csv_escape_reuse(char *s)
+{
+    static char *r = NULL;
+    static size_t rlen = 0;
+    size_t need;
+    int i, o;
+    int do_escape = 0;
+
+    /* any characters that require escaping? */
+    for (i = 0; s[i]; ++i) {
+        if (!isascii(s[i]) || !isgraph(s[i]) ||
+            s[i] == '"' || s[i] == ',') {
+
+            do_escape = 1;
+            break;
+        }
+    }
+
+    if (!do_escape) {
+        /* no need to change anything */
+        return(s);
+    }
+
+    /* make sure there's room */
+    need = strlen(s) * 2 + 3; /* maximum possible */
+    if (need > rlen) {
+        free(r);
+        rlen = need < 256 ? 256 : need;
+        r = malloc(rlen);
+    }
+
+    /* wrap in quotes and double any quotes */
+    o = 0;
+    r[o++] = '"';
+    for (i = 0; s[i]; ++i) {
+        if (s[i] == '"') {
+            r[o++] = '"';
+        }
+        r[o++] = s[i];
+    }
+    r[o++] = '"';
+    r[o] = '\0';
+    return(r);
+}
+
+/** ** timestamp formatters ** **/
+
+/*
+ * timestamp_log()
+ * Fill in a timestamp like: Sep 12 00:01:17.123
+ * Parameters:
+ *      ts - time to use as input
+ *      buf - buffer to store output
+ *      len - size of buffer
+ *      arg - ignored; will be a copy of timestamp_formatter_arg
+ * Returns:
+ *      length of resulting string
+ */
+static int timestamp_log(struct timespec *ts, char *buf, size_t len, void *arg)
+{
+    static PER_THREAD struct tscache tc;
+
+    return(timestamp_secs(ts, buf, len, "%b %d %H:%M:%S", &tc));
+}
+
+/*
+ * timestamp_raw()
+ * Fill in a timestamp like: 1599943404.456
+ * Parameters:
+ *      ts - time to use as input
+ *      buf - buffer to store output
+ *      len - size of buffer
+ *      arg - ignored; will be a copy of timestamp_formatter_arg
+ * Returns:
+ *      length of resulting string
+ */
+static int timestamp_raw(struct timespec *ts, char *buf, size_t len, void *arg)
+{
+    int pos = snprintf(buf, len, "%lu", (unsigned long)ts->tv_sec);
+    if (pos < len) {
+        pos += timestamp_frac(ts, buf + pos, len - pos);
+    }
+    if (pos >= len && len > 0) {
+        /* the string didn't fit; this shouldn't happen */
+        buf[pos = 0] = '\0';
+    }
+    return(pos);
+}
+
+/*
+ * timestamp_num()
+ * Fill in a timestamp like: 2020-09-12-13:46:43.789
+ * Parameters:
+ *      ts - time to use as input
+ *      buf - buffer to store output
+ *      len - size of buffer
+ *      arg - ignored; will be a copy of timestamp_formatter_arg
+ * Returns:
+ *      length of resulting string
+ */
+static int timestamp_num(struct timespec *ts, char *buf, size_t len, void *arg)
+{
+    static PER_THREAD struct tscache tc;
+
+    return(timestamp_secs(ts, buf, len, "%Y-%m-%d-%H:%M:%S", &tc));
+}
+
+/*
+ * timestamp_none()
+ * Don't fill in a timestamp, just empty string.
+ * Parameters:
+ *      ts - time to use as input
+ *      buf - buffer to store output
+ *      len - size of buffer
+ *      arg - ignored; will be a copy of timestamp_formatter_arg
+ * Returns:
+ *      length of resulting string
+ */
+static int timestamp_none(struct timespec *ts, char *buf, size_t len,
+                          void *arg)
+{
+    if (len > 0) {
+        buf[0] = '\0';
+    }
+    return(0);
+}
+
+/*
+ * timestamp_secs()
+ * Common part of timestamp_log() and timestamp_num(): fill in a timestamp
+ * using strftime() format 'fmt' followed by the fraction of a second.
+ * The part from strftime() is saved in 'tc' and reused within the same
+ * second.
+ * Parameters:
+ *      ts - time to use as input
+ *      buf - buffer to store output
+ *      len - size of buffer
+ *      fmt - strftime() format, for the time to the second
+ *      tc - saved result for the last second this was called for
+ * Returns:
+ *      length of resulting string
+ */
+static int timestamp_secs(struct timespec *ts, char *buf, size_t len,
+                          const char *fmt, struct tscache *tc)
+{
+    struct tm tm;
+    size_t pos;
+
+    if (tc->tc_len == 0 || tc->tc_sec != ts->tv_sec) {
+        /* a new second */
+        localtime_r(&ts->tv_sec, &tm);
+        tc->tc_len = strftime(tc->tc_buf, sizeof(tc->tc_buf), fmt, &tm);
+        tc->tc_sec = ts->tv_sec;
+    }
+    pos = tc->tc_len;
+    if (pos > 0 && pos < len) {
+        memcpy(buf, tc->tc_buf, pos);
+        pos += timestamp_frac(ts, buf + pos, len - pos);
+    }
+    if ((pos == 0 || pos >= len) && len > 0) {
+        /* the string didn't fit; this shouldn't happen */
+        buf[pos = 0] = '\0';
+    }
+    return(pos);
+}
+
+/*
+ * timestamp_frac()
+ * Fill in the fractional seconds part of a timestamp, like: .123
+ * to as many digits as timestamp_digits says.
+ * Parameters:
+ *      ts - time to use as input
+ *      buf - buffer to store output
+ *      len - size of buffer
+ * Returns:
+ *      length of resulting string, as with snprintf()
+ */
+static int timestamp_frac(struct timespec *ts, char *buf, size_t len)
+{
+    long frac = ts->tv_nsec;
+    int d;
+
+    for (d = timestamp_digits; d < 9; ++d) {
+        frac /= 10;
+    }
+    return(snprintf(buf, len, ".%0*ld", timestamp_digits, frac));
+}
+
+/** ** receiving packets ** **/
+
+/*
+ * rx_buffers_setup()
+ * (Re)allocate the space used to receive packets, 'rb'.  It holds cfg_batch
+ * packets, each of up to cfg_rx_len bytes; which by default is enough for
+ * any packet, so it doesn't depend on "-d".  Called at startup, and again
+ * if "-b" changes; the old buffers, and anything that was in them, are
+ * discarded.
+ */
+static void rx_buffers_setup(struct config *cfg, struct rxbufs *rb)
+{
+    int i, npkt;
+
+    if (cfg->cfg_batch < 1) {
+        cfg->cfg_batch = 1;
+    }
+    if (rb->rb_data) {
+        free(rb->rb_data);
+    }
+    if (rb->rb_pkt) {
+        free(rb->rb_pkt);
+    }
+    if (rb->rb_got) {
+        free(rb->rb_got);
+    }
+    if (rb->rb_trunc) {
+        free(rb->rb_trunc);
+    }
+    if (rb->rb_ts) {
+        free(rb->rb_ts);
+    }
+    if (rb->rb_from) {
+        free(rb->rb_from);
+        rb->rb_from = NULL;
+    }
+    rb->rb_batch = npkt = cfg->cfg_batch;
+    rb->rb_len = cfg->cfg_rx_len;
+#ifdef HAVE_UDP_GRO
+    /* with UDP_GRO each receive might be a bunch of packets */
+    rb->rb_gro = cfg->cfg_gro;
+    if (rb->rb_gso) {
+        free(rb->rb_gso);
+    }
+    rb->rb_gso = calloc(rb->rb_batch, sizeof(rb->rb_gso[0]));
+    if (rb->rb_gro) {
+        npkt *= RX_GRO_SEGS;
+        if (rb->rb_len < RX_GRO_LEN) {
+            rb->rb_len = RX_GRO_LEN;
+        }
+    }
+#endif /* HAVE_UDP_GRO */
+    rb->rb_data = malloc(rb->rb_len * rb->rb_batch);
+    rb->rb_pkt = calloc(npkt, sizeof(rb->rb_pkt[0]));
+    rb->rb_got = calloc(npkt, sizeof(rb->rb_got[0]));
+    rb->rb_trunc = calloc(npkt, sizeof(rb->rb_trunc[0]));
+    rb->rb_ts = calloc(npkt, sizeof(rb->rb_ts[0]));
+    if (cfg->cfg_rxsrc) {
+        rb->rb_from = calloc(npkt, sizeof(rb->rb_from[0]));
+    }
+    for (i = 0; i < rb->rb_batch; ++i) {
+        rb->rb_pkt[i] = rb->rb_data + i * rb->rb_len;
+    }
+#ifdef HAVE_SO_TIMESTAMPNS
+    if (rb->rb_ctl) {
+        free(rb->rb_ctl);
+    }
+    rb->rb_ctl = calloc(rb->rb_batch, RX_CTL_LEN);
+#endif /* HAVE_SO_TIMESTAMPNS */
+
+#ifdef HAVE_RECVMMSG
+    /* recvmmsg() wants a message header and I/O vector for each packet */
+    if (rb->rb_msgs) {
+        free(rb->rb_msgs);
+    }
+    if (rb->rb_iovs) {
+        free(rb->rb_iovs);
+    }
+    rb->rb_msgs = calloc(rb->rb_batch, sizeof(rb->rb_msgs[0]));
+    rb->rb_iovs = calloc(rb->rb_batch, sizeof(rb->rb_iovs[0]));
+    for (i = 0; i < rb->rb_batch; ++i) {
+        rb->rb_iovs[i].iov_base = rb->rb_data + i * rb->rb_len;
+        rb->rb_iovs[i].iov_len = rb->rb_len;
+        rb->rb_msgs[i].msg_hdr.msg_iov = &rb->rb_iovs[i];
+        rb->rb_msgs[i].msg_hdr.msg_iovlen = 1;
+        rb->rb_msgs[i].msg_hdr.msg_name = rb->rb_from ? &rb->rb_from[i] : NULL;
+    }
+#endif /* HAVE_RECVMMSG */
+}
+
+/*
+ * rx_batch()
+ * Receive up to rb_batch packets from 'sok', which should be ready
+ * for reading.  The packets go in rb->rb_data, at intervals of rb_len
+ * bytes, starting where rb->rb_pkt[] says; their lengths in rb->rb_got[];
+ * whether they were too big, and cut short, in rb->rb_trunc[];
+ * the times they were received in rb->rb_ts[]; who sent them in
+ * rb->rb_from[], if it's there; and (HAVE_SO_RXQ_OVFL) how many packets
+ * the kernel has dropped on the socket in rb->rb_drops.  Those times come
+ * from the kernel when it can tell us (HAVE_SO_TIMESTAMPNS), otherwise
+ * they're when rx_batch() got them.  With "-o gro" there may be more than
+ * rb_batch packets, split out of what the kernel combined.
+ *
+ * Returns the number of packets received, or -1 with errno set if none
+ * were received.
+ */
+static int rx_batch(struct rxbufs *rb, int sok)
+{
+    int got, rv;
+    struct timespec now;
+#ifdef HAVE_SO_TIMESTAMPNS
+    struct msghdr *mh;
+#else /* HAVE_SO_TIMESTAMPNS */
+    socklen_t fromlen;
+#endif /* !HAVE_SO_TIMESTAMPNS */
+#ifdef HAVE_SO_TIMESTAMPNS
+#ifndef HAVE_RECVMMSG
+    struct msghdr mhbuf;
+    struct iovec iov;
+#endif /* !HAVE_RECVMMSG */
+#endif /* HAVE_SO_TIMESTAMPNS */
+
+#ifdef HAVE_SO_RXQ_OVFL
+    rb->rb_drops = 0;
+#endif /* HAVE_SO_RXQ_OVFL */
+#ifdef HAVE_RECVMMSG
+    if (rb->rb_batch > 1) {
+        /* one system call for (potentially) all of them */
+#ifdef HAVE_SO_TIMESTAMPNS
+        for (got = 0; got < rb->rb_batch; ++got) {
+            rb->rb_msgs[got].msg_hdr.msg_control = rb->rb_ctl +
+                got * RX_CTL_LEN;
+            rb->rb_msgs[got].msg_hdr.msg_controllen = RX_CTL_LEN;
+        }
+#endif /* HAVE_SO_TIMESTAMPNS */
+        if (rb->rb_from) {
+            for (got = 0; got < rb->rb_batch; ++got) {
+                rb->rb_msgs[got].msg_hdr.msg_namelen = sizeof(rb->rb_from[0]);
+            }
+        }
+        prof_syscall();
+        rv = recvmmsg(sok, rb->rb_msgs, rb->rb_batch, MSG_DONTWAIT, NULL);
+        clock_gettime(CLOCK_REALTIME, &now);
+        for (got = 0; got < rv; ++got) {
+            rb->rb_got[got] = rb->rb_msgs[got].msg_len;
+            rb->rb_trunc[got] =
+                !!(rb->rb_msgs[got].msg_hdr.msg_flags & MSG_TRUNC);
+            rb->rb_ts[got] = now;
+#ifdef HAVE_SO_TIMESTAMPNS
+            rx_cmsg_ts(&rb->rb_msgs[got].msg_hdr, &rb->rb_ts[got]);
+#endif /* HAVE_SO_TIMESTAMPNS */
+#ifdef HAVE_UDP_GRO
+            rb->rb_gso[got] = rx_cmsg_gro(&rb->rb_msgs[got].msg_hdr);
+#endif /* HAVE_UDP_GRO */
+#ifdef HAVE_SO_RXQ_OVFL
+            rx_cmsg_ovfl(&rb->rb_msgs[got].msg_hdr, &rb->rb_drops);
+#endif /* HAVE_SO_RXQ_OVFL */
+        }
+#ifdef HAVE_UDP_GRO
+        if (rb->rb_gro && rv > 0) {
+            rv = rx_gro_split(rb, rv);
+        }
+#endif /* HAVE_UDP_GRO */
+        return(rv);
+    }
+#endif /* HAVE_RECVMMSG */
+
+    /* one system call per packet, not blocking after the first packet */
+    for (got = 0; got < rb->rb_batch; ++got) {
+#ifdef HAVE_SO_TIMESTAMPNS
+#ifdef HAVE_RECVMMSG
+        mh = &rb->rb_msgs[got].msg_hdr;
+#else /* HAVE_RECVMMSG */
+        mh = &mhbuf;
+        memset(mh, 0, sizeof(*mh));
+        iov.iov_base = rb->rb_data + got * rb->rb_len;
+        iov.iov_len = rb->rb_len;
+        mh->msg_iov = &iov;
+        mh->msg_iovlen = 1;
+#endif /* !HAVE_RECVMMSG */
+        mh->msg_control = rb->rb_ctl + got * RX_CTL_LEN;
+        mh->msg_controllen = RX_CTL_LEN;
+        mh->msg_name = rb->rb_from ? &rb->rb_from[got] : NULL;
+        mh->msg_namelen = rb->rb_from ? sizeof(rb->rb_from[0]) : 0;
+        prof_syscall();
+        rv = recvmsg(sok, mh, got ? MSG_DONTWAIT : 0);
+#else /* HAVE_SO_TIMESTAMPNS */
+        fromlen = sizeof(rb->rb_from[0]);
+        prof_syscall();
+        rv = recvfrom(sok, rb->rb_data + got * rb->rb_len,
+                      rb->rb_len, got ? MSG_DONTWAIT : 0,
+                      rb->rb_from ? (void *)&rb->rb_from[got] : NULL,
+                      rb->rb_from ? &fromlen : NULL);
+#endif /* !HAVE_SO_TIMESTAMPNS */
+        if (rv < 0) {
+            break;
+        }
+        rb->rb_got[got] = rv;
+#ifdef HAVE_SO_TIMESTAMPNS
+        rb->rb_trunc[got] = !!(mh->msg_flags & MSG_TRUNC);
+#else /* HAVE_SO_TIMESTAMPNS */
+        rb->rb_trunc[got] = (rv >= rb->rb_len); /* can't tell; maybe */
+#endif /* !HAVE_SO_TIMESTAMPNS */
+        clock_gettime(CLOCK_REALTIME, &rb->rb_ts[got]);
+#ifdef HAVE_SO_TIMESTAMPNS
+        rx_cmsg_ts(mh, &rb->rb_ts[got]);
+#endif /* HAVE_SO_TIMESTAMPNS */
+#ifdef HAVE_UDP_GRO
+        rb->rb_gso[got] = rx_cmsg_gro(mh);
+#endif /* HAVE_UDP_GRO */
+#ifdef HAVE_SO_RXQ_OVFL
+        rx_cmsg_ovfl(mh, &rb->rb_drops);
+#endif /* HAVE_SO_RXQ_OVFL */
+    }
+#ifdef HAVE_UDP_GRO
+    if (rb->rb_gro && got > 0) {
+        got = rx_gro_split(rb, got);
+    }
+#endif /* HAVE_UDP_GRO */
+    return(got ? got : -1);
+}
+
+#ifdef HAVE_SO_TIMESTAMPNS
+/*
+ * rx_cmsg_ts()
+ * Look in the control messages of a received packet, 'mh', for a
+ * timestamp ("-o tstamp=sw" or "-o tstamp=hw").  If there is one,
+ * store it in 'ts'; otherwise leave 'ts' alone.  A hardware timestamp
+ * is preferred, when there is one.  It comes from the network interface's
+ * own clock (PHC), and gets compared with the system clock (latency,
+ * "-C" join times), so it's only any good if something like phc2sys keeps
+ * the two together.  When it's more than HW_TS_SLOP off the kernel's
+ * timestamp, it's not used, with a warning the first time.
+ */
+static void rx_cmsg_ts(struct msghdr *mh, struct timespec *ts)
+{
+    struct cmsghdr *cm;
+#ifdef HAVE_SO_TIMESTAMPING
+    struct timespec tss[3];
+    static PER_THREAD int warned = 0;
+    int64_t off;
+#endif /* HAVE_SO_TIMESTAMPING */
+
+    for (cm = CMSG_FIRSTHDR(mh); cm; cm = CMSG_NXTHDR(mh, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+        if (cm->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(ts, CMSG_DATA(cm), sizeof(*ts));
+        }
+#ifdef HAVE_SO_TIMESTAMPING
+        if (cm->cmsg_type == SCM_TIMESTAMPING &&
+            cm->cmsg_len >= CMSG_LEN(sizeof(tss))) {
+
+            /* software timestamp in [0], raw hardware timestamp in [2] */
+            memcpy(tss, CMSG_DATA(cm), sizeof(tss));
+            if (tss[0].tv_sec == 0 && tss[0].tv_nsec == 0) {
+                clock_gettime(CLOCK_REALTIME, &tss[0]);
+            }
+            *ts = tss[0];
+            if (tss[2].tv_sec == 0 && tss[2].tv_nsec == 0) {
+                continue;
+            }
+            off = (int64_t)(tss[2].tv_sec - tss[0].tv_sec) * 1000000000 +
+                  (tss[2].tv_nsec - tss[0].tv_nsec);
+            if (off >= -HW_TS_SLOP && off <= HW_TS_SLOP) {
+                *ts = tss[2];
+            } else if (!warned) {
+                warned = 1;
+                errout("-o tstamp=hw: interface clock is %.3f sec off"
+                       " the system clock; is it synchronized (PTP)?"
+                       " Using kernel timestamps",
+                       (double)off / 1e9);
+            }
+        }
+#endif /* HAVE_SO_TIMESTAMPING */
+    }
+}
+
+#ifdef HAVE_SO_RXQ_OVFL
+/*
+ * rx_cmsg_ovfl()
+ * Look in the control messages of a received packet, 'mh', for the
+ * number of packets the kernel has dropped on the socket (SO_RXQ_OVFL;
+ * there's none until it's dropped some).  If it's more than '*drops',
+ * store it there.
+ */
+static void rx_cmsg_ovfl(struct msghdr *mh, uint32_t *drops)
+{
+    struct cmsghdr *cm;
+    uint32_t d;
+
+    for (cm = CMSG_FIRSTHDR(mh); cm; cm = CMSG_NXTHDR(mh, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_RXQ_OVFL &&
+            cm->cmsg_len >= CMSG_LEN(sizeof(d))) {
+            memcpy(&d, CMSG_DATA(cm), sizeof(d));
+            if (d > *drops) {
+                *drops = d;
+            }
+        }
+    }
+}
+#endif /* HAVE_SO_RXQ_OVFL */
+#endif /* HAVE_SO_TIMESTAMPNS */
+
+#ifdef HAVE_UDP_GRO
+/*
+ * rx_cmsg_gro()
+ * Look in the control messages of a received packet, 'mh', for the size
+ * of the packets UDP_GRO combined into it.  Returns it, or 0 if there's
+ * none, meaning it's just one packet.
+ */
+static int rx_cmsg_gro(struct msghdr *mh)
+{
+    struct cmsghdr *cm;
+    int gso = 0;
+
+    for (cm = CMSG_FIRSTHDR(mh); cm; cm = CMSG_NXTHDR(mh, cm)) {
+        if (cm->cmsg_level == IPPROTO_UDP && cm->cmsg_type == UDP_GRO &&
+            cm->cmsg_len >= CMSG_LEN(sizeof(gso))) {
+            memcpy(&gso, CMSG_DATA(cm), sizeof(gso));
+        }
+    }
+    return(gso);
+}
+
+/*
+ * rx_gro_split()
+ * After receiving 'n' times into 'rb' with "-o gro", split up what the
+ * kernel combined into separate packets, all with the same receive
+ * time (and source).  Returns the number of packets.
+ */
+static int rx_gro_split(struct rxbufs *rb, int n)
+{
+    int m, k, p, np, len, gso, trunc, total = 0;
+    struct timespec ts;
+
+    for (m = 0; m < n; ++m) {
+        gso = rb->rb_gso[m];
+        len = rb->rb_got[m];
+        np = (gso > 0 && len > gso) ? ((len + gso - 1) / gso) : 1;
+        total += (np < RX_GRO_SEGS) ? np : RX_GRO_SEGS;
+    }
+
+    /*
+     * From the end backwards, since each one's packets land at or
+     * after its own place in the arrays.
+     */
+    k = total;
+    for (m = n - 1; m >= 0; --m) {
+        gso = rb->rb_gso[m];
+        len = rb->rb_got[m];
+        ts = rb->rb_ts[m];
+        trunc = rb->rb_trunc[m];
+        np = (gso > 0 && len > gso) ? ((len + gso - 1) / gso) : 1;
+        if (np > RX_GRO_SEGS) {
+            np = RX_GRO_SEGS; /* shouldn't happen; last one gets the rest */
+        }
+        if (np == 1) {
+            gso = len;
+        }
+        for (p = np - 1; p >= 0; --p) {
+            --k;
+            rb->rb_pkt[k] = rb->rb_data + m * rb->rb_len + p * gso;
+            rb->rb_got[k] = (p == np - 1) ? (len - p * gso) : gso;
+            rb->rb_trunc[k] = (p == np - 1) ? trunc : 0;
+            rb->rb_ts[k] = ts;
+            if (rb->rb_from && k != m) {
+                rb->rb_from[k] = rb->rb_from[m];
+            }
+        }
+    }
+    return(total);
+}
+#endif /* HAVE_UDP_GRO */
+
+/*
+ * rx_mismatch()
+ * Check whether received packet number 'i' in 'rb', on group 'g', differs
+ * from what the -d option says to expect.  Returns nonzero if it does.
+ * With "-d seq" that means it doesn't have the header (or, with "-d prbs:"
+ * etc, the right stuff after it); and the sequence number gets tracked.
+ */
+static int rx_mismatch(struct config *cfg, struct mcgroup *g,
+                       struct rxbufs *rb, int i)
+{
+    struct pktdata *pd = g->mg_data;
+
+    if (pd->pd_seq) {
+        return(seq_track(g, rb->rb_pkt[i], rb->rb_got[i], &rb->rb_ts[i]) ||
+               seq_verify(pd, rb->rb_pkt[i], rb->rb_got[i]));
+    }
+    return(rb->rb_got[i] != pd->pd_len ||
+           memcmp(rb->rb_pkt[i], pd->pd_data, pd->pd_len) != 0);
+}
+
+/*
+ * rx_packets()
+ * In the main thread, handle 'n' packets just received in 'rb' on group
+ * 'g': report them, check them, count them.
+ */
+static void rx_packets(struct config *cfg, struct mcgroup *g,
+                       struct rxbufs *rb, int n)
+{
+    struct timespec *trx;
+    int i, bad, nbad = 0, was;
+
+    was = prof_enter(prof_check);
+    prof_packets(n);
+    g->mg_tlast = mono_ns();
+    for (i = 0; i < n; ++i) {
+        trx = &rb->rb_ts[i];
+        probe_rx(g, rb->rb_got[i], rb->rb_pkt[i]);
+        emit_at(cfg, g, reported_event_rx, NULL, trx);
+        bad = g->mg_data->pd_chk && !rb->rb_trunc[i] &&
+            rx_mismatch(cfg, g, rb, i);
+        if (cfg->cfg_binlog_fd >= 0) {
+            binlog_rx(cfg, &cfg->cfg_binlog, g, rb, i, bad);
+        }
+        if (bad) {
+            /* not what we expected */
+            emit_at(cfg, g, reported_event_pkt,
+                    "contents do not match '-d' option", trx);
+            ++nbad;
+        }
+        if (!g->mg_up) {
+            g->mg_up = 1;
+            theap_insert(cfg, g);
+            emit_at(cfg, g, reported_event_up, NULL, trx);
+        }
+    }
+    stats_add(g, rb, n, nbad);
+    if (rb->rb_from) {
+        rxsrc_add(cfg, g, rb, n);
+    }
+    if (g->mg_ch_wait || g->mg_ch_tleave) {
+        churn_rx(cfg, g, rb, n);
+    }
+    if (g->mg_data->pd_seq) {
+        seq_report(cfg, g, g->mg_sq_lost, g->mg_sq_reord, g->mg_sq_dup);
+    }
+    prof_leave(was);
+}
+
+#ifdef HAVE_PACKET_RING
+/** ** receiving packets from a packet ring ** **/
+
+/*
+ * ring_setup()
+ * For "-o ring": set up a packet ring on each interface the groups are
+ * on, and have the groups' own sockets throw away what they receive; they
+ * stay around to be members of the groups.  Where a ring can't be set
+ * up, the sockets are used instead.
+ */
+static void ring_setup(struct config *cfg, struct oligocast_evloop *evl)
+{
+    struct mcgroup *g;
+    struct rxring *rr;
+    char errbuf[512];
+    int i, j, n;
+    unsigned h;
+
+    cfg->cfg_rings = calloc(cfg->cfg_ngroups, sizeof(cfg->cfg_rings[0]));
+    cfg->cfg_nrings = 0;
+    for (i = 0; i < cfg->cfg_ngroups; ++i) {
+        g = cfg->cfg_groups[i];
+        for (j = 0; j < cfg->cfg_nrings; ++j) {
+            if (cfg->cfg_rings[j].rr_ifidx == g->mg_intf.idx) {
+                break;
+            }
+        }
+        rr = &cfg->cfg_rings[j];
+        if (j == cfg->cfg_nrings) {
+            /* first group on this interface */
+            ++cfg->cfg_nrings;
+            rr->rr_ifidx = g->mg_intf.idx;
+            rr->rr_ring = ring_open(&g->mg_intf, cfg->cfg_af,
+                                    errbuf, sizeof(errbuf));
+            if (rr->rr_ring == NULL) {
+                errout("-o ring on %s: %s; using sockets instead",
+                       g->mg_intf.nam, errbuf);
+            }
+        }
+        if (rr->rr_ring != NULL) {
+            g->mg_ring = rr;
+            ++rr->rr_ngroups;
+        }
+    }
+
+    /* now set up each ring's table of groups, and start watching it */
+    for (j = 0; j < cfg->cfg_nrings; ++j) {
+        rr = &cfg->cfg_rings[j];
+        if (rr->rr_ring == NULL) {
+            continue;
+        }
+        for (n = 4; n < rr->rr_ngroups * 2; n <<= 1)
+            ;
+        rr->rr_hash = calloc(n, sizeof(rr->rr_hash[0]));
+        rr->rr_hmask = n - 1;
+        rr->rr_rb.rb_batch = RX_RING_BATCH;
+        rr->rr_rb.rb_pkt = calloc(RX_RING_BATCH, sizeof(rr->rr_rb.rb_pkt[0]));
+        rr->rr_rb.rb_got = calloc(RX_RING_BATCH, sizeof(rr->rr_rb.rb_got[0]));
+        rr->rr_rb.rb_trunc = calloc(RX_RING_BATCH,
+                                    sizeof(rr->rr_rb.rb_trunc[0]));
+        rr->rr_rb.rb_ts = calloc(RX_RING_BATCH, sizeof(rr->rr_rb.rb_ts[0]));
+        if (cfg->cfg_rxsrc) {
+            rr->rr_rb.rb_from = calloc(RX_RING_BATCH,
+                                       sizeof(rr->rr_rb.rb_from[0]));
+        }
+        evloop_watch(evl, ring_fd(rr->rr_ring), EVLOOP_READ, NULL,
+                     errbuf, sizeof(errbuf));
+        if (errbuf[0]) {
+            errout("%s", errbuf);
+            exit(1);
+        }
+    }
+    for (i = 0; i < cfg->cfg_ngroups; ++i) {
+        g = cfg->cfg_groups[i];
+        if ((rr = g->mg_ring) == NULL) {
+            continue;
+        }
+        h = addr_hash(g->mg_grp.ss_family, addr_bytes(&g->mg_grp), g->mg_port);
+        while (rr->rr_hash[h & rr->rr_hmask] != NULL) {
+            ++h;
+        }
+        rr->rr_hash[h & rr->rr_hmask] = g;
+        socket_discard(g->mg_sok, errbuf, sizeof(errbuf));
+        if (errbuf[0]) {
+            errout("%s", errbuf);
+            /* go on; the socket's buffer will just fill up */
+        }
+    }
+}
+
+/*
+ * ring_match()
+ * Look at a packet 'pkt' of 'len' bytes, starting with its IP header,
+ * from packet ring 'rr', and see if it's a UDP packet for one of the
+ * groups and allowed by its source filter.  If so, return the group and
+ * fill in where its data is ('data', 'dlen') and, unless 'from' is NULL,
+ * who sent it.  If not, return NULL.
+ * IP fragments and IPv6 extension headers aren't handled.
+ */
+static struct mcgroup *ring_match(struct config *cfg, struct rxring *rr,
+                                  uint8_t *pkt, int len,
+                                  uint8_t **data, int *dlen,
+                                  struct sockaddr_storage *from)
+{
+    struct mcgroup *g;
+    uint8_t *src, *dst, *udp;
+    int hl, alen, port, ulen;
+    unsigned h;
+
+    if (len >= 20 && (pkt[0] >> 4) == 4 && cfg->cfg_af == AF_INET) {
+        hl = (pkt[0] & 15) * 4;
+        if (hl < 20 || pkt[9] != IPPROTO_UDP ||
+            (((pkt[6] << 8) | pkt[7]) & 0x3fff) != 0) {
+            return(NULL); /* not UDP, or a fragment */
+        }
+        src = pkt + 12;
+        dst = pkt + 16;
+        alen = 4;
+    } else if (len >= 40 && (pkt[0] >> 4) == 6 && cfg->cfg_af == AF_INET6) {
+        hl = 40;
+        if (pkt[6] != IPPROTO_UDP) {
+            return(NULL); /* not UDP, or has extension headers */
+        }
+        src = pkt + 8;
+        dst = pkt + 24;
+        alen = 16;
+    } else {
+        return(NULL);
+    }
+    if (len < hl + 8) {
+        return(NULL);
+    }
+    udp = pkt + hl;
+    port = (udp[2] << 8) | udp[3];
+    ulen = (udp[4] << 8) | udp[5];
+    if (ulen < 8 || hl + ulen > len) {
+        return(NULL); /* truncated */
+    }
+
+    /* which group is it for, if any */
+    h = addr_hash(cfg->cfg_af, dst, port);
+    for (;;) {
+        g = rr->rr_hash[h & rr->rr_hmask];
+        if (g == NULL) {
+            return(NULL);
+        }
+        if (g->mg_port == port &&
+            !memcmp(addr_bytes(&g->mg_grp), dst, alen)) {
+            break;
+        }
+        ++h;
+    }
+
+#ifdef DO_SOURCES
+    /* would the group's source filter let it through */
+    if (srcs_find(&g->mg_osources, src) != (g->mg_osfmode == MCAST_INCLUDE)) {
+        return(NULL);
+    }
+#endif /* DO_SOURCES */
+
+    *data = udp + 8;
+    *dlen = ulen - 8;
+    if (from != NULL) {
+        memset(from, 0, sizeof(*from));
+        from->ss_family = cfg->cfg_af;
+        memcpy(addr_bytes(from), src, alen);
+        memcpy(addr_port(from), udp, 2); /* already network byte order */
+    }
+    return(g);
+}
+
+/*
+ * ring_ready()
+ * If 'rd' is one of the packet rings, take the packets out of it, handle
+ * them, and return nonzero; otherwise return zero.  Consecutive packets
+ * for the same group are handled together, right where they are in the
+ * ring.
+ */
+static int ring_ready(struct config *cfg, struct oligocast_evready *rd)
+{
+    struct rxring *rr = NULL;
+    struct rxbufs *rb;
+    struct mcgroup *g, *cur = NULL;
+    struct timespec ts;
+    struct sockaddr_storage from;
+    uint8_t *pkt, *data;
+    int i, len, dlen, n, blocks;
+
+    for (i = 0; i < cfg->cfg_nrings; ++i) {
+        if (cfg->cfg_rings[i].rr_ring != NULL &&
+            ring_fd(cfg->cfg_rings[i].rr_ring) == rd->fd) {
+            rr = &cfg->cfg_rings[i];
+            break;
+        }
+    }
+    if (rr == NULL) {
+        return(0);
+    }
+
+    rb = &rr->rr_rb;
+    for (blocks = 0; blocks < RX_RING_BLOCKS; ++blocks) {
+        n = 0;
+        while (ring_next(rr->rr_ring, &pkt, &len, &ts)) {
+            g = ring_match(cfg, rr, pkt, len, &data, &dlen,
+                           rb->rb_from ? &from : NULL);
+            if (g == NULL) {
+                continue;
+            }
+            if (n > 0 && (g != cur || n >= rb->rb_batch)) {
+                rx_packets(cfg, cur, rb, n);
+                n = 0;
+            }
+            cur = g;
+            rb->rb_pkt[n] = data;
+            rb->rb_got[n] = dlen;
+            rb->rb_ts[n] = ts;
+            if (rb->rb_from) {
+                rb->rb_from[n] = from;
+            }
+            ++n;
+        }
+        if (n > 0) {
+            rx_packets(cfg, cur, rb, n);
+        }
+        if (!ring_release(rr->rr_ring)) {
+            break; /* no more blocks ready */
+        }
+    }
+    return(1);
+}
+#endif /* HAVE_PACKET_RING */
+
+/** ** sequence numbered packets ** **/
+
+/*
+ * The "-d seq" header, at the start of each packet, is SEQ_HDR_LEN bytes,
+ * all in network byte order:
+ *      4 bytes -- SEQ_MAGIC
+ *      4 bytes -- sender ID, chosen at random when the sender starts
+ *      8 bytes -- sequence number, counting from 0, separate for each group
+ *      8 bytes -- time sent, in nanoseconds since 1970 (CLOCK_REALTIME)
+ */
+
+/*
+ * seq_stamp()
+ * Fill in the "-d seq" header in 'buf' for the next packet sent to 'g'.
+ */
+static void seq_stamp(struct config *cfg, struct mcgroup *g, uint8_t *buf)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    put32(buf, SEQ_MAGIC);
+    put32(buf + 4, cfg->cfg_seq_id);
+    put64(buf + 8, g->mg_tx_seq++);
+    put64(buf + 16, ((uint64_t)ts.tv_sec) * 1000000000 + ts.tv_nsec);
+}
+
+/*
+ * With "-d prbs:" and "-d count:" the rest of the packet, after the
+ * header, is a pattern (see pattern_fill()) seeded from the header's
+ * sender ID and sequence number, so it's different in each packet.
+ * With ",crc" the last SEQ_CRC_LEN bytes are, instead, the CRC32C of all
+ * the rest, in network byte order.
+ */
+
+/*
+ * seq_seed()
+ * Returns the seed for the pattern in a packet with "-d seq" header 'hdr'.
+ */
+static uint64_t seq_seed(uint8_t *hdr)
+{
+    return((((uint64_t)get32(hdr + 4)) << 32) ^ get64(hdr + 8));
+}
+
+/*
+ * seq_fill()
+ * Fill in the part of a packet to be sent, 'rest', that follows the
+ * already filled in "-d seq" header 'hdr': the pattern and/or CRC that
+ * 'pd' calls for.
+ */
+static void seq_fill(struct pktdata *pd, uint8_t *hdr, uint8_t *rest)
+{
+    size_t len = pd->pd_len - SEQ_HDR_LEN;
+    uint32_t crc;
+
+    if (pd->pd_crc) {
+        len -= SEQ_CRC_LEN;
+    }
+    if (pd->pd_pat) {
+        pattern_fill(pd->pd_pat, seq_seed(hdr), rest, len);
+    }
+    if (pd->pd_crc) {
+        crc = crc32c(0, hdr, SEQ_HDR_LEN);
+        crc = crc32c(crc, rest, len);
+        put32(rest + len, crc);
+    }
+}
+
+/*
+ * seq_verify()
+ * Check that the 'len' bytes of a received packet 'buf', which has the
+ * "-d seq" header, are the right length and have the right pattern and/or
+ * CRC after the header, as 'pd' calls for.  Returns nonzero if not.
+ */
+static int seq_verify(struct pktdata *pd, uint8_t *buf, int len)
+{
+    size_t plen;
+
+    if (!SEQ_VARIES(pd)) {
+        return(0); /* nothing to check */
+    }
+    if (len != pd->pd_len) {
+        return(1);
+    }
+    plen = len - SEQ_HDR_LEN;
+    if (pd->pd_crc) {
+        plen -= SEQ_CRC_LEN;
+        if (crc32c(0, buf, len - SEQ_CRC_LEN) !=
+            get32(buf + len - SEQ_CRC_LEN)) {
+            return(1);
+        }
+    }
+    if (pd->pd_pat) {
+        return(pattern_check(pd->pd_pat, seq_seed(buf),
+                             buf + SEQ_HDR_LEN, plen));
+    }
+    return(0);
+}
+
+/*
+ * seq_track()
+ * Take note of the "-d seq" header of a packet received on 'g', counting
+ * missing (mg_sq_lost), out of order (mg_sq_reord), and repeated
+ * (mg_sq_dup) sequence numbers.  A packet that comes in late, after
+ * being counted missing, is un-counted.  Also record its one-way latency
+ * and jitter in mg_lat.
+ *
+ * Parameters:
+ *      g - group the packet was received on
+ *      buf - the packet
+ *      len - its length in bytes
+ *      rxts - when it was received
+ *
+ * Returns:
+ *      nonzero if the header isn't there
+ */
+static int seq_track(struct mcgroup *g, uint8_t *buf, int len,
+                     struct timespec *rxts)
+{
+    struct seqsender *ss;
+    uint32_t id;
+    uint64_t seq, off, bit;
+    int64_t transit, d, j;
+    struct histogram *h;
+    int first = 0, straggler = 0;
+
+    if (len < SEQ_HDR_LEN || get32(buf) != SEQ_MAGIC) {
+        return(1);
+    }
+    id = get32(buf + 4);
+    seq = get64(buf + 8);
+    transit = ((int64_t)rxts->tv_sec) * 1000000000 + rxts->tv_nsec -
+        (int64_t)get64(buf + 16);
+
+    /* which sender is it from? */
+    for (ss = g->mg_senders; ss != NULL; ss = ss->ss_next) {
+        if (ss->ss_id == id) {
+            break;
+        }
+    }
+    if (ss == NULL) {
+        /* new one; count from here, without guessing what was before */
+        ss = calloc(1, sizeof(*ss));
+        ss->ss_id = id;
+        ss->ss_lo = ss->ss_hi = seq;
+        ss->ss_next = g->mg_senders;
+        g->mg_senders = ss;
+        first = 1;
+    } else if (seq > ss->ss_hi) {
+        /* the usual case, just beyond ss_hi; or maybe a gap */
+        g->mg_sq_lost += seq - ss->ss_hi - 1;
+        if (seq - ss->ss_hi >= SEQ_WINDOW) {
+            memset(ss->ss_bits, 0, sizeof(ss->ss_bits));
+        } else {
+            for (off = ss->ss_hi + 1; off < seq; ++off) {
+                bit = off % SEQ_WINDOW;
+                ss->ss_bits[bit / 64] &= ~(((uint64_t)1) << (bit % 64));
+            }
+        }
+        ss->ss_hi = seq;
+    } else if (ss->ss_hi - seq < SEQ_WINDOW) {
+        /* behind ss_hi, but not too far behind to tell what it is */
+        bit = seq % SEQ_WINDOW;
+        if (ss->ss_bits[bit / 64] & (((uint64_t)1) << (bit % 64))) {
+            ++g->mg_sq_dup;
+            ss->ss_far = 0;
+            return(0);
+        }
+        ++g->mg_sq_reord;
+        if (seq < ss->ss_lo) {
+            ss->ss_lo = seq; /* from before we started counting */
+        } else {
+            --g->mg_sq_lost; /* we counted it as missing */
+        }
+    } else if (++ss->ss_far < SEQ_RESTART) {
+        /*
+         * Way behind: a straggler, too old to tell whether it was counted
+         * missing, or already received; just call it out of order.
+         */
+        ++g->mg_sq_reord;
+        straggler = 1;
+    } else {
+        /* way behind, again and again: the sender probably restarted */
+        memset(ss->ss_bits, 0, sizeof(ss->ss_bits));
+        ss->ss_lo = ss->ss_hi = seq;
+    }
+
+    if (!straggler) {
+        /* record that this one has been received */
+        bit = seq % SEQ_WINDOW;
+        ss->ss_bits[bit / 64] |= ((uint64_t)1) << (bit % 64);
+        ss->ss_far = 0;
+    }
+
+    /* latency, and jitter as in RFC 3550 section 6.4.1 */
+    h = HIST_GET(&g->mg_lat);
+    if (h == NULL) {
+        h = calloc(1, sizeof(*h));
+        if (h == NULL) {
+            errout("out of memory for -d seq latency");
+            exit(1);
+        }
+        HIST_PUT(&g->mg_lat, h);
+    }
+    hist_add(h, transit);
+    if (!first) {
+        d = transit - ss->ss_transit;
+        if (d < 0) {
+            d = -d;
+        }
+        j = HCOUNT_GET(&h->hi_jitter);
+        HCOUNT_SET(&h->hi_jitter, j + (d - j) / 16);
+    }
+    ss->ss_transit = transit;
+    return(0);
+}
+
+/** ** latency histograms ** **/
+
+/*
+ * hist_add()
+ * Add a sample 'v', in nanoseconds, to histogram 'h'.  Negative values,
+ * which can happen when the sender's and receiver's clocks disagree,
+ * are counted as zero.
+ */
+static void hist_add(struct histogram *h, int64_t v)
+{
+    if (v < 0) {
+        HCOUNT_ADD(&h->hi_negative, 1);
+        v = 0;
+    }
+    HCOUNT_ADD(&h->hi_bins[hist_bin(v)], 1);
+}
+
+/*
+ * hist_bin()
+ * Return the index in hi_bins[] of the bin for value 'v'.
+ */
+static int hist_bin(uint64_t v)
+{
+    int msb, shift;
+
+    if (v < 2 * HIST_SUB) {
+        return(v); /* small values, one bin each */
+    }
+    for (msb = 0; (v >> msb) > 1; ++msb)
+        ;
+    shift = msb - HIST_SUB_BITS;
+    return((shift + 1) * HIST_SUB + (int)(v >> shift) - HIST_SUB);
+}
+
+/*
+ * hist_value()
+ * Return the middle of the range of values that go in bin number 'bin'
+ * of a histogram.
+ */
+static uint64_t hist_value(int bin)
+{
+    int shift;
+
+    if (bin < 2 * HIST_SUB) {
+        return(bin);
+    }
+    shift = bin / HIST_SUB - 1;
+    return((((uint64_t)(HIST_SUB + bin % HIST_SUB)) << shift) +
+           (((uint64_t)1) << shift) / 2);
+}
+
+/*
+ * lat_reports()
+ * In receive (-r) mode with -L: if it's time, report latency statistics
+ * for each group; and with -C, for joining and leaving.  Returns the
+ * number of microseconds until next time.
+ */
+static long lat_reports(struct config *cfg)
+{
+    int64_t now = mono_ns();
+    int i;
+
+    if (cfg->cfg_lat_next == 0) {
+        /* first time: wait a whole period */
+        cfg->cfg_lat_next = now + cfg->cfg_lat_us * (int64_t)1000;
+    }
+    if (now >= cfg->cfg_lat_next) {
+        for (i = 0; i < cfg->cfg_ngroups; ++i) {
+            lat_report(cfg, cfg->cfg_groups[i]);
+        }
+        if (cfg->cfg_churnstats != NULL) {
+            churn_report(cfg);
+        }
+        cfg->cfg_lat_next += cfg->cfg_lat_us * (int64_t)1000;
+        if (cfg->cfg_lat_next <= now) {
+            /* way behind; don't try to catch up */
+            cfg->cfg_lat_next = now + cfg->cfg_lat_us * (int64_t)1000;
+        }
+    }
+    return((cfg->cfg_lat_next - now + 999) / 1000);
+}
+
+/*
+ * lat_report()
+ * Report latency statistics for one group, for the packets received since
+ * the last report.  If there weren't any, reports nothing.
+ */
+static void lat_report(struct config *cfg, struct mcgroup *g)
+{
+    struct histogram *h = HIST_GET(&g->mg_lat);
+    uint64_t n, val[4], neg;
+    char buf[512];
+    int pos;
+
+    if (h == NULL) {
+        return; /* no "-d seq" packets ever */
+    }
+    n = hist_since(h, val);
+    if (n == 0) {
+        return;
+    }
+
+    pos = snprintf(buf, sizeof(buf),
+                   "%llu packets, p50 %.1fus, p99 %.1fus, p99.9 %.1fus,"
+                   " max %.1fus, jitter %.1fus",
+                   (unsigned long long)n, val[0] / 1e+3, val[1] / 1e+3,
+                   val[2] / 1e+3, val[3] / 1e+3,
+                   HCOUNT_GET(&h->hi_jitter) / 1e+3);
+    neg = HCOUNT_GET(&h->hi_negative);
+    if (neg != h->hi_prev_negative && pos < sizeof(buf)) {
+        /* the clocks must not be in sync */
+        snprintf(buf + pos, sizeof(buf) - pos, ", %llu negative",
+                 (unsigned long long)(neg - h->hi_prev_negative));
+        h->hi_prev_negative = neg;
+    }
+    emit(cfg, g, reported_event_lat, buf);
+}
+
+/*
+ * hist_since()
+ * Find the median, 99th and 99.9th percentiles, and maximum, val[0-3],
+ * of the samples added to histogram 'h' since the last time; and start
+ * counting again from here.  Returns how many samples there were; if
+ * none, val[] is left alone.
+ */
+static uint64_t hist_since(struct histogram *h, uint64_t *val)
+{
+    static const double pct[] = { 0.5, 0.99, 0.999 };
+    uint64_t n = 0, cum, c;
+    int i, p;
+
+    /* how many samples, in each bin, since last time? */
+    for (i = 0; i < HIST_BINS; ++i) {
+        c = HCOUNT_GET(&h->hi_bins[i]);
+        n += c - h->hi_prev[i];
+    }
+    if (n == 0) {
+        return(0);
+    }
+
+    /* percentiles */
+    cum = 0;
+    p = 0;
+    val[3] = 0;
+    for (i = 0; i < HIST_BINS; ++i) {
+        c = HCOUNT_GET(&h->hi_bins[i]);
+        if (c == h->hi_prev[i]) {
+            continue;
+        }
+        cum += c - h->hi_prev[i];
+        h->hi_prev[i] = c;
+        while (p < 3 && cum >= ceil(pct[p] * n)) {
+            val[p++] = hist_value(i);
+        }
+        val[3] = hist_value(i);
+    }
+    while (p < 3) {
+        val[p++] = val[3]; /* shouldn't happen */
+    }
+    return(n);
+}
+
+/** ** joining and leaving groups over and over (-C) ** **/
+
+/*
+ * churn_new()
+ * For -C: set up to join and leave groups[0 - ngroups-1], at their share
+ * of the rate.  They start out not joined.  'seed' starts off the
+ * pseudorandom numbers for "random".
+ */
+static struct churn *churn_new(struct config *cfg, struct mcgroup **groups,
+                               int ngroups, uint64_t seed)
+{
+    struct churn *ch;
+    int i;
+
+    ch = calloc(1, sizeof(*ch));
+    if (ch == NULL) {
+        errout("out of memory for -C");
+        exit(1);
+    }
+    ch->ch_size = ngroups;
+    ch->ch_left = calloc(ngroups, sizeof(ch->ch_left[0]));
+    ch->ch_joined = calloc(ngroups, sizeof(ch->ch_joined[0]));
+    if (ch->ch_left == NULL || ch->ch_joined == NULL) {
+        errout("out of memory for -C");
+        exit(1);
+    }
+    for (i = 0; i < ngroups; ++i) {
+        ch->ch_left[i] = groups[i];
+    }
+    ch->ch_lhead = ch->ch_jhead = 0;
+    ch->ch_nleft = ngroups;
+    ch->ch_njoined = 0;
+    ch->ch_rate = cfg->cfg_churn_rate * ngroups / cfg->cfg_ngroups;
+    ch->ch_next = mono_ns();
+    ch->ch_carry = 0;
+    ch->ch_rand = (seed * 0x9e3779b97f4a7c15ULL) | 1; /* never 0 */
+    return(ch);
+}
+
+/*
+ * churn_ops()
+ * For -C: leave the groups that have been joined long enough, and join
+ * the ones that are due to be, up to CHURN_BURST at a time.  Called by
+ * the thread that receives the groups' packets.
+ *
+ * Parameters:
+ *      cfg - configuration
+ *      ch - the groups, and when to join and leave them
+ *      now - the current time, mono_ns()
+ *
+ * Returns:
+ *      when it should be called again, mono_ns()
+ */
+static int64_t churn_ops(struct config *cfg, struct churn *ch, int64_t now)
+{
+    struct mcgroup *g;
+    int64_t next;
+    double ns;
+    int n, k, was;
+
+    was = prof_enter(prof_churn);
+
+    /* leave the ones that have been joined long enough */
+    while (ch->ch_njoined > 0 &&
+           ch->ch_joined[ch->ch_jhead]->mg_ch_tdue <= now) {
+        g = ch->ch_joined[ch->ch_jhead];
+        ch->ch_jhead = (ch->ch_jhead + 1) % ch->ch_size;
+        --ch->ch_njoined;
+        churn_leave(cfg, g);
+        ch->ch_left[(ch->ch_lhead + ch->ch_nleft++) % ch->ch_size] = g;
+    }
+
+    /* join the ones that are due */
+    if (ch->ch_next < now - CHURN_MAX_LAG) {
+        /* way behind; don't try to catch up */
+        ch->ch_next = now;
+        ch->ch_carry = 0;
+    }
+    for (n = 0; n < CHURN_BURST && ch->ch_nleft > 0 && ch->ch_next <= now;
+         ++n) {
+        if (cfg->cfg_churn_random) {
+            /* any of them, not just the one that's waited longest */
+            k = (ch->ch_lhead + (int)(churn_random(ch) * ch->ch_nleft)) %
+                ch->ch_size;
+            g = ch->ch_left[k];
+            ch->ch_left[k] = ch->ch_left[ch->ch_lhead];
+            ch->ch_left[ch->ch_lhead] = g;
+        }
+        g = ch->ch_left[ch->ch_lhead];
+        ch->ch_lhead = (ch->ch_lhead + 1) % ch->ch_size;
+        --ch->ch_nleft;
+        if (churn_join(cfg, g, ch->ch_next)) {
+            ch->ch_joined[(ch->ch_jhead + ch->ch_njoined++) % ch->ch_size] =
+                g;
+        } else {
+            /* didn't work; it can wait its turn to try again */
+            ch->ch_left[(ch->ch_lhead + ch->ch_nleft++) % ch->ch_size] = g;
+        }
+
+        /* the next one's due evenly spaced; or with "random", Poisson */
+        ns = 1e+9 / ch->ch_rate;
+        if (cfg->cfg_churn_random) {
+            ns *= -log(1.0 - churn_random(ch));
+        }
+        ns += ch->ch_carry;
+        ch->ch_next += (int64_t)ns;
+        ch->ch_carry = ns - (int64_t)ns;
+    }
+    if (ch->ch_nleft == 0 && ch->ch_next < now) {
+        /* all joined; the next join waits for one to leave, no longer */
+        ch->ch_next = now;
+        ch->ch_carry = 0;
+    }
+
+    /* half an hour, if there's nothing to do */
+    next = (ch->ch_nleft > 0) ? ch->ch_next : now + 1800 * (int64_t)1000000000;
+    if (ch->ch_njoined > 0 && ch->ch_joined[ch->ch_jhead]->mg_ch_tdue < next) {
+        next = ch->ch_joined[ch->ch_jhead]->mg_ch_tdue;
+    }
+    prof_leave(was);
+    return(next);
+}
+
+/*
+ * churn_join()
+ * For -C: join group 'g', which was due to be joined at 'due', mono_ns();
+ * it's due to leave cfg_churn_hold after that.  If it was left before,
+ * that measurement is done: the last packet since, if any, was the last.
+ * Unlike group_filter(), failing to join isn't fatal: it's going to be
+ * tried again and again anyway.  Returns nonzero if it joined.
+ */
+static int churn_join(struct config *cfg, struct mcgroup *g, int64_t due)
+{
+    struct churnstats *cs = cfg->cfg_churnstats;
+    struct seqsender *ss;
+    struct timespec ts;
+    char errbuf[256];
+#ifdef DO_SOURCES
+    struct sockaddr_storage *sa;
+#endif /* DO_SOURCES */
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    if (g->mg_ch_tleave) {
+        hist_add(&cs->cs_leave, (g->mg_ch_tlate > g->mg_ch_tleave) ?
+                 (g->mg_ch_tlate - g->mg_ch_tleave) : 0);
+        g->mg_ch_tleave = g->mg_ch_tlate = 0;
+    }
+    while (g->mg_senders != NULL) {
+        /* what was sent while not joined wasn't lost; count afresh */
+        ss = g->mg_senders;
+        g->mg_senders = ss->ss_next;
+        free(ss);
+    }
+    g->mg_ch_tdue = (cfg->cfg_churn_hold < 0) ? INT64_MAX :
+        (due + cfg->cfg_churn_hold);
+    g->mg_ch_tjoin = ts.tv_sec * (int64_t)1000000000 + ts.tv_nsec;
+    g->mg_ch_joined = g->mg_ch_wait = 1;
+
+    /* joining is applying the whole source filter */
+    errbuf[0] = '\0';
+#ifdef DO_SOURCES
+    sa = srcs_sockaddrs(&g->mg_sources);
+#endif /* DO_SOURCES */
+    prof_syscall();
+    setup_mcast_listen(g->mg_sok, &g->mg_intf,
+                       (void *)&g->mg_grp, g->mg_grplen,
+#ifdef DO_SOURCES
+                       g->mg_sfmode, g->mg_sources.sl_n, sa,
+#endif /* DO_SOURCES */
+                       &g->mg_sml_state,
+                       errbuf, sizeof(errbuf));
+#ifdef DO_SOURCES
+    free(sa);
+#endif /* DO_SOURCES */
+    if (errbuf[0]) {
+        if (cfg->cfg_ngroups > 1) {
+            errout("%s: %s", g->mg_label, errbuf);
+        } else {
+            errout("%s", errbuf);
+        }
+        errthrottle();
+        g->mg_ch_joined = g->mg_ch_wait = 0;
+        return(0);
+    }
+#ifdef DO_SOURCES
+    /* the target/new settings have become the current/old ones */
+    g->mg_osfmode = g->mg_sfmode;
+    srcs_copy(&g->mg_osources, &g->mg_sources);
+    g->mg_sfull = 0;
+    g->mg_sadd.sl_n = g->mg_ssub.sl_n = 0;
+#endif /* DO_SOURCES */
+    g->mg_reapply = 0;
+    HCOUNT_ADD(&cs->cs_joins, 1);
+    return(1);
+}
+
+/*
+ * churn_leave()
+ * For -C: leave group 'g', and start measuring how long its packets keep
+ * coming.
+ */
+static void churn_leave(struct config *cfg, struct mcgroup *g)
+{
+    struct churnstats *cs = cfg->cfg_churnstats;
+    struct timespec ts;
+    char errbuf[256];
+
+    if (g->mg_ch_wait) {
+        /* no packet came the whole time it was joined */
+        HCOUNT_ADD(&cs->cs_nopkt, 1);
+        g->mg_ch_wait = 0;
+    }
+    clock_gettime(CLOCK_REALTIME, &ts);
+    g->mg_ch_tleave = ts.tv_sec * (int64_t)1000000000 + ts.tv_nsec;
+    g->mg_ch_tlate = 0;
+    g->mg_ch_joined = 0;
+    prof_syscall();
+    leave_mcast_group(g->mg_sok, &g->mg_intf,
+                      (void *)&g->mg_grp, g->mg_grplen,
+                      &g->mg_sml_state, errbuf, sizeof(errbuf));
+    if (errbuf[0]) {
+        if (cfg->cfg_ngroups > 1) {
+            errout("%s: %s", g->mg_label, errbuf);
+        } else {
+            errout("%s", errbuf);
+        }
+        errthrottle();
+    }
+    HCOUNT_ADD(&cs->cs_leaves, 1);
+}
+
+/*
+ * churn_rx()
+ * For -C: 'n' packets were received on group 'g', in 'rb'.  The first
+ * since it was joined tells how long joining took; and if it's been left,
+ * they tell how long the packets keep coming.  Packets received before
+ * (by their timestamps) don't count for either.
+ */
+static void churn_rx(struct config *cfg, struct mcgroup *g,
+                     struct rxbufs *rb, int n)
+{
+    int64_t t;
+    int i;
+
+    for (i = 0; i < n; ++i) {
+        t = rb->rb_ts[i].tv_sec * (int64_t)1000000000 + rb->rb_ts[i].tv_nsec;
+        if (g->mg_ch_wait && t >= g->mg_ch_tjoin) {
+            hist_add(&cfg->cfg_churnstats->cs_join, t - g->mg_ch_tjoin);
+            g->mg_ch_wait = 0;
+        }
+        if (g->mg_ch_tleave && t > g->mg_ch_tlate) {
+            g->mg_ch_tlate = t;
+        }
+    }
+}
+
+/*
+ * churn_random()
+ * For "-C ...:random": return a pseudorandom number x, 0 <= x < 1.
+ */
+static double churn_random(struct churn *ch)
+{
+    ch->ch_rand ^= ch->ch_rand << 13;
+    ch->ch_rand ^= ch->ch_rand >> 7;
+    ch->ch_rand ^= ch->ch_rand << 17;
+    return((ch->ch_rand >> 11) * (1.0 / 9007199254740992.0));
+}
+
+/*
+ * churn_report()
+ * For -C with -L: report how many times groups were joined and left since
+ * the last report, and how long it took: from joining to the first packet,
+ * and from leaving to the last.  If nothing happened, reports nothing.
+ */
+static void churn_report(struct config *cfg)
+{
+    struct churnstats *cs = cfg->cfg_churnstats;
+    uint64_t joins, leaves, nopkt, nj, nl, jv[4], lv[4];
+    char buf[512];
+    int pos;
+
+    joins = HCOUNT_GET(&cs->cs_joins);
+    leaves = HCOUNT_GET(&cs->cs_leaves);
+    nopkt = HCOUNT_GET(&cs->cs_nopkt);
+    nj = hist_since(&cs->cs_join, jv);
+    nl = hist_since(&cs->cs_leave, lv);
+    if (joins == cs->cs_prev_joins && leaves == cs->cs_prev_leaves &&
+        nj == 0 && nl == 0) {
+        return;
+    }
+
+    pos = snprintf(buf, sizeof(buf), "%llu joins, %llu leaves, %llu now joined",
+                   (unsigned long long)(joins - cs->cs_prev_joins),
+                   (unsigned long long)(leaves - cs->cs_prev_leaves),
+                   (unsigned long long)(joins - leaves));
+    if (nj > 0 && pos < sizeof(buf)) {
+        pos += snprintf(buf + pos, sizeof(buf) - pos,
+                        "; join to first packet %llu times, p50 %.1fus,"
+                        " p99 %.1fus, p99.9 %.1fus, max %.1fus",
+                        (unsigned long long)nj, jv[0] / 1e+3, jv[1] / 1e+3,
+                        jv[2] / 1e+3, jv[3] / 1e+3);
+    }
+    if (nl > 0 && pos < sizeof(buf)) {
+        pos += snprintf(buf + pos, sizeof(buf) - pos,
+                        "; leave to last packet %llu times, p50 %.1fus,"
+                        " p99 %.1fus, p99.9 %.1fus, max %.1fus",
+                        (unsigned long long)nl, lv[0] / 1e+3, lv[1] / 1e+3,
+                        lv[2] / 1e+3, lv[3] / 1e+3);
+    }
+    if (nopkt != cs->cs_prev_nopkt && pos < sizeof(buf)) {
+        /* joined, and left again, without a packet */
+        snprintf(buf + pos, sizeof(buf) - pos, "; %llu with no packet",
+                 (unsigned long long)(nopkt - cs->cs_prev_nopkt));
+    }
+    cs->cs_prev_joins = joins;
+    cs->cs_prev_leaves = leaves;
+    cs->cs_prev_nopkt = nopkt;
+    emit(cfg, NULL, reported_event_churn, buf);
+}
+
+/** ** counters for other programs: shared memory, HTTP ** **/
+
+/*
+ * group_counters()
+ * Fill in 'gc' with the counters for group 'g' as they are now.  The
+ * latency summary is over the whole run.
+ */
+static void group_counters(struct config *cfg, struct mcgroup *g,
+                           struct grpcount *gc)
+{
+    static const double pct[] = { 0.5, 0.99 };
+    struct histogram *h = HIST_GET(&g->mg_lat);
+    uint64_t n, cum, lat[2] = { 0, 0 }, max = 0;
+    int i, p;
+
+    n = 0;
+    if (h != NULL) {
+        for (i = 0; i < HIST_BINS; ++i) {
+            n += HCOUNT_GET(&h->hi_bins[i]);
+        }
+        cum = 0;
+        p = 0;
+        for (i = 0; i < HIST_BINS && n > 0; ++i) {
+            cum += HCOUNT_GET(&h->hi_bins[i]);
+            while (p < 2 && cum >= ceil(pct[p] * n)) {
+                lat[p++] = hist_value(i);
+            }
+            if (cum >= n) {
+                max = hist_value(i);
+                break;
+            }
+        }
+    }
+    gc->gc_lat_n = n;
+    gc->gc_lat_p50 = lat[0];
+    gc->gc_lat_p99 = lat[1];
+    gc->gc_lat_max = max;
+    gc->gc_jitter = h ? HCOUNT_GET(&h->hi_jitter) : 0;
+
+    gc->gc_up = g->mg_up;
+    if (cfg->cfg_dir > 0) {
+        gc->gc_pkts = g->mg_tx_pkts;
+        gc->gc_bytes = g->mg_tx_bytes;
+    } else {
+        gc->gc_pkts = HCOUNT_GET(&g->mg_stats.st_pkts);
+        gc->gc_bytes = HCOUNT_GET(&g->mg_stats.st_bytes);
+    }
+    gc->gc_bad = HCOUNT_GET(&g->mg_stats.st_bad);
+    gc->gc_trunc = HCOUNT_GET(&g->mg_stats.st_trunc);
+    gc->gc_kdrops = HCOUNT_GET(&g->mg_stats.st_kdrops);
+#ifdef DO_WORKERS
+    if (cfg->cfg_nworkers > 0) {
+        gc->gc_lost = atomic_load(&g->mg_wk_lost);
+        gc->gc_reord = atomic_load(&g->mg_wk_reord);
+        gc->gc_dup = atomic_load(&g->mg_wk_dup);
+        gc->gc_tlast = atomic_load(&g->mg_wk_trx);
+        return;
+    }
+#endif /* DO_WORKERS */
+    gc->gc_lost = g->mg_sq_lost;
+    gc->gc_reord = g->mg_sq_reord;
+    gc->gc_dup = g->mg_sq_dup;
+    gc->gc_tlast = g->mg_stats.st_tlast;
+}
+
+#ifdef HAVE_SHM_OPEN
+
+/*
+ * shm_option()
+ * Handle the "-M name[:sec]" option.  The segment itself is set up
+ * later, by shm_setup(), once the groups are known.
+ */
+static enum command_action shm_option(struct config *cfg, char *arg)
+{
+    char *colon;
+    double f = 1.0;
+
+    if (cfg->cfg_shm_name) {
+        free(cfg->cfg_shm_name);
+    }
+    cfg->cfg_shm_name = malloc(strlen(arg) + 2);
+    sprintf(cfg->cfg_shm_name, "%s%s", (arg[0] == '/') ? "" : "/", arg);
+    colon = strchr(cfg->cfg_shm_name, ':');
+    if (colon) {
+        *colon = '\0';
+        f = atof(colon + 1);
+    }
+    if (cfg->cfg_shm_name[1] == '\0' || strchr(cfg->cfg_shm_name + 1, '/')) {
+        errout("-M name must be nonempty and not contain '/'");
+        return(command_action_error);
+    }
+    if (!(f >= 0.01 && f <= 3600.0)) {
+        errout("-M period must be in range 0.01-3600 seconds");
+        return(command_action_error);
+    }
+    cfg->cfg_shm_us = rint(f * 1e+6);
+    return(command_action_none);
+}
+
+/*
+ * shm_setup()
+ * Create the "-M" shared memory segment, and fill in what doesn't change.
+ * If there's one by the same name already, it's only replaced if it's
+ * left over from an oligocast that's no longer running (shm_stale()).
+ * Exits on failure.
+ */
+static void shm_setup(struct config *cfg)
+{
+    struct shmgroup *sg;
+    struct mcgroup *g;
+    struct timespec now;
+    int fd, i;
+
+    cfg->cfg_shm_len = sizeof(struct shmhdr) +
+        cfg->cfg_ngroups * sizeof(struct shmgroup);
+    fd = shm_open(cfg->cfg_shm_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST && shm_stale(cfg)) {
+        shm_unlink(cfg->cfg_shm_name); /* left over from before */
+        fd = shm_open(cfg->cfg_shm_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0 && errno == EEXIST) {
+        errout("-M: shared memory %s is in use; is oligocast already"
+               " running?", cfg->cfg_shm_name);
+        exit(1);
+    }
+    if (fd < 0) {
+        errout("failed to create shared memory %s: %s",
+               cfg->cfg_shm_name, strerror(errno));
+        exit(1);
+    }
+    if (ftruncate(fd, cfg->cfg_shm_len) < 0) {
+        errout("failed to size shared memory %s: %s",
+               cfg->cfg_shm_name, strerror(errno));
+        exit(1);
+    }
+    cfg->cfg_shm = mmap(NULL, cfg->cfg_shm_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    if (cfg->cfg_shm == MAP_FAILED) {
+        errout("failed to map shared memory %s: %s",
+               cfg->cfg_shm_name, strerror(errno));
+        exit(1);
+    }
+    close(fd);
+
+    /* it's all zeroes now; fill in the header, and group names */
+    sg = (struct shmgroup *)(cfg->cfg_shm + 1);
+    for (i = 0; i < cfg->cfg_ngroups; ++i) {
+        g = cfg->cfg_groups[i];
+        sg[i].sg_idx = i;
+        snprintf(sg[i].sg_name, sizeof(sg[i].sg_name), "%s",
+                 g->mg_label ? : cfg->cfg_label);
+    }
+    clock_gettime(CLOCK_REALTIME, &now);
+    cfg->cfg_shm->sh_version = SHM_VERSION;
+    cfg->cfg_shm->sh_hdrlen = sizeof(struct shmhdr);
+    cfg->cfg_shm->sh_reclen = sizeof(struct shmgroup);
+    cfg->cfg_shm->sh_ngroups = cfg->cfg_ngroups;
+    cfg->cfg_shm->sh_pid = getpid();
+    cfg->cfg_shm->sh_start = now.tv_sec * (uint64_t)1000000000 + now.tv_nsec;
+    cfg->cfg_shm->sh_period_us = cfg->cfg_shm_us;
+    cfg->cfg_shm->sh_dir = (cfg->cfg_dir > 0) ? 1 : 2;
+    atomic_thread_fence(memory_order_release);
+    memcpy(cfg->cfg_shm->sh_magic, SHM_MAGIC, sizeof(cfg->cfg_shm->sh_magic));
+    cfg->cfg_shm_next = 0;
+}
+
+/*
+ * shm_update()
+ * With -M: if it's time, update the counters in shared memory.  Returns
+ * the number of microseconds until next time.
+ */
+static long shm_update(struct config *cfg)
+{
+    struct shmgroup *sg = (struct shmgroup *)(cfg->cfg_shm + 1);
+    struct timespec ts;
+    int64_t now = mono_ns();
+    int i;
+
+    if (now >= cfg->cfg_shm_next) {
+        for (i = 0; i < cfg->cfg_ngroups; ++i) {
+            shm_group(cfg, cfg->cfg_groups[i], &sg[i]);
+        }
+        clock_gettime(CLOCK_REALTIME, &ts);
+        atomic_store_explicit(&cfg->cfg_shm->sh_updated,
+                              ts.tv_sec * (uint64_t)1000000000 + ts.tv_nsec,
+                              memory_order_release);
+        cfg->cfg_shm_next = now + cfg->cfg_shm_us * (int64_t)1000;
+    }
+    return((cfg->cfg_shm_next - now + 999) / 1000);
+}
+
+/*
+ * shm_group()
+ * Update the shared memory counters 'sg' for group 'g'.
+ */
+static void shm_group(struct config *cfg, struct mcgroup *g,
+                      struct shmgroup *sg)
+{
+    struct grpcount gc;
+    uint64_t seq;
+
+    /* get the numbers before taking the "lock" */
+    group_counters(cfg, g, &gc);
+
+    /* now update it, with sg_seq odd meanwhile */
+    seq = atomic_load_explicit(&sg->sg_seq, memory_order_relaxed);
+    atomic_store_explicit(&sg->sg_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    sg->sg_up = gc.gc_up;
+    sg->sg_pkts = gc.gc_pkts;
+    sg->sg_bytes = gc.gc_bytes;
+    sg->sg_bad = gc.gc_bad;
+    sg->sg_lost = gc.gc_lost;
+    sg->sg_reord = gc.gc_reord;
+    sg->sg_dup = gc.gc_dup;
+    sg->sg_tlast = gc.gc_tlast;
+    sg->sg_lat_p50 = gc.gc_lat_p50;
+    sg->sg_lat_p99 = gc.gc_lat_p99;
+    sg->sg_lat_max = gc.gc_lat_max;
+    sg->sg_jitter = gc.gc_jitter;
+    sg->sg_trunc = gc.gc_trunc;
+    atomic_store_explicit(&sg->sg_seq, seq + 2, memory_order_release);
+}
+
+/*
+ * shm_stale()
+ * See whether the "-M" shared memory segment that's there already is
+ * left over: empty, or from an oligocast (sh_pid) that's not running any
+ * more.  Returns nonzero if so.  One that's not oligocast's is left alone.
+ */
+static int shm_stale(struct config *cfg)
+{
+    struct shmhdr *sh;
+    struct stat st;
+    int fd, stale = 0;
+
+    fd = shm_open(cfg->cfg_shm_name, O_RDONLY, 0);
+    if (fd < 0) {
+        return(0);
+    }
+    if (fstat(fd, &st) == 0 && st.st_size == 0) {
+        stale = 1; /* never got going */
+    } else if (fstat(fd, &st) == 0 && st.st_size >= sizeof(*sh)) {
+        sh = mmap(NULL, sizeof(*sh), PROT_READ, MAP_SHARED, fd, 0);
+        if (sh != MAP_FAILED) {
+            if (!memcmp(sh->sh_magic, "\0\0\0\0", sizeof(sh->sh_magic))) {
+                stale = 1; /* never got going */
+            } else if (!memcmp(sh->sh_magic, SHM_MAGIC,
+                               sizeof(sh->sh_magic))) {
+                stale = (kill(sh->sh_pid, 0) < 0 && errno == ESRCH);
+            }
+            munmap(sh, sizeof(*sh));
+        }
+    }
+    close(fd);
+    return(stale);
+}
+
+/*
+ * shm_remove()
+ * Remove the "-M" shared memory segment, when exiting.
+ */
+static void shm_remove(struct config *cfg)
+{
+    if (cfg->cfg_shm != NULL) {
+        shm_unlink(cfg->cfg_shm_name);
+    }
+}
+#endif /* HAVE_SHM_OPEN */
+
+/*
+ * The metrics served by -H, for each group; see http_metrics().
+ */
+#define HM_RX   1 /* only when receiving */
+#define HM_SEQ  2 /* only with "-d seq" */
+#define HM_NS   4 /* value is nanoseconds, shown as seconds */
+static const struct {
+    char *      hm_name;    /* metric family name */
+    char *      hm_type;    /* its type */
+    char *      hm_help;    /* description */
+    size_t      hm_off;     /* offset of value in struct grpcount */
+    int         hm_flags;   /* HM_* */
+} http_grpmetrics[] = {
+    { "oligocast_up", "gauge",
+      "Whether packets are being received on the group",
+      offsetof(struct grpcount, gc_up), HM_RX },
+    { "oligocast_packets", "counter", "Packets sent or received",
+      offsetof(struct grpcount, gc_pkts), 0 },
+    { "oligocast_bytes", "counter", "Bytes of data sent or received",
+      offsetof(struct grpcount, gc_bytes), 0 },
+    { "oligocast_mismatched", "counter",
+      "Packets received not matching the -d option",
+      offsetof(struct grpcount, gc_bad), HM_RX },
+    { "oligocast_truncated", "counter",
+      "Packets received too big for the buffer (-o rxlen), cut short",
+      offsetof(struct grpcount, gc_trunc), HM_RX },
+    { "oligocast_kernel_drops", "counter",
+      "Packets the kernel dropped because the socket buffer was full",
+      offsetof(struct grpcount, gc_kdrops), HM_RX },
+    { "oligocast_last_packet_time_seconds", "gauge",
+      "When the last packet was received",
+      offsetof(struct grpcount, gc_tlast), HM_RX | HM_NS },
+    { "oligocast_seq_lost", "counter", "Sequence numbered packets missing",
+      offsetof(struct grpcount, gc_lost), HM_RX | HM_SEQ },
+    { "oligocast_seq_reordered", "counter",
+      "Sequence numbered packets arriving out of order",
+      offsetof(struct grpcount, gc_reord), HM_RX | HM_SEQ },
+    { "oligocast_seq_duplicated", "counter",
+      "Sequence numbered packets arriving more than once",
+      offsetof(struct grpcount, gc_dup), HM_RX | HM_SEQ },
+    { "oligocast_latency_max_seconds", "gauge",
+      "Highest one way latency seen",
+      offsetof(struct grpcount, gc_lat_max), HM_RX | HM_SEQ | HM_NS },
+    { "oligocast_jitter_seconds", "gauge", "Jitter, as in RFC 3550",
+      offsetof(struct grpcount, gc_jitter), HM_RX | HM_SEQ | HM_NS },
+};
+
+/*
+ * http_setup()
+ * Start the -H metrics server, listening on cfg_http_addr, which is
+ * "port" or "address:port", where the address might be IPv6 in brackets.
+ * Exits on failure.
+ */
+static void http_setup(struct config *cfg, struct oligocast_evloop *evl)
+{
+    struct httpsrv *hs;
+    struct sockaddr_storage sa;
+    struct sockaddr_in *a4 = (void *)&sa;
+    struct sockaddr_in6 *a6 = (void *)&sa;
+    char ga[128], buf[512], *addr, *port, *lbl, *e;
+    struct mcgroup *g;
+    int i, j, arg = 1;
+
+    /* parse the address */
+    addr = strdup(cfg->cfg_http_addr);
+    port = strrchr(addr, ':');
+    if (port == NULL) {
+        port = addr;
+        addr = "";
+    } else {
+        *(port++) = '\0';
+        if (addr[0] == '[' && addr[strlen(addr) - 1] == ']') {
+            ++addr;
+            addr[strlen(addr) - 1] = '\0';
+        }
+    }
+    memset(&sa, 0, sizeof(sa));
+    if (addr[0] == '\0') {
+        a4->sin_family = AF_INET;
+        a4->sin_addr.s_addr = htonl(INADDR_ANY);
+    } else if (inet_pton(AF_INET, addr, &a4->sin_addr) > 0) {
+        a4->sin_family = AF_INET;
+    } else if (inet_pton(AF_INET6, addr, &a6->sin6_addr) > 0) {
+        a6->sin6_family = AF_INET6;
+    } else {
+        errout("-H: bad address '%s'", addr);
+        exit(1);
+    }
+    i = strtol(port, &e, 10);
+    if (*port == '\0' || *e != '\0' || i < 1 || i > 65535) {
+        errout("-H: bad port number '%s'", port);
+        exit(1);
+    }
+    if (sa.ss_family == AF_INET6) {
+        a6->sin6_port = htons(i);
+    } else {
+        a4->sin_port = htons(i);
+    }
+
+    /* set up the listening socket */
+    hs = cfg->cfg_http = calloc(1, sizeof(*hs));
+    hs->hs_evl = evl;
+    hs->hs_fd = socket(sa.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (hs->hs_fd < 0) {
+        errout("-H: failed to create socket: %s", strerror(errno));
+        exit(1);
+    }
+    if (setsockopt(hs->hs_fd, SOL_SOCKET, SO_REUSEADDR,
+                   &arg, sizeof(arg)) < 0) {
+        errout("-H: failed to set SO_REUSEADDR: %s", strerror(errno));
+        /* go on and try, in spite of this error */
+    }
+    if (bind(hs->hs_fd, (void *)&sa, (sa.ss_family == AF_INET6) ?
+             sizeof(*a6) : sizeof(*a4)) < 0) {
+        errout("-H: failed to bind to %s: %s",
+               cfg->cfg_http_addr, strerror(errno));
+        exit(1);
+    }
+    if (listen(hs->hs_fd, HTTP_MAXCONN) < 0 ||
+        fcntl(hs->hs_fd, F_SETFL, O_NONBLOCK) < 0) {
+        errout("-H: failed to listen: %s", strerror(errno));
+        exit(1);
+    }
+    evloop_watch(evl, hs->hs_fd, EVLOOP_READ, NULL, buf, sizeof(buf));
+    if (buf[0]) {
+        errout("%s", buf);
+        exit(1);
+    }
+    for (i = 0; i < HTTP_MAXCONN; ++i) {
+        hs->hs_conns[i].hc_fd = -1;
+    }
+
+    /*
+     * Work out the labels for each group's metrics ahead of time, and
+     * which interface each is on.
+     */
+    hs->hs_gc = calloc(cfg->cfg_ngroups, sizeof(hs->hs_gc[0]));
+    hs->hs_labels = calloc(cfg->cfg_ngroups, sizeof(hs->hs_labels[0]));
+    hs->hs_gintf = calloc(cfg->cfg_ngroups, sizeof(hs->hs_gintf[0]));
+    hs->hs_intfs = calloc(cfg->cfg_ngroups, sizeof(hs->hs_intfs[0]));
+    hs->hs_nintfs = 0;
+    for (i = 0; i < cfg->cfg_ngroups; ++i) {
+        g = cfg->cfg_groups[i];
+        auto_ntop(&g->mg_grp, ga, sizeof(ga));
+        lbl = http_label_value(g->mg_label ? : cfg->cfg_label);
+        snprintf(buf, sizeof(buf),
+                 "group=\"%s\",port=\"%d\",interface=\"%s\",label=\"%s\"",
+                 ga, g->mg_port, g->mg_intf.nam, lbl);
+        free(lbl);
+        hs->hs_labels[i] = strdup(buf);
+        for (j = 0; j < hs->hs_nintfs; ++j) {
+            if (!strcmp(hs->hs_intfs[j], g->mg_intf.nam)) {
+                break;
+            }
+        }
+        if (j == hs->hs_nintfs) {
+            hs->hs_intfs[hs->hs_nintfs++] = g->mg_intf.nam;
+        }
+        hs->hs_gintf[i] = j;
+    }
+
+    /* and where to build responses; it grows if it has to */
+    hs->hs_size = HTTP_HDRROOM + 4096 + cfg->cfg_ngroups * 2048;
+    hs->hs_buf = malloc(hs->hs_size);
+}
+
+/*
+ * http_label_value()
+ * Return a copy of string 's' escaped for use as an OpenMetrics label
+ * value, in a malloc()ed buffer.
+ */
+static char *http_label_value(char *s)
+{
+    char *buf = malloc(strlen(s) * 2 + 1), *d = buf;
+
+    for (; *s; ++s) {
+        if (*s == '\\' || *s == '"') {
+            *(d++) = '\\';
+            *(d++) = *s;
+        } else if (*s == '\n') {
+            *(d++) = '\\';
+            *(d++) = 'n';
+        } else {
+            *(d++) = *s;
+        }
+    }
+    *d = '\0';
+    return(buf);
+}
+
+/*
+ * http_ready()
+ * If 'rd' is the -H listening socket or one of its connections, handle
+ * it and return nonzero; otherwise return zero.
+ */
+static int http_ready(struct config *cfg, struct oligocast_evready *rd)
+{
+    struct httpsrv *hs = cfg->cfg_http;
+    struct httpconn *hc = NULL;
+    ssize_t rv;
+    int i;
+
+    if (rd->fd == hs->hs_fd) {
+        http_accept(cfg);
+        return(1);
+    }
+    for (i = 0; i < HTTP_MAXCONN; ++i) {
+        if (hs->hs_conns[i].hc_fd == rd->fd) {
+            hc = &hs->hs_conns[i];
+            break;
+        }
+    }
+    if (hc == NULL) {
+        return(0);
+    }
+
+    if (hc->hc_out != NULL) {
+        /* sending the rest of a response */
+        if (rd->events & (EVLOOP_WRITE | EVLOOP_ERROR)) {
+            http_send(cfg, hc, hc->hc_out + hc->hc_sent,
+                      hc->hc_outlen - hc->hc_sent);
+        }
+        return(1);
+    }
+
+    /* receiving a request */
+    rv = recv(hc->hc_fd, hc->hc_req + hc->hc_got,
+              sizeof(hc->hc_req) - 1 - hc->hc_got, 0);
+    if (rv < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+                   errno == EINTR)) {
+        return(1); /* nothing really happened */
+    }
+    if (rv <= 0) {
+        /* closed or failed before there was a whole request */
+        http_close(cfg, hc);
+        return(1);
+    }
+    hc->hc_got += rv;
+    hc->hc_req[hc->hc_got] = '\0';
+    if (strstr(hc->hc_req, "\r\n\r\n") || strstr(hc->hc_req, "\n\n") ||
+        hc->hc_got >= sizeof(hc->hc_req) - 1) {
+        /* got the whole request header, or all there's room for */
+        http_request(cfg, hc);
+    }
+    return(1);
+}
+
+/*
+ * http_accept()
+ * Accept new connections to the -H metrics server.  If there are too
+ * many, the oldest ones are dropped.
+ */
+static void http_accept(struct config *cfg)
+{
+    struct httpsrv *hs = cfg->cfg_http;
+    struct httpconn *hc;
+    char errbuf[512];
+    int fd, i;
+
+    for (;;) {
+        fd = accept(hs->hs_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                errout("-H: accept() failed: %s", strerror(errno));
+                errthrottle();
+            }
+            return;
+        }
+        if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+            errout("-H: failed to make connection nonblocking: %s",
+                   strerror(errno));
+            close(fd);
+            continue;
+        }
+
+        /* find a slot for it */
+        hc = &hs->hs_conns[0];
+        for (i = 0; i < HTTP_MAXCONN; ++i) {
+            if (hs->hs_conns[i].hc_fd < 0) {
+                hc = &hs->hs_conns[i];
+                break;
+            }
+            if (hs->hs_conns[i].hc_when < hc->hc_when) {
+                hc = &hs->hs_conns[i];
+            }
+        }
+        if (hc->hc_fd >= 0) {
+            http_close(cfg, hc);
+        }
+        hc->hc_fd = fd;
+        hc->hc_when = mono_ns();
+        hc->hc_got = 0;
+        evloop_watch(hs->hs_evl, fd, EVLOOP_READ, NULL,
+                     errbuf, sizeof(errbuf));
+        if (errbuf[0]) {
+            errout("%s", errbuf);
+            http_close(cfg, hc);
+        }
+    }
+}
+
+/*
+ * http_request()
+ * Respond to the HTTP request received on connection 'hc'.  Only
+ * GET (or HEAD) of "/metrics" or "/" is supported.
+ */
+static void http_request(struct config *cfg, struct httpconn *hc)
+{
+    struct httpsrv *hs = cfg->cfg_http;
+    char method[16], path[256], hdr[HTTP_HDRROOM], *status, *q;
+    size_t blen = 0, hlen;
+    int head = 0;
+
+    method[0] = path[0] = '\0';
+    if (sscanf(hc->hc_req, "%15s %255s", method, path) < 2) {
+        status = "400 Bad Request";
+    } else if (strcmp(method, "GET") && strcmp(method, "HEAD")) {
+        status = "405 Method Not Allowed";
+    } else {
+        head = !strcmp(method, "HEAD");
+        q = strchr(path, '?');
+        if (q) {
+            *q = '\0';
+        }
+        if (strcmp(path, "/metrics") && strcmp(path, "/")) {
+            status = "404 Not Found";
+        } else {
+            status = NULL;
+            blen = http_metrics(cfg);
+        }
+    }
+
+    /* the header goes right before the body, so they're sent together */
+    if (status != NULL) {
+        hlen = snprintf(hdr, sizeof(hdr),
+                        "HTTP/1.0 %s\r\n"
+                        "Content-Type: text/plain; charset=utf-8\r\n"
+                        "Content-Length: %d\r\n"
+                        "Connection: close\r\n\r\n%s\n",
+                        status, (int)strlen(status) + 1, status);
+        blen = 0;
+    } else {
+        hlen = snprintf(hdr, sizeof(hdr),
+                        "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: application/openmetrics-text; "
+                        "version=1.0.0; charset=utf-8\r\n"
+                        "Content-Length: %lu\r\n"
+                        "Connection: close\r\n\r\n",
+                        (unsigned long)blen);
+        if (head) {
+            blen = 0;
+        }
+    }
+    memcpy(hs->hs_buf + HTTP_HDRROOM - hlen, hdr, hlen);
+    http_send(cfg, hc, hs->hs_buf + HTTP_HDRROOM - hlen, hlen + blen);
+}
+
+/*
+ * http_send()
+ * Send 'len' bytes of 'data' on connection 'hc', the end of the response,
+ * and close it.  Whatever won't go right away is saved in hc_out to send
+ * when the connection's ready for it.
+ */
+static void http_send(struct config *cfg, struct httpconn *hc,
+                      char *data, size_t len)
+{
+    char errbuf[512];
+    ssize_t rv;
+
+    rv = send(hc->hc_fd, data, len, MSG_NOSIGNAL);
+    if (rv < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            http_close(cfg, hc); /* never mind the response */
+            return;
+        }
+        rv = 0;
+    }
+    if (rv == len) {
+        http_close(cfg, hc); /* all done */
+        return;
+    }
+    if (hc->hc_out == NULL) {
+        /* save the rest, and wait for when it can be sent */
+        hc->hc_out = malloc(len - rv);
+        memcpy(hc->hc_out, data + rv, len - rv);
+        hc->hc_outlen = len - rv;
+        hc->hc_sent = 0;
+        evloop_watch(cfg->cfg_http->hs_evl, hc->hc_fd, EVLOOP_WRITE, NULL,
+                     errbuf, sizeof(errbuf));
+        if (errbuf[0]) {
+            errout("%s", errbuf);
+            http_close(cfg, hc);
+        }
+    } else {
+        hc->hc_sent += rv;
+    }
+}
+
+/*
+ * http_close()
+ * Close connection 'hc' to the -H metrics server.
+ */
+static void http_close(struct config *cfg, struct httpconn *hc)
+{
+    char errbuf[512];
+
+    evloop_watch(cfg->cfg_http->hs_evl, hc->hc_fd, 0, NULL,
+                 errbuf, sizeof(errbuf));
+    close(hc->hc_fd);
+    hc->hc_fd = -1;
+    if (hc->hc_out != NULL) {
+        free(hc->hc_out);
+        hc->hc_out = NULL;
+    }
+}
+
+/*
+ * http_metrics()
+ * Build the -H metrics, in OpenMetrics text format, into hs_buf after
+ * HTTP_HDRROOM.  Returns their length.
+ */
+static size_t http_metrics(struct config *cfg)
+{
+    struct httpsrv *hs = cfg->cfg_http;
+    struct grpcount *gc;
+    struct churnstats *cs;
+    uint64_t v, *tot;
+    int i, m, rx = cfg->cfg_dir < 0;
+    int seq = 0; /* any "-d seq" groups, for HM_SEQ metrics */
+
+    for (i = 0; i < cfg->cfg_ngroups; ++i) {
+        group_counters(cfg, cfg->cfg_groups[i], &hs->hs_gc[i]);
+        seq |= rx && cfg->cfg_groups[i]->mg_data->pd_seq;
+    }
+    tot = calloc(hs->hs_nintfs * 3, sizeof(tot[0]));
+    for (i = 0; i < cfg->cfg_ngroups; ++i) {
+        tot[hs->hs_gintf[i] * 3 + 0] += hs->hs_gc[i].gc_up;
+        tot[hs->hs_gintf[i] * 3 + 1] += hs->hs_gc[i].gc_pkts;
+        tot[hs->hs_gintf[i] * 3 + 2] += hs->hs_gc[i].gc_bytes;
+    }
+
+    do {
+        hs->hs_used = HTTP_HDRROOM;
+        hs->hs_overflow = 0;
+
+        /* for each group */
+        for (m = 0; m < sizeof(http_grpmetrics) / sizeof(http_grpmetrics[0]);
+             ++m) {
+            if (((http_grpmetrics[m].hm_flags & HM_RX) && !rx) ||
+                ((http_grpmetrics[m].hm_flags & HM_SEQ) && !seq)) {
+                continue;
+            }
+            http_add(hs, "# TYPE %s %s\n# HELP %s %s.\n",
+                     http_grpmetrics[m].hm_name, http_grpmetrics[m].hm_type,
+                     http_grpmetrics[m].hm_name, http_grpmetrics[m].hm_help);
+            for (i = 0; i < cfg->cfg_ngroups; ++i) {
+                v = *(uint64_t *)((char *)&hs->hs_gc[i] +
+                                  http_grpmetrics[m].hm_off);
+                if (http_grpmetrics[m].hm_flags & HM_NS) {
+                    http_add(hs, "%s{%s} %llu.%09u\n",
+                             http_grpmetrics[m].hm_name, hs->hs_labels[i],
+                             (unsigned long long)(v / 1000000000),
+                             (unsigned)(v % 1000000000));
+                } else {
+                    http_add(hs, "%s%s{%s} %llu\n",
+                             http_grpmetrics[m].hm_name,
+                             strcmp(http_grpmetrics[m].hm_type, "counter") ?
+                             "" : "_total",
+                             hs->hs_labels[i], (unsigned long long)v);
+                }
+            }
+        }
+        if (seq) {
+            /* latency quantiles, as a summary */
+            http_add(hs, "# TYPE oligocast_latency_seconds summary\n"
+                     "# HELP oligocast_latency_seconds "
+                     "One way latency of sequence numbered packets.\n");
+            for (i = 0; i < cfg->cfg_ngroups; ++i) {
+                gc = &hs->hs_gc[i];
+                http_add(hs,
+                         "oligocast_latency_seconds_count{%s} %llu\n"
+                         "oligocast_latency_seconds{%s,quantile=\"0.5\"} "
+                         "%llu.%09u\n"
+                         "oligocast_latency_seconds{%s,quantile=\"0.99\"} "
+                         "%llu.%09u\n",
+                         hs->hs_labels[i], (unsigned long long)gc->gc_lat_n,
+                         hs->hs_labels[i],
+                         (unsigned long long)(gc->gc_lat_p50 / 1000000000),
+                         (unsigned)(gc->gc_lat_p50 % 1000000000),
+                         hs->hs_labels[i],
+                         (unsigned long long)(gc->gc_lat_p99 / 1000000000),
+                         (unsigned)(gc->gc_lat_p99 % 1000000000));
+            }
+        }
+
+        if (cfg->cfg_churnstats != NULL) {
+            /* joining and leaving (-C), all the groups together */
+            cs = cfg->cfg_churnstats;
+            http_add(hs, "# TYPE oligocast_joins counter\n"
+                     "# HELP oligocast_joins "
+                     "Times groups were joined (-C).\n"
+                     "oligocast_joins_total %llu\n"
+                     "# TYPE oligocast_leaves counter\n"
+                     "# HELP oligocast_leaves "
+                     "Times groups were left (-C).\n"
+                     "oligocast_leaves_total %llu\n",
+                     (unsigned long long)HCOUNT_GET(&cs->cs_joins),
+                     (unsigned long long)HCOUNT_GET(&cs->cs_leaves));
+            http_hist(hs, "oligocast_join_latency_seconds",
+                      "Time from joining a group to its first packet (-C)",
+                      &cs->cs_join);
+            http_hist(hs, "oligocast_leave_latency_seconds",
+                      "Time from leaving a group to its last packet (-C)",
+                      &cs->cs_leave);
+        }
+
+        /* for each interface */
+        http_add(hs, "# TYPE oligocast_interface_groups gauge\n"
+                 "# HELP oligocast_interface_groups "
+                 "Groups on the interface.\n");
+        for (i = 0; i < hs->hs_nintfs; ++i) {
+            int j, n = 0;
+            for (j = 0; j < cfg->cfg_ngroups; ++j) {
+                n += (hs->hs_gintf[j] == i);
+            }
+            http_add(hs, "oligocast_interface_groups{interface=\"%s\"} %d\n",
+                     hs->hs_intfs[i], n);
+        }
+        if (rx) {
+            http_add(hs, "# TYPE oligocast_interface_groups_up gauge\n"
+                     "# HELP oligocast_interface_groups_up "
+                     "Groups on the interface where packets are being "
+                     "received.\n");
+            for (i = 0; i < hs->hs_nintfs; ++i) {
+                http_add(hs, "oligocast_interface_groups_up"
+                         "{interface=\"%s\"} %llu\n",
+                         hs->hs_intfs[i], (unsigned long long)tot[i * 3]);
+            }
+        }
+        http_add(hs, "# TYPE oligocast_interface_packets counter\n"
+                 "# HELP oligocast_interface_packets "
+                 "Packets sent or received, all groups on the interface.\n");
+        for (i = 0; i < hs->hs_nintfs; ++i) {
+            http_add(hs, "oligocast_interface_packets_total"
+                     "{interface=\"%s\"} %llu\n",
+                     hs->hs_intfs[i], (unsigned long long)tot[i * 3 + 1]);
+        }
+        http_add(hs, "# TYPE oligocast_interface_bytes counter\n"
+                 "# HELP oligocast_interface_bytes "
+                 "Bytes sent or received, all groups on the interface.\n");
+        for (i = 0; i < hs->hs_nintfs; ++i) {
+            http_add(hs, "oligocast_interface_bytes_total"
+                     "{interface=\"%s\"} %llu\n",
+                     hs->hs_intfs[i], (unsigned long long)tot[i * 3 + 2]);
+        }
+        http_add(hs, "# EOF\n");
+
+        if (hs->hs_overflow) {
+            /* didn't fit; make more room and try again */
+            hs->hs_size *= 2;
+            hs->hs_buf = realloc(hs->hs_buf, hs->hs_size);
+        }
+    } while (hs->hs_overflow);
+
+    free(tot);
+    return(hs->hs_used - HTTP_HDRROOM);
+}
+
+/*
+ * http_add()
+ * Add formatted text to the response being built in hs_buf.  If there's
+ * not room, sets hs_overflow.
+ */
+static void http_add(struct httpsrv *hs, char *fmt, ...)
+{
+    va_list ap;
+    int rv;
+
+    if (hs->hs_overflow) {
+        return;
+    }
+    va_start(ap, fmt);
+    rv = vsnprintf(hs->hs_buf + hs->hs_used, hs->hs_size - hs->hs_used,
+                   fmt, ap);
+    va_end(ap);
+    if (rv < 0 || rv >= hs->hs_size - hs->hs_used) {
+        hs->hs_overflow = 1;
+    } else {
+        hs->hs_used += rv;
+    }
+}
+
+/*
+ * http_hist()
+ * Add histogram 'h', of nanoseconds, to the response being built, as
+ * OpenMetrics histogram 'name' in seconds, with buckets a factor of ten
+ * apart, described by 'help'.  The sum is approximate, figured from
+ * the middle of each bin.
+ */
+static void http_hist(struct httpsrv *hs, char *name, char *help,
+                      struct histogram *h)
+{
+    static const char *les[] = {
+        "0.00001", "0.0001", "0.001", "0.01", "0.1", "1", "10"
+    };
+    uint64_t bound = 10000, cum = 0, sum = 0, c;
+    int i, b = 0;
+
+    http_add(hs, "# TYPE %s histogram\n# HELP %s %s.\n", name, name, help);
+    for (i = 0; i < HIST_BINS; ++i) {
+        while (b < sizeof(les) / sizeof(les[0]) && hist_value(i) > bound) {
+            http_add(hs, "%s_bucket{le=\"%s\"} %llu\n",
+                     name, les[b++], (unsigned long long)cum);
+            bound *= 10;
+        }
+        c = HCOUNT_GET(&h->hi_bins[i]);
+        cum += c;
+        sum += c * hist_value(i);
+    }
+    while (b < sizeof(les) / sizeof(les[0])) {
+        http_add(hs, "%s_bucket{le=\"%s\"} %llu\n",
+                 name, les[b++], (unsigned long long)cum);
+    }
+    http_add(hs, "%s_bucket{le=\"+Inf\"} %llu\n"
+             "%s_count %llu\n%s_sum %llu.%09u\n",
+             name, (unsigned long long)cum, name, (unsigned long long)cum,
+             name, (unsigned long long)(sum / 1000000000),
+             (unsigned)(sum % 1000000000));
+}
+
+/** ** packet statistics ** **/
+
+/*
+ * stats_add()
+ * Count 'n' packets just received, in 'rb', on group 'g', of which 'bad'
+ * didn't match the "-d" option, in g->mg_stats.  Those that were cut
+ * short (rb_trunc[]) are counted separately; they're not checked.
+ * Also notes the kernel's count of dropped packets, if it gave one.
+ * Called by whatever thread received them.
+ */
+static void stats_add(struct mcgroup *g, struct rxbufs *rb, int n, int bad)
+{
+    struct rxstats *st = &g->mg_stats;
+    uint64_t bytes = 0, sum = 0, nd = 0, min = UINT64_MAX, max = 0, d;
+    int64_t t;
+    int i, trunc = 0;
+
+    for (i = 0; i < n; ++i) {
+        bytes += rb->rb_got[i];
+        trunc += rb->rb_trunc[i];
+        t = rb->rb_ts[i].tv_sec * (int64_t)1000000000 + rb->rb_ts[i].tv_nsec;
+        if (st->st_tlast != 0 && t >= st->st_tlast) {
+            d = t - st->st_tlast;
+            sum += d;
+            ++nd;
+            if (d < min) min = d;
+            if (d > max) max = d;
+        }
+        st->st_tlast = t;
+    }
+
+    /* fold them in, with as few updates as possible */
+    HCOUNT_ADD(&st->st_pkts, n);
+    HCOUNT_ADD(&st->st_bytes, bytes);
+    if (bad) {
+        HCOUNT_ADD(&st->st_bad, bad);
+    }
+    if (trunc) {
+        HCOUNT_ADD(&st->st_trunc, trunc);
+    }
+#ifdef HAVE_SO_RXQ_OVFL
+    if (rb->rb_drops > HCOUNT_GET(&st->st_kdrops)) {
+        /* the kernel's count is of all drops so far on the socket */
+        HCOUNT_SET(&st->st_kdrops, rb->rb_drops);
+    }
+#endif /* HAVE_SO_RXQ_OVFL */
+    if (nd) {
+        HCOUNT_ADD(&st->st_iat_n, nd);
+        HCOUNT_ADD(&st->st_iat_sum, sum);
+        if (min < HCOUNT_GET(&st->st_iat_min)) {
+            HCOUNT_SET(&st->st_iat_min, min);
+        }
+        if (max > HCOUNT_GET(&st->st_iat_max)) {
+            HCOUNT_SET(&st->st_iat_max, max);
+        }
+    }
+}
+
+/*
+ * stats_reports()
+ * In receive (-r) mode with -S: if it's time, report packet statistics
+ * for each group.  Returns the number of microseconds until next time.
+ */
+static long stats_reports(struct config *cfg)
+{
+    int64_t now = mono_ns();
+    int i;
+
+    if (cfg->cfg_stats_next == 0) {
+        /* first time: wait a whole period */
+        cfg->cfg_stats_next = now + cfg->cfg_stats_us * (int64_t)1000;
+    }
+    if (now >= cfg->cfg_stats_next) {
+        for (i = 0; i < cfg->cfg_ngroups; ++i) {
+            stats_report(cfg, cfg->cfg_groups[i], cfg->cfg_stats_us / 1e+6);
+            if (cfg->cfg_rxsrc) {
+                rxsrc_report(cfg, cfg->cfg_groups[i],
+                             cfg->cfg_stats_us / 1e+6);
+            }
+        }
+        cfg->cfg_stats_next += cfg->cfg_stats_us * (int64_t)1000;
+        if (cfg->cfg_stats_next <= now) {
+            /* way behind; don't try to catch up */
+            cfg->cfg_stats_next = now + cfg->cfg_stats_us * (int64_t)1000;
+        }
+    }
+    return((cfg->cfg_stats_next - now + 999) / 1000);
+}
+
+/*
+ * stats_report()
+ * Report what's been received on group 'g' since the last report, a
+ * period of 'sec' seconds: one line, even if nothing was.
+ */
+static void stats_report(struct config *cfg, struct mcgroup *g, double sec)
+{
+    struct rxstats *st = &g->mg_stats;
+    uint64_t pkts, bytes, bad, trunc, kdrops, lost;
+    uint64_t iat_n, iat_sum, iat_min, iat_max;
+    uint64_t v;
+    char buf[512];
+    int pos;
+
+    v = HCOUNT_GET(&st->st_pkts);
+    pkts = v - st->st_prev_pkts;
+    st->st_prev_pkts = v;
+    v = HCOUNT_GET(&st->st_bytes);
+    bytes = v - st->st_prev_bytes;
+    st->st_prev_bytes = v;
+    v = HCOUNT_GET(&st->st_bad);
+    bad = v - st->st_prev_bad;
+    st->st_prev_bad = v;
+    v = HCOUNT_GET(&st->st_trunc);
+    trunc = v - st->st_prev_trunc;
+    st->st_prev_trunc = v;
+    v = HCOUNT_GET(&st->st_kdrops);
+    kdrops = v - st->st_prev_kdrops;
+    st->st_prev_kdrops = v;
+    v = HCOUNT_GET(&st->st_iat_n);
+    iat_n = v - st->st_prev_iat_n;
+    st->st_prev_iat_n = v;
+    v = HCOUNT_GET(&st->st_iat_sum);
+    iat_sum = v - st->st_prev_iat_sum;
+    st->st_prev_iat_sum = v;
+    iat_min = HCOUNT_GET(&st->st_iat_min);
+    HCOUNT_SET(&st->st_iat_min, UINT64_MAX);
+    iat_max = HCOUNT_GET(&st->st_iat_max);
+    HCOUNT_SET(&st->st_iat_max, 0);
+#ifdef DO_WORKERS
+    v = (cfg->cfg_nworkers > 0) ? atomic_load(&g->mg_wk_lost) : g->mg_sq_lost;
+#else /* DO_WORKERS */
+    v = g->mg_sq_lost;
+#endif /* !DO_WORKERS */
+    lost = v - st->st_prev_lost;
+    st->st_prev_lost = v;
+
+    if (cfg->cfg_csv) {
+        /*
+         * packets, bytes, mismatched, lost, then inter-arrival min/avg/max,
+         * then truncated, dropped by the kernel
+         */
+        pos = snprintf(buf, sizeof(buf), "%llu,%llu,%llu,%llu",
+                       (unsigned long long)pkts, (unsigned long long)bytes,
+                       (unsigned long long)bad, (unsigned long long)lost);
+        if (iat_n > 0 && pos < sizeof(buf)) {
+            pos += snprintf(buf + pos, sizeof(buf) - pos, ",%.1f,%.1f,%.1f",
+                            iat_min / 1e+3, (double)iat_sum / iat_n / 1e+3,
+                            iat_max / 1e+3);
+        } else if (pos < sizeof(buf)) {
+            pos += snprintf(buf + pos, sizeof(buf) - pos, ",,,");
+        }
+        if (pos < sizeof(buf)) {
+            snprintf(buf + pos, sizeof(buf) - pos, ",%llu,%llu",
+                     (unsigned long long)trunc, (unsigned long long)kdrops);
+        }
+    } else {
+        pos = snprintf(buf, sizeof(buf),
+                       "%llu packets (%.1f/s), %llu bytes, %llu mismatched,"
+                       " %llu lost",
+                       (unsigned long long)pkts, pkts / sec,
+                       (unsigned long long)bytes,
+                       (unsigned long long)bad, (unsigned long long)lost);
+        if (trunc > 0 && pos < sizeof(buf)) {
+            pos += snprintf(buf + pos, sizeof(buf) - pos, ", %llu truncated",
+                            (unsigned long long)trunc);
+        }
+        if (kdrops > 0 && pos < sizeof(buf)) {
+            pos += snprintf(buf + pos, sizeof(buf) - pos,
+                            ", %llu dropped by the kernel",
+                            (unsigned long long)kdrops);
+        }
+        if (iat_n > 0 && pos < sizeof(buf)) {
+            snprintf(buf + pos, sizeof(buf) - pos,
+                     ", interarrival min %.1fus avg %.1fus max %.1fus",
+                     iat_min / 1e+3, (double)iat_sum / iat_n / 1e+3,
+                     iat_max / 1e+3);
+        }
+    }
+    emit(cfg, g, reported_event_stats, buf);
+}
+
+/*
+ * seq_report()
+ * Report the "-d seq" counts for group 'g', if they've changed since
+ * they were last reported.
+ */
+static void seq_report(struct config *cfg, struct mcgroup *g,
+                       uint64_t lost, uint64_t reord, uint64_t dup)
+{
+    char buf[256];
+
+    if (lost == g->mg_sq_lost_seen && reord == g->mg_sq_reord_seen &&
+        dup == g->mg_sq_dup_seen) {
+        return; /* nothing new */
+    }
+    g->mg_sq_lost_seen = lost;
+    g->mg_sq_reord_seen = reord;
+    g->mg_sq_dup_seen = dup;
+    snprintf(buf, sizeof(buf),
+             "sequence numbers: %llu lost, %llu reordered, %llu duplicated",
+             (unsigned long long)lost, (unsigned long long)reord,
+             (unsigned long long)dup);
+    emit(cfg, g, reported_event_pkt, buf);
+}
+
+/** ** per-source accounting ("-o sources") ** **/
+
+/*
+ * rxsrc_find()
+ * Find, or add, the entry in group 'g's table of sources for source
+ * address and port 'from'.  Returns it, or NULL if the table's full
+ * (RXSRC_MAX); new entries are all zero but for rs_used, rs_addr, rs_port.
+ */
+static struct rxsource *rxsrc_find(struct config *cfg, struct mcgroup *g,
+                                   struct sockaddr_storage *from)
+{
+    struct rxsource *rs;
+    uint8_t *addr = addr_bytes(from);
+    int port = ntohs(*addr_port(from));
+    int af = g->mg_grp.ss_family, alen = (af == AF_INET6) ? 16 : 4;
+    unsigned h;
+
+    if (g->mg_rxsrc == NULL) {
+        rxsrc_grow(g);
+    }
+    h = addr_hash(af, addr, port);
+    for (;;) {
+        rs = &g->mg_rxsrc[h & g->mg_rxsrc_mask];
+        if (!rs->rs_used) {
+            break;
+        }
+        if (rs->rs_port == port && !memcmp(rs->rs_addr, addr, alen)) {
+            return(rs);
+        }
+        ++h;
+    }
+
+    /* it's new */
+    if (g->mg_rxsrc_n >= RXSRC_MAX) {
+        if (!g->mg_rxsrc_full) {
+            g->mg_rxsrc_full = 1;
+            emit(cfg, g, reported_event_note,
+                 "too many sources; not keeping track of any more");
+        }
+        return(NULL);
+    }
+    if ((g->mg_rxsrc_n + 1) * 2 > g->mg_rxsrc_mask + 1) {
+        /* keep it no more than half full; new place for it in a new table */
+        rxsrc_grow(g);
+        h = addr_hash(af, addr, port);
+        while (g->mg_rxsrc[h & g->mg_rxsrc_mask].rs_used) {
+            ++h;
+        }
+        rs = &g->mg_rxsrc[h & g->mg_rxsrc_mask];
+    }
+    ++g->mg_rxsrc_n;
+    rs->rs_used = 1;
+    memcpy(rs->rs_addr, addr, alen);
+    rs->rs_port = port;
+    return(rs);
+}
+
+/*
+ * rxsrc_grow()
+ * Make group 'g's table of sources, mg_rxsrc[], twice as big (or
+ * RXSRC_MIN to start with), and move what's in it to the new one.
+ */
+static void rxsrc_grow(struct mcgroup *g)
+{
+    struct rxsource *old = g->mg_rxsrc, *rs;
+    unsigned i, h, osize = old ? g->mg_rxsrc_mask + 1 : 0;
+    unsigned size = old ? osize * 2 : RXSRC_MIN;
+
+    g->mg_rxsrc = calloc(size, sizeof(g->mg_rxsrc[0]));
+    g->mg_rxsrc_mask = size - 1;
+    for (i = 0; i < osize; ++i) {
+        rs = &old[i];
+        if (!rs->rs_used) {
+            continue;
+        }
+        h = addr_hash(g->mg_grp.ss_family, rs->rs_addr, rs->rs_port);
+        while (g->mg_rxsrc[h & g->mg_rxsrc_mask].rs_used) {
+            ++h;
+        }
+        g->mg_rxsrc[h & g->mg_rxsrc_mask] = *rs;
+    }
+    if (old) {
+        free(old);
+    }
+}
+
+/*
+ * rxsrc_add()
+ * Count 'n' packets just received, in 'rb', on group 'g', under the
+ * sources they came from (rb->rb_from[]); and report any source that
+ * wasn't "up" before.  Consecutive packets from the same source, as
+ * usually come in a batch, only need to be looked up once.
+ */
+static void rxsrc_add(struct config *cfg, struct mcgroup *g,
+                      struct rxbufs *rb, int n)
+{
+    struct rxsource *rs = NULL;
+    struct sockaddr_storage *from;
+    int64_t now = mono_ns(), t;
+    uint64_t d;
+    int i, alen = (g->mg_grp.ss_family == AF_INET6) ? 16 : 4;
+
+    for (i = 0; i < n; ++i) {
+        from = &rb->rb_from[i];
+        if (rs == NULL || *addr_port(from) != htons(rs->rs_port) ||
+            memcmp(addr_bytes(from), rs->rs_addr, alen) != 0) {
+            rs = rxsrc_find(cfg, g, from);
+        }
+        if (rs == NULL) {
+            continue; /* too many */
+        }
+        t = rb->rb_ts[i].tv_sec * (int64_t)1000000000 + rb->rb_ts[i].tv_nsec;
+        if (rs->rs_tlast != 0 && t >= rs->rs_tlast) {
+            d = t - rs->rs_tlast;
+            if (d > rs->rs_gap_max) {
+                rs->rs_gap_max = d;
+            }
+        }
+        rs->rs_tlast = t;
+        rs->rs_tseen = now;
+        ++rs->rs_pkts;
+        rs->rs_bytes += rb->rb_got[i];
+        if (!rs->rs_up) {
+            rs->rs_up = 1;
+            rxsrc_event(cfg, g, rs, reported_event_srcup, NULL);
+        }
+    }
+}
+
+/*
+ * rxsrc_sweeps()
+ * With "-o sources": if it's time, look for sources that haven't been
+ * heard from in the timeout period, and report them "down."  This is
+ * done a few times per timeout period, so it's up to a quarter of it
+ * late.  Returns the number of microseconds until next time.
+ */
+static long rxsrc_sweeps(struct config *cfg)
+{
+    int64_t now = mono_ns(), tmo = cfg->cfg_timeout_ns;
+    int64_t step = tmo / 4;
+    struct mcgroup *g;
+    struct rxsource *rs;
+    unsigned j;
+    int i;
+
+    if (step < 1000000) {
+        step = 1000000; /* no more than 1000 times a second */
+    }
+    if (now >= cfg->cfg_rxsrc_next) {
+        for (i = 0; i < cfg->cfg_ngroups; ++i) {
+            g = cfg->cfg_groups[i];
+            if (g->mg_rxsrc == NULL) {
+                continue;
+            }
+            for (j = 0; j <= g->mg_rxsrc_mask; ++j) {
+                rs = &g->mg_rxsrc[j];
+                if (rs->rs_up && now - rs->rs_tseen >= tmo) {
+                    rs->rs_up = 0;
+                    rxsrc_event(cfg, g, rs, reported_event_srcdn, NULL);
+                }
+            }
+        }
+        cfg->cfg_rxsrc_next = now + step;
+    }
+    return((cfg->cfg_rxsrc_next - now + 999) / 1000);
+}
+
+/*
+ * rxsrc_report()
+ * Report what's been received on group 'g' from each source since the
+ * last report, a period of 'sec' seconds: one line for each that's
+ * up or sent anything.
+ */
+static void rxsrc_report(struct config *cfg, struct mcgroup *g, double sec)
+{
+    struct rxsource *rs;
+    uint64_t pkts, bytes;
+    unsigned j;
+    char buf[256];
+
+    if (g->mg_rxsrc == NULL) {
+        return;
+    }
+    for (j = 0; j <= g->mg_rxsrc_mask; ++j) {
+        rs = &g->mg_rxsrc[j];
+        if (!rs->rs_used || (!rs->rs_up && rs->rs_pkts == rs->rs_prev_pkts)) {
+            continue;
+        }
+        pkts = rs->rs_pkts - rs->rs_prev_pkts;
+        rs->rs_prev_pkts = rs->rs_pkts;
+        bytes = rs->rs_bytes - rs->rs_prev_bytes;
+        rs->rs_prev_bytes = rs->rs_bytes;
+        if (cfg->cfg_csv) {
+            /* packets, bytes, longest gap (usec), since last packet (sec) */
+            snprintf(buf, sizeof(buf), "%llu,%llu,%.1f,%.3f",
+                     (unsigned long long)pkts, (unsigned long long)bytes,
+                     rs->rs_gap_max / 1e+3,
+                     (mono_ns() - rs->rs_tseen) / 1e+9);
+        } else {
+            snprintf(buf, sizeof(buf),
+                     "%llu packets (%.1f/s), %llu bytes, longest gap %.1fus,"
+                     " last %.3fs ago",
+                     (unsigned long long)pkts, pkts / sec,
+                     (unsigned long long)bytes, rs->rs_gap_max / 1e+3,
+                     (mono_ns() - rs->rs_tseen) / 1e+9);
+        }
+        rs->rs_gap_max = 0;
+        rxsrc_event(cfg, g, rs, reported_event_srcstats, buf);
+    }
+}
+
+/*
+ * rxsrc_event()
+ * Report event 'evt' about source 'rs' on group 'g', with the source's
+ * address and port, and 'more' (if not NULL) after them.
+ */
+static void rxsrc_event(struct config *cfg, struct mcgroup *g,
+                        struct rxsource *rs, enum reported_events evt,
+                        char *more)
+{
+    char abuf[INET6_ADDRSTRLEN], buf[512];
+
+    if (!inet_ntop(g->mg_grp.ss_family, rs->rs_addr, abuf, sizeof(abuf))) {
+        snprintf(abuf, sizeof(abuf), "?");
+    }
+    if (cfg->cfg_csv) {
+        /* address, port, then whatever 'more' has */
+        snprintf(buf, sizeof(buf), "%s,%d%s%s", abuf, (int)rs->rs_port,
+                 more ? "," : "", more ? : "");
+    } else {
+        snprintf(buf, sizeof(buf), "from %s port %d%s%s", abuf,
+                 (int)rs->rs_port, more ? ": " : "", more ? : "");
+    }
+    emit(cfg, g, evt, buf);
+}
+
+#ifdef DO_WORKERS
+/** ** receiving packets in worker threads ** **/
+
+/*
+ * worker_setup()
+ * With -w: divide the groups among worker threads, and start them.
+ * They let the main thread know when there are packets to report, by
+ * writing their index, one byte, to the cfg_wake pipe.  Errors are fatal.
+ */
+static void worker_setup(struct config *cfg)
+{
+    struct worker *wk;
+    struct mcgroup *g;
+    sigset_t sigs, osigs;
+    char errbuf[256];
+    int i, rv;
+
+    if (cfg->cfg_nworkers > cfg->cfg_ngroups) {
+        /* there's no use for more workers than groups */
+        cfg->cfg_nworkers = cfg->cfg_ngroups;
+    }
+    if (pipe(cfg->cfg_wake) < 0) {
+        errout("failed to create pipe: %s", strerror(errno));
+        exit(1);
+    }
+
+    cfg->cfg_workers = calloc(cfg->cfg_nworkers, sizeof(cfg->cfg_workers[0]));
+    for (i = 0; i < cfg->cfg_nworkers; ++i) {
+        wk = cfg->cfg_workers[i] = calloc(1, sizeof(*wk));
+        wk->wk_idx = i;
+        wk->wk_cfg = cfg;
+        wk->wk_evl = evloop_create(errbuf, sizeof(errbuf));
+        if (wk->wk_evl == NULL) {
+            errout("%s", errbuf);
+            exit(1);
+        }
+        rx_buffers_setup(cfg, &wk->wk_rx);
+        wk->wk_groups = calloc(cfg->cfg_ngroups / cfg->cfg_nworkers + 1,
+                               sizeof(wk->wk_groups[0]));
+        wk->wk_ngroups = 0;
+        atomic_init(&wk->wk_pending, 0);
+        atomic_init(&wk->wk_flush, 0);
+        wk->wk_vring = calloc(WK_VRING, sizeof(wk->wk_vring[0]));
+        if (wk->wk_vring == NULL) {
+            errout("out of memory for worker threads");
+            exit(1);
+        }
+        atomic_init(&wk->wk_vhead, 0);
+        atomic_init(&wk->wk_vtail, 0);
+        atomic_init(&wk->wk_vlost, 0);
+        wk->wk_vlost_seen = 0;
+        if (pipe(wk->wk_poke) < 0) {
+            errout("failed to create pipe: %s", strerror(errno));
+            exit(1);
+        }
+        evloop_watch(wk->wk_evl, wk->wk_poke[0], EVLOOP_READ, NULL,
+                     errbuf, sizeof(errbuf));
+        if (errbuf[0]) {
+            errout("%s", errbuf);
+            exit(1);
+        }
+    }
+
+    /* deal the groups out like cards */
+    for (i = 0; i < cfg->cfg_ngroups; ++i) {
+        g = cfg->cfg_groups[i];
+        wk = cfg->cfg_workers[i % cfg->cfg_nworkers];
+        g->mg_worker = wk;
+        atomic_init(&g->mg_wk_rx, 0);
+        atomic_init(&g->mg_wk_bad, 0);
+        atomic_init(&g->mg_wk_tlast, 0);
+        atomic_init(&g->mg_wk_trx, 0);
+        atomic_init(&g->mg_wk_lost, 0);
+        atomic_init(&g->mg_wk_reord, 0);
+        atomic_init(&g->mg_wk_dup, 0);
+        g->mg_wk_rx_seen = g->mg_wk_bad_seen = 0;
+        wk->wk_groups[wk->wk_ngroups++] = g;
+        evloop_watch(wk->wk_evl, g->mg_sok, EVLOOP_READ, g,
+                     errbuf, sizeof(errbuf));
+        if (errbuf[0]) {
+            errout("%s", errbuf);
+            exit(1);
+        }
+    }
+    if (cfg->cfg_churnstats != NULL) {
+        /* and with -C, each joins and leaves its own groups */
+        for (i = 0; i < cfg->cfg_nworkers; ++i) {
+            wk = cfg->cfg_workers[i];
+            wk->wk_churn = churn_new(cfg, wk->wk_groups, wk->wk_ngroups,
+                                     cfg->cfg_seq_id + i + 1);
+        }
+    }
+
+    /*
+     * start them, each on its own CPU if possible; and with the signals
+     * exit_setup() handles blocked, so they go to the main thread
+     */
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &sigs, &osigs);
+    for (i = 0; i < cfg->cfg_nworkers; ++i) {
+        wk = cfg->cfg_workers[i];
+        rv = pthread_create(&wk->wk_thread, NULL, worker_main, wk);
+        if (rv != 0) {
+            errout("failed to start worker thread: %s", strerror(rv));
+            exit(1);
+        }
+        wk->wk_running = 1;
+        thread_pin(wk->wk_thread, i, errbuf, sizeof(errbuf));
+        if (errbuf[0]) {
+            errout("%s", errbuf);
+            /* go on, in spite of this error */
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &osigs, NULL);
+}
+
+/*
+ * worker_main()
+ * Main loop of a worker thread: receive packets on its groups, and count
+ * them; and with -C, join and leave them.  'arg' is the 'struct worker'.
+ * Never returns.
+ */
+static void *worker_main(void *arg)
+{
+    struct worker *wk = arg;
+    struct config *cfg = wk->wk_cfg;
+    struct oligocast_evready ready[MAX_READY];
+    struct mcgroup *g;
+    int64_t tlast, now, tnext;
+    unsigned char idx = wk->wk_idx;
+    char poke;
+    int nready, r, i, rv, b, bad, got;
+
+    for (;;) {
+        now = mono_ns();
+        tnext = now + 1800 * (int64_t)1000000000; /* nothing in particular */
+        if (wk->wk_churn != NULL) {
+            /* joining and leaving groups (-C) */
+            tnext = churn_ops(cfg, wk->wk_churn, now);
+        }
+        tnext = sooner(tnext, now, binlog_aging(cfg, &wk->wk_binlog));
+        if (cfg->cfg_spin) {
+            tnext = 0; /* "-o spin": don't sleep */
+        }
+        nready = evloop_wait_until(wk->wk_evl, tnext, ready, MAX_READY);
+        if (nready < 0) {
+            if (errno != EINTR && errno != EAGAIN) {
+                errout("event loop error: %s", strerror(errno));
+                errthrottle();
+            }
+            continue;
+        }
+
+        got = 0;
+        for (r = 0; r < nready; ++r) {
+            g = ready[r].tag;
+            if (g == NULL) {
+                /* the main thread wants something; see below */
+                if (read(wk->wk_poke[0], &poke, 1) < 0) {
+                    errout("failed to hear from main thread: %s",
+                           strerror(errno));
+                    errthrottle();
+                }
+                continue;
+            }
+            rv = rx_batch(&wk->wk_rx, g->mg_sok);
+            if (rv < 0) {
+                /* packet not received */
+                if (errno == EAGAIN || errno == EWOULDBLOCK ||
+                    errno == EINTR) {
+                    /* not really an error */
+                } else {
+                    errout("recv() failed: %s", strerror(errno));
+                    errthrottle();
+                }
+                continue;
+            }
+
+            /* packet(s) received */
+            tlast = mono_ns();
+            if (g->mg_ch_wait || g->mg_ch_tleave) {
+                churn_rx(cfg, g, &wk->wk_rx, rv);
+            }
+            bad = 0;
+            for (i = 0; i < rv; ++i) {
+                b = g->mg_data->pd_chk && !wk->wk_rx.rb_trunc[i] &&
+                    rx_mismatch(cfg, g, &wk->wk_rx, i);
+                if (cfg->cfg_binlog_fd >= 0) {
+                    binlog_rx(cfg, &wk->wk_binlog, g, &wk->wk_rx, i, b);
+                }
+                bad += b;
+            }
+            worker_vpush(wk, g, &wk->wk_rx, rv);
+            if (g->mg_data->pd_chk) {
+                if (g->mg_data->pd_seq) {
+                    atomic_store(&g->mg_wk_lost, g->mg_sq_lost);
+                    atomic_store(&g->mg_wk_reord, g->mg_sq_reord);
+                    atomic_store(&g->mg_wk_dup, g->mg_sq_dup);
+                }
+            }
+            stats_add(g, &wk->wk_rx, rv, bad);
+            atomic_store(&g->mg_wk_tlast, tlast);
+            atomic_store(&g->mg_wk_trx,
+                         wk->wk_rx.rb_ts[rv - 1].tv_sec * (int64_t)1000000000 +
+                         wk->wk_rx.rb_ts[rv - 1].tv_nsec);
+            atomic_fetch_add(&g->mg_wk_bad, bad);
+            atomic_fetch_add(&g->mg_wk_rx, rv);
+            got = 1;
+        }
+
+        if (atomic_load(&wk->wk_flush)) {
+            /* write out the binary event log records, see worker_flush() */
+            binlog_write(cfg, &wk->wk_binlog);
+            atomic_store(&wk->wk_flush, 0);
+        }
+        if (got && !atomic_exchange(&wk->wk_pending, 1)) {
+            /* the main thread doesn't know yet; tell it */
+            if (write(cfg->cfg_wake[1], &idx, 1) < 0) {
+                errout("failed to wake main thread: %s", strerror(errno));
+                atomic_store(&wk->wk_pending, 0);
+                errthrottle();
+            }
+        }
+    }
+    return(NULL);
+}
+
+/*
+ * worker_flush()
+ * In the main thread: have each worker thread write out the records it
+ * has for the "-f binary:" event log, and wait (a little while) for them
+ * to be done; before the program exits, or the file's closed.
+ */
+static void worker_flush(struct config *cfg)
+{
+    struct timespec ms = { 0, 1000000 };
+    struct worker *wk;
+    int i, tries;
+
+    if (cfg->cfg_workers == NULL) {
+        return; /* not started yet */
+    }
+    for (i = 0; i < cfg->cfg_nworkers; ++i) {
+        wk = cfg->cfg_workers[i];
+        if (wk == NULL || !wk->wk_running) {
+            continue; /* exiting while they're being set up */
+        }
+        atomic_store(&wk->wk_flush, 1);
+        if (write(wk->wk_poke[1], "", 1) < 0) {
+            errout("failed to wake worker thread: %s", strerror(errno));
+        }
+    }
+    for (i = 0; i < cfg->cfg_nworkers; ++i) {
+        wk = cfg->cfg_workers[i];
+        if (wk == NULL || !wk->wk_running) {
+            continue;
+        }
+        for (tries = 0; atomic_load(&wk->wk_flush); ++tries) {
+            if (tries >= 1000) {
+                errout("worker thread %d didn't write out its records", i);
+                break;
+            }
+            nanosleep(&ms, NULL);
+        }
+    }
+}
+
+/*
+ * worker_wake()
+ * In the main thread: the cfg_wake pipe is ready to read; see which
+ * workers have packets to report, and report them.
+ */
+static void worker_wake(struct config *cfg)
+{
+    unsigned char idx[MAX_WORKERS];
+    int rv, i;
+
+    rv = read(cfg->cfg_wake[0], idx, sizeof(idx));
+    if (rv < 0) {
+        if (errno != EINTR && errno != EAGAIN) {
+            errout("failed to hear from worker threads: %s", strerror(errno));
+            errthrottle();
+        }
+        return;
+    }
+    for (i = 0; i < rv; ++i) {
+        if (idx[i] < cfg->cfg_nworkers) {
+            worker_collect(cfg, cfg->cfg_workers[idx[i]]);
+        }
+    }
+}
+
+/*
+ * worker_vpush()
+ * In worker thread 'wk': pass on the 'n' packets just received in 'rb'
+ * on group 'g' for the main thread to report with "-v", as many as fit
+ * in wk_vring[].  It's done whether or not there's "-v" right now; the
+ * main thread just skips them if not.
+ */
+static void worker_vpush(struct worker *wk, struct mcgroup *g,
+                         struct rxbufs *rb, int n)
+{
+    struct wkpkt *wp;
+    unsigned head, tail;
+    int i;
+
+    head = atomic_load_explicit(&wk->wk_vhead, memory_order_acquire);
+    tail = atomic_load_explicit(&wk->wk_vtail, memory_order_relaxed);
+    for (i = 0; i < n && tail - head < WK_VRING; ++i, ++tail) {
+        wp = &wk->wk_vring[tail % WK_VRING];
+        wp->wp_g = g;
+        wp->wp_ns = rb->rb_ts[i].tv_sec * (int64_t)1000000000 +
+                    rb->rb_ts[i].tv_nsec;
+    }
+    atomic_store_explicit(&wk->wk_vtail, tail, memory_order_release);
+    if (i < n) {
+        atomic_fetch_add(&wk->wk_vlost, n - i);
+    }
+}
+
+/*
+ * worker_collect()
+ * In the main thread: report packets that worker 'wk' has counted since
+ * last time.  With "-v" each is reported, with the time it came in, from
+ * wk_vring[]; otherwise it's just a matter of noticing any group that's
+ * started receiving packets.
+ */
+static void worker_collect(struct config *cfg, struct worker *wk)
+{
+    struct mcgroup *g;
+    struct wkpkt *wp;
+    struct timespec trx;
+    uint64_t rx, bad, vlost;
+    unsigned head, tail;
+    int64_t ns;
+    char buf[128];
+    int i;
+
+    /* clear this first, so packets received after this point wake us again */
+    atomic_store(&wk->wk_pending, 0);
+
+    /* each packet, for "-v" */
+    tail = atomic_load_explicit(&wk->wk_vtail, memory_order_acquire);
+    head = atomic_load_explicit(&wk->wk_vhead, memory_order_relaxed);
+    for (; cfg->cfg_verbose && head != tail; ++head) {
+        wp = &wk->wk_vring[head % WK_VRING];
+        trx.tv_sec = wp->wp_ns / 1000000000;
+        trx.tv_nsec = wp->wp_ns % 1000000000;
+        emit_at(cfg, wp->wp_g, reported_event_rx, NULL, &trx);
+    }
+    atomic_store_explicit(&wk->wk_vhead, tail, memory_order_release);
+    vlost = atomic_load(&wk->wk_vlost);
+    if (vlost != wk->wk_vlost_seen && cfg->cfg_verbose) {
+        snprintf(buf, sizeof(buf), "-v: %llu packets received by worker"
+                 " thread %d came too fast to report each one",
+                 (unsigned long long)(vlost - wk->wk_vlost_seen), wk->wk_idx);
+        emit(cfg, NULL, reported_event_note, buf);
+    }
+    wk->wk_vlost_seen = vlost;
+
+    for (i = 0; i < wk->wk_ngroups; ++i) {
+        g = wk->wk_groups[i];
+        rx = atomic_load(&g->mg_wk_rx);
+        bad = atomic_load(&g->mg_wk_bad);
+        if (rx == g->mg_wk_rx_seen) {
+            continue; /* nothing new */
+        }
+        worker_tlast(g);
+        ns = atomic_load(&g->mg_wk_trx);
+        trx.tv_sec = ns / 1000000000;
+        trx.tv_nsec = ns % 1000000000;
+        g->mg_wk_rx_seen = rx;
+        if (!g->mg_up) {
+            g->mg_up = 1;
+            theap_insert(cfg, g);
+            emit_at(cfg, g, reported_event_up, NULL, &trx);
+        }
+        for (; g->mg_wk_bad_seen < bad; ++g->mg_wk_bad_seen) {
+            emit(cfg, g, reported_event_pkt,
+                 "contents do not match '-d' option");
+        }
+        if (g->mg_data->pd_seq) {
+            seq_report(cfg, g, atomic_load(&g->mg_wk_lost),
+                       atomic_load(&g->mg_wk_reord),
+                       atomic_load(&g->mg_wk_dup));
+        }
+    }
+}
+
+/*
+ * worker_tlast()
+ * Update g->mg_tlast from the last packet time recorded by its worker.
+ */
+static void worker_tlast(struct mcgroup *g)
+{
+    g->mg_tlast = atomic_load(&g->mg_wk_tlast);
+}
+#endif /* DO_WORKERS */
+
+#ifdef DEE_PROFILE
+/** ** self profiling (DEE_PROFILE) ** **/
+
+/*
+ * prof_start()
+ * Start measuring, from now; called just before the main loop.
+ */
+static void prof_start(void)
+{
+    memset(&prof, 0, sizeof(prof));
+    prof.pf_start = prof.pf_since = mono_ns();
+    prof.pf_cur = prof_other;
+}
+
+/*
+ * prof_enter()
+ * Start phase 'phase' (enum prof_phase), charging the time since the
+ * last change to the one before it.  Returns that one, for prof_leave()
+ * to go back to when this phase ends; phases can be inside others.
  */
-static void errthrottle(void)
+static int prof_enter(int phase)
 {
-    static int errthrottle_ctr = 0; /* calls in 64 second period */
-    static time_t errthrottle_lst = 0; /* last 64 second period called */
-    int prd;
+    int64_t now = mono_ns();
+    int was = prof.pf_cur;
+
+    prof.pf_ns[was] += now - prof.pf_since;
+    prof.pf_since = now;
+    prof.pf_cur = phase;
+    ++prof.pf_calls[phase];
+    return(was);
+}
 
-    /* what time is it? use 64 second periods for convenience */
-    prd = time(NULL) >> 6;
+/*
+ * prof_leave()
+ * End the current phase, going back to 'was', which prof_enter()
+ * returned when this one started.
+ */
+static void prof_leave(int was)
+{
+    int64_t now = mono_ns();
 
-    /* how many times has errthrottle() been called in that time? */
-    if (errthrottle_lst != prd) {
-        errthrottle_lst = prd;
-        errthrottle_ctr = 0;
+    prof.pf_ns[prof.pf_cur] += now - prof.pf_since;
+    prof.pf_since = now;
+    prof.pf_cur = was;
+}
+
+/*
+ * prof_report()
+ * For "?c" and on exit: report, as notes, where the main thread's time
+ * has gone since it started: in each phase, the time, times it was
+ * entered, and system calls made; and per packet sent or received.
+ */
+static void prof_report(struct config *cfg)
+{
+    static const char *names[prof_nphases] = {
+        "other", "wait", "recv", "check", "emit", "flush", "send",
+        "timers", "churn", "command",
+    };
+    struct profile pf;
+    char buf[256];
+    double total, pkts;
+    uint64_t sys = 0;
+    int i;
+
+    /* bring it up to date and take a snapshot, so reporting isn't in it */
+    prof_leave(prof.pf_cur);
+    pf = prof;
+    total = pf.pf_since - pf.pf_start;
+    if (total <= 0) {
+        total = 1;
+    }
+    pkts = pf.pf_pkts ? pf.pf_pkts : 1;
+    for (i = 0; i < prof_nphases; ++i) {
+        sys += pf.pf_sys[i];
     }
-    ++errthrottle_ctr;
 
-    /* sleep if it's a lot */
-    if (errthrottle_ctr > 20) {
-        sleep(1);
+    snprintf(buf, sizeof(buf),
+             "profile: %.3f sec, %llu packets, %llu wakeups (%.3f per packet),"
+             " %llu system calls (%.3f per packet)", total * 1e-9,
+             (unsigned long long)pf.pf_pkts,
+             (unsigned long long)pf.pf_calls[prof_wait],
+             pf.pf_calls[prof_wait] / pkts, (unsigned long long)sys,
+             sys / pkts);
+    emit(cfg, NULL, reported_event_note, buf);
+    for (i = 0; i < prof_nphases; ++i) {
+        snprintf(buf, sizeof(buf),
+                 "profile %s: %.6f sec (%.1f%%), %llu calls, %llu system"
+                 " calls, %.0f ns per packet", names[i], pf.pf_ns[i] * 1e-9,
+                 pf.pf_ns[i] * 100.0 / total,
+                 (unsigned long long)pf.pf_calls[i],
+                 (unsigned long long)pf.pf_sys[i], pf.pf_ns[i] / pkts);
+        emit(cfg, NULL, reported_event_note, buf);
+    }
+}
+#endif /* DEE_PROFILE */
+
+/** ** sending packets ** **/
+
+/*
+ * mono_ns()
+ * Returns the time on a monotonic clock (one that doesn't get set), in
+ * nanoseconds.  Only useful for intervals.
+ */
+static int64_t mono_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(((int64_t)ts.tv_sec) * 1000000000 + ts.tv_nsec);
+}
+
+/*
+ * tx_interval()
+ * Returns the time between packets sent to group 'g', in nanoseconds:
+ * from its own rate (-R in the -G file), or else -R, or else the period
+ * (-P).  Stores in *rated whether it's from a rate.
+ */
+static double tx_interval(struct config *cfg, struct mcgroup *g, int *rated)
+{
+    double pps = cfg->cfg_rate;
+    int bits = cfg->cfg_rate_bits;
+    size_t len = g->mg_data->pd_len;
+
+    if (g->mg_rate >= 0) {
+        /* its own */
+        pps = g->mg_rate;
+        bits = g->mg_rate_bits;
     }
+    *rated = (pps > 0);
+    if (pps <= 0) {
+        return(cfg->cfg_period_ns);
+    }
+    if (bits) {
+        pps /= 8.0 * (len ? len : 1);
+    }
+    return(1e+9 / pps);
 }
 
 /*
- * emit()
- * Emit a line of our main output.
+ * tx_pace()
+ * Figure out whether it's time to send to group 'g', and how much.
+ *
  * Parameters:
- *      cfg - configuration
- *      evt - event: what happened; one of enum reported_events
- *      extra - extra information if any
+ *      cfg - configuration, including rate & period
+ *      g - the group, including the state of its schedule
+ *      now - the current time, mono_ns()
+ *      due - number of packets that are due to be sent now is stored
+ *          here: up to cfg_batch when sending at a rate, 1 by period
+ *
+ * Returns:
+ *      When the next packet is due, mono_ns(); 'now' if it's already
+ *      due, in which case *due is at least 1.
  */
-static void emit(struct config *cfg, enum reported_events evt, char *extra)
+static int64_t tx_pace(struct config *cfg, struct mcgroup *g, int64_t now,
+                       int *due)
 {
-    struct timeval tv;
-    char ts[128];
-    char *ekw, *eph, *eex;
+    double interval, behind, n;
+    int rated, burst;
 
-    /*
-     * Decide whether 'evt' is an event we're reporting now,
-     * and what to call it.
-     */
-    switch (evt) {
-    case reported_event_tx:
-        /* transmitted packet: only report if verbose */
-        if (cfg->cfg_verbose == 0) return;
-        ekw = "sent";
-        eph = "sent packet to";
-        break;
-    case reported_event_rx:
-        /* received packet: only report if verbose */
-        if (cfg->cfg_verbose == 0) return;
-        ekw = "recv";
-        eph = "received packet on";
-        break;
-    case reported_event_up:
+    if (cfg->cfg_trace != NULL) {
+        /* not at a rate, but as the -F traffic profile has it */
+        return(trace_pace(cfg, g, now, due));
+    }
+    interval = tx_interval(cfg, g, &rated);
+    burst = rated ? cfg->cfg_batch : 1;
+
+    if (g->mg_tx_next == 0) {
         /*
-         * Coming "up" after receiving a packet: *don't* report if verbose,
-         * because then reported_event_rx shows up.
-         * (except with doubly-verbose)
+         * first time: at a rate, start right away; by period, the first
+         * packet goes a period from now
          */
-        if (cfg->cfg_verbose == 1) return;
-        ekw = "up";
-        eph = "started receiving packets on";
-        break;
-    case reported_event_dn:
-        /* timeout after not receiving a packet: *don't* report if verbose,
-         * because then the absence of reported_event_rx should be clear
-         * enough.
-         * (except with doubly-verbose)
+        g->mg_tx_next = rated ? now : (now + (int64_t)interval);
+        g->mg_tx_carry = 0;
+    }
+    behind = now - g->mg_tx_next;
+    if (behind < 0) {
+        /* not yet */
+        *due = 0;
+        return(g->mg_tx_next);
+    }
+    if (behind > TX_MAX_LAG && behind > interval * burst) {
+        /*
+         * We've fallen way behind schedule, maybe because the rate
+         * changed, or because we can't go that fast.  Don't try to make up
+         * for it with a big burst.
          */
-        if (cfg->cfg_verbose == 1) return;
-        ekw = "down";
-        eph = "no longer receiving packets on";
-        break;
-    case reported_event_cmd:
-        /* command issued on stdin; see -k */
-        ekw = "command";
-        eph = "received command for";
-        break;
-    case reported_event_note:
-        /* informational note */
-        ekw = "note";
-        eph = "note:";
-        break;
-    case reported_event_pkt:
-        /* something about a packet we received */
-        ekw = "pkt";
-        eph = "for packet on";
-        break;
-    default:
-        /* unknown event, don't report it */
+        g->mg_tx_next = now;
+        g->mg_tx_carry = 0;
+        behind = 0;
+    }
+    n = 1 + floor(behind / interval);
+    *due = (n < burst) ? (int)n : burst;
+    return(now);
+}
+
+/*
+ * tx_paced()
+ * Advance group 'g's schedule past 'sent' packets that have been sent.
+ * That's from when they were due, not when they went, so the schedule
+ * doesn't drift.
+ */
+static void tx_paced(struct config *cfg, struct mcgroup *g, int sent)
+{
+    double adv;
+    int64_t whole;
+    int rated;
+
+    if (cfg->cfg_trace != NULL) {
+        return; /* trace_pace() took care of it */
+    }
+    adv = sent * tx_interval(cfg, g, &rated) + g->mg_tx_carry;
+    whole = floor(adv);
+    g->mg_tx_next += whole;
+    g->mg_tx_carry = adv - whole;
+}
+
+/*
+ * tx_start()
+ * In send (-t) mode, before sending anything: make room for tx_groups()
+ * to work in, and put all the groups in cfg_theap[], due right away.
+ * Each one's schedule starts when tx_pace() first sees it.
+ */
+static void tx_start(struct config *cfg)
+{
+    int i;
+
+    cfg->cfg_tx_gs = calloc(cfg->cfg_ngroups, sizeof(cfg->cfg_tx_gs[0]));
+    cfg->cfg_tx_gn = calloc(cfg->cfg_ngroups, sizeof(cfg->cfg_tx_gn[0]));
+    for (i = 0; i < cfg->cfg_ngroups; ++i) {
+        cfg->cfg_groups[i]->mg_tdue = 0;
+        cfg->cfg_groups[i]->mg_theap_pos = i;
+        cfg->cfg_theap[i] = cfg->cfg_groups[i];
+    }
+    cfg->cfg_ntheap = cfg->cfg_ngroups;
+}
+
+/*
+ * tx_groups()
+ * In send (-t) mode, send whatever packets are due, to all the groups.
+ *
+ * All the groups are kept in a min-heap, cfg_theap[], on mg_tdue, when
+ * each next has a packet due; so thousands of them, each at its own rate,
+ * are interleaved by when their packets are due, and only the ones due
+ * get looked at.  Groups that come due together and share a socket
+ * ("-o txshare") are sent to with one system call.
+ *
+ * Parameters:
+ *      cfg - configuration, including the groups
+ *      now - the current time, mono_ns()
+ *
+ * Returns:
+ *      when the next packet is due, mono_ns()
+ */
+static int64_t tx_groups(struct config *cfg, int64_t now)
+{
+    struct mcgroup *g;
+    int due, nb = 0, npkts = 0;
+
+    while (cfg->cfg_theap[0]->mg_tdue <= now) {
+        g = cfg->cfg_theap[0];
+        tx_pace(cfg, g, now, &due);
+        if (due > 0) {
+            if (nb > 0 && (g->mg_sok != cfg->cfg_tx_gs[0]->mg_sok ||
+                           npkts + due > TX_BATCH_MAX)) {
+                /* can't go with the ones collected so far */
+                tx_batch(cfg, nb);
+                nb = npkts = 0;
+            }
+            cfg->cfg_tx_gs[nb] = g;
+            cfg->cfg_tx_gn[nb++] = due;
+            npkts += due;
+            tx_paced(cfg, g, due); /* don't try to catch up on failures */
+        }
+        /*
+         * If it's still behind, it'll get another turn next time around,
+         * after the others that are due now.
+         */
+        g->mg_tdue = (g->mg_tx_next > now) ? g->mg_tx_next : (now + 1);
+        theap_down(cfg, 0);
+    }
+    if (nb > 0) {
+        tx_batch(cfg, nb);
+    }
+    return(cfg->cfg_theap[0]->mg_tdue);
+}
+
+/*
+ * tx_batch()
+ * Send the packets tx_groups() has collected for the first 'ng' groups
+ * in cfg_tx_gs[], and report and count them.
+ */
+static void tx_batch(struct config *cfg, int ng)
+{
+    struct mcgroup *g;
+    struct trpos tp;
+    struct iovec iov[2];
+    int k, i, rv, was;
+
+    was = prof_enter(prof_send);
+    rv = tx_burst(cfg, cfg->cfg_tx_gs, cfg->cfg_tx_gn, ng);
+    prof_leave(was);
+    if (rv < 0) {
+        errout("sending failed: %s", strerror(errno));
+        errthrottle();
         return;
     }
+    prof_packets(rv);
+    for (k = 0; k < ng; ++k) {
+        g = cfg->cfg_tx_gs[k];
+        rv = cfg->cfg_tx_gn[k];
+        for (i = 0; i < rv; ++i) {
+            emit(cfg, g, reported_event_tx, NULL);
+        }
+        probe_tx(g, rv);
+        g->mg_tx_pkts += rv;
+        if (cfg->cfg_trace != NULL) {
+            /* -F: each its own length */
+            tp = g->mg_tr_send;
+            for (i = 0; i < rv; ++i) {
+                g->mg_tx_bytes += trace_pkt(cfg, g, &tp, iov);
+            }
+        } else {
+            g->mg_tx_bytes += rv * g->mg_data->pd_len;
+        }
+        if (cfg->cfg_binlog_fd >= 0) {
+            binlog_tx(cfg, g, rv);
+        }
+    }
+}
 
-    /* fill in a timestamp */
-    gettimeofday(&tv, NULL);
-    (*timestamp_formatter)(&tv, ts, sizeof(ts), timestamp_formatter_arg);
+/*
+ * tx_burst()
+ * Send packets to the 'ng' groups in 'gs': counts[k] copies of the packet
+ * data (mg_data) of gs[k], using sendmmsg() if available.  With
+ * "-d seq" each gets its own header.  With "-o gso" several packets go
+ * in each message given to sendmmsg(), and the kernel splits them up.
+ * More than one group at a time only works if they share a socket
+ * ("-o txshare"); then each message says which interface it goes out on.
+ * Stores the number of packets sent to each group in counts[].
+ * Returns the total number of packets sent, or -1 with errno set if none
+ * were sent.
+ */
+static int tx_burst(struct config *cfg, struct mcgroup **gs, int *counts,
+                    int ng)
+{
+    struct mcgroup *g = gs[0];
+    struct pktdata *pd;
+    struct trpos tp;
+    int count, sent, rv, i, k;
+#ifdef HAVE_SENDMMSG
+    int flags = 0, many;
+#endif /* HAVE_SENDMMSG */
+#ifdef HAVE_MSG_ZEROCOPY
+    /*
+     * Not when what follows the headers differs in each packet: there's
+     * only one cfg_tx_body, which the kernel would still be reading.
+     * Groups with zero copy don't share sockets, so there's just the one.
+     */
+    int zc = g->mg_zc && !SEQ_VARIES(g->mg_data);
+#endif /* HAVE_MSG_ZEROCOPY */
 
-    /* message */
-    if (cfg->cfg_csv) {
-        /* comma separated values format: time, label, keyword, extra */
-        eex = extra ? csv_escape(extra) : NULL;
-        printf("%s%s%s,%s,%s\n",
-               ts, ts[0] ? "," : "",
-               cfg->cfg_label_csv, ekw, eex ? : "");
-        if (eex) {
-            free(eex);
+    for (count = k = 0; k < ng; ++k) {
+        count += counts[k];
+    }
+#ifdef HAVE_SENDMMSG
+    many = (count > 1);
+#ifdef HAVE_TX_PKTINFO
+    if (cfg->cfg_txshare) {
+        many = 1; /* to say which interface, sendto() can't */
+    }
+#endif /* HAVE_TX_PKTINFO */
+#endif /* HAVE_SENDMMSG */
+
+#ifdef HAVE_MSG_ZEROCOPY
+    if (zc) {
+        /*
+         * Zero copy: always use sendmmsg(), so "-d seq" headers can come
+         * from the pool; and don't send more than there are headers free.
+         */
+        int avail;
+
+        zc_reap(cfg, g, 0);
+        avail = ZC_POOL - (int)(g->mg_zc_hsent - g->mg_zc_hdone);
+        if (avail <= 0) {
+            zc_reap(cfg, g, ZC_WAIT_MS);
+            avail = ZC_POOL - (int)(g->mg_zc_hsent - g->mg_zc_hdone);
+        }
+        if (avail <= 0) {
+            errno = ENOBUFS;
+            return(-1);
+        }
+        if (count > avail) {
+            count = counts[0] = avail;
+        }
+        many = 1;
+        flags = MSG_ZEROCOPY;
+    }
+#endif /* HAVE_MSG_ZEROCOPY */
+
+#ifdef HAVE_SENDMMSG
+    if (many) {
+        /* one system call for (potentially) all of them */
+        struct iovec *iov;
+        struct msghdr *mh;
+        size_t bodylen = 0;
+        int per, nmsgs, m, n, p, e;
+#ifdef HAVE_UDP_SEGMENT
+        int segs = 0;
+#endif /* HAVE_UDP_SEGMENT */
+
+        if (cfg->cfg_tx_nmsgs < count) {
+            /* need bigger arrays for sendmmsg() */
+            if (cfg->cfg_tx_msgs) {
+                free(cfg->cfg_tx_msgs);
+            }
+            if (cfg->cfg_tx_iovs) {
+                free(cfg->cfg_tx_iovs);
+            }
+            if (cfg->cfg_tx_hdrs) {
+                free(cfg->cfg_tx_hdrs);
+            }
+            if (cfg->cfg_tx_ctl) {
+                free(cfg->cfg_tx_ctl);
+            }
+            cfg->cfg_tx_nmsgs = count;
+            cfg->cfg_tx_msgs = calloc(count, sizeof(cfg->cfg_tx_msgs[0]));
+            cfg->cfg_tx_iovs = calloc(count * 2, sizeof(cfg->cfg_tx_iovs[0]));
+            cfg->cfg_tx_hdrs = calloc(count, SEQ_HDR_LEN);
+            cfg->cfg_tx_ctl = calloc(count, TX_CTL_LEN);
+        }
+        for (k = 0; k < ng; ++k) {
+            pd = gs[k]->mg_data;
+            if (SEQ_VARIES(pd) && pd->pd_len - SEQ_HDR_LEN > bodylen) {
+                bodylen = pd->pd_len - SEQ_HDR_LEN;
+            }
+        }
+        if (bodylen > 0 &&
+            (cfg->cfg_tx_nbody < count || cfg->cfg_tx_bodylen < bodylen)) {
+            /* need a bigger space for what's after them */
+            if (cfg->cfg_tx_body) {
+                free(cfg->cfg_tx_body);
+            }
+            cfg->cfg_tx_nbody = cfg->cfg_tx_nmsgs;
+            cfg->cfg_tx_bodylen = bodylen;
+            cfg->cfg_tx_body = calloc(cfg->cfg_tx_nbody,
+                                      cfg->cfg_tx_bodylen);
+        }
+
+        /* two parts to each packet, so they can be put together */
+        for (p = k = 0; k < ng; ++k) {
+            g = gs[k];
+            pd = g->mg_data;
+            tp = g->mg_tr_send;
+            for (i = 0; i < counts[k]; ++i, ++p) {
+                iov = &cfg->cfg_tx_iovs[p * 2];
+                if (cfg->cfg_trace != NULL) {
+                    /* -F: the length, and data, from the profile */
+                    trace_pkt(cfg, g, &tp, iov);
+                }
+                if (pd->pd_seq) {
+                    /* a header of its own, then the rest of the data */
+                    iov[0].iov_base = cfg->cfg_tx_hdrs + p * SEQ_HDR_LEN;
+#ifdef HAVE_MSG_ZEROCOPY
+                    if (zc) {
+                        iov[0].iov_base = g->mg_zc_hdrs + SEQ_HDR_LEN *
+                            ((g->mg_zc_hsent + p) % ZC_POOL);
+                    }
+#endif /* HAVE_MSG_ZEROCOPY */
+                    iov[0].iov_len = SEQ_HDR_LEN;
+                    seq_stamp(cfg, g, iov[0].iov_base);
+                    if (cfg->cfg_trace != NULL) {
+                        continue; /* the rest's from trace_pkt() */
+                    }
+                    iov[1].iov_base = pd->pd_data + SEQ_HDR_LEN;
+                    iov[1].iov_len = pd->pd_len - SEQ_HDR_LEN;
+                    if (SEQ_VARIES(pd)) {
+                        /* and that, of its own too */
+                        iov[1].iov_base = cfg->cfg_tx_body +
+                            p * cfg->cfg_tx_bodylen;
+                        seq_fill(pd, iov[0].iov_base, iov[1].iov_base);
+                    }
+                } else if (cfg->cfg_trace == NULL) {
+                    iov[0].iov_base = pd->pd_data;
+                    iov[0].iov_len = pd->pd_len;
+                    iov[1].iov_base = pd->pd_data;
+                    iov[1].iov_len = 0;
+                }
+            }
+        }
+
+        /* and up to 'per' packets to each message, all for one group */
+        for (p = nmsgs = k = 0; k < ng; ++k) {
+            g = gs[k];
+            per = tx_per(g);
+            for (m = 0; m < counts[k]; m += per, ++nmsgs) {
+                n = (counts[k] - m < per) ? (counts[k] - m) : per;
+                mh = &cfg->cfg_tx_msgs[nmsgs].msg_hdr;
+                mh->msg_name = &g->mg_dst;
+                mh->msg_namelen = g->mg_dstlen;
+                mh->msg_iov = &cfg->cfg_tx_iovs[(p + m) * 2];
+                mh->msg_iovlen = n * 2;
+                tx_control(cfg, g, mh, cfg->cfg_tx_ctl + nmsgs * TX_CTL_LEN,
+                           n);
+#ifdef HAVE_UDP_SEGMENT
+                segs |= (n > 1);
+#endif /* HAVE_UDP_SEGMENT */
+            }
+            p += counts[k];
+        }
+        prof_syscall();
+        rv = sendmmsg(gs[0]->mg_sok, cfg->cfg_tx_msgs, nmsgs, flags);
+        e = errno;
+
+#ifdef HAVE_MSG_ZEROCOPY
+        /* keep track of the pool's headers, for each message that went */
+        g = gs[0]; /* the only group, with zero copy */
+        per = tx_per(g);
+        for (m = 0; zc && m < rv; ++m) {
+            n = (count - m * per < per) ? (count - m * per) : per;
+            g->mg_zc_hsent += n;
+            g->mg_zc_marks[g->mg_zc_sent % ZC_POOL] = g->mg_zc_hsent;
+            ++g->mg_zc_sent;
+        }
+#endif /* HAVE_MSG_ZEROCOPY */
+
+        /* count the packets in the messages that went, for each group */
+        m = (rv < 0) ? 0 : rv;
+        for (sent = k = 0; k < ng; ++k) {
+            g = gs[k];
+            per = tx_per(g);
+            n = (counts[k] + per - 1) / per; /* messages it had */
+            i = (m >= n) ? counts[k] : (m * per);
+            m = (m >= n) ? (m - n) : 0;
+            if (g->mg_data->pd_seq) {
+                /* sequence numbers not sent, will be used next time */
+                g->mg_tx_seq -= counts[k] - i;
+            }
+            counts[k] = i;
+            sent += i;
+        }
+#ifdef HAVE_UDP_SEGMENT
+        if (rv < 0 && segs &&
+            (e == EINVAL || e == EIO || e == EMSGSIZE)) {
+            /* probably means segmentation can't be done here */
+            errout("-o gso: send failed (%s); turning it off", strerror(e));
+            for (k = 0; k < ng; ++k) {
+                gs[k]->mg_gso = 0;
+            }
+        }
+#endif /* HAVE_UDP_SEGMENT */
+        errno = e;
+        return(sent ? sent : -1);
+    }
+#endif /* HAVE_SENDMMSG */
+
+    /* one system call per packet */
+    for (sent = k = 0; k < ng; ++k) {
+        g = gs[k];
+        pd = g->mg_data;
+        tp = g->mg_tr_send;
+        for (i = 0; i < counts[k]; ++i) {
+            if (pd->pd_seq) {
+                seq_stamp(cfg, g, pd->pd_data);
+                if (SEQ_VARIES(pd)) {
+                    seq_fill(pd, pd->pd_data, pd->pd_data + SEQ_HDR_LEN);
+                }
+            }
+            prof_syscall();
+            if (cfg->cfg_trace != NULL) {
+                /* -F: the length, and data, from the profile */
+                struct iovec iov[2];
+                struct msghdr mh;
+
+                trace_pkt(cfg, g, &tp, iov);
+                if (pd->pd_seq) {
+                    iov[0].iov_base = pd->pd_data; /* the header */
+                }
+                memset(&mh, 0, sizeof(mh));
+                mh.msg_name = &g->mg_dst;
+                mh.msg_namelen = g->mg_dstlen;
+                mh.msg_iov = iov;
+                mh.msg_iovlen = 2;
+                rv = sendmsg(g->mg_sok, &mh, 0);
+            } else {
+                rv = sendto(g->mg_sok, pd->pd_data, pd->pd_len, 0,
+                            (void *)&g->mg_dst, g->mg_dstlen);
+            }
+            if (rv < 0) {
+                if (pd->pd_seq) {
+                    --g->mg_tx_seq; /* not sent, will be used next time */
+                }
+                break;
+            }
+        }
+        sent += i;
+        if (i < counts[k]) {
+            /* it failed; don't go on to the rest */
+            counts[k] = i;
+            while (++k < ng) {
+                counts[k] = 0;
+            }
+        }
+    }
+    return(sent ? sent : -1);
+}
+
+#ifdef HAVE_SENDMMSG
+/*
+ * tx_per()
+ * Returns how many packets to put in each message sent to group 'g':
+ * with "-o gso", as many as the kernel can split up; otherwise 1.
+ */
+static int tx_per(struct mcgroup *g)
+{
+    int per = 1;
+
+#ifdef HAVE_UDP_SEGMENT
+    if (g->mg_gso && g->mg_data->pd_len > 0) {
+        per = TX_GSO_MAX / g->mg_data->pd_len;
+        if (per > TX_GSO_SEGS) {
+            per = TX_GSO_SEGS;
+        } else if (per < 1) {
+            per = 1;
+        }
+    }
+#endif /* HAVE_UDP_SEGMENT */
+    return(per);
+}
+
+/*
+ * tx_control()
+ * Fill in the control messages, if any, for message 'mh' of 'n' packets
+ * to group 'g', in 'ctl', which has room for TX_CTL_LEN bytes: with
+ * "-o gso", where the kernel is to split it; with "-o txshare", which
+ * interface it goes out on.
+ */
+static void tx_control(struct config *cfg, struct mcgroup *g,
+                       struct msghdr *mh, uint8_t *ctl, int n)
+{
+    struct cmsghdr *cm;
+    size_t len = 0;
+
+    mh->msg_control = NULL;
+    mh->msg_controllen = 0;
+#ifdef HAVE_UDP_SEGMENT
+    if (n > 1) {
+        /* tell the kernel where to split it */
+        uint16_t gso = g->mg_data->pd_len;
+
+        cm = (void *)(ctl + len);
+        cm->cmsg_level = IPPROTO_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(gso));
+        memcpy(CMSG_DATA(cm), &gso, sizeof(gso));
+        len += CMSG_SPACE(sizeof(gso));
+    }
+#endif /* HAVE_UDP_SEGMENT */
+#ifdef HAVE_TX_PKTINFO
+    if (cfg->cfg_txshare && cfg->cfg_af == AF_INET6) {
+        /* the socket's shared: tell the kernel which interface */
+        struct in6_pktinfo pi;
+
+        memset(&pi, 0, sizeof(pi));
+        pi.ipi6_ifindex = g->mg_intf.idx;
+        cm = (void *)(ctl + len);
+        cm->cmsg_level = IPPROTO_IPV6;
+        cm->cmsg_type = IPV6_PKTINFO;
+        cm->cmsg_len = CMSG_LEN(sizeof(pi));
+        memcpy(CMSG_DATA(cm), &pi, sizeof(pi));
+        len += CMSG_SPACE(sizeof(pi));
+    } else if (cfg->cfg_txshare) {
+        struct in_pktinfo pi;
+
+        memset(&pi, 0, sizeof(pi));
+        pi.ipi_ifindex = g->mg_intf.idx;
+        cm = (void *)(ctl + len);
+        cm->cmsg_level = IPPROTO_IP;
+        cm->cmsg_type = IP_PKTINFO;
+        cm->cmsg_len = CMSG_LEN(sizeof(pi));
+        memcpy(CMSG_DATA(cm), &pi, sizeof(pi));
+        len += CMSG_SPACE(sizeof(pi));
+    }
+#endif /* HAVE_TX_PKTINFO */
+    if (len > 0) {
+        mh->msg_control = ctl;
+        mh->msg_controllen = len;
+    }
+}
+#endif /* HAVE_SENDMMSG */
+
+#ifdef HAVE_TX_PKTINFO
+/*
+ * tx_share()
+ * For "-o txshare": if an earlier group has a socket group 'g' can share,
+ * give 'g' that one instead of its own.  That's one with everything
+ * group_socket() sets per group the same: the TTL, and the interface
+ * (which also goes with each packet, see tx_control()).  Returns nonzero
+ * if it found one.
+ */
+static int tx_share(struct config *cfg, struct mcgroup *g)
+{
+    struct mcgroup *o;
+    int i;
+
+    for (i = 0; i < g->mg_idx; ++i) {
+        o = cfg->cfg_groups[i];
+        if (o->mg_ttl == g->mg_ttl && o->mg_intf.idx == g->mg_intf.idx &&
+            o->mg_intf.adr.s_addr == g->mg_intf.adr.s_addr) {
+            g->mg_sok = o->mg_sok;
+#ifdef HAVE_UDP_SEGMENT
+            g->mg_gso = o->mg_gso;
+#endif /* HAVE_UDP_SEGMENT */
+            group_dest(g);
+            return(1);
+        }
+    }
+    return(0);
+}
+#endif /* HAVE_TX_PKTINFO */
+
+#ifdef HAVE_MSG_ZEROCOPY
+/*
+ * zc_reap()
+ * With "-o zerocopy": read the kernel's notices of which sends on group
+ * 'g' it's done with, from the socket's error queue.  If there are none,
+ * wait up to 'wait_ms' milliseconds for one.
+ */
+static void zc_reap(struct config *cfg, struct mcgroup *g, int wait_ms)
+{
+    static int copied_complained = 0; /* only say it once, not per group */
+    char ctl[CMSG_SPACE(sizeof(struct sock_extended_err) +
+                        sizeof(struct sockaddr_in6))];
+    struct msghdr mh;
+    struct cmsghdr *cm;
+    struct sock_extended_err *ee;
+    struct pollfd pfd;
+    uint32_t off, end, inflight;
+
+    for (;;) {
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_control = ctl;
+        mh.msg_controllen = sizeof(ctl);
+        if (recvmsg(g->mg_sok, &mh, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_ms > 0) {
+                /* errors, including these notices, show up as POLLERR */
+                pfd.fd = g->mg_sok;
+                pfd.events = 0;
+                if (poll(&pfd, 1, wait_ms) > 0) {
+                    wait_ms = 0;
+                    continue;
+                }
+            }
+            return;
+        }
+        wait_ms = 0;
+        for (cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)) {
+            if (!(cm->cmsg_level == IPPROTO_IP &&
+                  cm->cmsg_type == IP_RECVERR) &&
+                !(cm->cmsg_level == IPPROTO_IPV6 &&
+                  cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            ee = (void *)CMSG_DATA(cm);
+            if (ee->ee_errno != 0 || ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            /*
+             * Sends ee_info through ee_data are done: mark the ones still
+             * in flight, then move mg_zc_done past as many as are done in
+             * a row.  It never goes back, and never past one not done.
+             */
+            inflight = g->mg_zc_sent - g->mg_zc_done;
+            off = ee->ee_info - g->mg_zc_done;
+            end = ee->ee_data - g->mg_zc_done;
+            if ((int32_t)off < 0) {
+                off = 0; /* some of them were done already */
+            }
+            for (; (int32_t)off <= (int32_t)end && off < inflight; ++off) {
+                g->mg_zc_fin[(g->mg_zc_done + off) % ZC_POOL] = 1;
+            }
+            while (g->mg_zc_done != g->mg_zc_sent &&
+                   g->mg_zc_fin[g->mg_zc_done % ZC_POOL]) {
+                g->mg_zc_fin[g->mg_zc_done % ZC_POOL] = 0;
+                g->mg_zc_hdone = g->mg_zc_marks[g->mg_zc_done % ZC_POOL];
+                ++g->mg_zc_done;
+            }
+            if ((ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) &&
+                !copied_complained) {
+                errout("-o zerocopy: the kernel copied the data anyway"
+                       " (looped back, or not supported by the interface)");
+                copied_complained = 1;
+            }
         }
-    } else {
-        /* more or less human readable format */
-        printf("%s%s%s %s%s%s\n",
-               ts, ts[0] ? " " : "", eph, cfg->cfg_label,
-               extra ? " " : "", extra ? : "");
     }
-
-    /* write out the message right away */
-    fflush(stdout);
 }
 
 /*
- * auto_pton()
- *
- * Parse an IP address.  Determines from its contents whether it's IPv4
- * or IPv6.
- *
- * Parameters:
- *      s - the address string to parse
- *      ss - structure to store it in
- *      sslen - before: size of 'ss'; after: size actually used in 'ss'
- *      cfg - config structure; cfg->cfg_af will be updated/enforced, so
- *          that this program accepts only all-IPv4 or all-IPv6.
- * Return:
- *      !=0 on success
- *      0 on failure
+ * zc_drain()
+ * With "-o zerocopy": wait a little while for the kernel to finish with
+ * all the sends, so the data can be changed.
  */
-static int auto_pton(char *s, struct sockaddr_storage *ss,
-                     socklen_t *sslen, struct config *cfg)
+static void zc_drain(struct config *cfg)
 {
-    int rv;
-    void *ap;
-
-    if (cfg->cfg_af == AF_UNSPEC) {
-        /*
-         * Figure out what address family this is.  Simple idea: ':'
-         * appears in IPv6 addresses, not in IPv4.
-         */
-        if (strchr(s, ':')) {
-            cfg->cfg_af = AF_INET6;
-        } else {
-            cfg->cfg_af = AF_INET;
-        }
-    }
-    memset(ss, 0, sizeof(*ss));
-    ss->ss_family = cfg->cfg_af;
-    if (cfg->cfg_af == AF_INET6) {
-        if (*sslen < sizeof(struct sockaddr_in6)) {
-            errout("internal error: trying to fit IPv6 address in short space");
-            return(0);
-        }
-        *sslen = sizeof(struct sockaddr_in6);
-        ap = &((struct sockaddr_in6 *)ss)->sin6_addr;
-        ((struct sockaddr_in6 *)ss)->sin6_port = 0;
-#ifdef HAVE_SA_LEN
-        ((struct sockaddr_in6 *)ss)->sin6_len = sizeof(struct sockaddr_in6);
-#endif
-    } else {
-        if (*sslen < sizeof(struct sockaddr_in)) {
-            errout("internal error: trying to fit IPv4 address in short space");
-            return(0);
+    struct mcgroup *g;
+    int i, tries;
+
+    for (i = 0; i < cfg->cfg_ngroups; ++i) {
+        g = cfg->cfg_groups[i];
+        for (tries = 0; g->mg_zc && g->mg_zc_sent != g->mg_zc_done; ++tries) {
+            if (tries >= 100) {
+                errout("-o zerocopy: data changed while %u packets"
+                       " still in flight",
+                       (unsigned)(g->mg_zc_sent - g->mg_zc_done));
+                break;
+            }
+            zc_reap(cfg, g, 10);
         }
-        *sslen = sizeof(struct sockaddr_in);
-        ap = &((struct sockaddr_in *)ss)->sin_addr;
-        ((struct sockaddr_in *)ss)->sin_port = 0;
-#ifdef HAVE_SA_LEN
-        ((struct sockaddr_in *)ss)->sin_len = sizeof(struct sockaddr_in);
-#endif
-    }
-    rv = inet_pton(cfg->cfg_af, s, ap);
-    if (rv > 0) {
-        return(1); /* success */
-    } else if (rv == 0) {
-        errout("Invalid %s address '%s'",
-               (cfg->cfg_af == AF_INET6) ? "IPv6" : "IPv4", s);
-        return(0);
-    } else {
-        errout("Error in parsing address '%s': %s", s, strerror(errno));
-        return(0);
     }
 }
+#endif /* HAVE_MSG_ZEROCOPY */
+
+/** ** replaying traffic profiles (-F) ** **/
 
 /*
- * auto_ntop()
- *
- * Format an IPv4 or IPv6 address.  Determines from its contents whether
- * it's IPv4 or IPv6.  Wrapper around inet_ntop().
- *
- * Parameters:
- *      src - the address (pointer to a 'struct sockaddr*')
- *      dst - buffer to store the result
- *      size - size of dst in bytes
- * Return:
- *      pointer to the string in dst
+ * trace_load()
+ * For -F: map the traffic profile file into memory, figure out what kind
+ * it is, and go through it once, to count the packets and see how long
+ * they take.  Exits on failure.
  */
-static char *auto_ntop(void *src, char *dst, socklen_t size)
+static void trace_load(struct config *cfg)
 {
-    int af;
-
-    /* what kind of address is it? */
-    if (src == NULL) {
-        af = AF_UNSPEC;
+    struct trace *tr;
+    struct trpkt pk;
+    struct stat st;
+    uint32_t magic, order;
+    uint16_t version, reclen;
+    size_t off, maxlen;
+    int64_t t = 0;
+    int fd, rv;
+
+    tr = calloc(1, sizeof(*tr));
+    tr->tr_fn = cfg->cfg_trace_fn;
+    tr->tr_speed = cfg->cfg_trace_speed;
+    fd = open(tr->tr_fn, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        errout("-F %s: %s", tr->tr_fn, strerror(errno));
+        exit(1);
+    }
+    tr->tr_size = st.st_size;
+    if (tr->tr_size < 24) {
+        errout("-F %s: too short to be a traffic profile", tr->tr_fn);
+        exit(1);
+    }
+    tr->tr_map = mmap(NULL, tr->tr_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (tr->tr_map == MAP_FAILED) {
+        errout("-F %s: mmap() failed: %s", tr->tr_fn, strerror(errno));
+        exit(1);
+    }
+    close(fd);
+    /* so replaying it doesn't wait for the disk */
+    posix_madvise(tr->tr_map, tr->tr_size, POSIX_MADV_WILLNEED);
+
+    /* what kind of file is it? */
+    memcpy(&magic, tr->tr_map, sizeof(magic));
+    if (!memcmp(tr->tr_map, TRACE_MAGIC, 4)) {
+        /* ours: struct tracehdr */
+        tr->tr_fmt = trace_format_olgt;
+        memcpy(&order, tr->tr_map + offsetof(struct tracehdr, th_order),
+               sizeof(order));
+        if (order != 0x01020304) {
+            tr->tr_swap = 1;
+            trace_get(tr, (void *)&order, &order, sizeof(order));
+        }
+        trace_get(tr, tr->tr_map + offsetof(struct tracehdr, th_version),
+                  &version, sizeof(version));
+        trace_get(tr, tr->tr_map + offsetof(struct tracehdr, th_reclen),
+                  &reclen, sizeof(reclen));
+        if (order != 0x01020304 || version != TRACE_VERSION ||
+            reclen < sizeof(struct tracerec)) {
+            errout("-F %s: unknown byte order, version %u, or record"
+                   " length %u", tr->tr_fn, (unsigned)version,
+                   (unsigned)reclen);
+            exit(1);
+        }
+        tr->tr_reclen = reclen;
+        tr->tr_first = sizeof(struct tracehdr);
+    } else if (magic == 0xa1b2c3d4 || magic == 0xd4c3b2a1 ||
+               magic == 0xa1b23c4d || magic == 0x4d3cb2a1) {
+        /* pcap: timestamps in micro- or nanoseconds, either byte order */
+        tr->tr_swap = (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1);
+        tr->tr_fmt = (magic == 0xa1b2c3d4 || magic == 0xd4c3b2a1) ?
+            trace_format_pcap : trace_format_pcap_ns;
+        trace_get(tr, tr->tr_map + 20, &tr->tr_link, sizeof(tr->tr_link));
+        tr->tr_link &= 0xffff; /* the rest can be about FCS */
+        switch (tr->tr_link) {
+        case 0: case 1: case 12: case 14: case 101: case 108:
+        case 113: case 228: case 229: case 276:
+            break;
+        default:
+            errout("-F %s: pcap link type %u isn't supported", tr->tr_fn,
+                   (unsigned)tr->tr_link);
+            exit(1);
+        }
+        tr->tr_first = 24;
+    } else if (magic == 0x0a0d0d0a) {
+        errout("-F %s: pcapng isn't supported; convert it with"
+               " \"editcap -F pcap\"", tr->tr_fn);
+        exit(1);
     } else {
-        af = ((struct sockaddr *)src)->sa_family;
+        errout("-F %s: not a pcap file or oligocast trace", tr->tr_fn);
+        exit(1);
     }
 
-    /* format this kind of address */
-    switch (af) {
-    case AF_INET:
-        /* IPv4 */
-        if(!inet_ntop(af, &((struct sockaddr_in *)src)->sin_addr, dst, size)) {
-            snprintf(dst, size, "?");
+    /* go through it once: what's to be replayed, and how long it takes */
+    maxlen = (cfg->cfg_af == AF_INET6) ? UDP_MAX_IPV6 : UDP_MAX_IPV4;
+    for (off = tr->tr_first; (rv = trace_parse(tr, off, &pk)) >= 0;
+         off = pk.tk_next) {
+        if (rv == 0) {
+            continue; /* not a UDP packet */
         }
-        break;
-    case AF_INET6:
-        /* IPv6 */
-        if(!inet_ntop(af, &((struct sockaddr_in6 *)src)->sin6_addr, dst, size)){
-            snprintf(dst, size, "?");
+        if (pk.tk_len > maxlen) {
+            errout("-F %s: packet %llu is %lu bytes, more than UDP allows"
+                   " (%lu)", tr->tr_fn, (unsigned long long)tr->tr_npkts + 1,
+                   (unsigned long)pk.tk_len, (unsigned long)maxlen);
+            exit(1);
         }
-        break;
-    default:
-        /* unsupported, or maybe there's no address */
-        snprintf(dst, size, "?");
-        break;
+        if (tr->tr_fmt == trace_format_olgt && tr->tr_npkts > 0 &&
+            (pk.tk_t < 0 || pk.tk_t > TRACE_MAX_DELTA ||
+             t > TRACE_MAX_SPAN - pk.tk_t)) {
+            errout("-F %s: packet %llu comes too long after the one"
+                   " before", tr->tr_fn, (unsigned long long)tr->tr_npkts + 1);
+            exit(1);
+        }
+        if (tr->tr_npkts++ == 0) {
+            tr->tr_first = off;
+            tr->tr_t0 = pk.tk_t;
+        } else if (tr->tr_fmt == trace_format_olgt) {
+            t += pk.tk_t;
+        } else if (pk.tk_t - tr->tr_t0 > t) {
+            t = pk.tk_t - tr->tr_t0; /* and not back in time */
+        }
+        if (pk.tk_len > tr->tr_maxlen) {
+            tr->tr_maxlen = pk.tk_len;
+        }
+    }
+    if (tr->tr_npkts == 0) {
+        errout("-F %s: no UDP packets in it", tr->tr_fn);
+        exit(1);
+    }
+    if (off < tr->tr_size) {
+        errout("-F %s: ignoring what's cut off at the end", tr->tr_fn);
     }
 
-    return(dst);
+    /*
+     * It's replayed over and over, each pass starting one packet's usual
+     * spacing after the last; one that all happens at once, every -P.
+     */
+    tr->tr_period = t + ((tr->tr_npkts > 1 && t > 0) ?
+                         (int64_t)(t / (tr->tr_npkts - 1)) :
+                         (int64_t)rint(cfg->cfg_period * 1e+9));
+    if (t < 0 || t > TRACE_MAX_SPAN || tr->tr_period <= 0) {
+        errout("-F %s: its times don't make sense", tr->tr_fn);
+        exit(1);
+    }
+    tr->tr_zero = calloc(1, tr->tr_maxlen + 1);
+    if (cfg->cfg_verbose) {
+        errout("-F %s: %llu packets in %.6f seconds, replayed at %gx",
+               tr->tr_fn, (unsigned long long)tr->tr_npkts, t / 1e+9,
+               tr->tr_speed);
+    }
+    cfg->cfg_trace = tr;
 }
 
-#ifdef DO_SOURCES
 /*
- * sort_addrs()
- *
- * Sort an array of addresses into a straightforward consistent order.
- * That makes comparisons and merges easier.
- *
- * Parameters:
- *      addrs - the addresses
- *      naddrs - number of entries in 'addrs'
+ * trace_get()
+ * Copy a 'len' byte number at 'p' in traffic profile 'tr' into 'v',
+ * turning it around if it's in the other byte order.
  */
-static void sort_addrs(struct sockaddr_storage *addrs, int naddrs)
+static void trace_get(struct trace *tr, uint8_t *p, void *v, size_t len)
 {
-    qsort(addrs, naddrs, sizeof(addrs[0]), &sort_addrs_compare);
+    uint8_t tmp[8];
+    size_t i;
+
+    if (!tr->tr_swap) {
+        memcpy(v, p, len);
+        return;
+    }
+    for (i = 0; i < len; ++i) {
+        tmp[i] = p[len - 1 - i];
+    }
+    memcpy(v, tmp, len);
 }
 
 /*
- * sort_addrs_compare()
+ * trace_parse()
+ * Look at the record at offset 'off' in traffic profile 'tr': a packet
+ * to replay, or in a pcap file, maybe something else.
  *
- * Compare two addresses and return <0, =0, >0 depending on their
- * relationship.  This is used with qsort(), by sort_addrs(), to put
- * addresses in a consistent order.
- *
- * It handles having addresses of different family, or NULL, even though
- * this program avoids the former, and qsort() itself should avoid the latter.
+ * Parameters:
+ *      tr - the traffic profile
+ *      off - offset of the record in tr_map
+ *      pk - where to store what's in it; tk_next is filled in even if
+ *          it's not a packet to replay
  *
- * The addresses are stored in a 'struct sockaddr_storage' but this function
- * only compares the address part, not the port, flow, or scope.
+ * Returns:
+ *      1 if it's a packet to replay; 0 if not, like a TCP packet in a
+ *      pcap file; -1 if there's no (whole) record there, at the end
  */
-static int sort_addrs_compare(const void *x, const void *y)
+static int trace_parse(struct trace *tr, size_t off, struct trpkt *pk)
 {
-    const struct sockaddr_storage *xx = x;
-    const struct sockaddr_storage *yy = y;
-
-    if (xx == NULL) {
-        if (yy == NULL) {
-            return(0);
-        } else {
+    uint8_t *p = tr->tr_map + off;
+    uint32_t sec, frac, caplen, len;
+    size_t hl, ul;
+    int proto, nh;
+
+    if (tr->tr_fmt == trace_format_olgt) {
+        /* struct tracerec, then the packet */
+        if (tr->tr_size - off < tr->tr_reclen) {
+            return(-1);
+        }
+        trace_get(tr, p + offsetof(struct tracerec, tc_delta),
+                  &pk->tk_t, sizeof(pk->tk_t));
+        trace_get(tr, p + offsetof(struct tracerec, tc_len),
+                  &len, sizeof(len));
+        trace_get(tr, p + offsetof(struct tracerec, tc_caplen),
+                  &caplen, sizeof(caplen));
+        if (tr->tr_size - off - tr->tr_reclen < caplen) {
             return(-1);
         }
-    } else if (yy == NULL) {
+        pk->tk_len = len;
+        pk->tk_pay = p + tr->tr_reclen;
+        pk->tk_paylen = (caplen < len) ? caplen : len;
+        pk->tk_next = off + tr->tr_reclen + ((caplen + 7) & ~(size_t)7);
+        if (pk->tk_next > tr->tr_size) {
+            pk->tk_next = tr->tr_size; /* the padding's optional at the end */
+        }
         return(1);
-    } else if (xx->ss_family < yy->ss_family) {
+    }
+
+    /* pcap record header */
+    if (tr->tr_size - off < 16) {
         return(-1);
-    } else if (xx->ss_family > yy->ss_family) {
-        return(1);
-    } else if (xx->ss_family == AF_INET) {
-        const struct sockaddr_in *x4 = x;
-        const struct sockaddr_in *y4 = y;
-        return(memcmp(&(x4->sin_addr), &(y4->sin_addr),
-                      sizeof(x4->sin_addr)));
-    } else if (yy->ss_family == AF_INET6) {
-        const struct sockaddr_in6 *x6 = x;
-        const struct sockaddr_in6 *y6 = y;
-        return(memcmp(&(x6->sin6_addr), &(y6->sin6_addr),
-                      sizeof(x6->sin6_addr)));
-    } else {
-        /* shouldn't happen */
+    }
+    trace_get(tr, p, &sec, sizeof(sec));
+    trace_get(tr, p + 4, &frac, sizeof(frac));
+    trace_get(tr, p + 8, &caplen, sizeof(caplen));
+    if (tr->tr_size - off - 16 < caplen) {
+        return(-1);
+    }
+    pk->tk_t = sec * (int64_t)1000000000 +
+        frac * ((tr->tr_fmt == trace_format_pcap_ns) ? 1 : 1000);
+    pk->tk_next = off + 16 + caplen;
+    p += 16;
+
+    /* link layer header; proto is its EtherType, or 0 to look at the IP */
+    switch (tr->tr_link) {
+    case 1: /* Ethernet, maybe with VLAN tags */
+        hl = 14;
+        proto = (caplen >= hl) ? ((p[12] << 8) | p[13]) : -1;
+        while ((proto == 0x8100 || proto == 0x88a8) && caplen >= hl + 4) {
+            proto = (p[hl + 2] << 8) | p[hl + 3];
+            hl += 4;
+        }
+        break;
+    case 113: /* Linux "cooked" */
+        hl = 16;
+        proto = (caplen >= hl) ? ((p[14] << 8) | p[15]) : -1;
+        break;
+    case 276: /* Linux "cooked" v2 */
+        hl = 20;
+        proto = (caplen >= hl) ? ((p[0] << 8) | p[1]) : -1;
+        break;
+    case 0: case 108: /* BSD loopback */
+        hl = 4;
+        proto = 0;
+        break;
+    default: /* raw IP */
+        hl = 0;
+        proto = 0;
+        break;
+    }
+    if (proto < 0 || caplen <= hl) {
         return(0);
     }
-}
+    p += hl;
+    caplen -= hl;
+    if (proto == 0) {
+        proto = ((p[0] >> 4) == 4) ? 0x0800 :
+            (((p[0] >> 4) == 6) ? 0x86dd : -1);
+    }
 
-/*
- * add_addrs()
- *
- * Given two arrays of addresses, allocate and fill in a new one that
- * contains everything the two inputs have, without any duplicates.
- * Expects, and maintains, the ordering within arrays that sort_addrs()
- * establishes.
- *
- * Parameters:
- *      res_addrs - the newly allocated resulting array will be stored here
- *      res_naddrs - the size of res_addrs will be stored here
- *      lft_addrs - one of the input arrays
- *      lft_naddrs - size of lft_addrs
- *      rgt_addrs - the other input array
- *      rgt_naddrs - size of rgt_addrs
- */
-static void add_addrs(struct sockaddr_storage **res_addrs, int *res_naddrs,
-                      struct sockaddr_storage *lft_addrs, int lft_naddrs,
-                      struct sockaddr_storage *rgt_addrs, int rgt_naddrs)
-{
-    int i, j, o, c;
-    struct sockaddr_storage *last = NULL;
-
-    /* allocate *res_addrs[] as max size it could be */
-    *res_addrs = calloc(lft_naddrs + rgt_naddrs, sizeof((*res_addrs)[0]));
-
-    /* go through the arrays */
-    for (i = j = o = 0; i < lft_naddrs || j < rgt_naddrs; ) {
-        /* which comes first in order? */
-        if (i >= lft_naddrs) {
-            c = 1; /* nothing left on left, use right */
-        } else if (j >= rgt_naddrs) {
-            c = -1; /* nothing left on right, use left */
-        } else {
-            c = sort_addrs_compare(&lft_addrs[i], &rgt_addrs[j]);
+    /* IP header, and maybe IPv6 extension headers, to get to the UDP */
+    if (proto == 0x0800) {
+        if (caplen < 20 || p[9] != IPPROTO_UDP ||
+            (((p[6] << 8) | p[7]) & 0x3fff) != 0) {
+            return(0); /* not UDP, or a fragment */
         }
-
-        /* if it's not a duplicate, take it; if it is, skip it */
-        if (c <= 0) {
-            if (last == NULL || 0 != sort_addrs_compare(&lft_addrs[i], last)) {
-                /* not duplicate */
-                memcpy(&(*res_addrs)[o], &lft_addrs[i],
-                       sizeof((*res_addrs)[o]));
-                last = &(*res_addrs)[o];
-                ++o;
-            }
-            ++i;
-        } else {
-            if (last == NULL || 0 != sort_addrs_compare(&rgt_addrs[j], last)) {
-                /* not duplicate */
-                memcpy(&(*res_addrs)[o], &rgt_addrs[j],
-                       sizeof((*res_addrs)[o]));
-                last = &(*res_addrs)[o];
-                ++o;
-            }
-            ++j;
+        hl = (p[0] & 15) * 4;
+    } else if (proto == 0x86dd) {
+        if (caplen < 40) {
+            return(0);
+        }
+        nh = p[6];
+        hl = 40;
+        while ((nh == 0 || nh == 43 || nh == 60) && caplen >= hl + 8) {
+            /* hop-by-hop, routing, or destination options */
+            nh = p[hl];
+            hl += (p[hl + 1] + 1) * 8;
+        }
+        if (nh != IPPROTO_UDP) {
+            return(0); /* not UDP, or a fragment */
         }
+    } else {
+        return(0);
+    }
+    if (caplen < hl + 8) {
+        return(0);
     }
-    *res_naddrs = o;
+    ul = (p[hl + 4] << 8) | p[hl + 5];
+    if (ul < 8) {
+        return(0);
+    }
+    pk->tk_len = ul - 8;
+    pk->tk_pay = p + hl + 8;
+    pk->tk_paylen = caplen - hl - 8;
+    if (pk->tk_paylen > pk->tk_len) {
+        pk->tk_paylen = pk->tk_len; /* Ethernet padding */
+    }
+    return(1);
 }
 
 /*
- * sub_addrs()
- * 
- * Given two arrays of addresses, allocate and fill in a new one that
- * contains everything the left input has, without anything the right
- * input has. Expects, and maintains, the ordering within arrays that
- * sort_addrs() establishes.
- *
- * Parameters:
- *      res_addrs - the newly allocated resulting array will be stored here
- *      res_naddrs - the size of res_addrs will be stored here
- *      inc_addrs - the input array with stuff to include
- *      inc_naddrs - size of lft_addrs
- *      exc_addrs - the input array with stuff to exclude
- *      exc_naddrs - size of rgt_addrs
+ * trace_read()
+ * Read the packet at 'tp' in traffic profile 'tr' into 'pk', and move
+ * 'tp' on to the next one to replay.  Returns 1 if that was the last one,
+ * and 'tp' went back to the first for another pass; 0 if not.
  */
-static void sub_addrs(struct sockaddr_storage **res_addrs, int *res_naddrs,
-                      struct sockaddr_storage *inc_addrs, int inc_naddrs,
-                      struct sockaddr_storage *exc_addrs, int exc_naddrs)
+static int trace_read(struct trace *tr, struct trpos *tp, struct trpkt *pk)
 {
-    int i, j, o, c;
-
-    /* allocate *res_addrs[] as max size it could be */
-    *res_addrs = calloc(inc_naddrs, sizeof((*res_addrs)[0]));
-
-    for (i = j = o = 0; i < inc_naddrs && j < exc_naddrs; ) {
-        /* which comes first in order? */
-        c = sort_addrs_compare(&inc_addrs[i], &exc_addrs[j]);
+    struct trpkt nx;
+    size_t off;
+    int rv;
 
-        if (c < 0) {
-            /* something included, not excluded */
-            memcpy(&((*res_addrs)[o]), &inc_addrs[i], sizeof((*res_addrs)[o]));
-            ++i;
-            ++o;
-        } else if (c > 0) {
-            /* something excluded, wasn't there anyways */
-            ++j;
-        } else if (c == 0) {
-            /* something in both lists, leave it out */
-            ++i;
-        }
+    trace_parse(tr, tp->tp_off, pk);
+    for (off = pk->tk_next; (rv = trace_parse(tr, off, &nx)) == 0;
+         off = nx.tk_next) {
+        /* skip what isn't to be replayed */
     }
-    if (i < inc_naddrs) {
-        /* a bunch of things to just include */
-        memcpy(&((*res_addrs)[o]), &inc_addrs[i],
-               sizeof((*res_addrs)[o]) * (inc_naddrs - i));
-        o += inc_naddrs - i;
+    if (rv < 0) {
+        tp->tp_off = tr->tr_first;
+        tp->tp_t = 0;
+        return(1);
+    }
+    tp->tp_off = off;
+    if (tr->tr_fmt == trace_format_olgt) {
+        tp->tp_t += nx.tk_t;
+    } else if (nx.tk_t - tr->tr_t0 > tp->tp_t) {
+        tp->tp_t = nx.tk_t - tr->tr_t0;
     }
-    *res_naddrs = o;
+    return(0);
 }
-#endif /* DO_SOURCES */
 
 /*
- * csv_escape()
- * Returns a copy of 's' with quotes and escapes added to make any odd
- * characters safe for inclusion in a single field of a CSV file.  The
- * returned string is allocated memory and should be freed by the caller
- * when no longer needed.
- *
- * See also RFC 4180.
+ * trace_pkt()
+ * For -F: read the next packet to send to group 'g' from the traffic
+ * profile, at 'tp', and move 'tp' on past it.  Its data goes in iov[0]
+ * and iov[1], the way tx_burst() has it: with "-d seq" iov[1] gets what
+ * comes after the header, and only iov[0]'s length is filled in, for the
+ * header; without, iov[0] gets it all.  If the profile doesn't have the
+ * whole packet, it's sent as that many zeroes.  Returns its length.
  */
-static char *csv_escape(char *s)
+static size_t trace_pkt(struct config *cfg, struct mcgroup *g,
+                        struct trpos *tp, struct iovec *iov)
 {
-    int i, o;
-    int do_escape = 0;
-    char *r;
-
-    /* any characters that require escaping? */
-    for (i = 0; s[i]; ++i) {
-        if (!isascii(s[i]) || !isgraph(s[i]) ||
-            s[i] == '"' || s[i] == ',') {
+    struct trace *tr = cfg->cfg_trace;
+    struct trpkt pk;
+    uint8_t *data;
 
-            do_escape = 1;
-            break;
-        }
+    trace_read(tr, tp, &pk);
+    data = (pk.tk_paylen >= pk.tk_len) ? pk.tk_pay : tr->tr_zero;
+    if (!g->mg_data->pd_seq) {
+        iov[0].iov_base = data;
+        iov[0].iov_len = pk.tk_len;
+        iov[1].iov_base = data;
+        iov[1].iov_len = 0;
+        return(pk.tk_len);
     }
 
-    if (do_escape) {
-        /* wrap in quotes and double any quotes */
-        r = malloc(strlen(s) * 2 + 3); /* maximum possible */
-        o = 0;
-        r[o++] = '"';
-        for (i = 0; s[i]; ++i) {
-            if (s[i] == '"') {
-                r[o++] = '"';
-            }
-            r[o++] = s[i];
-        }
-        r[o++] = '"';
-        r[o] = '\0';
-        return(r);
-    } else {
-        /* no need to change anything */
-        return(strdup(s));
+    /* the header takes the place of the start of it, or pads it out */
+    iov[0].iov_len = SEQ_HDR_LEN;
+    if (pk.tk_len <= SEQ_HDR_LEN) {
+        iov[1].iov_base = data;
+        iov[1].iov_len = 0;
+        return(SEQ_HDR_LEN);
     }
+    iov[1].iov_base = data + SEQ_HDR_LEN;
+    iov[1].iov_len = pk.tk_len - SEQ_HDR_LEN;
+    return(pk.tk_len);
 }
 
-/** ** timestamp formatters ** **/
-
 /*
- * timestamp_log()
- * Fill in a timestamp like: Sep 12 00:01:17.123
+ * trace_pace()
+ * tx_pace() for -F: figure out how many of group 'g's packets from the
+ * traffic profile are due, and move its place in the profile past them,
+ * remembering in mg_tr_send where they start, for tx_burst().
+ *
+ * Each group replays the whole profile, starting when it's first sent
+ * to, with the times in it divided by the -F speed; and then does it
+ * again, and again.  If sending falls well behind, the rest of the
+ * profile is put off, rather than sent in a big burst to catch up.
+ *
  * Parameters:
- *      tv - time to use as input
- *      buf - buffer to store output
- *      len - size of buffer
- *      arg - ignored; will be a copy of timestamp_formatter_arg
+ *      cfg - configuration, including the traffic profile
+ *      g - the group, including its place in the profile
+ *      now - the current time, mono_ns()
+ *      due - number of packets that are due to be sent now is stored
+ *          here, up to cfg_batch
+ *
  * Returns:
- *      length of resulting string
+ *      When the next packet is due, mono_ns(); 'now' if it's already
+ *      due, in which case *due is at least 1.
  */
-static int timestamp_log(struct timeval *tv, char *buf, size_t len, void *arg)
+static int64_t trace_pace(struct config *cfg, struct mcgroup *g, int64_t now,
+                          int *due)
 {
-    struct tm *tm;
-    size_t pos;
-
-    tm = localtime(&tv->tv_sec);
-    pos = strftime(buf, len, "%b %d %H:%M:%S", tm);
-    if (pos > 0 && pos < len) {
-        pos += snprintf(buf + pos, len - pos, ".%03u",
-                        (unsigned)(tv->tv_usec / 1000));
+    struct trace *tr = cfg->cfg_trace;
+    struct trpkt pk;
+    int n;
+
+    if (g->mg_tx_next == 0) {
+        /* first time: start at the beginning, right away */
+        g->mg_tr.tp_off = tr->tr_first;
+        g->mg_tr.tp_t = 0;
+        g->mg_tr_base = g->mg_tx_next = now;
     }
-    if ((pos == 0 || pos >= len) && len > 0) {
-        /* the string didn't fit; this shouldn't happen */
-        buf[pos = 0] = '\0';
+    if (g->mg_tx_next > now) {
+        /* not yet */
+        *due = 0;
+        return(g->mg_tx_next);
     }
-    return(pos);
-}
-
-/*
- * timestamp_raw()
- * Fill in a timestamp like: 1599943404.456
- * Parameters:
- *      tv - time to use as input
- *      buf - buffer to store output
- *      len - size of buffer
- *      arg - ignored; will be a copy of timestamp_formatter_arg
- * Returns:
- *      length of resulting string
+    if (now - g->mg_tx_next > TX_MAX_LAG) {
+        /* way behind schedule; go on from here */
+        g->mg_tr_base += now - g->mg_tx_next;
+        g->mg_tx_next = now;
+    }
+    g->mg_tr_send = g->mg_tr;
+    for (n = 0; n < cfg->cfg_batch && g->mg_tx_next <= now; ++n) {
+        if (trace_read(tr, &g->mg_tr, &pk)) {
+            /* that was the last; the next pass goes a period after */
+            g->mg_tr_base += (int64_t)(tr->tr_period / tr->tr_speed);
+        }
+        g->mg_tx_next = g->mg_tr_base +
+            (int64_t)(g->mg_tr.tp_t / tr->tr_speed);
+    }
+    *due = n;
+    return(now);
+}
+
+/** ** exiting ** **/
+
+/*
+ * exit_setup()
+ * Arrange for exit_cleanup() to run when the program exits, whether by
+ * command, error, or signal (SIGINT, SIGTERM, SIGHUP).  A signal is
+ * handled in the main loop: exit_signal() writes to signal_pipe, which
+ * event loop 'evl' watches.  Exits on failure.
  */
-static int timestamp_raw(struct timeval *tv, char *buf, size_t len, void *arg)
+static void exit_setup(struct config *cfg, struct oligocast_evloop *evl)
 {
-    int pos = snprintf(buf, len, "%lu.%03u",
-                       (unsigned long)tv->tv_sec,
-                       (unsigned)(tv->tv_usec / 1000));
-    if (pos >= len && len > 0) {
-        /* the string didn't fit; this shouldn't happen */
-        buf[pos = 0] = '\0';
+    static const int sigs[] = { SIGINT, SIGTERM, SIGHUP };
+    struct sigaction sa;
+    char errbuf[256];
+    int i;
+
+    if (pipe(signal_pipe) < 0 ||
+        fcntl(signal_pipe[0], F_SETFL, O_NONBLOCK) < 0 ||
+        fcntl(signal_pipe[1], F_SETFL, O_NONBLOCK) < 0) {
+        errout("failed to create pipe: %s", strerror(errno));
+        exit(1);
     }
-    return(pos);
+    evloop_watch(evl, signal_pipe[0], EVLOOP_READ, NULL,
+                 errbuf, sizeof(errbuf));
+    if (errbuf[0]) {
+        errout("%s", errbuf);
+        exit(1);
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = exit_signal;
+    sigemptyset(&sa.sa_mask);
+    for (i = 0; i < sizeof(sigs) / sizeof(sigs[0]); ++i) {
+        if (sigaction(sigs[i], &sa, NULL) < 0) {
+            errout("failed to handle signal %d: %s", sigs[i], strerror(errno));
+            exit(1);
+        }
+    }
+    exit_cfg = cfg;
+#ifdef DO_WORKERS
+    main_thread = pthread_self();
+#endif /* DO_WORKERS */
+    atexit(exit_cleanup);
 }
 
 /*
- * timestamp_num()
- * Fill in a timestamp like: 2020-09-12-13:46:43.789
- * Parameters:
- *      tv - time to use as input
- *      buf - buffer to store output
- *      len - size of buffer
- *      arg - ignored; will be a copy of timestamp_formatter_arg
- * Returns:
- *      length of resulting string
+ * exit_signal()
+ * Signal handler: note signal 'sig', and wake up the main loop to exit.
  */
-static int timestamp_num(struct timeval *tv, char *buf, size_t len, void *arg)
+static void exit_signal(int sig)
 {
-    struct tm *tm;
-    size_t pos;
+    int e = errno;
 
-    tm = localtime(&tv->tv_sec);
-    pos = strftime(buf, len, "%Y-%m-%d-%H:%M:%S", tm);
-    if (pos > 0 && pos < len) {
-        pos += snprintf(buf + pos, len - pos, ".%03u",
-                        (unsigned)(tv->tv_usec / 1000));
-    }
-    if ((pos == 0 || pos >= len) && len > 0) {
-        /* the string didn't fit; this shouldn't happen */
-        buf[pos = 0] = '\0';
+    caught_signal = sig;
+    if (write(signal_pipe[1], "", 1) < 0) {
+        /* full already; the main loop will see that */
     }
-    return(pos);
+    errno = e;
 }
 
 /*
- * timestamp_none()
- * Don't fill in a timestamp, just empty string.
- * Parameters:
- *      tv - time to use as input
- *      buf - buffer to store output
- *      len - size of buffer
- *      arg - ignored; will be a copy of timestamp_formatter_arg
- * Returns:
- *      length of resulting string
+ * exit_cleanup()
+ * Write out the "-f binary:" records still buffered, and clean up what
+ * would otherwise outlast the program: the "-M" shared memory segment
+ * and the -K socket.  Run by exit(), and when exiting on a signal; only
+ * does anything the first time.
  */
-static int timestamp_none(struct timeval *tv, char *buf, size_t len, void *arg)
+static void exit_cleanup(void)
 {
-    if (len > 0) {
-        buf[0] = '\0';
+    struct config *cfg = exit_cfg;
+
+    if (cfg == NULL) {
+        return; /* not set up, or done already */
     }
-    return(0);
+    exit_cfg = NULL;
+#ifdef DO_WORKERS
+    if (pthread_equal(pthread_self(), main_thread)) {
+        /* a worker thread exiting can't touch the main thread's buffer */
+        binlog_write(cfg, &cfg->cfg_binlog);
+        if (cfg->cfg_binlog_fd >= 0) {
+            worker_flush(cfg);
+        }
+    }
+#else /* DO_WORKERS */
+    binlog_write(cfg, &cfg->cfg_binlog);
+#endif /* !DO_WORKERS */
+#ifdef HAVE_SHM_OPEN
+    shm_remove(cfg);
+#endif /* HAVE_SHM_OPEN */
+    cmdsock_remove(cfg);
 }
 
 /** ** main program ** **/
@@ -1850,18 +10297,16 @@ static int timestamp_none(struct timeval *tv, char *buf, size_t len, void *arg)
 int main(int argc, char **argv)
 {
     struct config main_cfg, *cfg;
-    int oc, sok, rv;
-    int recompute_timeout, reapply_filter, filter_critical;
-    int rx_state_up = 0;
+    int oc, rv, i, r;
+    int recompute_timeout, reapply_filter;
     enum command_action ca;
     char empty[1], errbuf[256];
-    struct sockaddr_storage as, dsta;
-    struct sockaddr_in *a4;
-    struct sockaddr_in6 *a6;
-    struct timeval tnow, tsel, tlast;
-    socklen_t alen, dstalen;
-    fd_set rfds;
-    long tflat;
+    struct mcgroup *g;
+    struct timeval tnow;
+    struct oligocast_evloop *evl;
+    struct oligocast_evready ready[MAX_READY];
+    int nready, stdin_watched = 0, was;
+    int64_t now, tnext, due;
 
     /* figure out program name & what it implies as to functionality */
     if (argc > 0) {
@@ -1875,50 +10320,165 @@ int main(int argc, char **argv)
     }
     progname_to_progdir();
 
+    /* output is flushed when "-f flush:" says, even to a terminal */
+    setvbuf(stdout, NULL, _IOFBF, OUT_BUFSIZE);
+
     /* default config and other initializations */
     memset(&main_cfg, 0, sizeof(main_cfg));
     cfg = &main_cfg;
     main_cfg.cfg_dir = progdir;
     main_cfg.cfg_af = AF_UNSPEC;
-    main_cfg.cfg_grp.ss_family = AF_UNSPEC;
-    main_cfg.cfg_grplen = sizeof(main_cfg.cfg_grp);
-    main_cfg.cfg_port = 0;
-    main_cfg.cfg_intf.nam[0] = '\0';
-    main_cfg.cfg_intf.idx = 0;
-    main_cfg.cfg_intf.adr.s_addr = INADDR_ANY;
-    main_cfg.cfg_ttl = DEF_TTL;
+    main_cfg.cfg_tmpl.mg_idx = -1;
+    main_cfg.cfg_tmpl.mg_grp.ss_family = AF_UNSPEC;
+    main_cfg.cfg_tmpl.mg_grplen = sizeof(main_cfg.cfg_tmpl.mg_grp);
+    main_cfg.cfg_tmpl.mg_port = 0;
+    main_cfg.cfg_tmpl.mg_intf.nam[0] = '\0';
+    main_cfg.cfg_tmpl.mg_intf.idx = 0;
+    main_cfg.cfg_tmpl.mg_intf.adr.s_addr = INADDR_ANY;
+    main_cfg.cfg_tmpl.mg_label = NULL;
+    main_cfg.cfg_tmpl.mg_label_csv = NULL;
+#ifdef DO_SOURCES
+    main_cfg.cfg_tmpl.mg_sfmode = MCAST_EXCLUDE;
+    main_cfg.cfg_tmpl.mg_sources = srcs_empty;
+    main_cfg.cfg_tmpl.mg_osfmode = MCAST_EXCLUDE;
+    main_cfg.cfg_tmpl.mg_osources = srcs_empty;
+    main_cfg.cfg_tmpl.mg_sfull = 1;
+    main_cfg.cfg_tmpl.mg_sadd = main_cfg.cfg_tmpl.mg_ssub = srcs_empty;
+#endif /* DO_SOURCES */
+    main_cfg.cfg_tmpl.mg_reapply = main_cfg.cfg_tmpl.mg_critical = 1;
+    main_cfg.cfg_tmpl.mg_sml_state.ever_called = 0;
+    main_cfg.cfg_tmpl.mg_sok = -1;
+    main_cfg.cfg_tmpl.mg_up = 0;
+    main_cfg.cfg_tmpl.mg_theap_pos = -1;
+    main_cfg.cfg_tmpl.mg_data = &main_cfg.cfg_data;
+    main_cfg.cfg_tmpl.mg_ttl = DEF_TTL;
+    main_cfg.cfg_tmpl.mg_rate = -1; /* cfg_rate */
+    main_cfg.cfg_tmpl.mg_rate_bits = 0;
+    main_cfg.cfg_tmpl.mg_tx_next = 0;
+    main_cfg.cfg_tmpl.mg_tx_carry = 0;
+    main_cfg.cfg_group_file = NULL;
+    main_cfg.cfg_groups = NULL;
+    main_cfg.cfg_ngroups = 0;
+    main_cfg.cfg_gsel = NULL;
+    main_cfg.cfg_gcmd = NULL;
+    main_cfg.cfg_theap = NULL;
+    main_cfg.cfg_ntheap = 0;
     main_cfg.cfg_verbose = 0;
     main_cfg.cfg_label = NULL;
     main_cfg.cfg_label_csv = NULL;
     main_cfg.cfg_csv = 0;
+    main_cfg.cfg_flush = flush_policy_line;
+    main_cfg.cfg_flush_lines = 1;
+    main_cfg.cfg_flush_us = 0;
+    main_cfg.cfg_flush_count = 0;
+    main_cfg.cfg_flush_next = 0;
+#ifdef HAVE_SHM_OPEN
+    main_cfg.cfg_shm_name = NULL;
+    main_cfg.cfg_shm_us = 1000000;
+    main_cfg.cfg_shm_next = 0;
+    main_cfg.cfg_shm = NULL;
+    main_cfg.cfg_shm_len = 0;
+#endif /* HAVE_SHM_OPEN */
+    main_cfg.cfg_http_addr = NULL;
+    main_cfg.cfg_http = NULL;
+    main_cfg.cfg_binlog_fd = -1;
+    memset(&main_cfg.cfg_binlog, 0, sizeof(main_cfg.cfg_binlog));
     main_cfg.cfg_period = 1.0;
-    main_cfg.cfg_period_us = 1000000;
+    main_cfg.cfg_period_ns = 1000000000;
     main_cfg.cfg_multiplier = 3.0;
-    main_cfg.cfg_timeout_us = 3000000;
-    main_cfg.cfg_data = NULL;
-    main_cfg.cfg_data_len = 0;
-    main_cfg.cfg_data_chk = 0;
-    main_cfg.cfg_data_rx = NULL;
+    main_cfg.cfg_timeout_ns = 3000000000LL;
+    main_cfg.cfg_rate = 0;
+    main_cfg.cfg_rate_bits = 0;
+    main_cfg.cfg_tx_gs = NULL;
+    main_cfg.cfg_tx_gn = NULL;
+#ifdef HAVE_SENDMMSG
+    main_cfg.cfg_tx_msgs = NULL;
+    main_cfg.cfg_tx_iovs = NULL;
+    main_cfg.cfg_tx_nmsgs = 0;
+    main_cfg.cfg_tx_hdrs = NULL;
+    main_cfg.cfg_tx_ctl = NULL;
+    main_cfg.cfg_tx_body = NULL;
+    main_cfg.cfg_tx_nbody = 0;
+    main_cfg.cfg_tx_bodylen = 0;
+#endif /* HAVE_SENDMMSG */
+    main_cfg.cfg_data.pd_data = NULL;
+    main_cfg.cfg_data.pd_len = 0;
+    main_cfg.cfg_data.pd_chk = 0;
+    main_cfg.cfg_data.pd_seq = 0;
+    main_cfg.cfg_data.pd_pat = 0;
+    main_cfg.cfg_data.pd_crc = 0;
+    main_cfg.cfg_lat_us = 0;
+    main_cfg.cfg_lat_next = 0;
+    main_cfg.cfg_stats_us = 0;
+    main_cfg.cfg_stats_next = 0;
+    memset(&main_cfg.cfg_rx, 0, sizeof(main_cfg.cfg_rx));
+    main_cfg.cfg_nworkers = 0;
+    main_cfg.cfg_workers = NULL;
+    main_cfg.cfg_wake[0] = main_cfg.cfg_wake[1] = -1;
+    main_cfg.cfg_batch = 1;
+    main_cfg.cfg_rx_len = RX_MAXLEN;
+    main_cfg.cfg_rcvbuf = 0;
+    main_cfg.cfg_sndbuf = 0;
+#ifdef HAVE_SO_BUSY_POLL
+    main_cfg.cfg_busypoll = -1;
+#endif /* HAVE_SO_BUSY_POLL */
+#ifdef HAVE_SO_PRIORITY
+    main_cfg.cfg_priority = -1;
+#endif /* HAVE_SO_PRIORITY */
+    main_cfg.cfg_spin = 0;
+    main_cfg.cfg_spinwait = 0;
+    main_cfg.cfg_rxsrc = 0;
+    main_cfg.cfg_rxsrc_next = 0;
+    main_cfg.cfg_churn_rate = 0;
+    main_cfg.cfg_churn_hold = 1000000000;
+    main_cfg.cfg_churn_random = 0;
+    main_cfg.cfg_churn = NULL;
+    main_cfg.cfg_churnstats = NULL;
+    main_cfg.cfg_trace_fn = NULL;
+    main_cfg.cfg_trace_speed = 1.0;
+    main_cfg.cfg_trace = NULL;
+#ifdef HAVE_SO_TIMESTAMPNS
+    main_cfg.cfg_tstamp = rx_tstamp_sw;
+#else /* HAVE_SO_TIMESTAMPNS */
+    main_cfg.cfg_tstamp = rx_tstamp_user;
+#endif /* !HAVE_SO_TIMESTAMPNS */
+#ifdef HAVE_MSG_ZEROCOPY
+    main_cfg.cfg_zerocopy = 0;
+#endif /* HAVE_MSG_ZEROCOPY */
+#ifdef HAVE_UDP_SEGMENT
+    main_cfg.cfg_gso = 0;
+#endif /* HAVE_UDP_SEGMENT */
+#ifdef HAVE_TX_PKTINFO
+    main_cfg.cfg_txshare = 0;
+#endif /* HAVE_TX_PKTINFO */
+#ifdef HAVE_UDP_GRO
+    main_cfg.cfg_gro = 0;
+#endif /* HAVE_UDP_GRO */
+#ifdef HAVE_PACKET_RING
+    main_cfg.cfg_ring = 0;
+    main_cfg.cfg_rings = NULL;
+    main_cfg.cfg_nrings = 0;
+#endif /* HAVE_PACKET_RING */
     main_cfg.cfg_join = 0;
     main_cfg.cfg_command_in = 0;
-    main_cfg.cfg_command_got = 0;
+    main_cfg.cfg_command_ring.cr_head = main_cfg.cfg_command_ring.cr_got = 0;
     main_cfg.cfg_command_ignore = 0;
-#ifdef DO_SOURCES
-    main_cfg.cfg_sfmode = MCAST_EXCLUDE;
-    main_cfg.cfg_sources = calloc(1, sizeof(main_cfg.cfg_sources[0]));
-    main_cfg.cfg_nsources = 0;
-    main_cfg.cfg_osfmode = MCAST_EXCLUDE;
-    main_cfg.cfg_osources = calloc(1, sizeof(main_cfg.cfg_osources[0]));
-    main_cfg.cfg_onsources = 0;
-#endif /* DO_SOURCES */
-    main_cfg.cfg_sml_state.ever_called = 0;
+    main_cfg.cfg_cmdsock_path = NULL;
+    main_cfg.cfg_cmdsock = NULL;
 
     gettimeofday(&tnow, NULL);
-    tlast = tnow;
+    main_cfg.cfg_seq_id = (((uint32_t)getpid()) << 16) ^
+        (uint32_t)tnow.tv_sec ^ (((uint32_t)tnow.tv_usec) << 8);
 
     /* parse the command line options */
     while ((oc = getopt(argc, argv,
-                        "trg:p:i:T:E:I:vl:f:P:m:d:jkh"
+                        "trg:p:i:G:T:E:I:vl:f:P:m:L:S:C:F:R:d:b:o:H:jkK:h"
+#ifdef DO_WORKERS
+                        "w:"
+#endif
+#ifdef HAVE_SHM_OPEN
+                        "M:"
+#endif
 #ifdef DEE_TEST
                         "D:"
 #endif
@@ -1940,189 +10500,237 @@ int main(int argc, char **argv)
         usage(stderr);
         exit(1);
     }
-    recompute_timeout = reapply_filter = filter_critical = 1;
+    recompute_timeout = reapply_filter = 1;
 
     /* sanity checks and adjustments to the configuration */
     if (cfg->cfg_dir == 0) {
         errout("am I sending or receiving? specify -t or -r; or -h for help");
         exit(1);
     }
-    if (cfg->cfg_grp.ss_family == AF_UNSPEC) {
-        /* default multicast group */
-        cfg->cfg_grplen = sizeof(cfg->cfg_grp);
-        if (cfg->cfg_af == AF_INET6) {
-            auto_pton(DEF_IPV6_GROUP, &cfg->cfg_grp, &cfg->cfg_grplen, cfg);
-        } else {
-            auto_pton(DEF_IPV4_GROUP, &cfg->cfg_grp, &cfg->cfg_grplen, cfg);
-        }
+    if (cfg->cfg_nworkers > 0 && cfg->cfg_dir > 0) {
+        errout("-w only works when receiving (-r)");
+        exit(1);
+    }
+    if (cfg->cfg_nworkers > 0 && cfg->cfg_rxsrc) {
+        errout("-o sources doesn't work with -w");
+        exit(1);
     }
-    if (cfg->cfg_port == 0) {
-        /* default port number */
-        cfg->cfg_port = DEF_UDP_PORT; /* port number */
+    if (cfg->cfg_dir > 0) {
+        cfg->cfg_rxsrc = 0; /* only for receiving */
     }
-    if (cfg->cfg_intf.nam[0] == '\0') {
-        errout("what network interface? specify -i");
+    if (cfg->cfg_churn_rate > 0 && cfg->cfg_dir > 0) {
+        errout("-C only works when receiving (-r)");
         exit(1);
     }
-    group_check(cfg, 1);
-
-    /* set up the socket which is used for all network interactions */
-    sok = socket(cfg->cfg_af, SOCK_DGRAM, IPPROTO_UDP);
-    if (sok < 0) {
-        errout("failed to create socket: %s", strerror(errno));
+    if (cfg->cfg_trace_fn != NULL && cfg->cfg_dir < 0) {
+        errout("-F only works when sending (-t)");
         exit(1);
     }
-
-    if (cfg->cfg_dir < 0) {
-        /* avoid EADDRINUSE */
-        int arg = 1;
-        rv = setsockopt(sok, SOL_SOCKET, SO_REUSEADDR, &arg, sizeof(arg));
-        if (rv < 0) {
-            errout("failed to set SO_REUSEADDR: %s", strerror(errno));
-            /* go on and try, in spite of this error */
-        }
+    if (cfg->cfg_trace_fn != NULL && cfg->cfg_rate > 0) {
+        errout("-F and -R can't be used together");
+        exit(1);
     }
-
-    if (cfg->cfg_dir < 0) {
-        /* to receive packets we have to bind() the socket */
-        memset(&as, 0, sizeof(as));
-        if (cfg->cfg_af == AF_INET6) {
-            a6 = (void *)&as;
-            a6->sin6_family = AF_INET6;
-            a6->sin6_port = htons(cfg->cfg_port);
-            a6->sin6_addr = in6addr_any;
-            alen = sizeof(*a6);
-        } else {
-            a4 = (void *)&as;
-            a4->sin_family = AF_INET;
-            a4->sin_port = htons(cfg->cfg_port);
-            a4->sin_addr.s_addr = INADDR_ANY;
-            alen = sizeof(*a4);
-        }
-        rv = bind(sok, (void *)&as, alen);
-        if (rv < 0) {
-            errout("failed to bind socket: %s", strerror(errno));
-            exit(1);
-        }
+#ifdef HAVE_UDP_SEGMENT
+    if (cfg->cfg_trace_fn != NULL && cfg->cfg_gso) {
+        errout("-o gso doesn't work with -F: the packets differ in length");
+        exit(1);
     }
-
-    if (cfg->cfg_dir < 0) {
-#ifdef HAVE_MULTICAST_ALL
-        if (cfg->cfg_af == AF_INET) {
-            /* don't receive packets for groups other sockets joined */
-            int arg = 0;
-            rv = setsockopt(sok, IPPROTO_IP, IP_MULTICAST_ALL,
-                            &arg, sizeof(arg));
-            if (rv < 0) {
-                errout("failed to set IP_MULTICAST_ALL to False: %s",
-                       strerror(errno));
-                /* go on and try, in spite of this error */
-            }
-        }
-#endif /* HAVE_MULTICAST_ALL */
-#ifdef HAVE_V6_MULTICAST_ALL
-        if (cfg->cfg_af == AF_INET6) {
-            /* don't receive packets for groups other sockets joined */
-            int arg = 0;
-            rv = setsockopt(sok, IPPROTO_IPV6, IPV6_MULTICAST_ALL,
-                            &arg, sizeof(arg));
-            if (rv < 0) {
-                errout("failed to set IPV6_MULTICAST_ALL to False: %s",
-                       strerror(errno));
-                /* go on and try, in spite of this error */
-            }
-        }
-#endif /* HAVE_V6_MULTICAST_ALL */
+#endif /* HAVE_UDP_SEGMENT */
+#ifdef HAVE_PACKET_RING
+    if (cfg->cfg_nworkers > 0 && cfg->cfg_ring) {
+        errout("-o ring doesn't work with -w");
+        exit(1);
     }
-
     if (cfg->cfg_dir > 0) {
-        if (cfg->cfg_ttl >= 0) {
-            /* specify time to live / hop limit value, when sending */
+        cfg->cfg_ring = 0; /* only for receiving */
+    }
+#endif /* HAVE_PACKET_RING */
+#ifdef HAVE_TX_PKTINFO
+#ifdef HAVE_MSG_ZEROCOPY
+    if (cfg->cfg_txshare && cfg->cfg_zerocopy) {
+        errout("-o txshare doesn't work with -o zerocopy");
+        exit(1);
+    }
+#endif /* HAVE_MSG_ZEROCOPY */
+    if (cfg->cfg_dir < 0) {
+        cfg->cfg_txshare = 0; /* only for sending */
+    }
+#endif /* HAVE_TX_PKTINFO */
+    if (cfg->cfg_group_file == NULL) {
+        /* just one group, given on the command line */
+        g = &cfg->cfg_tmpl;
+        if (g->mg_grp.ss_family == AF_UNSPEC) {
+            /* default multicast group */
+            g->mg_grplen = sizeof(g->mg_grp);
             if (cfg->cfg_af == AF_INET6) {
-                int arg = cfg->cfg_ttl;
-                rv = setsockopt(sok, IPPROTO_IPV6, IPV6_MULTICAST_HOPS,
-                                &arg, sizeof(arg));
-                if (rv < 0) {
-                    errout("failed to set IPV6_MULTICAST_HOPS to %d: %s",
-                           (int)cfg->cfg_ttl, strerror(errno));
-                    /* this error is not fatal; go on */
-                }
+                auto_pton(DEF_IPV6_GROUP, &g->mg_grp, &g->mg_grplen, cfg);
             } else {
-                int arg = cfg->cfg_ttl;
-                rv = setsockopt(sok, IPPROTO_IP, IP_MULTICAST_TTL,
-                                &arg, sizeof(arg));
-                if (rv < 0) {
-                    errout("failed to set IP_MULTICAST_TTL to %d: %s",
-                           (int)cfg->cfg_ttl, strerror(errno));
-                    /* go on and try, in spite of this error */
-                }
+                auto_pton(DEF_IPV4_GROUP, &g->mg_grp, &g->mg_grplen, cfg);
             }
         }
-    }
-
-    /* attach to a network interface */
-    if (cfg->cfg_af == AF_INET6) {
-        /* IPV6_MULTICAST_IF takes ifindex */
-        int arg = cfg->cfg_intf.idx;
-        rv = setsockopt(sok, IPPROTO_IPV6, IPV6_MULTICAST_IF,
-                        &arg, sizeof(arg));
-        if (rv < 0) {
-            errout("failed to set IPV6_MULTICAST_IF to %d (%s): %s",
-                   (int)cfg->cfg_intf.idx, cfg->cfg_intf.nam,
-                   strerror(errno));
-            /* go on and try, in spite of this error */
+        if (g->mg_port == 0) {
+            /* default port number */
+            g->mg_port = DEF_UDP_PORT; /* port number */
         }
+        if (g->mg_intf.nam[0] == '\0') {
+            errout("what network interface? specify -i");
+            exit(1);
+        }
+        group_check(cfg, g, 1);
+        g = group_new(&cfg->cfg_tmpl);
+        g->mg_grp = cfg->cfg_tmpl.mg_grp;
+        g->mg_grplen = cfg->cfg_tmpl.mg_grplen;
+        group_add(cfg, g);
     } else {
-#ifdef HAVE_MULTICAST_IF_IP_MREQN
-        /* IP_MULTICAST_IF can take a 'struct ip_mreqn' which can
-         * hold an ifindex
-         */
-        struct ip_mreqn oarg;
-        memset(&oarg, 0, sizeof(oarg));
-        oarg.imr_ifindex = cfg->cfg_intf.idx;
-#else /* HAVE_MULTICAST_IF_IP_MREQN */
-        /* IP_MULTICAST_IF takes an interface address */
-        struct in_addr oarg = cfg->cfg_intf.adr;
-        if (oarg.s_addr == INADDR_ANY) {
-            errout("problem setting IP_MULTICAST_IF:"
-                   " IPv4 address not found for '%s'", cfg->cfg_intf.nam);
-            /* go on and try, in spite of this error */
+        /* several groups, listed in a file */
+        if (cfg->cfg_tmpl.mg_grp.ss_family != AF_UNSPEC) {
+            errout("-g and -G may not be used together");
+            exit(1);
         }
-#endif /* HAVE_MULTICAST_IF_IP_MREQN */
-        rv = setsockopt(sok, IPPROTO_IP, IP_MULTICAST_IF, &oarg, sizeof(oarg));
-        if (rv < 0) {
-            errout("failed to set IP_MULTICAST_IF: %s", strerror(errno));
-            /* go on and try, in spite of this error */
+        if (cfg->cfg_tmpl.mg_port == 0) {
+            /* default port number */
+            cfg->cfg_tmpl.mg_port = DEF_UDP_PORT; /* port number */
+        }
+        group_file(cfg, cfg->cfg_group_file);
+        for (i = 0; i < cfg->cfg_ngroups; ++i) {
+            g = cfg->cfg_groups[i];
+            if (g->mg_intf.nam[0] == '\0') {
+                errout("what network interface for group %d? specify -i", i);
+                exit(1);
+            }
+            group_check(cfg, g, 1);
+            if (g->mg_label == NULL) {
+                g->mg_label = make_default_label(g);
+                g->mg_label_csv = csv_escape(g->mg_label);
+            }
+        }
+        if (cfg->cfg_label == NULL) {
+            cfg->cfg_label = strdup(cfg->cfg_group_file);
         }
     }
+    cfg->cfg_gsel = cfg->cfg_groups[0];
 
-    /* set up address to send to; for convenience set it up even if receiving */
-    dsta = cfg->cfg_grp;
-    dstalen = cfg->cfg_grplen;
-    if (cfg->cfg_grp.ss_family == AF_INET6) {
-        a6 = (void *)&dsta;
-        a6->sin6_port = htons(cfg->cfg_port);
-    } else {
-        a4 = (void *)&dsta;
-        a4->sin_port = htons(cfg->cfg_port);
+    /* set up a socket for each group; or, with "-o txshare", fewer */
+    for (i = 0; i < cfg->cfg_ngroups; ++i) {
+        g = cfg->cfg_groups[i];
+#ifdef HAVE_TX_PKTINFO
+        if (cfg->cfg_dir > 0 && cfg->cfg_txshare && tx_share(cfg, g)) {
+            continue;
+        }
+#endif /* HAVE_TX_PKTINFO */
+        group_socket(cfg, g);
+    }
+
+    /* set up the event loop, to wait for packets, commands, and timeouts */
+    evl = evloop_create(errbuf, sizeof(errbuf));
+    if (evl == NULL) {
+        errout("%s", errbuf);
+        exit(1);
+    }
+    exit_setup(cfg, evl);
+#ifdef HAVE_PACKET_RING
+    if (cfg->cfg_ring) {
+        /* packets come by packet ring instead of the sockets (-o ring) */
+        ring_setup(cfg, evl);
+    }
+#endif /* HAVE_PACKET_RING */
+    if (cfg->cfg_dir < 0 && cfg->cfg_nworkers == 0) {
+        for (i = 0; i < cfg->cfg_ngroups; ++i) {
+            g = cfg->cfg_groups[i];
+#ifdef HAVE_PACKET_RING
+            if (g->mg_ring != NULL) {
+                continue; /* ring_setup() took care of it */
+            }
+#endif /* HAVE_PACKET_RING */
+            evloop_watch(evl, g->mg_sok, EVLOOP_READ, g,
+                         errbuf, sizeof(errbuf));
+            if (errbuf[0]) {
+                errout("%s", errbuf);
+                exit(1);
+            }
+        }
     }
 
     /* figure out some default stuff */
     if (cfg->cfg_label == NULL) {
-        cfg->cfg_label = make_default_label(cfg);
+        cfg->cfg_label = make_default_label(cfg->cfg_groups[0]);
     }
     if (cfg->cfg_label_csv == NULL) {
         cfg->cfg_label_csv = csv_escape(cfg->cfg_label);
     }
-    if (cfg->cfg_data == NULL) {
-        cfg->cfg_data = malloc(8);
-        ((uint32_t *)cfg->cfg_data)[0] = htonl(tnow.tv_sec);
-        ((uint32_t *)cfg->cfg_data)[1] = htonl(tnow.tv_usec);
-        cfg->cfg_data_len = 8;
-        cfg->cfg_data_rx = malloc(cfg->cfg_data_len + RX_EXTRA);
+    if (cfg->cfg_data.pd_data == NULL) {
+        cfg->cfg_data.pd_data = malloc(8);
+        ((uint32_t *)cfg->cfg_data.pd_data)[0] = htonl(tnow.tv_sec);
+        ((uint32_t *)cfg->cfg_data.pd_data)[1] = htonl(tnow.tv_usec);
+        cfg->cfg_data.pd_len = 8;
+    }
+    if (cfg->cfg_dir < 0 && cfg->cfg_nworkers == 0) {
+        /* space to receive packets, once, big enough for any */
+        rx_buffers_setup(cfg, &cfg->cfg_rx);
+    }
+    if (cfg->cfg_churn_rate > 0) {
+        /* join and leave the groups, over and over (-C), instead */
+        cfg->cfg_churnstats = calloc(1, sizeof(*cfg->cfg_churnstats));
+        if (cfg->cfg_churn_hold >= 0 && cfg->cfg_ngroups <
+            cfg->cfg_churn_rate * cfg->cfg_churn_hold / 1e+9) {
+            errout("-C: %d groups, joined %.3f seconds each, can only be"
+                   " joined %.1f times per second", cfg->cfg_ngroups,
+                   cfg->cfg_churn_hold / 1e+9,
+                   cfg->cfg_ngroups * 1e+9 / cfg->cfg_churn_hold);
+            /* go on; joins will wait for groups to leave */
+        }
+        if (cfg->cfg_nworkers == 0) {
+            cfg->cfg_churn = churn_new(cfg, cfg->cfg_groups,
+                                       cfg->cfg_ngroups, cfg->cfg_seq_id);
+        }
+    }
+    if (cfg->cfg_trace_fn != NULL) {
+        /* send packets as a traffic profile has them (-F) */
+        for (i = 0; i < cfg->cfg_ngroups; ++i) {
+            g = cfg->cfg_groups[i];
+            if (g->mg_rate >= 0) {
+                errout("%s: -F and -R can't be used together", g->mg_label);
+                exit(1);
+            }
+            if (SEQ_VARIES(g->mg_data)) {
+                errout("-F only works with -d seq, not prbs, count, or crc");
+                exit(1);
+            }
+        }
+        trace_load(cfg);
+    }
+#ifdef DO_WORKERS
+    if (cfg->cfg_nworkers > 0) {
+        /* worker threads receive the packets and tell us about them */
+        worker_setup(cfg);
+        evloop_watch(evl, cfg->cfg_wake[0], EVLOOP_READ, NULL,
+                     errbuf, sizeof(errbuf));
+        if (errbuf[0]) {
+            errout("%s", errbuf);
+            exit(1);
+        }
+    }
+#endif /* DO_WORKERS */
+#ifdef HAVE_SHM_OPEN
+    if (cfg->cfg_shm_name != NULL) {
+        /* counters in shared memory (-M) */
+        shm_setup(cfg);
+    }
+#endif /* HAVE_SHM_OPEN */
+    if (cfg->cfg_http_addr != NULL) {
+        /* counters over HTTP (-H) */
+        http_setup(cfg, evl);
+    }
+    if (cfg->cfg_cmdsock_path != NULL) {
+        /* commands over a Unix socket (-K) */
+        cmdsock_setup(cfg, evl);
     }
 
     /* main loop, where stuff actually happens */
+    if (cfg->cfg_dir > 0) {
+        tx_start(cfg);
+    }
+    prof_start();
     for (;;) {
         if (cfg->cfg_verbose > 2) {
             errout("top of main loop"); /* handy for debugging */
@@ -2131,9 +10739,10 @@ int main(int argc, char **argv)
         /* Handle changes to the timeout in the configuration */
         if (recompute_timeout) {
             recompute_timeout = 0;
-            cfg->cfg_period_us = rint(cfg->cfg_period * 1e+6);
-            cfg->cfg_timeout_us = rint(cfg->cfg_period * 1e+6 *
+            cfg->cfg_period_ns = rint(cfg->cfg_period * 1e+9);
+            cfg->cfg_timeout_ns = rint(cfg->cfg_period * 1e+9 *
                                        cfg->cfg_multiplier);
+            theap_rekey(cfg);
         }
 
         /*
@@ -2146,140 +10755,105 @@ int main(int argc, char **argv)
         }
         if (reapply_filter) {
             reapply_filter = 0;
-            errbuf[0] = '\0';
-            setup_mcast_listen(sok, &cfg->cfg_intf,
-                               (void *)&cfg->cfg_grp, cfg->cfg_grplen,
-#ifdef DO_SOURCES
-                               cfg->cfg_sfmode, cfg->cfg_nsources,
-                               cfg->cfg_sources,
-#endif /* DO_SOURCES */
-                               &cfg->cfg_sml_state,
-                               errbuf, sizeof(errbuf));
-            if (errbuf[0]) {
-                /* setup_mcast_listen() failed */
-
-                errout("%s", errbuf);
-#ifdef DO_SOURCES
-                if (filter_critical) {
-                    exit(1);
-                }
-                /* instead of giving up, try to set back the old value */
-                errthrottle();
-                if (cfg->cfg_sources) {
-                    free(cfg->cfg_sources);
+            for (i = 0; i < cfg->cfg_ngroups; ++i) {
+                g = cfg->cfg_groups[i];
+                if (cfg->cfg_churn_rate > 0 &&
+                    (cfg->cfg_nworkers > 0 || !g->mg_ch_joined)) {
+                    continue; /* -C applies it when it joins the group */
                 }
-                cfg->cfg_sfmode = cfg->cfg_osfmode;
-                cfg->cfg_nsources = cfg->cfg_onsources;
-                cfg->cfg_sources = calloc(cfg->cfg_nsources,
-                                          sizeof(cfg->cfg_sources[0]));
-                memcpy(cfg->cfg_sources,
-                       cfg->cfg_osources,
-                       cfg->cfg_nsources * sizeof(cfg->cfg_sources[0]));
-                reapply_filter = filter_critical = 1;
-                continue;
-#else /* DO_SOURCES */
-                /* no tricky retries when we can't even join the group */
-                exit(1);
-#endif /* !DO_SOURCES */
-            } else {
-#ifdef DO_SOURCES
-                /* the target/new settings have become the current/old ones */
-                if (cfg->cfg_osources) {
-                    free(cfg->cfg_osources);
-                }
-                cfg->cfg_osfmode = cfg->cfg_sfmode;
-                cfg->cfg_onsources = cfg->cfg_nsources;
-                cfg->cfg_osources = calloc(cfg->cfg_nsources,
-                                           sizeof(cfg->cfg_osources[0]));
-                memcpy(cfg->cfg_osources,
-                       cfg->cfg_sources,
-                       cfg->cfg_nsources * sizeof(cfg->cfg_osources[0]));
-#endif /* DO_SOURCES */
+                group_filter(cfg, g);
             }
         }
 
         /*
          * Figure out what to wait for -- input, timeout.
-         * "rfds" gets bits for the inputs to monitor.
-         * "tsel" gets the time to wait.
-         * "tflat" temporarily holds the time in the more convenient
-         * form of a single number.  Near the top it's the time that's passed
-         * since the last thing happened.  Further down it's the time until
-         * next time.  Either way it's a number of microseconds.
+         * The event loop "evl" knows what inputs to monitor; those only
+         * change when stdin commands are turned on or off.
+         * "tnext" holds the time to wait until: a deadline in nanoseconds
+         * on the monotonic clock, mono_ns(), so that neither the time it
+         * takes to get to the wait nor setting the system clock throws
+         * the schedule off.  The wall clock is only for output.
          */
-        FD_ZERO(&rfds);
-        gettimeofday(&tnow, NULL);
-        tflat = tnow.tv_sec - tlast.tv_sec;
-        tflat *= 1000000;
-        tflat += tnow.tv_usec - tlast.tv_usec;
-        if (tflat < 0) {
-            /* Time has gone backwards.  Or at least the clock. */
-            tflat = 0;
-            tlast = tnow;
-        }
-        if (cfg->cfg_command_in) {
+        if (cfg->cfg_command_in != stdin_watched) {
             /* listening for commands, if enabled */
-            FD_SET(STDIN_FILENO, &rfds);
+            stdin_watched = cfg->cfg_command_in;
+            evloop_watch(evl, STDIN_FILENO, stdin_watched ? EVLOOP_READ : 0,
+                         NULL, errbuf, sizeof(errbuf));
+            if (errbuf[0]) {
+                errout("%s", errbuf);
+            }
         }
+        was = prof_enter(prof_timers);
+        now = mono_ns();
         if (cfg->cfg_dir < 0) {
-            /* receive (-r) mode: listen for packets & wait for timeout */
-            FD_SET(sok, &rfds);
-            if (rx_state_up) {
-                tflat = cfg->cfg_timeout_us - tflat;
-            } else {
-                /* too late to time out; just wait for packets */
-                tflat = 1800000000L; /* half an hour */
+            /* receive (-r) mode: listen for packets & wait for timeouts */
+            tnext = group_timeouts(cfg, now);
+            if (cfg->cfg_lat_us > 0) {
+                /* and to report latency (-L) */
+                tnext = sooner(tnext, now, lat_reports(cfg));
             }
-        } else {
-            /* transmit (-t) mode: wait for next send time */
-            tflat = cfg->cfg_period_us - tflat;
-        }
-        if (tflat < 0) {
-            /* We missed it. Hopefully not by much.  Better go *now.* */
-            tflat = 0;
-        }
-        tsel.tv_sec = tflat / 1000000;
-        tsel.tv_usec = tflat % 1000000;
-
-        /* if it's already time to do something, do it */
-        if (tflat == 0) {
-            if (cfg->cfg_dir < 0 && rx_state_up) {
-                /* receive (-r) mode: time out */
-                rx_state_up = 0;
-                emit(cfg, reported_event_dn, NULL);
-            }
-            if (cfg->cfg_dir > 0) {
-                /* send (-t) mode: send a packet */
-                rv = sendto(sok, cfg->cfg_data, cfg->cfg_data_len,
-                            0, (void *)&dsta, dstalen);
-                if (rv < 0) {
-                    errout("sendto() failed: %s", strerror(errno));
-                } else {
-                    emit(cfg, reported_event_tx, NULL);
-                }
-                tlast = tnow;
+            if (cfg->cfg_stats_us > 0) {
+                /* and to report statistics (-S) */
+                tnext = sooner(tnext, now, stats_reports(cfg));
             }
+            if (cfg->cfg_rxsrc) {
+                /* and to notice sources going quiet (-o sources) */
+                tnext = sooner(tnext, now, rxsrc_sweeps(cfg));
+            }
+            if (cfg->cfg_churn != NULL) {
+                /* and to join and leave groups (-C) */
+                due = churn_ops(cfg, cfg->cfg_churn, now);
+                tnext = (due < tnext) ? due : tnext;
+            }
+        } else {
+            /*
+             * transmit (-t) mode: send whatever packets are due, and wait
+             * until the next one is
+             */
+            tnext = tx_groups(cfg, now);
+        }
+        prof_leave(was);
+
+        /* write out any output that's waited long enough ("-f flush:") */
+        tnext = sooner(tnext, now, out_flushing(cfg));
+        tnext = sooner(tnext, now, binlog_aging(cfg, &cfg->cfg_binlog));
+#ifdef HAVE_SHM_OPEN
+        if (cfg->cfg_shm != NULL) {
+            /* shared memory counters (-M) */
+            tnext = sooner(tnext, now, shm_update(cfg));
         }
+#endif /* HAVE_SHM_OPEN */
 
         /* wait until there's something to do */
-        rv = select(sok + 1, &rfds, NULL, NULL, &tsel);
+        if (cfg->cfg_spin && cfg->cfg_dir < 0 && cfg->cfg_nworkers == 0) {
+            tnext = 0; /* "-o spin": just look, don't sleep */
+        } else if (cfg->cfg_spinwait > 0) {
+            /* "-o spinwait": sleep until shortly before, then just look */
+            tnext = (tnext - cfg->cfg_spinwait <= now) ? 0 :
+                (tnext - cfg->cfg_spinwait);
+        }
+        was = prof_enter(prof_wait);
+        prof_syscall();
+        nready = evloop_wait_until(evl, tnext, ready, MAX_READY);
+        prof_leave(was);
 
         /* and how did that turn out? */
-        if (rv < 0) {
+        if (nready < 0) {
             if (errno == EINTR || errno == EAGAIN) {
                 /* nothing really wrong, just go around again */
             } else {
                 /* some kind of error */
-                errout("select() error: %s", strerror(errno));
+                errout("event loop error: %s", strerror(errno));
                 errthrottle();
             }
             continue;
-        } else {
-            if (cfg->cfg_command_in && FD_ISSET(STDIN_FILENO, &rfds)) {
+        }
+        for (r = 0; r < nready; ++r) {
+            if (cfg->cfg_command_in && ready[r].fd == STDIN_FILENO) {
                 /* read command data into the buffer */
-                rv = read(STDIN_FILENO,
-                          &cfg->cfg_command_buf[cfg->cfg_command_got],
-                          sizeof(cfg->cfg_command_buf) - cfg->cfg_command_got);
+                was = prof_enter(prof_command);
+                rv = cmdring_read(&cfg->cfg_command_ring, STDIN_FILENO);
+                prof_leave(was);
                 if (rv < 0) {
                     if (errno == EAGAIN || errno == EINTR ||
                         errno == EWOULDBLOCK) {
@@ -2298,13 +10872,36 @@ int main(int argc, char **argv)
                     errout("end of command input: implicit +k");
                     cfg->cfg_command_in = 0;
                     cfg->cfg_command_ignore = 0;
-                } else {
-                    cfg->cfg_command_got += rv;
                 }
-            } else if (cfg->cfg_dir < 0 && FD_ISSET(sok, &rfds)) {
-                /* receive a packet */
-                rv = recv(sok, cfg->cfg_data_rx,
-                          cfg->cfg_data_len + RX_EXTRA, 0);
+#ifdef DO_WORKERS
+            } else if (cfg->cfg_nworkers > 0 &&
+                       ready[r].fd == cfg->cfg_wake[0]) {
+                /* worker thread(s) have packets to report */
+                worker_wake(cfg);
+#endif /* DO_WORKERS */
+            } else if (ready[r].fd == signal_pipe[0]) {
+                /* SIGINT, SIGTERM, or SIGHUP: clean up and go */
+                rv = caught_signal;
+                errout("exiting on signal: %s", strsignal(rv));
+                exit_cleanup();
+                signal(rv, SIG_DFL);
+                raise(rv);
+                exit(1);
+            } else if (cfg->cfg_http != NULL && http_ready(cfg, &ready[r])) {
+                /* HTTP metrics server (-H); already handled */
+            } else if (cfg->cfg_cmdsock != NULL &&
+                       cmdsock_ready(cfg, &ready[r])) {
+                /* command socket (-K); commands handled below */
+#ifdef HAVE_PACKET_RING
+            } else if (cfg->cfg_nrings > 0 && ring_ready(cfg, &ready[r])) {
+                /* packet ring (-o ring); already handled */
+#endif /* HAVE_PACKET_RING */
+            } else if (cfg->cfg_dir < 0 && ready[r].tag != NULL) {
+                /* receive a packet, or several, on one group's socket */
+                g = ready[r].tag;
+                was = prof_enter(prof_recv);
+                rv = rx_batch(&cfg->cfg_rx, g->mg_sok);
+                prof_leave(was);
                 if (rv < 0) {
                     /* packet not received */
                     if (errno == EAGAIN || errno == EWOULDBLOCK ||
@@ -2315,31 +10912,29 @@ int main(int argc, char **argv)
                         errthrottle();
                     }
                 } else {
-                    /* packet received */
-                    gettimeofday(&tlast, NULL);
-                    emit(cfg, reported_event_rx, NULL);
-                    if (cfg->cfg_data_chk) {
-                        /* what did we get? */
-                        if (rv != cfg->cfg_data_len ||
-                            memcmp(cfg->cfg_data_rx, cfg->cfg_data, rv) != 0) {
-
-                            emit(cfg, reported_event_pkt,
-                                 "contents do not match '-d' option");
-                        }
-                    }
-                    if (!rx_state_up) {
-                        rx_state_up = 1;
-                        emit(cfg, reported_event_up, NULL);
-                    }
+                    /* packet(s) received */
+                    rx_packets(cfg, g, &cfg->cfg_rx, rv);
                 }
             }
         }
 
-        /* handle any commands that came in on stdin */
-        while (cfg->cfg_command_in && cfg->cfg_command_got > 0) {
-            ca = command(cfg);
+        /*
+         * Handle any commands that came in on stdin or the -K socket; all
+         * of them, before the changes they make (like to the source
+         * filters) are applied, together, at the top of the loop.
+         */
+        was = prof_enter(prof_command);
+        for (;;) {
+            ca = command_action_wait;
+            if (cfg->cfg_command_in && cfg->cfg_command_ring.cr_got > 0) {
+                ca = command(cfg);
+                cfg->cfg_gcmd = cfg->cfg_gsel;
+            }
+            if (ca == command_action_wait && cfg->cfg_cmdsock != NULL) {
+                ca = cmdsock_command(cfg);
+            }
             if (ca == command_action_wait) {
-                /* no complete lines left */
+                /* no complete commands left */
                 break;
             }
             switch (ca) {
@@ -2352,15 +10947,19 @@ int main(int argc, char **argv)
     #ifdef DO_SOURCES
             case command_action_source:
                 /* source filter mode / list change */
-                group_check(cfg, 0);
+                group_check(cfg, cfg->cfg_gcmd, 0);
+                cfg->cfg_gcmd->mg_reapply = 1;
+                cfg->cfg_gcmd->mg_critical = 0;
                 reapply_filter = 1;
-                filter_critical = 0;
                 break;
     #endif /* DO_SOURCES */
             case command_action_exit_program:
                 /* end the program */
                 errout("exiting on command");
-                exit(0);
+#ifdef DEE_PROFILE
+                prof_report(cfg);
+#endif /* DEE_PROFILE */
+                exit(0); /* exit_cleanup() does the rest */
                 break;
             case command_action_time_change:
                 /* period/multiplier/timeout changed */
@@ -2372,5 +10971,6 @@ int main(int argc, char **argv)
                 break;
             }
         }
+        prof_leave(was);
     }
 }
@@ -50,6 +50,38 @@ struct oligocast_sml_state {
     int             joined;             /* nonzero if we've joined the group */
 };
 
+/*
+ * State of the event loop, which waits for file descriptors to be
+ * ready and for timeouts.  Its contents are private to oligocast_compat.c.
+ */
+struct oligocast_evloop;
+
+struct oligocast_evready {
+    /*
+     * One file descriptor that's ready, as reported by evloop_wait_until().
+     */
+    int             fd;                 /* file descriptor */
+    int             events;             /* EVLOOP_* flags for what's ready */
+    void *          tag;                /* as passed to evloop_watch() */
+};
+
+#ifdef HAVE_PACKET_RING
+/*
+ * A ring buffer of received packets shared with the kernel ("-o ring").
+ * Its contents are private to oligocast_compat.c.
+ */
+struct oligocast_ring;
+#endif /* HAVE_PACKET_RING */
+
+/* flags for evloop_watch() and evloop_wait_until() */
+#define EVLOOP_READ     1               /* ready to read */
+#define EVLOOP_ERROR    2               /* error condition; always reported */
+#define EVLOOP_WRITE    4               /* ready to write */
+
+/* patterns for pattern_fill() and pattern_check() */
+#define PATTERN_PRBS    1               /* pseudorandom (xorshift32) */
+#define PATTERN_COUNT   2               /* counting 32-bit words */
+
 /* functions in oligocast.c */
 
 /* functions in oligocast_compat.c */
@@ -63,4 +95,41 @@ void setup_mcast_listen(int sok, struct oligocast_if *intf,
 #endif /* DO_SOURCES */
                         struct oligocast_sml_state *st,
                         char *errbuf, size_t errlen);
+void leave_mcast_group(int sok, struct oligocast_if *intf,
+                       struct sockaddr *group, socklen_t grouplen,
+                       struct oligocast_sml_state *state,
+                       char *errbuf, size_t errlen);
+#if defined(DO_SOURCES) && defined(HAVE_MCAST_JOIN_SOURCE_GROUP)
+void update_mcast_source(int sok, struct oligocast_if *intf,
+                         struct sockaddr *group, socklen_t grouplen,
+                         uint32_t fmode, int add,
+                         struct sockaddr_storage *source,
+                         char *errbuf, size_t errlen);
+#endif /* DO_SOURCES && HAVE_MCAST_JOIN_SOURCE_GROUP */
+struct oligocast_evloop *evloop_create(char *errbuf, size_t errlen);
+void evloop_watch(struct oligocast_evloop *evl, int fd, int events, void *tag,
+                  char *errbuf, size_t errlen);
+int64_t evloop_now(void);
+int evloop_wait_until(struct oligocast_evloop *evl, int64_t deadline,
+                      struct oligocast_evready *ready, int nready);
+#ifdef HAVE_SO_TIMESTAMPING
+void hw_timestamps(int sok, struct oligocast_if *intf,
+                   char *errbuf, size_t errlen);
+#endif /* HAVE_SO_TIMESTAMPING */
+#ifdef HAVE_PACKET_RING
+struct oligocast_ring *ring_open(struct oligocast_if *intf, int af,
+                                 char *errbuf, size_t errlen);
+int ring_fd(struct oligocast_ring *r);
+int ring_next(struct oligocast_ring *r, uint8_t **pkt, int *len,
+              struct timespec *ts);
+int ring_release(struct oligocast_ring *r);
+void socket_discard(int sok, char *errbuf, size_t errlen);
+#endif /* HAVE_PACKET_RING */
+const char *pattern_init(void);
+void pattern_fill(int pat, uint64_t seed, uint8_t *buf, size_t len);
+int pattern_check(int pat, uint64_t seed, const uint8_t *buf, size_t len);
+uint32_t crc32c(uint32_t crc, const uint8_t *buf, size_t len);
+#ifdef DO_WORKERS
+void thread_pin(pthread_t t, int n, char *errbuf, size_t errlen);
+#endif /* DO_WORKERS */
 
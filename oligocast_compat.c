@@ -46,6 +46,10 @@
 #if defined(__linux__) && defined(HAVE_SETSOURCEFILTER)
 #define _GNU_SOURCE /* for setsourcefilter() */
 #endif 
+#if defined(__linux__) && defined(HAVE_PTHREAD_AFFINITY) && \
+    !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* for pthread_setaffinity_np() */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -57,9 +61,43 @@
 #include <netinet/ip.h>
 #include <arpa/inet.h>
 #include <net/if.h>
+#include <time.h>
 #ifdef HAVE_GETIFADDRS
 #include <ifaddrs.h>
 #endif
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#else /* HAVE_EPOLL */
+#include <poll.h>
+#endif /* !HAVE_EPOLL */
+#ifdef DO_WORKERS
+#include <pthread.h>
+#ifdef HAVE_PTHREAD_AFFINITY
+#include <sched.h>
+#endif /* HAVE_PTHREAD_AFFINITY */
+#endif /* DO_WORKERS */
+#ifdef HAVE_SO_TIMESTAMPING
+#include <sys/ioctl.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#endif /* HAVE_SO_TIMESTAMPING */
+#include <stdint.h>
+#if defined(__SSE2__) || defined(HAVE_CPU_DISPATCH)
+#include <immintrin.h>
+#endif /* __SSE2__ || HAVE_CPU_DISPATCH */
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif /* __ARM_NEON */
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif /* __ARM_FEATURE_CRC32 */
+#ifdef HAVE_PACKET_RING
+#include <sys/mman.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#endif /* HAVE_PACKET_RING */
 #include "oligocast.h"
 
 #if !defined(HAVE_MULTICAST_IF_IP_MREQN)
@@ -212,6 +250,125 @@ void setup_mcast_listen(int sok, struct oligocast_if *intf,
     return;
 }
 
+/*
+ * leave_mcast_group()
+ *
+ * Leave a multicast group that a socket joined with setup_mcast_listen(),
+ * whatever its source filter.  Calling setup_mcast_listen() again joins
+ * it again.
+ *
+ * Parameters:
+ *      sok -- the socket to act on
+ *      intf -- identifies the network interface it's listening on
+ *      group -- multicast group address
+ *      grouplen -- length of *group
+ *      state -- as given to setup_mcast_listen()
+ *      errbuf -- buffer that will get an error message in case of failure,
+ *          otherwise empty string
+ *      errlen -- length of errbuf in bytes
+ */
+void leave_mcast_group(int sok, struct oligocast_if *intf,
+                       struct sockaddr *group, socklen_t grouplen,
+                       struct oligocast_sml_state *state,
+                       char *errbuf, size_t errlen)
+{
+    int rv;
+
+    if (errlen > 0) {
+        errbuf[0] = '\0';
+    }
+    if (!state->ever_called || !state->joined) {
+        return; /* not a member, nothing to leave */
+    }
+
+    if (group->sa_family == AF_INET6) {
+        /* IPv6 */
+        struct ipv6_mreq ipv6mr;
+        memset(&ipv6mr, 0, sizeof(ipv6mr));
+        ipv6mr.ipv6mr_multiaddr = ((struct sockaddr_in6 *)group)->sin6_addr;
+        ipv6mr.ipv6mr_interface = intf->idx;
+        rv = setsockopt(sok, IPPROTO_IPV6, IPV6_LEAVE_GROUP,
+                        &ipv6mr, sizeof(ipv6mr));
+    } else {
+        /* IPv4 */
+#ifdef HAVE_IP_ADD_MEMBERSHIP_IP_MREQN
+        struct ip_mreqn imr;
+        memset(&imr, 0, sizeof(imr));
+        imr.imr_multiaddr = ((struct sockaddr_in *)group)->sin_addr;
+        imr.imr_address.s_addr = INADDR_ANY;
+        imr.imr_ifindex = intf->idx;
+#else /* HAVE_IP_ADD_MEMBERSHIP_IP_MREQN */
+        struct ip_mreq imr;
+        memset(&imr, 0, sizeof(imr));
+        imr.imr_multiaddr = ((struct sockaddr_in *)group)->sin_addr;
+        imr.imr_interface = intf->adr;
+#endif /* !HAVE_IP_ADD_MEMBERSHIP_IP_MREQN */
+        rv = setsockopt(sok, IPPROTO_IP, IP_DROP_MEMBERSHIP,
+                        &imr, sizeof(imr));
+    }
+    if (rv) {
+        snprintf(errbuf, errlen, "failed to leave group: %s",
+                 strerror(errno));
+        return;
+    }
+    state->joined = 0;
+}
+
+#if defined(DO_SOURCES) && defined(HAVE_MCAST_JOIN_SOURCE_GROUP)
+/*
+ * update_mcast_source()
+ *
+ * Change one source in the filter of a socket that's already listening
+ * to a multicast group, as set up by setup_mcast_listen(), without
+ * replacing the whole filter.  Implemented using the per-source socket
+ * options of RFC 3678, MCAST_JOIN_SOURCE_GROUP & co.
+ *
+ * Parameters:
+ *      sok -- the socket to act on
+ *      intf -- identifies the network interface it's listening on
+ *      group -- multicast group address
+ *      grouplen -- length of *group
+ *      fmode -- filter mode the socket is in, MCAST_INCLUDE or
+ *          MCAST_EXCLUDE; this doesn't change it
+ *      add -- nonzero to add 'source' to the list, zero to remove it
+ *      source -- source address to include/exclude depending on fmode
+ *      errbuf -- buffer that will get an error message in case of failure,
+ *          otherwise empty string
+ *      errlen -- length of errbuf in bytes
+ */
+void update_mcast_source(int sok, struct oligocast_if *intf,
+                         struct sockaddr *group, socklen_t grouplen,
+                         uint32_t fmode, int add,
+                         struct sockaddr_storage *source,
+                         char *errbuf, size_t errlen)
+{
+    struct group_source_req gsr;
+    int opt;
+    const char *what;
+
+    if (errlen > 0) {
+        errbuf[0] = '\0';
+    }
+
+    memset(&gsr, 0, sizeof(gsr));
+    gsr.gsr_interface = intf ? intf->idx : 0;
+    memcpy(&gsr.gsr_group, group, grouplen);
+    memcpy(&gsr.gsr_source, source, sizeof(gsr.gsr_source));
+    if (fmode == MCAST_INCLUDE) {
+        opt = add ? MCAST_JOIN_SOURCE_GROUP : MCAST_LEAVE_SOURCE_GROUP;
+        what = add ? "include" : "stop including";
+    } else {
+        opt = add ? MCAST_BLOCK_SOURCE : MCAST_UNBLOCK_SOURCE;
+        what = add ? "exclude" : "stop excluding";
+    }
+    if (setsockopt(sok, (group->sa_family == AF_INET6) ?
+                   IPPROTO_IPV6 : IPPROTO_IP, opt, &gsr, sizeof(gsr))) {
+        snprintf(errbuf, errlen, "failed to %s source: %s",
+                 what, strerror(errno));
+    }
+}
+#endif /* DO_SOURCES && HAVE_MCAST_JOIN_SOURCE_GROUP */
+
 /*
  * identify_interface()
  *
@@ -298,3 +455,1308 @@ void identify_interface(char *name, struct oligocast_if *intf,
 #endif /* WANT_IFADDR */
 }
 
+
+/*
+ * The event loop: waits for file descriptors to become ready, or for
+ * a timeout, whichever comes first.  It's implemented using epoll(7)
+ * where available (HAVE_EPOLL) and poll() elsewhere.  Unlike select(),
+ * neither one limits file descriptor numbers to FD_SETSIZE, and the set
+ * of things waited for is only changed when the caller says so.
+ */
+
+struct oligocast_evloop_fd {
+    /* what's known about one file descriptor in the event loop */
+    int             events;             /* EVLOOP_* flags watched; 0 if not */
+    void *          tag;                /* as passed to evloop_watch() */
+#ifdef HAVE_EPOLL
+    int             always;             /* epoll refused it; always "ready" */
+#else /* HAVE_EPOLL */
+    int             pos;                /* index in pfds[] */
+#endif /* HAVE_EPOLL */
+};
+
+struct oligocast_evloop {
+    struct oligocast_evloop_fd *fds;    /* indexed by file descriptor */
+    int             nfds;               /* number of entries in fds[] */
+#ifdef HAVE_EPOLL
+    int             epfd;               /* epoll file descriptor */
+    int             tfd;                /* timerfd for sub-millisecond waits */
+    int             tarmed;             /* whether tfd might be running */
+    int             nalways;            /* number of fds with 'always' set */
+    struct epoll_event *evs;            /* results from epoll_wait() */
+    int             nevs;               /* number of fds in the epoll set */
+    int             aevs;               /* allocated size of evs[] */
+#else /* HAVE_EPOLL */
+    struct pollfd * pfds;               /* file descriptors for poll() */
+    int             npfds;              /* used entries in pfds[] */
+    int             apfds;              /* allocated entries in pfds[] */
+#endif /* !HAVE_EPOLL */
+};
+
+/*
+ * evloop_create()
+ *
+ * Create a new event loop, with nothing to wait for to begin with.
+ *
+ * Parameters:
+ *      errbuf -- filled in with error message if any, empty string otherwise
+ *      errlen -- length of errbuf in bytes
+ *
+ * Returns:
+ *      the event loop; or NULL on failure
+ */
+struct oligocast_evloop *evloop_create(char *errbuf, size_t errlen)
+{
+    struct oligocast_evloop *evl;
+
+    errbuf[0] = '\0';
+    evl = calloc(1, sizeof(*evl));
+    evl->fds = NULL;
+    evl->nfds = 0;
+
+#ifdef HAVE_EPOLL
+    evl->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (evl->epfd < 0) {
+        snprintf(errbuf, errlen, "epoll_create1() failed: %s",
+                 strerror(errno));
+        free(evl);
+        return(NULL);
+    }
+
+    /*
+     * epoll_wait() only times out to the millisecond; for finer timing
+     * use a timerfd, which goes into the epoll set like anything else.
+     * If that doesn't work out, go on with millisecond timing.
+     */
+    evl->tarmed = 0;
+    evl->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (evl->tfd >= 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = evl->tfd;
+        if (epoll_ctl(evl->epfd, EPOLL_CTL_ADD, evl->tfd, &ev) < 0) {
+            close(evl->tfd);
+            evl->tfd = -1;
+        }
+    }
+    evl->nalways = 0;
+    evl->nevs = 0;
+    evl->aevs = 1; /* room for tfd */
+    evl->evs = calloc(evl->aevs, sizeof(evl->evs[0]));
+#else /* HAVE_EPOLL */
+    evl->pfds = NULL;
+    evl->npfds = evl->apfds = 0;
+#endif /* !HAVE_EPOLL */
+
+    return(evl);
+}
+
+/*
+ * evloop_watch()
+ *
+ * Change what the event loop waits for on a file descriptor.
+ *
+ * Parameters:
+ *      evl -- the event loop
+ *      fd -- file descriptor
+ *      events -- EVLOOP_READ to wait for it to be readable, EVLOOP_WRITE
+ *          to wait for it to be writable; 0 to stop waiting for it.
+ *          EVLOOP_ERROR is reported whether asked for or not.
+ *      tag -- pointer that will be passed back by evloop_wait_until()
+ *      errbuf -- filled in with error message if any, empty string otherwise
+ *      errlen -- length of errbuf in bytes
+ */
+void evloop_watch(struct oligocast_evloop *evl, int fd, int events, void *tag,
+                  char *errbuf, size_t errlen)
+{
+    struct oligocast_evloop_fd *efd;
+    int old;
+
+    errbuf[0] = '\0';
+    if (fd < 0) {
+        snprintf(errbuf, errlen, "invalid file descriptor %d", fd);
+        return;
+    }
+    if (fd >= evl->nfds) {
+        /* make room in the table */
+        int n = (fd + 1) * 2;
+        evl->fds = realloc(evl->fds, n * sizeof(evl->fds[0]));
+        memset(&evl->fds[evl->nfds], 0,
+               (n - evl->nfds) * sizeof(evl->fds[0]));
+        evl->nfds = n;
+    }
+    efd = &evl->fds[fd];
+    old = efd->events;
+    efd->tag = tag;
+    if (old == events) {
+        return; /* nothing to change */
+    }
+
+#ifdef HAVE_EPOLL
+    if (efd->always) {
+        /* epoll can't wait for this one anyway */
+        if (!events) {
+            efd->always = 0;
+            --evl->nalways;
+        }
+    } else {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = ((events & EVLOOP_READ) ? EPOLLIN : 0) |
+                    ((events & EVLOOP_WRITE) ? EPOLLOUT : 0);
+        ev.data.fd = fd;
+        if (epoll_ctl(evl->epfd,
+                      (!old) ? EPOLL_CTL_ADD :
+                      (events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL),
+                      fd, &ev) < 0) {
+            if (errno == EPERM && !old) {
+                /*
+                 * epoll refuses regular files, which would always be ready
+                 * anyway, for instance stdin redirected from a file.
+                 */
+                efd->always = 1;
+                ++evl->nalways;
+            } else {
+                snprintf(errbuf, errlen, "epoll_ctl() failed on fd %d: %s",
+                         fd, strerror(errno));
+                return;
+            }
+        }
+        if (!old && !efd->always) {
+            /* room for another result from epoll_wait() */
+            ++evl->nevs;
+            if (evl->nevs + 1 > evl->aevs) {
+                evl->aevs = (evl->nevs + 1) * 2;
+                evl->evs = realloc(evl->evs,
+                                   evl->aevs * sizeof(evl->evs[0]));
+            }
+        } else if (!events) {
+            --evl->nevs;
+        }
+    }
+#else /* HAVE_EPOLL */
+    if (!old) {
+        /* add it to pfds[] */
+        if (evl->npfds >= evl->apfds) {
+            evl->apfds = evl->apfds * 2 + 4;
+            evl->pfds = realloc(evl->pfds,
+                                evl->apfds * sizeof(evl->pfds[0]));
+        }
+        efd->pos = evl->npfds++;
+        evl->pfds[efd->pos].fd = fd;
+    }
+    if (events) {
+        evl->pfds[efd->pos].events = ((events & EVLOOP_READ) ? POLLIN : 0) |
+                                     ((events & EVLOOP_WRITE) ? POLLOUT : 0);
+        evl->pfds[efd->pos].revents = 0;
+    } else {
+        /* remove it from pfds[], by moving the last one into its place */
+        --evl->npfds;
+        if (efd->pos < evl->npfds) {
+            evl->pfds[efd->pos] = evl->pfds[evl->npfds];
+            evl->fds[evl->pfds[efd->pos].fd].pos = efd->pos;
+        }
+    }
+#endif /* !HAVE_EPOLL */
+    efd->events = events;
+}
+
+/*
+ * evloop_now()
+ *
+ * Returns the time, in nanoseconds, on the clock evloop_wait_until()
+ * uses: CLOCK_MONOTONIC, which doesn't get set, so it's only useful for
+ * intervals and deadlines.
+ */
+int64_t evloop_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(((int64_t)ts.tv_sec) * 1000000000 + ts.tv_nsec);
+}
+
+/*
+ * evloop_wait_until()
+ *
+ * Wait until at least one of the file descriptors being watched is ready,
+ * or a given time arrives.  Taking a deadline instead of a timeout means
+ * the time spent getting here isn't added on.
+ *
+ * Parameters:
+ *      evl -- the event loop
+ *      deadline -- when to stop waiting, in nanoseconds on the clock
+ *          evloop_now() reads; 0 (or any time that's past) to just check
+ *          without waiting; negative to wait without a time limit
+ *      ready -- array, filled in with what's ready
+ *      nready -- size of ready[]
+ *
+ * Returns:
+ *      number of entries filled in ready[], 0 if it timed out, -1 if it
+ *      failed (with errno set)
+ */
+int evloop_wait_until(struct oligocast_evloop *evl, int64_t deadline,
+                      struct oligocast_evready *ready, int nready)
+{
+    int got = 0, rv, i, fd, events;
+    int64_t now = 0;
+    long ms;
+
+    if (deadline > 0) {
+        now = evloop_now();
+        if (deadline <= now) {
+            deadline = 0; /* already past: just check */
+        }
+    }
+#ifdef HAVE_EPOLL
+    if (evl->nalways > 0) {
+        /* some are always ready, so don't wait */
+        deadline = 0;
+    }
+    if (deadline > 0 && evl->tfd >= 0) {
+        /* use the timerfd for the timeout; it's on the same clock */
+        struct itimerspec its;
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = deadline / 1000000000;
+        its.it_value.tv_nsec = deadline % 1000000000;
+        if (timerfd_settime(evl->tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+            return(-1);
+        }
+        evl->tarmed = 1;
+        ms = -1;
+    } else {
+        if (evl->tarmed) {
+            /* stop an old timeout from interrupting this wait */
+            struct itimerspec its;
+            memset(&its, 0, sizeof(its));
+            timerfd_settime(evl->tfd, 0, &its, NULL);
+            evl->tarmed = 0;
+        }
+        ms = (deadline <= 0) ? deadline :
+            ((deadline - now + 999999) / 1000000);
+    }
+    if (ms < -1) {
+        ms = -1;
+    }
+
+    rv = epoll_wait(evl->epfd, evl->evs,
+                    (evl->nevs + 1 < nready) ? evl->nevs + 1 : nready, ms);
+    if (rv < 0) {
+        return(-1);
+    }
+    for (i = 0; i < rv; ++i) {
+        fd = evl->evs[i].data.fd;
+        if (fd == evl->tfd) {
+            /* the timeout has passed */
+            uint64_t expirations;
+            if (read(evl->tfd, &expirations, sizeof(expirations)) < 0) {
+                /* doesn't matter */
+            }
+            evl->tarmed = 0;
+            continue;
+        }
+        events = 0;
+        if (evl->evs[i].events & (EPOLLIN | EPOLLHUP)) {
+            events |= EVLOOP_READ;
+        }
+        if (evl->evs[i].events & EPOLLOUT) {
+            events |= EVLOOP_WRITE;
+        }
+        if (evl->evs[i].events & EPOLLERR) {
+            events |= EVLOOP_ERROR;
+        }
+        ready[got].fd = fd;
+        ready[got].events = events;
+        ready[got].tag = evl->fds[fd].tag;
+        ++got;
+    }
+    for (fd = 0; evl->nalways > 0 && fd < evl->nfds && got < nready; ++fd) {
+        if (evl->fds[fd].always) {
+            ready[got].fd = fd;
+            ready[got].events = EVLOOP_READ;
+            ready[got].tag = evl->fds[fd].tag;
+            ++got;
+        }
+    }
+#else /* HAVE_EPOLL */
+    if (deadline < 0) {
+        ms = -1;
+    } else if (deadline == 0) {
+        ms = 0;
+    } else {
+        ms = (deadline - now + 999999) / 1000000;
+    }
+    rv = poll(evl->pfds, evl->npfds, ms);
+    if (rv < 0) {
+        return(-1);
+    }
+    for (i = 0; i < evl->npfds && got < nready; ++i) {
+        if (evl->pfds[i].revents == 0) {
+            continue;
+        }
+        events = 0;
+        if (evl->pfds[i].revents & (POLLIN | POLLHUP)) {
+            events |= EVLOOP_READ;
+        }
+        if (evl->pfds[i].revents & POLLOUT) {
+            events |= EVLOOP_WRITE;
+        }
+        if (evl->pfds[i].revents & (POLLERR | POLLNVAL)) {
+            events |= EVLOOP_ERROR;
+        }
+        fd = evl->pfds[i].fd;
+        ready[got].fd = fd;
+        ready[got].events = events;
+        ready[got].tag = evl->fds[fd].tag;
+        ++got;
+    }
+#endif /* !HAVE_EPOLL */
+
+    return(got);
+}
+
+#ifdef HAVE_SO_TIMESTAMPING
+/*
+ * hw_timestamps()
+ * Set up socket 'sok' to get receive timestamps from the hardware of
+ * network interface 'intf' where it can, and from the kernel
+ * otherwise.  Turning them on in the interface usually needs privileges
+ * (CAP_NET_ADMIN); if it's already on (say, for PTP) it's left as it is.
+ * The setting is for the whole interface, and stays after we exit.
+ *
+ * Parameters:
+ *      sok - the socket
+ *      intf - the network interface
+ *      errbuf - buffer to store error message in; left empty on success
+ *      errlen - size of errbuf
+ */
+void hw_timestamps(int sok, struct oligocast_if *intf,
+                   char *errbuf, size_t errlen)
+{
+    struct hwtstamp_config hc;
+    struct ifreq ifr;
+    int arg;
+
+    errbuf[0] = '\0';
+    arg = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+          SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (setsockopt(sok, SOL_SOCKET, SO_TIMESTAMPING, &arg, sizeof(arg)) < 0) {
+        snprintf(errbuf, errlen, "failed to set SO_TIMESTAMPING: %s",
+                 strerror(errno));
+        return;
+    }
+
+    /* see what the interface is doing already */
+    memset(&hc, 0, sizeof(hc));
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%.*s",
+             (int)sizeof(ifr.ifr_name) - 1, intf->nam);
+    ifr.ifr_data = (void *)&hc;
+    if (ioctl(sok, SIOCGHWTSTAMP, &ifr) >= 0 &&
+        hc.rx_filter != HWTSTAMP_FILTER_NONE) {
+        return; /* already timestamping received packets */
+    }
+
+    /* have it timestamp every packet it receives */
+    memset(&hc, 0, sizeof(hc));
+    hc.tx_type = HWTSTAMP_TX_OFF;
+    hc.rx_filter = HWTSTAMP_FILTER_ALL;
+    if (ioctl(sok, SIOCSHWTSTAMP, &ifr) < 0) {
+        snprintf(errbuf, errlen,
+                 "failed to enable hardware timestamps on %s: %s",
+                 intf->nam, strerror(errno));
+    }
+}
+#endif /* HAVE_SO_TIMESTAMPING */
+
+#ifdef DO_WORKERS
+/*
+ * thread_pin()
+ * Restrict thread 't' to run on one CPU: the n'th (counting from 0, and
+ * wrapping around) of the CPUs this process is allowed to run on.
+ * On platforms without a way to do that, does nothing.
+ *
+ * Parameters:
+ *      t - the thread
+ *      n - which CPU
+ *      errbuf - buffer to store error message in; left empty on success
+ *      errlen - size of errbuf
+ */
+void thread_pin(pthread_t t, int n, char *errbuf, size_t errlen)
+{
+#ifdef HAVE_PTHREAD_AFFINITY
+    cpu_set_t allowed, one;
+    int cpu, count, rv;
+
+    errbuf[0] = '\0';
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        snprintf(errbuf, errlen, "sched_getaffinity() failed: %s",
+                 strerror(errno));
+        return;
+    }
+    count = CPU_COUNT(&allowed);
+    if (count < 1) {
+        return; /* shouldn't happen */
+    }
+    n %= count;
+    for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && n-- == 0) {
+            break;
+        }
+    }
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    rv = pthread_setaffinity_np(t, sizeof(one), &one);
+    if (rv != 0) {
+        snprintf(errbuf, errlen, "failed to run thread on CPU %d: %s",
+                 cpu, strerror(rv));
+    }
+#else /* HAVE_PTHREAD_AFFINITY */
+    errbuf[0] = '\0';
+#endif /* !HAVE_PTHREAD_AFFINITY */
+}
+#endif /* DO_WORKERS */
+
+#ifdef HAVE_PACKET_RING
+/*
+ * The packet ring ("-o ring"): an AF_PACKET socket with a TPACKET_V3
+ * receive ring shared with the kernel, for the packets of one protocol
+ * (IPv4 or IPv6) on one network interface.  It's bound to ETH_P_ALL,
+ * not the protocol, since only then does it also get the packets this
+ * host sends; others are skipped in ring_next().  The kernel fills in
+ * blocks of packets; each block is handed back when all its packets have
+ * been looked at.
+ */
+
+#define RING_BLOCK_SIZE (1 << 20)       /* bytes per block */
+#define RING_BLOCKS     16              /* blocks in the ring */
+#define RING_FRAME_SIZE 2048            /* nominal; TPACKET_V3 packs them */
+#define RING_TIMEOUT_MS 1               /* hand over partly full blocks */
+
+struct oligocast_ring {
+    int             fd;                 /* AF_PACKET socket */
+    int             proto;              /* ETH_P_IP or ETH_P_IPV6 */
+    uint8_t *       map;                /* the ring, mapped */
+    size_t          maplen;             /* its size */
+    int             cur;                /* block being looked at, or next */
+    struct tpacket_block_desc *bd;      /* that block, if it's ours */
+    int             left;               /* packets in it not looked at */
+    uint8_t *       next;               /* next one of them */
+};
+
+/*
+ * ring_open()
+ *
+ * Set up a packet ring receiving IPv4 or IPv6 packets on a network
+ * interface.
+ *
+ * Parameters:
+ *      intf -- the network interface
+ *      af -- AF_INET or AF_INET6
+ *      errbuf -- filled in with error message if any, empty string otherwise
+ *      errlen -- length of errbuf in bytes
+ *
+ * Returns:
+ *      the ring; or NULL on failure
+ */
+struct oligocast_ring *ring_open(struct oligocast_if *intf, int af,
+                                 char *errbuf, size_t errlen)
+{
+    struct oligocast_ring *r;
+    struct tpacket_req3 req;
+    struct sockaddr_ll sll;
+    int proto = htons(ETH_P_ALL);
+    int arg = TPACKET_V3;
+
+    errbuf[0] = '\0';
+    r = calloc(1, sizeof(*r));
+    r->map = MAP_FAILED;
+    r->proto = htons((af == AF_INET6) ? ETH_P_IPV6 : ETH_P_IP);
+    r->fd = socket(AF_PACKET, SOCK_DGRAM, proto);
+    if (r->fd < 0) {
+        snprintf(errbuf, errlen, "failed to create packet socket: %s",
+                 strerror(errno));
+        goto fail;
+    }
+    if (setsockopt(r->fd, SOL_PACKET, PACKET_VERSION,
+                   &arg, sizeof(arg)) < 0) {
+        snprintf(errbuf, errlen, "failed to set TPACKET_V3: %s",
+                 strerror(errno));
+        goto fail;
+    }
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = RING_BLOCK_SIZE;
+    req.tp_block_nr = RING_BLOCKS;
+    req.tp_frame_size = RING_FRAME_SIZE;
+    req.tp_frame_nr = (RING_BLOCK_SIZE / RING_FRAME_SIZE) * RING_BLOCKS;
+    req.tp_retire_blk_tov = RING_TIMEOUT_MS;
+    if (setsockopt(r->fd, SOL_PACKET, PACKET_RX_RING,
+                   &req, sizeof(req)) < 0) {
+        snprintf(errbuf, errlen, "failed to set up PACKET_RX_RING: %s",
+                 strerror(errno));
+        goto fail;
+    }
+    r->maplen = (size_t)RING_BLOCK_SIZE * RING_BLOCKS;
+    r->map = mmap(NULL, r->maplen, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  r->fd, 0);
+    if (r->map == MAP_FAILED) {
+        snprintf(errbuf, errlen, "failed to map packet ring: %s",
+                 strerror(errno));
+        goto fail;
+    }
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = proto;
+    sll.sll_ifindex = intf->idx;
+    if (bind(r->fd, (void *)&sll, sizeof(sll)) < 0) {
+        snprintf(errbuf, errlen, "failed to bind packet socket to %s: %s",
+                 intf->nam, strerror(errno));
+        goto fail;
+    }
+    r->cur = 0;
+    r->bd = NULL;
+    return(r);
+
+fail:
+    if (r->map != MAP_FAILED) {
+        munmap(r->map, r->maplen);
+    }
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    free(r);
+    return(NULL);
+}
+
+/*
+ * ring_fd()
+ * Returns the file descriptor that's readable when ring 'r' has packets.
+ */
+int ring_fd(struct oligocast_ring *r)
+{
+    return(r->fd);
+}
+
+/*
+ * ring_next()
+ *
+ * Get the next packet from the block of the ring being looked at (or the
+ * next block, if the kernel's done with it).  Packets this host sent show
+ * up once, as they're sent (packet sockets don't get the looped back
+ * copy), much like a UDP socket would see them with IP_MULTICAST_LOOP.
+ * The packet stays where it is, in the ring, until ring_release().
+ *
+ * Parameters:
+ *      r -- the ring
+ *      pkt -- filled in with where the packet is, starting at the IP header
+ *      len -- filled in with its length
+ *      ts -- filled in with when it was received
+ *
+ * Returns:
+ *      1 if a packet was found; 0 if there are no more in the block, or
+ *      no block is ready
+ */
+int ring_next(struct oligocast_ring *r, uint8_t **pkt, int *len,
+              struct timespec *ts)
+{
+    struct tpacket_block_desc *bd;
+    struct tpacket3_hdr *h;
+    struct sockaddr_ll *sll;
+
+    if (r->bd == NULL) {
+        bd = (void *)(r->map + (size_t)r->cur * RING_BLOCK_SIZE);
+        if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+              TP_STATUS_USER)) {
+            return(0); /* the kernel's still filling it */
+        }
+        r->bd = bd;
+        r->left = bd->hdr.bh1.num_pkts;
+        r->next = (uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt;
+    }
+    while (r->left > 0) {
+        h = (void *)r->next;
+        --r->left;
+        r->next += h->tp_next_offset;
+        sll = (void *)((uint8_t *)h +
+                       TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        if (sll->sll_protocol != r->proto) {
+            continue;
+        }
+        *pkt = (uint8_t *)h + h->tp_net;
+        *len = h->tp_snaplen;
+        ts->tv_sec = h->tp_sec;
+        ts->tv_nsec = h->tp_nsec;
+        return(1);
+    }
+    return(0);
+}
+
+/*
+ * ring_release()
+ * Give the block being looked at in ring 'r' back to the kernel, after
+ * all the packets gotten from it by ring_next() are done with.  Returns
+ * 1 if there was such a block, 0 if not.
+ */
+int ring_release(struct oligocast_ring *r)
+{
+    if (r->bd == NULL) {
+        return(0);
+    }
+    __atomic_store_n(&r->bd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                     __ATOMIC_RELEASE);
+    r->bd = NULL;
+    r->cur = (r->cur + 1) % RING_BLOCKS;
+    return(1);
+}
+
+/*
+ * socket_discard()
+ *
+ * Have the kernel throw away everything that arrives on socket 'sok',
+ * without affecting its multicast group memberships.  For use when
+ * packets are received another way, like the packet ring.
+ *
+ * Parameters:
+ *      sok -- the socket
+ *      errbuf -- filled in with error message if any, empty string otherwise
+ *      errlen -- length of errbuf in bytes
+ */
+void socket_discard(int sok, char *errbuf, size_t errlen)
+{
+    struct sock_filter drop = BPF_STMT(BPF_RET | BPF_K, 0);
+    struct sock_fprog prog;
+
+    errbuf[0] = '\0';
+    prog.len = 1;
+    prog.filter = &drop;
+    if (setsockopt(sok, SOL_SOCKET, SO_ATTACH_FILTER,
+                   &prog, sizeof(prog)) < 0) {
+        snprintf(errbuf, errlen, "failed to set SO_ATTACH_FILTER: %s",
+                 strerror(errno));
+    }
+}
+#endif /* HAVE_PACKET_RING */
+
+/*
+ * Payload patterns, for "-d prbs:" and "-d count:"; and CRC32C, for
+ * "-d ...,crc".  These are generated and checked in bulk, so there are
+ * versions using the vector instructions of SSE2, AVX2 (chosen at run
+ * time, with HAVE_CPU_DISPATCH), and NEON, besides the plain one.  They
+ * all produce the same thing:
+ *
+ * The pattern is a series of 32-bit words, in little endian byte order,
+ * generated PAT_LANES at a time, side by side.  Each of those "lanes" has
+ * its own 32-bit state, set up from a 64-bit seed (see pat_start()):
+ *      PATTERN_PRBS -- xorshift32: each block, the state is stepped and
+ *          the result is the word
+ *      PATTERN_COUNT -- the word is the state, which goes up by PAT_LANES
+ *          each block; so the words count up one by one
+ * If the length isn't a multiple of a block, the last one's cut short.
+ */
+
+#define PAT_LANES 8                     /* words generated side by side */
+#define PAT_BLOCK (PAT_LANES * 4)       /* bytes per block of those */
+
+struct pat_kernels {
+    /*
+     * One implementation of the patterns: functions to fill or check
+     * 'nblk' whole blocks at 'buf', continuing from lane state 'st' and
+     * updating it.  The check functions return zero if it all matched.
+     */
+    const char *name;
+    void (*fill[3])(uint32_t *st, uint8_t *buf, size_t nblk);
+    uint32_t (*check[3])(uint32_t *st, const uint8_t *buf, size_t nblk);
+};
+
+static void pat_fill_prbs_generic(uint32_t *st, uint8_t *buf, size_t nblk);
+static uint32_t pat_check_prbs_generic(uint32_t *st, const uint8_t *buf,
+                                       size_t nblk);
+static void pat_fill_count_generic(uint32_t *st, uint8_t *buf, size_t nblk);
+static uint32_t pat_check_count_generic(uint32_t *st, const uint8_t *buf,
+                                        size_t nblk);
+static uint32_t crc32c_generic(uint32_t crc, const uint8_t *buf, size_t len);
+
+static const struct pat_kernels pat_generic = {
+    "generic",
+    { NULL, &pat_fill_prbs_generic, &pat_fill_count_generic },
+    { NULL, &pat_check_prbs_generic, &pat_check_count_generic },
+};
+static const struct pat_kernels *pat_impl = &pat_generic;
+static uint32_t (*crc32c_impl)(uint32_t crc, const uint8_t *buf,
+                               size_t len) = &crc32c_generic;
+static const char *crc32c_name = "generic";
+static uint32_t crc32c_table[8][256];
+
+/* the plain versions, a word at a time */
+
+static void put32le(uint8_t *buf, uint32_t v)
+{
+    buf[0] = v;
+    buf[1] = v >> 8;
+    buf[2] = v >> 16;
+    buf[3] = v >> 24;
+}
+
+static uint32_t get32le(const uint8_t *buf)
+{
+    return(buf[0] | (buf[1] << 8) | (buf[2] << 16) |
+           (((uint32_t)buf[3]) << 24));
+}
+
+static void pat_fill_prbs_generic(uint32_t *st, uint8_t *buf, size_t nblk)
+{
+    size_t b;
+    int j;
+    uint32_t x;
+
+    for (b = 0; b < nblk; ++b) {
+        for (j = 0; j < PAT_LANES; ++j) {
+            x = st[j];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            st[j] = x;
+            put32le(buf, x);
+            buf += 4;
+        }
+    }
+}
+
+static uint32_t pat_check_prbs_generic(uint32_t *st, const uint8_t *buf,
+                                       size_t nblk)
+{
+    size_t b;
+    int j;
+    uint32_t x, diff = 0;
+
+    for (b = 0; b < nblk; ++b) {
+        for (j = 0; j < PAT_LANES; ++j) {
+            x = st[j];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            st[j] = x;
+            diff |= x ^ get32le(buf);
+            buf += 4;
+        }
+    }
+    return(diff);
+}
+
+static void pat_fill_count_generic(uint32_t *st, uint8_t *buf, size_t nblk)
+{
+    size_t b;
+    int j;
+
+    for (b = 0; b < nblk; ++b) {
+        for (j = 0; j < PAT_LANES; ++j) {
+            put32le(buf, st[j]);
+            st[j] += PAT_LANES;
+            buf += 4;
+        }
+    }
+}
+
+static uint32_t pat_check_count_generic(uint32_t *st, const uint8_t *buf,
+                                        size_t nblk)
+{
+    size_t b;
+    int j;
+    uint32_t diff = 0;
+
+    for (b = 0; b < nblk; ++b) {
+        for (j = 0; j < PAT_LANES; ++j) {
+            diff |= st[j] ^ get32le(buf);
+            st[j] += PAT_LANES;
+            buf += 4;
+        }
+    }
+    return(diff);
+}
+
+/*
+ * crc32c_generic()
+ * CRC32C (Castagnoli), eight bytes at a time using crc32c_table[][]
+ * ("slicing by 8").  Takes and returns the CRC register, not inverted.
+ */
+static uint32_t crc32c_generic(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    while (len >= 8) {
+        crc ^= get32le(buf);
+        crc = crc32c_table[7][crc & 255] ^
+              crc32c_table[6][(crc >> 8) & 255] ^
+              crc32c_table[5][(crc >> 16) & 255] ^
+              crc32c_table[4][crc >> 24] ^
+              crc32c_table[3][buf[4]] ^
+              crc32c_table[2][buf[5]] ^
+              crc32c_table[1][buf[6]] ^
+              crc32c_table[0][buf[7]];
+        buf += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *buf) & 255];
+        ++buf;
+        --len;
+    }
+    return(crc);
+}
+
+#if defined(__SSE2__)
+/* SSE2: PAT_LANES words in two 128 bit registers */
+
+static __m128i pat_xorshift_sse2(__m128i x)
+{
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+    return(_mm_xor_si128(x, _mm_slli_epi32(x, 5)));
+}
+
+static void pat_fill_prbs_sse2(uint32_t *st, uint8_t *buf, size_t nblk)
+{
+    __m128i a = _mm_loadu_si128((void *)st);
+    __m128i b = _mm_loadu_si128((void *)(st + 4));
+    size_t i;
+
+    for (i = 0; i < nblk; ++i) {
+        a = pat_xorshift_sse2(a);
+        b = pat_xorshift_sse2(b);
+        _mm_storeu_si128((void *)buf, a);
+        _mm_storeu_si128((void *)(buf + 16), b);
+        buf += PAT_BLOCK;
+    }
+    _mm_storeu_si128((void *)st, a);
+    _mm_storeu_si128((void *)(st + 4), b);
+}
+
+static uint32_t pat_check_prbs_sse2(uint32_t *st, const uint8_t *buf,
+                                    size_t nblk)
+{
+    __m128i a = _mm_loadu_si128((void *)st);
+    __m128i b = _mm_loadu_si128((void *)(st + 4));
+    __m128i diff = _mm_setzero_si128();
+    size_t i;
+
+    for (i = 0; i < nblk; ++i) {
+        a = pat_xorshift_sse2(a);
+        b = pat_xorshift_sse2(b);
+        diff = _mm_or_si128(diff, _mm_xor_si128(a,
+                            _mm_loadu_si128((void *)buf)));
+        diff = _mm_or_si128(diff, _mm_xor_si128(b,
+                            _mm_loadu_si128((void *)(buf + 16))));
+        buf += PAT_BLOCK;
+    }
+    _mm_storeu_si128((void *)st, a);
+    _mm_storeu_si128((void *)(st + 4), b);
+    return(_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) !=
+           0xffff);
+}
+
+static void pat_fill_count_sse2(uint32_t *st, uint8_t *buf, size_t nblk)
+{
+    __m128i a = _mm_loadu_si128((void *)st);
+    __m128i b = _mm_loadu_si128((void *)(st + 4));
+    __m128i step = _mm_set1_epi32(PAT_LANES);
+    size_t i;
+
+    for (i = 0; i < nblk; ++i) {
+        _mm_storeu_si128((void *)buf, a);
+        _mm_storeu_si128((void *)(buf + 16), b);
+        a = _mm_add_epi32(a, step);
+        b = _mm_add_epi32(b, step);
+        buf += PAT_BLOCK;
+    }
+    _mm_storeu_si128((void *)st, a);
+    _mm_storeu_si128((void *)(st + 4), b);
+}
+
+static uint32_t pat_check_count_sse2(uint32_t *st, const uint8_t *buf,
+                                     size_t nblk)
+{
+    __m128i a = _mm_loadu_si128((void *)st);
+    __m128i b = _mm_loadu_si128((void *)(st + 4));
+    __m128i step = _mm_set1_epi32(PAT_LANES);
+    __m128i diff = _mm_setzero_si128();
+    size_t i;
+
+    for (i = 0; i < nblk; ++i) {
+        diff = _mm_or_si128(diff, _mm_xor_si128(a,
+                            _mm_loadu_si128((void *)buf)));
+        diff = _mm_or_si128(diff, _mm_xor_si128(b,
+                            _mm_loadu_si128((void *)(buf + 16))));
+        a = _mm_add_epi32(a, step);
+        b = _mm_add_epi32(b, step);
+        buf += PAT_BLOCK;
+    }
+    _mm_storeu_si128((void *)st, a);
+    _mm_storeu_si128((void *)(st + 4), b);
+    return(_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) !=
+           0xffff);
+}
+
+static const struct pat_kernels pat_sse2 = {
+    "sse2",
+    { NULL, &pat_fill_prbs_sse2, &pat_fill_count_sse2 },
+    { NULL, &pat_check_prbs_sse2, &pat_check_count_sse2 },
+};
+#endif /* __SSE2__ */
+
+#ifdef HAVE_CPU_DISPATCH
+/* AVX2: PAT_LANES words in one 256 bit register */
+
+#define PAT_AVX2 __attribute__((target("avx2")))
+
+PAT_AVX2 static __m256i pat_xorshift_avx2(__m256i x)
+{
+    x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+    return(_mm256_xor_si256(x, _mm256_slli_epi32(x, 5)));
+}
+
+PAT_AVX2 static void pat_fill_prbs_avx2(uint32_t *st, uint8_t *buf,
+                                        size_t nblk)
+{
+    __m256i a = _mm256_loadu_si256((void *)st);
+    size_t i;
+
+    for (i = 0; i < nblk; ++i) {
+        a = pat_xorshift_avx2(a);
+        _mm256_storeu_si256((void *)buf, a);
+        buf += PAT_BLOCK;
+    }
+    _mm256_storeu_si256((void *)st, a);
+}
+
+PAT_AVX2 static uint32_t pat_check_prbs_avx2(uint32_t *st,
+                                             const uint8_t *buf, size_t nblk)
+{
+    __m256i a = _mm256_loadu_si256((void *)st);
+    __m256i diff = _mm256_setzero_si256();
+    size_t i;
+
+    for (i = 0; i < nblk; ++i) {
+        a = pat_xorshift_avx2(a);
+        diff = _mm256_or_si256(diff, _mm256_xor_si256(a,
+                               _mm256_loadu_si256((void *)buf)));
+        buf += PAT_BLOCK;
+    }
+    _mm256_storeu_si256((void *)st, a);
+    return(!_mm256_testz_si256(diff, diff));
+}
+
+PAT_AVX2 static void pat_fill_count_avx2(uint32_t *st, uint8_t *buf,
+                                         size_t nblk)
+{
+    __m256i a = _mm256_loadu_si256((void *)st);
+    __m256i step = _mm256_set1_epi32(PAT_LANES);
+    size_t i;
+
+    for (i = 0; i < nblk; ++i) {
+        _mm256_storeu_si256((void *)buf, a);
+        a = _mm256_add_epi32(a, step);
+        buf += PAT_BLOCK;
+    }
+    _mm256_storeu_si256((void *)st, a);
+}
+
+PAT_AVX2 static uint32_t pat_check_count_avx2(uint32_t *st,
+                                              const uint8_t *buf, size_t nblk)
+{
+    __m256i a = _mm256_loadu_si256((void *)st);
+    __m256i step = _mm256_set1_epi32(PAT_LANES);
+    __m256i diff = _mm256_setzero_si256();
+    size_t i;
+
+    for (i = 0; i < nblk; ++i) {
+        diff = _mm256_or_si256(diff, _mm256_xor_si256(a,
+                               _mm256_loadu_si256((void *)buf)));
+        a = _mm256_add_epi32(a, step);
+        buf += PAT_BLOCK;
+    }
+    _mm256_storeu_si256((void *)st, a);
+    return(!_mm256_testz_si256(diff, diff));
+}
+
+static const struct pat_kernels pat_avx2 = {
+    "avx2",
+    { NULL, &pat_fill_prbs_avx2, &pat_fill_count_avx2 },
+    { NULL, &pat_check_prbs_avx2, &pat_check_count_avx2 },
+};
+
+/* SSE4.2: CRC32C instruction, eight bytes at a time */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *buf, size_t len)
+{
+#if defined(__x86_64__)
+    uint64_t c = crc, w;
+
+    while (len >= 8) {
+        memcpy(&w, buf, 8);
+        c = _mm_crc32_u64(c, w);
+        buf += 8;
+        len -= 8;
+    }
+    crc = c;
+#endif /* __x86_64__ */
+    while (len > 0) {
+        crc = _mm_crc32_u8(crc, *buf);
+        ++buf;
+        --len;
+    }
+    return(crc);
+}
+#endif /* HAVE_CPU_DISPATCH */
+
+#if defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+/* NEON: PAT_LANES words in two 128 bit registers */
+
+static uint32x4_t pat_xorshift_neon(uint32x4_t x)
+{
+    x = veorq_u32(x, vshlq_n_u32(x, 13));
+    x = veorq_u32(x, vshrq_n_u32(x, 17));
+    return(veorq_u32(x, vshlq_n_u32(x, 5)));
+}
+
+static void pat_fill_prbs_neon(uint32_t *st, uint8_t *buf, size_t nblk)
+{
+    uint32x4_t a = vld1q_u32(st), b = vld1q_u32(st + 4);
+    size_t i;
+
+    for (i = 0; i < nblk; ++i) {
+        a = pat_xorshift_neon(a);
+        b = pat_xorshift_neon(b);
+        vst1q_u8(buf, vreinterpretq_u8_u32(a));
+        vst1q_u8(buf + 16, vreinterpretq_u8_u32(b));
+        buf += PAT_BLOCK;
+    }
+    vst1q_u32(st, a);
+    vst1q_u32(st + 4, b);
+}
+
+static uint32_t pat_check_prbs_neon(uint32_t *st, const uint8_t *buf,
+                                    size_t nblk)
+{
+    uint32x4_t a = vld1q_u32(st), b = vld1q_u32(st + 4);
+    uint32x4_t diff = vdupq_n_u32(0);
+    size_t i;
+
+    for (i = 0; i < nblk; ++i) {
+        a = pat_xorshift_neon(a);
+        b = pat_xorshift_neon(b);
+        diff = vorrq_u32(diff, veorq_u32(a,
+                         vreinterpretq_u32_u8(vld1q_u8(buf))));
+        diff = vorrq_u32(diff, veorq_u32(b,
+                         vreinterpretq_u32_u8(vld1q_u8(buf + 16))));
+        buf += PAT_BLOCK;
+    }
+    vst1q_u32(st, a);
+    vst1q_u32(st + 4, b);
+    return(vmaxvq_u32(diff));
+}
+
+static void pat_fill_count_neon(uint32_t *st, uint8_t *buf, size_t nblk)
+{
+    uint32x4_t a = vld1q_u32(st), b = vld1q_u32(st + 4);
+    uint32x4_t step = vdupq_n_u32(PAT_LANES);
+    size_t i;
+
+    for (i = 0; i < nblk; ++i) {
+        vst1q_u8(buf, vreinterpretq_u8_u32(a));
+        vst1q_u8(buf + 16, vreinterpretq_u8_u32(b));
+        a = vaddq_u32(a, step);
+        b = vaddq_u32(b, step);
+        buf += PAT_BLOCK;
+    }
+    vst1q_u32(st, a);
+    vst1q_u32(st + 4, b);
+}
+
+static uint32_t pat_check_count_neon(uint32_t *st, const uint8_t *buf,
+                                     size_t nblk)
+{
+    uint32x4_t a = vld1q_u32(st), b = vld1q_u32(st + 4);
+    uint32x4_t step = vdupq_n_u32(PAT_LANES);
+    uint32x4_t diff = vdupq_n_u32(0);
+    size_t i;
+
+    for (i = 0; i < nblk; ++i) {
+        diff = vorrq_u32(diff, veorq_u32(a,
+                         vreinterpretq_u32_u8(vld1q_u8(buf))));
+        diff = vorrq_u32(diff, veorq_u32(b,
+                         vreinterpretq_u32_u8(vld1q_u8(buf + 16))));
+        a = vaddq_u32(a, step);
+        b = vaddq_u32(b, step);
+        buf += PAT_BLOCK;
+    }
+    vst1q_u32(st, a);
+    vst1q_u32(st + 4, b);
+    return(vmaxvq_u32(diff));
+}
+
+static const struct pat_kernels pat_neon = {
+    "neon",
+    { NULL, &pat_fill_prbs_neon, &pat_fill_count_neon },
+    { NULL, &pat_check_prbs_neon, &pat_check_count_neon },
+};
+#endif /* __ARM_NEON && !__ARM_BIG_ENDIAN */
+
+#if defined(__ARM_FEATURE_CRC32)
+/* ARMv8 CRC32C instructions, eight bytes at a time */
+static uint32_t crc32c_arm(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    uint64_t w;
+
+    while (len >= 8) {
+        memcpy(&w, buf, 8);
+        crc = __crc32cd(crc, w);
+        buf += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        crc = __crc32cb(crc, *buf);
+        ++buf;
+        --len;
+    }
+    return(crc);
+}
+#endif /* __ARM_FEATURE_CRC32 */
+
+/*
+ * pattern_init()
+ *
+ * Pick the fastest versions of the pattern and CRC functions that this
+ * CPU can run.  Call it, in the main thread, before using any of them.
+ *
+ * Returns:
+ *      a description of what was picked, like "avx2, crc32c sse4.2"
+ */
+const char *pattern_init(void)
+{
+    static char desc[64];
+    uint32_t c;
+    int i, k;
+
+    if (desc[0] != '\0') {
+        return(desc); /* already done */
+    }
+
+    /* tables for crc32c_generic() */
+    for (i = 0; i < 256; ++i) {
+        c = i;
+        for (k = 0; k < 8; ++k) {
+            c = (c >> 1) ^ ((c & 1) ? 0x82f63b78 : 0);
+        }
+        crc32c_table[0][i] = c;
+    }
+    for (i = 0; i < 256; ++i) {
+        for (k = 1; k < 8; ++k) {
+            c = crc32c_table[k - 1][i];
+            crc32c_table[k][i] = (c >> 8) ^ crc32c_table[0][c & 255];
+        }
+    }
+
+#if defined(__SSE2__)
+    pat_impl = &pat_sse2;
+#endif /* __SSE2__ */
+#if defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+    pat_impl = &pat_neon;
+#endif /* __ARM_NEON && !__ARM_BIG_ENDIAN */
+#if defined(__ARM_FEATURE_CRC32)
+    crc32c_impl = &crc32c_arm;
+    crc32c_name = "armv8";
+#endif /* __ARM_FEATURE_CRC32 */
+#ifdef HAVE_CPU_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        pat_impl = &pat_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_impl = &crc32c_sse42;
+        crc32c_name = "sse4.2";
+    }
+#endif /* HAVE_CPU_DISPATCH */
+    snprintf(desc, sizeof(desc), "%s, crc32c %s", pat_impl->name, crc32c_name);
+    return(desc);
+}
+
+/*
+ * pat_start()
+ * Set up the lane state 'st' for pattern 'pat' from 'seed'.
+ */
+static void pat_start(int pat, uint64_t seed, uint32_t *st)
+{
+    uint64_t x;
+    int j;
+
+    for (j = 0; j < PAT_LANES; ++j) {
+        if (pat == PATTERN_COUNT) {
+            st[j] = (uint32_t)seed + j;
+        } else {
+            /* SplitMix64, so nearby seeds look nothing alike */
+            x = seed + (uint64_t)(j + 1) * 0x9e3779b97f4a7c15ull;
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+            x ^= x >> 31;
+            st[j] = (uint32_t)x | 1; /* xorshift32 gets stuck on zero */
+        }
+    }
+}
+
+/*
+ * pattern_fill()
+ *
+ * Fill in 'len' bytes at 'buf' with pattern 'pat' (PATTERN_PRBS or
+ * PATTERN_COUNT) generated from 'seed'.
+ */
+void pattern_fill(int pat, uint64_t seed, uint8_t *buf, size_t len)
+{
+    uint32_t st[PAT_LANES];
+    uint8_t tail[PAT_BLOCK];
+    size_t nblk = len / PAT_BLOCK;
+
+    pat_start(pat, seed, st);
+    pat_impl->fill[pat](st, buf, nblk);
+    if (len % PAT_BLOCK) {
+        pat_generic.fill[pat](st, tail, 1);
+        memcpy(buf + nblk * PAT_BLOCK, tail, len % PAT_BLOCK);
+    }
+}
+
+/*
+ * pattern_check()
+ *
+ * Check whether the 'len' bytes at 'buf' are what pattern_fill() would
+ * put there.
+ *
+ * Returns:
+ *      zero if they are, nonzero if they're not
+ */
+int pattern_check(int pat, uint64_t seed, const uint8_t *buf, size_t len)
+{
+    uint32_t st[PAT_LANES];
+    uint8_t tail[PAT_BLOCK];
+    size_t nblk = len / PAT_BLOCK;
+
+    pat_start(pat, seed, st);
+    if (pat_impl->check[pat](st, buf, nblk)) {
+        return(1);
+    }
+    if (len % PAT_BLOCK) {
+        pat_generic.fill[pat](st, tail, 1);
+        return(memcmp(buf + nblk * PAT_BLOCK, tail, len % PAT_BLOCK) != 0);
+    }
+    return(0);
+}
+
+/*
+ * crc32c()
+ *
+ * Compute the CRC32C (Castagnoli) of 'len' bytes at 'buf', continuing
+ * from 'crc', which is 0 to start.  So crc32c(crc32c(0, a), b) is the
+ * CRC32C of a followed by b.
+ */
+uint32_t crc32c(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    return(~crc32c_impl(~crc, buf, len));
+}
@@ -45,6 +45,14 @@
  *          Use RFC 3678's fanciest interface setsourcefilter().
  *          Recommendation: #define this on most platforms.  It seems to
  *          be a well established standard.
+ *      HAVE_MCAST_JOIN_SOURCE_GROUP
+ *          When the "+" / "-" forms of the -I and -E commands change a
+ *          few sources in the filter, make just those changes with the
+ *          MCAST_JOIN_SOURCE_GROUP, MCAST_LEAVE_SOURCE_GROUP,
+ *          MCAST_BLOCK_SOURCE and MCAST_UNBLOCK_SOURCE socket options
+ *          (RFC 3678), instead of setting the whole filter again.
+ *          Requires DO_SOURCES.
+ *          Recommendation: #define this on Linux 2.6.15 and later.
  *      HAVE_IPV6_JOIN_GROUP
  *          Use RFC 3493's IPV6_JOIN_GROUP socket option to join IPv6
  *          multicast groups.
@@ -80,6 +88,96 @@
  *          'struct sockaddr' has a member 'sa_len' and it needs to be filled
  *          in with the right length.
  *          Recommendation: #define this on BSD systems; not on Linux
+ *      HAVE_RECVMMSG
+ *          Use recvmmsg() to receive several packets with one system call.
+ *          Without it, "-b" is still honored, using repeated recv() calls.
+ *          Recommendation: #define this on Linux 2.6.33 and later.
+ *      HAVE_SENDMMSG
+ *          Use sendmmsg() to send several packets with one system call,
+ *          when sending at a rate given by "-R".  Without it, repeated
+ *          sendto() calls are used.
+ *          Recommendation: #define this on Linux 3.0 and later.
+ *      HAVE_EPOLL
+ *          Use epoll(7), and timerfd_create(), to wait for input and timeouts
+ *          in the main loop.  Without it, poll() is used, which is more
+ *          widely available, but only has millisecond timing.
+ *          Recommendation: #define this on Linux 2.6.27 and later.
+ *      HAVE_SO_TIMESTAMPNS
+ *          Use the SO_TIMESTAMPNS socket option to have the kernel say when
+ *          each packet was received, for measuring latency.  Without it,
+ *          the time is taken after the packet is received.
+ *          Recommendation: #define this on Linux 2.6.22 and later.
+ *      HAVE_SO_TIMESTAMPING
+ *          Enable "-o tstamp=hw", which uses the SO_TIMESTAMPING socket
+ *          option and the SIOCSHWTSTAMP ioctl to get receive timestamps
+ *          from the network interface hardware.  Requires
+ *          HAVE_SO_TIMESTAMPNS.
+ *          Recommendation: #define this on Linux 3.14 and later.
+ *      HAVE_MSG_ZEROCOPY
+ *          Enable "-o zerocopy", which uses the SO_ZEROCOPY socket option
+ *          and the MSG_ZEROCOPY flag to send without copying the data.
+ *          Requires HAVE_SENDMMSG.
+ *          Recommendation: #define this on Linux 4.14 and later.
+ *      HAVE_UDP_SEGMENT
+ *          Enable "-o gso", which uses the UDP_SEGMENT control message to
+ *          have the kernel split one big send into many packets (UDP GSO).
+ *          Requires HAVE_SENDMMSG.
+ *          Recommendation: #define this on Linux 4.18 and later.
+ *      HAVE_TX_PKTINFO
+ *          Enable "-o txshare", where groups being sent to share sockets,
+ *          and each packet says which interface it goes out on with an
+ *          IP_PKTINFO or IPV6_PKTINFO control message.  Requires
+ *          HAVE_SENDMMSG.
+ *          Recommendation: #define this on Linux 2.6.14 and later.
+ *      HAVE_UDP_GRO
+ *          Enable "-o gro", which uses the UDP_GRO socket option to let
+ *          the kernel combine received packets (UDP GRO); they're split
+ *          up again before being checked.  Requires HAVE_SO_TIMESTAMPNS.
+ *          Recommendation: #define this on Linux 5.0 and later.
+ *      HAVE_PACKET_RING
+ *          Enable "-o ring", to receive through an AF_PACKET socket with a
+ *          TPACKET_V3 ring buffer shared with the kernel, instead of the
+ *          UDP sockets; group membership is still done with the sockets.
+ *          Recommendation: #define this on Linux 3.2 and later.
+ *      HAVE_SO_BUFFORCE
+ *          Have "-o rcvbuf" and "-o sndbuf" try the SO_RCVBUFFORCE and
+ *          SO_SNDBUFFORCE socket options first, which can go past the
+ *          system's limit when running with privileges.
+ *          Recommendation: #define this on Linux 2.6.14 and later.
+ *      HAVE_SO_BUSY_POLL
+ *          Enable "-o busypoll", which uses the SO_BUSY_POLL socket option
+ *          to have the kernel poll the network interface for packets.
+ *          Recommendation: #define this on Linux 3.11 and later.
+ *      HAVE_SO_PRIORITY
+ *          Enable "-o priority", which uses the SO_PRIORITY socket option.
+ *          Recommendation: #define this on Linux.
+ *      HAVE_SO_RXQ_OVFL
+ *          Use the SO_RXQ_OVFL socket option to find out how many packets
+ *          the kernel dropped for lack of room in the socket buffer, and
+ *          report them with "-S".  Requires HAVE_SO_TIMESTAMPNS.
+ *          Recommendation: #define this on Linux 2.6.33 and later.
+ *      HAVE_CPU_DISPATCH
+ *          Have versions of the "-d prbs:" / "-d count:" pattern code
+ *          using AVX2, and of CRC32C using SSE4.2, and pick at run time
+ *          whether to use them; with __builtin_cpu_supports() and the
+ *          "target" function attribute.  SSE2 and NEON versions are used
+ *          whenever the compiler has them turned on.
+ *          Recommendation: #define this with GCC 4.9+ or clang on x86.
+ *      DO_WORKERS
+ *          Enable the "-w" option, to receive packets in several threads.
+ *          Needs POSIX threads and C11 atomics; and the "-pthread" flag
+ *          in the Makefile.
+ *          Recommendation: #define this if you can.
+ *      HAVE_SHM_OPEN
+ *          Enable the "-M" option, to keep counters in POSIX shared memory
+ *          (shm_open()) for other programs to read.  Needs C11 atomics;
+ *          and on older systems the "-lrt" library in the Makefile.
+ *          Recommendation: #define this on Linux and other POSIX systems.
+ *      HAVE_PTHREAD_AFFINITY
+ *          Use pthread_setaffinity_np() to run each "-w" worker thread on
+ *          its own CPU.  Without it, the threads go wherever the system
+ *          puts them.
+ *          Recommendation: #define this on Linux with glibc 2.3.4 and later.
  */
 
 /*
@@ -92,17 +190,50 @@
 #define DO_SOURCES
 #define HAVE_SETSOURCEFILTER
 #define NEED_MEMBERSHIP_FIRST
+#define DO_WORKERS
 #if defined(__linux__)
 #define HAVE_IPV6_JOIN_GROUP
 #define HAVE_MULTICAST_ALL
 /* #define HAVE_V6_MULTICAST_ALL */
 #define HAVE_MULTICAST_IF_IP_MREQN
 #define HAVE_IP_ADD_MEMBERSHIP_IP_MREQN
+#define HAVE_RECVMMSG
+#define HAVE_SENDMMSG
+#define HAVE_EPOLL
+#define HAVE_SO_TIMESTAMPNS
+#define HAVE_SO_TIMESTAMPING
+#define HAVE_MSG_ZEROCOPY
+#define HAVE_UDP_SEGMENT
+#define HAVE_UDP_GRO
+#define HAVE_TX_PKTINFO
+#define HAVE_PACKET_RING
+#define HAVE_MCAST_JOIN_SOURCE_GROUP
+#define HAVE_SO_BUFFORCE
+#define HAVE_SO_BUSY_POLL
+#define HAVE_SO_PRIORITY
+#define HAVE_SO_RXQ_OVFL
+#define HAVE_PTHREAD_AFFINITY
+#define HAVE_SHM_OPEN
 #else /* __linux__ */
 #define HAVE_IPV6_JOIN_GROUP
 #define HAVE_SA_LEN
 #endif /* !__linux__ */
 #define HAVE_GETIFADDRS
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_CPU_DISPATCH
+#endif /* __GNUC__ && x86 */
+
+/* some of the above need others; drop them if those aren't there */
+#ifndef HAVE_SENDMMSG
+#undef HAVE_MSG_ZEROCOPY
+#undef HAVE_UDP_SEGMENT
+#undef HAVE_TX_PKTINFO
+#endif /* !HAVE_SENDMMSG */
+#ifndef HAVE_SO_TIMESTAMPNS
+#undef HAVE_SO_TIMESTAMPING
+#undef HAVE_UDP_GRO
+#undef HAVE_SO_RXQ_OVFL
+#endif /* !HAVE_SO_TIMESTAMPNS */
 
 /*
  * #defines related to defaults:
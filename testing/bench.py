@@ -0,0 +1,223 @@
+#!/usr/bin/python3
+# bench.py
+# Measures oligocast's own performance: runs a sender and a receiver,
+# over loopback or between two network namespaces, for each combination
+# of packet size, rate, batch size (-b), and group count, and reports what
+# they achieved as CSV.  "make bench" runs it with the defaults.
+#
+# Command line parameters:
+#       -s sizes -- packet sizes, comma separated (default 64,512,1400)
+#       -r rates -- packets per second per group, "-R" style, comma
+#                   separated (default 10k,100k)
+#       -b batches -- "-b" values for both ends (default 1,32)
+#       -g counts -- numbers of groups (default 1,8)
+#       -t sec -- how long each sender runs (default 3)
+#       -i intf -- interface to use (default lo)
+#       -n -- instead of -i, make a pair of network namespaces joined by
+#             veth interfaces, the way ns-test-setup.py does; the sender
+#             runs in one and the receiver in the other.  Needs root.
+#       -x "opts" -- more options for the receiver, like "-o gro"
+#       -X "opts" -- more options for the sender, like "-o gso"
+#       -p path -- oligocast program (default ./oligocast)
+#       -o file -- write the report there instead of stdout
+#
+# The report has one line per combination:
+#       size, rate, batch, groups -- the settings
+#       tx_pps -- packets sent per second, all groups; counted by the
+#                 receiver as received + lost
+#       rx_pps -- packets received per second, all groups
+#       loss_pct -- percent of the packets sent that were lost
+#       tx_cpu_ns, rx_cpu_ns -- CPU time (user + system) per packet,
+#                 nanoseconds, for the sender & receiver processes
+#       lat_p50_us -- median one way latency, microseconds (the average
+#                 of each second's median)
+#       lat_p99_us, lat_p999_us -- 99th & 99.9th percentile latency, in
+#                 the worst second
+#       lat_max_us -- highest latency seen
+# Loss is only noticed by gaps in the sequence numbers, so packets lost
+# at the very end aren't counted.
+
+from sys import argv, exit, stderr, stdout
+import getopt
+import os
+import re
+import shlex
+import subprocess
+import tempfile
+import time
+
+NS_TX = "olbench1"
+NS_RX = "olbench2"
+GROUP_BASE = "239.77.0."
+
+def msg(s):
+    print(s, file= stderr, flush= True)
+
+def usage():
+    msg("USAGE: python3 testing/bench.py [-s sizes] [-r rates] [-b batches]"
+        " [-g counts] [-t sec] [-i intf | -n] [-x opts] [-X opts]"
+        " [-p path] [-o file]")
+    exit(1)
+
+try:
+    opts, args = getopt.getopt(argv[1:], "s:r:b:g:t:i:nx:X:p:o:")
+except getopt.GetoptError as e:
+    msg(str(e))
+    usage()
+if args:
+    usage()
+sizes = [64, 512, 1400]
+rates = ["10k", "100k"]
+batches = [1, 32]
+gcounts = [1, 8]
+secs = 3.0
+intf = "lo"
+netns = False
+rxopts = []
+txopts = []
+prog = "./oligocast"
+outfn = None
+for (o, a) in opts:
+    if o == "-s":
+        sizes = [int(x) for x in a.split(",")]
+    elif o == "-r":
+        rates = a.split(",")
+    elif o == "-b":
+        batches = [int(x) for x in a.split(",")]
+    elif o == "-g":
+        gcounts = [int(x) for x in a.split(",")]
+    elif o == "-t":
+        secs = float(a)
+    elif o == "-i":
+        intf = a
+    elif o == "-n":
+        netns = True
+    elif o == "-x":
+        rxopts = shlex.split(a)
+    elif o == "-X":
+        txopts = shlex.split(a)
+    elif o == "-p":
+        prog = a
+    elif o == "-o":
+        outfn = a
+prog = os.path.abspath(prog)
+
+def sh(cmd):
+    # run a setup command, complaining if it fails
+    if subprocess.call(cmd, shell= True) != 0:
+        msg("failed: " + cmd)
+
+def netns_setup():
+    # two namespaces and a veth pair between them
+    netns_cleanup()
+    for ns in (NS_TX, NS_RX):
+        sh("ip netns add " + ns)
+    sh("ip link add olbv1 netns {} type veth peer name olbv2 netns {}".
+       format(NS_TX, NS_RX))
+    for (ns, i) in ((NS_TX, 1), (NS_RX, 2)):
+        sh("ip -n {} addr add 10.97.0.{}/24 dev olbv{}".format(ns, i, i))
+        sh("ip -n {} link set olbv{} up".format(ns, i))
+        sh("ip -n {} link set lo up".format(ns))
+    time.sleep(1.0) # let IPv6 DAD etc settle
+
+def netns_cleanup():
+    for ns in (NS_TX, NS_RX):
+        subprocess.call("ip netns delete {} 2>/dev/null".format(ns),
+                        shell= True)
+
+def start(ns, cmd):
+    # start oligocast, taking commands on stdin so it can be told to exit
+    if ns is not None:
+        cmd = ["ip", "netns", "exec", ns] + cmd
+    return(subprocess.Popen(cmd, stdin= subprocess.PIPE,
+                            stdout= subprocess.PIPE,
+                            stderr= subprocess.STDOUT,
+                            universal_newlines= True))
+
+def stop(p):
+    # tell it to exit; returns its output and CPU time in seconds
+    p.stdin.write(".x\n")
+    p.stdin.flush()
+    out = p.stdout.read()
+    (pid, status, ru) = os.wait4(p.pid, 0)
+    p.returncode = status
+    return(out, ru.ru_utime + ru.ru_stime)
+
+STATS_RE = re.compile(r" statistics on \S+ (\d+) packets .* (\d+) lost")
+LAT_RE = re.compile(r" latency on \S+ (\d+) packets, p50 ([0-9.]+)us,"
+                    r" p99 ([0-9.]+)us, p99.9 ([0-9.]+)us, max ([0-9.]+)us")
+
+def run(size, rate, batch, ngroups, gfile):
+    common = ["-d", "seq:{}".format(size), "-b", str(batch), "-k"]
+    if ngroups > 1:
+        with open(gfile, "w") as fp:
+            for i in range(ngroups):
+                print("-g {}{}".format(GROUP_BASE, i + 1), file= fp)
+        common += ["-G", gfile]
+    else:
+        common += ["-g", GROUP_BASE + "1"]
+    rxif = "olbv2" if netns else intf
+    txif = "olbv1" if netns else intf
+    rx = start(NS_RX if netns else None,
+               [prog, "-r", "-i", rxif, "-S", "1", "-L", "1"] +
+               common + rxopts)
+    time.sleep(0.5) # for it to join
+    tx = start(NS_TX if netns else None,
+               [prog, "-t", "-i", txif, "-R", rate] + common + txopts)
+    t0 = time.time()
+    time.sleep(secs)
+    (txout, txcpu) = stop(tx)
+    elapsed = time.time() - t0
+    time.sleep(1.5) # for the receiver to report the last of it
+    (rxout, rxcpu) = stop(rx)
+
+    # add up what the receiver reported
+    pkts = lost = 0
+    p50s = []
+    p99 = p999 = lmax = 0.0
+    for line in rxout.splitlines():
+        m = STATS_RE.search(line)
+        if m:
+            pkts += int(m.group(1))
+            lost += int(m.group(2))
+            continue
+        m = LAT_RE.search(line)
+        if m:
+            p50s.append((int(m.group(1)), float(m.group(2))))
+            p99 = max(p99, float(m.group(3)))
+            p999 = max(p999, float(m.group(4)))
+            lmax = max(lmax, float(m.group(5)))
+    if tx.returncode != 0 or rx.returncode != 0:
+        msg("oligocast failed:\n" + txout + rxout)
+    sent = pkts + lost
+    n = sum(c for (c, v) in p50s)
+    p50 = (sum(c * v for (c, v) in p50s) / n) if n else 0.0
+    return([size, rate, batch, ngroups,
+            "{:.0f}".format(sent / elapsed),
+            "{:.0f}".format(pkts / elapsed),
+            "{:.3f}".format((100.0 * lost / sent) if sent else 0.0),
+            "{:.0f}".format((txcpu * 1e9 / sent) if sent else 0.0),
+            "{:.0f}".format((rxcpu * 1e9 / pkts) if pkts else 0.0),
+            "{:.1f}".format(p50), "{:.1f}".format(p99),
+            "{:.1f}".format(p999), "{:.1f}".format(lmax)])
+
+out = open(outfn, "w") if outfn else stdout
+print("size,rate,batch,groups,tx_pps,rx_pps,loss_pct,tx_cpu_ns,rx_cpu_ns,"
+      "lat_p50_us,lat_p99_us,lat_p999_us,lat_max_us", file= out, flush= True)
+if netns:
+    netns_setup()
+gfile = tempfile.mkstemp(prefix= "olbench", suffix= ".groups")[1]
+try:
+    for ngroups in gcounts:
+        for batch in batches:
+            for size in sizes:
+                for rate in rates:
+                    msg("size {} rate {} batch {} groups {}".
+                        format(size, rate, batch, ngroups))
+                    row = run(size, rate, batch, ngroups, gfile)
+                    print(",".join(str(x) for x in row), file= out,
+                          flush= True)
+finally:
+    os.unlink(gfile)
+    if netns:
+        netns_cleanup()
@@ -0,0 +1,113 @@
+#!/usr/bin/python3
+# binlog.py
+# Decodes the binary event log written by "oligocast -f binary:file".
+# The file is mapped into memory and its records read in place, so even
+# long logs can be handled without much trouble.
+#
+# Command line parameters:
+#       -s -- instead of listing the records, summarize them per group
+#       file name
+#
+# The file format (see 'struct binhdr' and 'struct binrec' in oligocast.c)
+# is a 32 byte header followed by 32 byte records, in the byte order of
+# the machine that wrote it.
+
+from sys import argv, exit, stderr
+import mmap
+import struct
+
+EVENTS = ["tx", "rx", "up", "down", "command", "note", "pkt", "latency",
+          "stats", "srcup", "srcdown", "srcstats", "churn"]
+BINREC_SEQ = 1
+BINREC_LAT = 2
+BINREC_BAD = 4
+
+args = argv[1:]
+summary = False
+if args and args[0] == "-s":
+    summary = True
+    args = args[1:]
+if len(args) != 1:
+    print("USAGE: python3 testing/binlog.py [-s] file", file= stderr)
+    exit(1)
+
+with open(args[0], "rb") as fp:
+    mm = mmap.mmap(fp.fileno(), 0, access= mmap.ACCESS_READ)
+
+# header: figure out byte order and record length
+if len(mm) < 32 or mm[0:4] != b"OLGE":
+    print("{}: not an oligocast binary event log".format(args[0]),
+          file= stderr)
+    exit(1)
+for bo in "<>":
+    order, version, reclen = struct.unpack_from(bo + "IHH", mm, 4)
+    if order == 0x01020304:
+        break
+else:
+    print("{}: unknown byte order".format(args[0]), file= stderr)
+    exit(1)
+if version != 1 or reclen < 32:
+    print("{}: unknown version {} or record length {}".
+          format(args[0], version, reclen), file= stderr)
+    exit(1)
+start, = struct.unpack_from(bo + "Q", mm, 16)
+rec = struct.Struct(bo + "QQqIHBB")
+nrecs = (len(mm) - 32) // reclen
+
+def records():
+    for i in range(nrecs):
+        yield rec.unpack_from(mm, 32 + i * reclen)
+
+def event_name(evt):
+    return(EVENTS[evt] if evt < len(EVENTS) else str(evt))
+
+if not summary:
+    # one CSV line per record
+    print("time,group,event,len,seq,latency_ns,bad")
+    for (t, seq, lat, grp, ln, evt, flags) in records():
+        print("{}.{:09d},{},{},{},{},{},{}".format(
+              t // 1000000000, t % 1000000000,
+              "" if grp == 0xffffffff else grp,
+              event_name(evt), ln,
+              seq if flags & BINREC_SEQ else "",
+              lat if flags & BINREC_LAT else "",
+              1 if flags & BINREC_BAD else 0))
+    exit(0)
+
+# summary: per group, packets, bytes, mismatches, sequence range, latency
+groups = dict()
+for (t, seq, lat, grp, ln, evt, flags) in records():
+    g = groups.setdefault(grp, dict(rx= 0, tx= 0, bytes= 0, bad= 0,
+                                    seqs= set(), lats= [], other= 0,
+                                    first= t, last= t))
+    g["last"] = t
+    if evt == 0 or evt == 1:
+        g["tx" if evt == 0 else "rx"] += 1
+        g["bytes"] += ln
+        if flags & BINREC_BAD:
+            g["bad"] += 1
+        if flags & BINREC_SEQ:
+            g["seqs"].add(seq)
+        if flags & BINREC_LAT:
+            g["lats"].append(lat)
+    else:
+        g["other"] += 1
+
+print("{} records, starting {}.{:09d}".format(
+      nrecs, start // 1000000000, start % 1000000000))
+for grp in sorted(groups):
+    g = groups[grp]
+    line = "group {}: {} rx, {} tx, {} bytes, {} mismatched, {} other".format(
+           "-" if grp == 0xffffffff else grp,
+           g["rx"], g["tx"], g["bytes"], g["bad"], g["other"])
+    if g["seqs"]:
+        lo, hi = min(g["seqs"]), max(g["seqs"])
+        line += ", seq {}-{} ({} missing)".format(
+                lo, hi, hi - lo + 1 - len(g["seqs"]))
+    if g["lats"]:
+        lats = sorted(g["lats"])
+        line += ", latency p50 {:.1f}us p99 {:.1f}us max {:.1f}us".format(
+                lats[len(lats) // 2] / 1e3,
+                lats[min(len(lats) - 1, (len(lats) * 99) // 100)] / 1e3,
+                lats[-1] / 1e3)
+    print(line)
@@ -0,0 +1,98 @@
+#!/usr/bin/python3
+# mktrace.py
+# Makes a traffic profile for "oligocast -t -F file": bursts of packets,
+# like market data tends to come in, with quiet between them.  (oligocast
+# can replay pcap files too; this is for when you don't have one.)
+#
+# Command line parameters:
+#       -n count -- number of bursts (default 100)
+#       -b count -- packets in each burst (default 32); "8-64" for a
+#                   random number in that range each time
+#       -g sec -- time from the start of one burst to the next (default
+#                 0.01); with -r, that's the average, and it varies
+#       -i ns -- time between packets within a burst (default 1000)
+#       -s len -- packet length in bytes (default 200); "64-1400" for a
+#                 random length in that range each time
+#       -p -- include the packets' data, made up, instead of leaving it
+#             to oligocast (which sends zeroes)
+#       -r -- random (Poisson) times between bursts
+#       -S seed -- random number seed
+#       file name to write
+#
+# The file format (see 'struct tracehdr' and 'struct tracerec' in
+# oligocast.c) is a 16 byte header, then for each packet a 16 byte record
+# of: nanoseconds since the packet before, length, length of the data that
+# follows; then the data, padded to a multiple of 8 bytes.  All in the
+# byte order of the machine that writes it.
+
+from sys import argv, exit, stderr
+import getopt
+import random
+import struct
+
+def usage():
+    print("USAGE: python3 testing/mktrace.py [-n count] [-b count] [-g sec]"
+          " [-i ns] [-s len] [-p] [-r] [-S seed] file", file= stderr)
+    exit(1)
+
+def span(a):
+    # "123", or "12-345" for a range
+    lo, _, hi = a.partition("-")
+    return((int(lo), int(hi or lo)))
+
+try:
+    opts, args = getopt.getopt(argv[1:], "n:b:g:i:s:prS:")
+except getopt.GetoptError as e:
+    print(str(e), file= stderr)
+    usage()
+if len(args) != 1:
+    usage()
+nbursts = 100
+burst = (32, 32)
+gap = 0.01
+spacing = 1000
+size = (200, 200)
+payload = False
+poisson = False
+for (o, a) in opts:
+    if o == "-n":
+        nbursts = int(a)
+    elif o == "-b":
+        burst = span(a)
+    elif o == "-g":
+        gap = float(a)
+    elif o == "-i":
+        spacing = int(a)
+    elif o == "-s":
+        size = span(a)
+    elif o == "-p":
+        payload = True
+    elif o == "-r":
+        poisson = True
+    elif o == "-S":
+        random.seed(int(a))
+if size[0] < 0 or size[1] > 65507 or size[0] > size[1] or \
+   burst[0] < 1 or burst[0] > burst[1] or nbursts < 1:
+    usage()
+
+hdr = struct.Struct("=4sIHHI")
+rec = struct.Struct("=QII")
+npkts = 0
+with open(args[0], "wb") as fp:
+    fp.write(hdr.pack(b"OLGT", 0x01020304, 1, rec.size, 0))
+    delta = 0 # ns since the packet before
+    for b in range(nbursts):
+        n = random.randint(burst[0], burst[1])
+        for i in range(n):
+            ln = random.randint(size[0], size[1])
+            fp.write(rec.pack(delta, ln, ln if payload else 0))
+            if payload:
+                fp.write(bytes(random.getrandbits(8) for j in range(ln)))
+                fp.write(bytes(-ln % 8))
+            npkts += 1
+            delta = spacing
+        # and on to the next burst
+        g = random.expovariate(1.0 / gap) if poisson else gap
+        delta = max(int(g * 1e9) - (n - 1) * spacing, spacing)
+print("{}: {} packets in {} bursts".format(args[0], npkts, nbursts),
+      file= stderr)